@@ -0,0 +1,43 @@
+# Copyright 2012 The FLWOR Foundation.
+# 
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+# 
+# http://www.apache.org/licenses/LICENSE-2.0
+# 
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+IF (ZSTD_INCLUDE_DIR)
+  SET (ZSTD_FIND_QUIETLY TRUE)
+ENDIF (ZSTD_INCLUDE_DIR)
+
+FIND_PATH (
+  ZSTD_INCLUDE_DIR
+  zstd.h
+  PATHS ${ZSTD_INCLUDE_DIR} /usr/include/ /usr/local/include /opt/local/include )
+MARK_AS_ADVANCED (ZSTD_INCLUDE_DIR)
+
+FIND_LIBRARY (
+  ZSTD_LIBRARY
+  NAMES zstd
+  PATHS ${ZSTD_LIBRARY_DIR} /usr/lib /usr/local/lib /opt/local/lib)
+MARK_AS_ADVANCED (ZSTD_LIBRARY)
+
+IF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+  SET (ZSTD_FOUND 1)
+  SET (ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+  SET (ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+  IF (NOT ZSTD_FIND_QUIETLY)
+    MESSAGE (STATUS "Found zstd library: " ${ZSTD_LIBRARY})
+    MESSAGE (STATUS "Found zstd include path : " ${ZSTD_INCLUDE_DIR})
+  ENDIF (NOT ZSTD_FIND_QUIETLY)
+ELSE (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+  SET (ZSTD_FOUND 0)
+  SET (ZSTD_LIBRARIES)
+  SET (ZSTD_INCLUDE_DIRS)
+ENDIF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
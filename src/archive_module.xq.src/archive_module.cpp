@@ -17,6 +17,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -39,15 +41,21 @@
 #include <zorba/empty_sequence.h>
 #include <zorba/item_factory.h>
 #include <zorba/singleton_item_sequence.h>
+#include <zorba/store_consts.h>
 #include <zorba/user_exception.h>
 #include <zorba/util/base64_util.h>
 #include <zorba/util/base64_stream.h>
 #include <zorba/util/transcode_stream.h>
+#include <zorba/vector_item_sequence.h>
+#include <zorba/xmldatamanager.h>
 
 #include "archive.h"
 #include "archive_entry.h"
 #include "archive_module.h"
+#include "archive_sniffer.h"
 #include "config.h"
+#include "digest.h"
+#include "text_codec.h"
 
 #define ERROR_ENTRY_COUNT_MISMATCH "ENTRY-COUNT"
 #define ERROR_INVALID_OPTIONS "INVALID-OPTIONS"
@@ -55,6 +63,9 @@
 #define ERROR_INVALID_ENCODING "INVALID-ENCODING"
 #define ERROR_CORRUPTED_ARCHIVE "CORRUPTED-ARCHIVE"
 #define ERROR_DIFFERENT_COMPRESSIONS_NOT_SUPPORTED "DIFFERENT-COMPRESSIONS-NOT-SUPPORTED"
+#define ERROR_INVALID_HANDLE "INVALID-HANDLE"
+#define ERROR_LIMIT_EXCEEDED "LIMIT-EXCEEDED"
+#define ERROR_INVALID_INDEX "INVALID-INDEX"
 
 namespace zorba { namespace archive {
 
@@ -106,6 +117,78 @@ zorba::Item ArchiveModule::globalEncodingKey;
       {
         lFunc = new OptionsFunction(this);
       }
+      else if (localName == "transform")
+      {
+        lFunc = new TransformFunction(this);
+      }
+      else if (localName == "extract-range")
+      {
+        lFunc = new ExtractRangeFunction(this);
+      }
+      else if (localName == "stat")
+      {
+        lFunc = new StatFunction(this);
+      }
+      else if (localName == "open")
+      {
+        lFunc = new OpenFunction(this);
+      }
+      else if (localName == "close")
+      {
+        lFunc = new CloseFunction(this);
+      }
+      else if (localName == "set-cache-budget")
+      {
+        lFunc = new SetCacheBudgetFunction(this);
+      }
+      else if (localName == "cache-statistics")
+      {
+        lFunc = new CacheStatisticsFunction(this);
+      }
+      else if (localName == "set-read-ahead")
+      {
+        lFunc = new SetReadAheadFunction(this);
+      }
+      else if (localName == "set-pipeline")
+      {
+        lFunc = new SetPipelineFunction(this);
+      }
+      else if (localName == "extract-json")
+      {
+        lFunc = new ExtractParsedFunction(this, ExtractParsedFunction::JSON);
+      }
+      else if (localName == "extract-xml")
+      {
+        lFunc = new ExtractParsedFunction(this, ExtractParsedFunction::XML);
+      }
+      else if (localName == "extract-lines")
+      {
+        lFunc = new ExtractLinesFunction(this);
+      }
+      else if (localName == "grep")
+      {
+        lFunc = new GrepFunction(this);
+      }
+      else if (localName == "checksums")
+      {
+        lFunc = new ChecksumsFunction(this);
+      }
+      else if (localName == "verify")
+      {
+        lFunc = new VerifyFunction(this);
+      }
+      else if (localName == "set-limits")
+      {
+        lFunc = new SetLimitsFunction(this);
+      }
+      else if (localName == "build-index")
+      {
+        lFunc = new BuildIndexFunction(this);
+      }
+      else if (localName == "benchmark")
+      {
+        lFunc = new BenchmarkFunction(this);
+      }
     }
 
     return lFunc;
@@ -205,6 +288,7 @@ zorba::Item ArchiveModule::globalEncodingKey;
 
   ArchiveFunction::ArchiveEntry::ArchiveEntry()
     : theEncoding("UTF-8"),
+      theHasLastModified(false),
       theEntryType(regular)
   {
     // use current time as a default for each entry
@@ -225,13 +309,17 @@ zorba::Item ArchiveModule::globalEncodingKey;
 
     if (archive_entry_size_is_set(aEntry))
     {
-      theSize = (int)archive_entry_size(aEntry);
+      theSize = archive_entry_size(aEntry);
     }
 
     if (archive_entry_mtime_is_set(aEntry))
     {
       theLastModified = archive_entry_mtime(aEntry);
+      theHasLastModified = true;
     }
+
+    const char* lHardlink = archive_entry_hardlink(aEntry);
+    theHardlink = lHardlink ? lHardlink : "";
     //check if it is encoded
 
     switch(archive_entry_filetype(aEntry))
@@ -270,6 +358,7 @@ zorba::Item ArchiveModule::globalEncodingKey;
         else if (lKey.getStringValue() == ArchiveModule::getGlobalItems(ArchiveModule::LAST_MODIFIED).getStringValue())
         {
           ArchiveModule::parseDateTimeItem(lKeyValue, theLastModified);
+          theHasLastModified = true;
         }
         else if (lKey.getStringValue() == ArchiveModule::getGlobalItems(ArchiveModule::ENCODING).getStringValue())
         {
@@ -309,15 +398,44 @@ zorba::Item ArchiveModule::globalEncodingKey;
   ArchiveFunction::ArchiveOptions::ArchiveOptions()
     : theCompression("DEFLATE"),
       theFormat("ZIP"),
-      theSkipExtraAttrs(false)
+      theSkipExtraAttrs(false),
+      theDedup(false),
+      theFrameSize(ZORBA_ARCHIVE_ZSTD_FRAME_SIZE),
+      theAlignment(0),
+      theDictionary(false)
   {}
 
   void
-  ArchiveFunction::ArchiveOptions::setValues(struct archive* aArchive)
+  ArchiveFunction::ArchiveOptions::setValues(
+      struct archive* aArchive,
+      bool aDictionary)
   {
     theCompression = ArchiveFunction::compressionName(
         archive_compression(aArchive));
     theFormat = ArchiveFunction::formatName(archive_format(aArchive));
+    if (hasEntryCompression())
+    {
+      // libarchive only reports filters, i.e. not how entries are compressed
+      theCompression = getDefaultCompression(theFormat);
+    }
+    if (aDictionary)
+    {
+      theCompression = "ZSTD-SEEKABLE";
+      theDictionary = true;
+    }
+  }
+
+  void
+  ArchiveFunction::ArchiveOptions::setEntryCompression(
+      const char* aData,
+      size_t aSize)
+  {
+    std::string lCompression;
+    if (theFormat == "XAR"
+        && ArchiveSniffer::xarCompression(aData, aSize, lCompression))
+    {
+      theCompression = lCompression;
+    }
   }
 
   void
@@ -325,6 +443,7 @@ zorba::Item ArchiveModule::globalEncodingKey;
   {
     if(aOptions.isJSONItem())
     {
+      bool lHasCompression = false;
       Item lOptionKey;
       Iterator_t lKeyIter = aOptions.getObjectKeys();
       lKeyIter->open();
@@ -341,6 +460,7 @@ zorba::Item ArchiveModule::globalEncodingKey;
               theCompression.begin(),
               theCompression.end(),
               theCompression.begin(), ::toupper);
+          lHasCompression = true;
         }
         else if (lOptionKey.getStringValue() == ArchiveModule::getGlobalItems(ArchiveModule::FORMAT).getStringValue())
         {
@@ -349,11 +469,81 @@ zorba::Item ArchiveModule::globalEncodingKey;
               theFormat.begin(),
               theFormat.end(),
               theFormat.begin(), ::toupper);
+          if (theFormat == "7Z")
+          {
+            theFormat = "7ZIP";
+          }
         }
         else if (lOptionKey.getStringValue() == "skip-extra-attributes")
         {
           theSkipExtraAttrs = lOptionValue.getStringValue() == "true" ? true : false;
         }
+        else if (lOptionKey.getStringValue() == "dedup")
+        {
+          theDedup = lOptionValue.getStringValue() == "true" ? true : false;
+        }
+        else if (lOptionKey.getStringValue() == "dictionary")
+        {
+          theDictionary = lOptionValue.getStringValue() == "true" ? true : false;
+        }
+        else if (lOptionKey.getStringValue() == "frame-size")
+        {
+          double lFrameSize = getLimitValue(lOptionKey, lOptionValue);
+          if (lFrameSize < 1 || lFrameSize > ZORBA_ARCHIVE_ZSTD_MAX_FRAME_SIZE)
+          {
+            std::ostringstream lMsg;
+            lMsg << lOptionValue.getStringValue()
+              << ": invalid value for frame-size (required: 1 to "
+              << ZORBA_ARCHIVE_ZSTD_MAX_FRAME_SIZE << ")";
+            throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+          }
+          theFrameSize = static_cast<uint64_t>(lFrameSize);
+        }
+        else if (lOptionKey.getStringValue() == "align")
+        {
+          double lAlignment = getLimitValue(lOptionKey, lOptionValue);
+          uint32_t lValue = static_cast<uint32_t>(lAlignment);
+          if (lAlignment > ZORBA_ZIP_MAX_ALIGNMENT
+              || lValue != lAlignment
+              || (lValue & (lValue - 1)))
+          {
+            std::ostringstream lMsg;
+            lMsg << lOptionValue.getStringValue()
+              << ": invalid value for align (required: power of 2 up to "
+              << ZORBA_ZIP_MAX_ALIGNMENT << ")";
+            throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+          }
+          theAlignment = lValue;
+        }
+        else if (lOptionKey.getStringValue() == "max-entries")
+        {
+          theLimits.theMaxEntries
+            = static_cast<uint64_t>(getLimitValue(lOptionKey, lOptionValue));
+        }
+        else if (lOptionKey.getStringValue() == "max-size")
+        {
+          theLimits.theMaxSize
+            = static_cast<uint64_t>(getLimitValue(lOptionKey, lOptionValue));
+        }
+        else if (lOptionKey.getStringValue() == "max-entry-size")
+        {
+          theLimits.theMaxEntrySize
+            = static_cast<uint64_t>(getLimitValue(lOptionKey, lOptionValue));
+        }
+        else if (lOptionKey.getStringValue() == "max-ratio")
+        {
+          theLimits.theMaxRatio = getLimitValue(lOptionKey, lOptionValue);
+        }
+      }
+      if (!lHasCompression && hasEntryCompression())
+      {
+        theCompression = getDefaultCompression(theFormat);
+      }
+      if (theAlignment && theFormat != "ZIP")
+      {
+        std::ostringstream lMsg;
+        lMsg << theFormat << ": align is only supported for ZIP format";
+        throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
       }
       if (theFormat == "ZIP")
       {
@@ -366,26 +556,117 @@ zorba::Item ArchiveModule::globalEncodingKey;
           throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
         }
       }
-      if (theFormat == "TAR")
+      if (isTarFormat() || theFormat == "CPIO")
       {        if (theCompression != "GZIP"
 #ifndef WIN32
             && theCompression != "BZIP2"
             && theCompression != "LZMA"
+#endif
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+            && (theCompression != "ZSTD-SEEKABLE" || !isTarFormat())
 #endif
           )
         {
           std::ostringstream lMsg;
           lMsg
             << theCompression
-            << ": compression algorithm not supported for TAR format (required: gzip"
+            << ": compression algorithm not supported for "
+            << theFormat << " format (required: gzip"
 #ifndef WIN32
             << ", bzip2, lzma"
+#endif
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+            << (isTarFormat() ? ", zstd-seekable" : "")
 #endif
             << ")";
           throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
         }
       }
+      if (theDictionary && theCompression != "ZSTD-SEEKABLE")
+      {
+        std::ostringstream lMsg;
+        lMsg << theCompression
+          << ": dictionary is only supported for ZSTD-SEEKABLE compression";
+        throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+      }
+      if (theFormat == "7ZIP")
+      {
+        if (theCompression != "LZMA2" && theCompression != "LZMA"
+            && theCompression != "BZIP2" && theCompression != "DEFLATE"
+            && theCompression != "PPMD" && theCompression != "STORE")
+        {
+          std::ostringstream lMsg;
+          lMsg
+            << theCompression
+            << ": compression algorithm not supported for 7ZIP format (required: lzma2, lzma, bzip2, deflate, ppmd, store)";
+          throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+        }
+      }
+      if (theFormat == "XAR")
+      {
+        if (theCompression != "GZIP" && theCompression != "BZIP2"
+            && theCompression != "LZMA" && theCompression != "XZ"
+            && theCompression != "NONE")
+        {
+          std::ostringstream lMsg;
+          lMsg
+            << theCompression
+            << ": compression algorithm not supported for XAR format (required: gzip, bzip2, lzma, xz, none)";
+          throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+        }
+      }
+    }
+  }
+
+  std::string
+  ArchiveFunction::ArchiveOptions::getEntryCompressionOption() const
+  {
+    std::string lFormat = theFormat;
+    std::string lCompression = theCompression;
+    std::transform(lFormat.begin(), lFormat.end(), lFormat.begin(), ::tolower);
+    std::transform(
+        lCompression.begin(), lCompression.end(),
+        lCompression.begin(), ::tolower);
+    if (theFormat == "7ZIP" && lCompression == "lzma")
+    {
+      lCompression = "lzma1";
+    }
+    return lFormat + ":compression=" + lCompression;
+  }
+
+  std::string
+  ArchiveFunction::ArchiveOptions::getDefaultCompression(
+      const std::string& aFormat)
+  {
+    if (aFormat == "7ZIP")
+    {
+      // solid LZMA2 blocks, i.e. the best ratio for similar entries
+      return "LZMA2";
+    }
+    else if (aFormat == "ZIP")
+    {
+      return "DEFLATE";
+    }
+    return "GZIP";
+  }
+
+  double
+  ArchiveFunction::ArchiveOptions::getLimitValue(
+      const Item& aKey,
+      const Item& aValue)
+  {
+    // 0 means unlimited
+    std::string lValue = aValue.getStringValue().str();
+    char* lEnd = 0;
+    double lLimit = strtod(lValue.c_str(), &lEnd);
+    if (lValue.empty() || *lEnd || !(lLimit >= 0))
+    {
+      std::ostringstream lMsg;
+      lMsg << lValue << ": invalid value for " << aKey.getStringValue()
+        << " (required: non-negative number)";
+      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
     }
+    return lLimit;
   }
 
   /************************
@@ -395,7 +676,10 @@ zorba::Item ArchiveModule::globalEncodingKey;
   ArchiveFunction::ArchiveCompressor::ArchiveCompressor()
     : theArchive(0),
       theEntry(0),
-      theStream(new std::stringstream())
+      theStream(new std::stringstream()),
+      theZipWriter(0),
+      theSeekableWriter(0),
+      theOpened(false)
   {
     theEntry = archive_entry_new();
   }
@@ -403,6 +687,8 @@ zorba::Item ArchiveModule::globalEncodingKey;
   ArchiveFunction::ArchiveCompressor::~ArchiveCompressor()
   {
     archive_entry_free(theEntry);
+    delete theZipWriter;
+    delete theSeekableWriter;
   }
 
   void
@@ -414,8 +700,38 @@ zorba::Item ArchiveModule::globalEncodingKey;
     int lErr = archive_write_set_format(theArchive, lFormatCode);
     ArchiveFunction::checkForError(lErr, 0, theArchive);
 
-    int lCompressionCode = compressionCode(aOptions.getCompression().c_str());
-    setArchiveCompression(theArchive, lCompressionCode);
+    if (aOptions.hasEntryCompression())
+    {
+      // no filter on top of the compressed entries
+      lErr = archive_write_set_compression_none(theArchive);
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+      lErr = archive_write_set_options(
+          theArchive, aOptions.getEntryCompressionOption().c_str());
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+    }
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    else if (aOptions.getCompression() == "ZSTD-SEEKABLE")
+    {
+      lErr = archive_write_set_compression_none(theArchive);
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+      // unblocked, i.e. an entry is written once it's finished such
+      // that frames can start at entry boundaries
+      lErr = archive_write_set_bytes_per_block(theArchive, 0);
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+      theSeekableWriter = new ZstdSeekableWriter(
+          *theStream, static_cast<size_t>(aOptions.getFrameSize()));
+      if (aOptions.getDictionary())
+      {
+        theSeekableWriter->setDictionarySize(
+            ZORBA_ARCHIVE_ZSTD_DICTIONARY_SIZE);
+      }
+    }
+#endif
+    else
+    {
+      int lCompressionCode = compressionCode(aOptions.getCompression().c_str());
+      setArchiveCompression(theArchive, lCompressionCode);
+    }
 
     if (aOptions.getSkipExtraAttrs())
     {
@@ -424,9 +740,53 @@ zorba::Item ArchiveModule::globalEncodingKey;
       archive_write_set_options(theArchive, "zip:skip-extras=true");
     }
 
-    lErr = archive_write_open(
+    // the writer is opened with the first entry (see openWriter)
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::openWriter(uint64_t aLargestSize)
+  {
+    if (theOpened) return;
+
+    if (aLargestSize >= 0xFFFFFFFFULL && theOptions.getFormat() == "ZIP")
+    {
+      // format options can't be changed once the writer is open
+      int lErr = archive_write_set_options(theArchive, "zip:zip64");
+      if (lErr != ARCHIVE_OK)
+      {
+        throwError(ERROR_INVALID_OPTIONS,
+            "ZIP64 (entries of 4 GB or more) is not supported by the used version of libarchive");
+      }
+    }
+
+    int lErr = archive_write_open(
         theArchive, this, 0, ArchiveFunction::writeStream, 0);
     ArchiveFunction::checkForError(lErr, 0, theArchive);
+    theOpened = true;
+  }
+
+  uint64_t
+  ArchiveFunction::ArchiveCompressor::getKnownSize(zorba::Item& aFile)
+  {
+    if (aFile.isStreamable())
+    {
+      if (!aFile.isSeekable()) return 0;
+
+      std::istream& lStream = aFile.getStream();
+      lStream.clear();
+      lStream.seekg(0, std::ios::end);
+      uint64_t lSize = static_cast<uint64_t>(lStream.tellg());
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+      return aFile.isEncoded() ? lSize / 4 * 3 : lSize;
+    }
+    else if (aFile.getTypeCode() == store::XS_BASE64BINARY)
+    {
+      size_t lSize;
+      aFile.getBase64BinaryValue(lSize);
+      return aFile.isEncoded() ? lSize / 4 * 3 : lSize;
+    }
+    return aFile.getStringValue().length();
   }
 
   bool
@@ -444,19 +804,49 @@ zorba::Item ArchiveModule::globalEncodingKey;
     {
       aResStream = &aFile.getStream();
 
-      if (transcode::is_necessary(aEncoding.c_str()))
-      {
-        transcode::attach(*aResStream, aEncoding.c_str());
-      }
-
       std::stringstream* lStream = new std::stringstream();
 
-      char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
-      while (aResStream->good())
+      TextCodec::Charset lCharset = TextCodec::getCharset(aEncoding.c_str());
+      if (transcode::is_necessary(aEncoding.c_str())
+          && lCharset != TextCodec::OTHER)
+      {
+        // converted block by block; a sequence split by the end of a
+        // block is kept for the next one
+        std::string lBlock;
+        std::string lEncoded;
+        char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+        while (aResStream->good())
+        {
+          aResStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+          lBlock.append(lBuf, static_cast<size_t>(aResStream->gcount()));
+          size_t lLen = aResStream->good()
+            ? TextCodec::completeUtf8(lBlock.data(), lBlock.size())
+            : lBlock.size();
+
+          lEncoded.clear();
+          if (!TextCodec::encode(lCharset, lBlock.data(), lLen, lEncoded))
+          {
+            encodeText(aEncoding, lBlock.substr(0, lLen), lEncoded);
+          }
+          lStream->write(lEncoded.data(), lEncoded.size());
+          aResFileSize += lEncoded.size();
+          lBlock.erase(0, lLen);
+        }
+      }
+      else
       {
-        aResStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
-        lStream->write(lBuf, aResStream->gcount());
-        aResFileSize += aResStream->gcount();
+        if (transcode::is_necessary(aEncoding.c_str()))
+        {
+          transcode::attach(*aResStream, aEncoding.c_str());
+        }
+
+        char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+        while (aResStream->good())
+        {
+          aResStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+          lStream->write(lBuf, aResStream->gcount());
+          aResFileSize += aResStream->gcount();
+        }
       }
       aResStream = lStream;
       return true; // delete after use
@@ -480,17 +870,11 @@ zorba::Item ArchiveModule::globalEncodingKey;
       //    3.1 with transcoding
       if (transcode::is_necessary(aEncoding.c_str()))
       {
-        transcode::stream<std::istringstream> lTranscoder(
-            aEncoding.c_str(),
-            aFile.getStringValue().c_str()
-          );
-        char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
-        while (lTranscoder.good())
-        {
-          lTranscoder.read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
-          lStream->write(lBuf, lTranscoder.gcount());
-          aResFileSize += lTranscoder.gcount();
-        }
+        zorba::String lString = aFile.getStringValue();
+        std::string lEncoded;
+        encodeText(aEncoding, lString.str(), lEncoded);
+        lStream->write(lEncoded.data(), lEncoded.size());
+        aResFileSize = lEncoded.size();
       }
       else // 3.2 without transcoding
       {
@@ -503,6 +887,31 @@ zorba::Item ArchiveModule::globalEncodingKey;
     }
   }
 
+  void
+  ArchiveFunction::ArchiveCompressor::encodeText(
+      const zorba::String& aEncoding,
+      const std::string& aContent,
+      std::string& aResult)
+  {
+    TextCodec::Charset lCharset = TextCodec::getCharset(aEncoding.c_str());
+    if (TextCodec::encode(lCharset, aContent.data(), aContent.size(), aResult))
+    {
+      return;
+    }
+
+    aResult.clear();
+    transcode::stream<std::istringstream> lTranscoder(
+        aEncoding.c_str(),
+        aContent.c_str()
+      );
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    while (lTranscoder.good())
+    {
+      lTranscoder.read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      aResult.append(lBuf, static_cast<size_t>(lTranscoder.gcount()));
+    }
+  }
+
   bool
   ArchiveFunction::ArchiveCompressor::getStreamForBase64(
       zorba::Item& aFile,
@@ -582,10 +991,52 @@ zorba::Item ArchiveModule::globalEncodingKey;
 
   }
 
+  bool
+  ArchiveFunction::ArchiveCompressor::getDigestStream(
+      const ArchiveEntry& aEntry,
+      zorba::Item& aFile,
+      std::istream*& aResStream,
+      uint64_t& aResFileSize) const
+  {
+    if (getStream(aEntry, aFile, aResStream, aResFileSize))
+    {
+      return true;
+    }
+    if (aFile.getTypeCode() != store::XS_BASE64BINARY || !aFile.isEncoded())
+    {
+      return false;
+    }
+
+    // the decoding of an attached stream only goes forward
+    std::stringstream* lStream = new std::stringstream();
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    aResFileSize = 0;
+    while (aResStream->good())
+    {
+      aResStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      lStream->write(lBuf, aResStream->gcount());
+      aResFileSize += aResStream->gcount();
+    }
+    aResStream = lStream;
+    return true;
+  }
+
   void
   ArchiveFunction::ArchiveCompressor::open(
     const ArchiveOptions& aOptions)
   {
+    if ((aOptions.getDedup() || aOptions.getAlignment())
+        && aOptions.getFormat() == "ZIP")
+    {
+      // libarchive can't write an entry from already compressed data (or
+      // pad its header), i.e. entries are compressed one by one and
+      // copied into the archive
+      theOptions = aOptions;
+      theZipWriter = new ZipWriter(*theStream);
+      theZipWriter->setAlignment(aOptions.getAlignment());
+      return;
+    }
+
     theArchive = archive_write_new();
 
     if (!theArchive)
@@ -600,61 +1051,151 @@ zorba::Item ArchiveModule::globalEncodingKey;
     const std::vector<ArchiveEntry>& aEntries,
     zorba::Iterator_t& aFiles)
   {  
-    zorba::Item lFile;
-    aFiles->open();
+    std::vector<zorba::Item> lFiles;
+    getContents(aEntries, aFiles, lFiles);
 
-    for (size_t i = 0; i < aEntries.size(); ++i)
+    if (!theZipWriter && theOptions.getFormat() == "ZIP")
     {
-      if(aEntries[i].getEntryType() == ArchiveEntry::regular)
+      // ZIP64 has to be requested before the first entry is written
+      uint64_t lLargestSize = 0;
+      for (size_t i = 0; i < aEntries.size(); ++i)
       {
-        if (!aFiles->next(lFile))
+        if (aEntries[i].getEntryType() == ArchiveEntry::regular)
         {
-          std::ostringstream lMsg;
-          lMsg << "number of entries (" << aEntries.size()
-            << ") doesn't match number of content arguments (" << i << ")";
-          throwError(ERROR_ENTRY_COUNT_MISMATCH, lMsg.str().c_str());
+          lLargestSize = std::max(lLargestSize, getKnownSize(lFiles[i]));
         }
       }
-
-      const ArchiveEntry& lEntry = aEntries[i];
-      
-      compress(lEntry, lFile);
-    
+      openWriter(lLargestSize);
     }
 
-    if (aFiles->next(lFile))
+    for (size_t i = 0; i < aEntries.size(); ++i)
     {
-      std::ostringstream lMsg;
-      lMsg << "number of entries (" << aEntries.size()
-        << ") less than number of content arguments";
-      throwError(ERROR_ENTRY_COUNT_MISMATCH, lMsg.str().c_str());
+      compress(aEntries[i], lFiles[i]);
     }
-
-    aFiles->close();
   }
 
   void ArchiveFunction::ArchiveCompressor::compress(const ArchiveEntry& aEntry, Item aFile)
   {
+      if (theZipWriter)
+      {
+        compressZip(aEntry, aFile);
+        return;
+      }
+
+      const std::string lPath = aEntry.getEntryPath().str();
+
+      if (aEntry.getEntryType() == ArchiveEntry::regular
+          && theOptions.isTarFormat())
+      {
+        // keep hardlinks (e.g. on update) if their target is still there
+        PathMap::const_iterator lTarget
+          = theTarPaths.find(aEntry.getHardlink().str());
+        if (lTarget != theTarPaths.end())
+        {
+          writeHeader(aEntry, 0, lTarget->second);
+          archive_write_finish_entry(theArchive);
+          theTarPaths[lPath] = lTarget->second;
+          return;
+        }
+
+        if (theOptions.getDedup())
+        {
+          std::istream* lStream;
+          uint64_t lFileSize;
+          std::auto_ptr<std::istream> lOwnedStream;
+          if (getDigestStream(aEntry, aFile, lStream, lFileSize))
+          {
+            lOwnedStream.reset(lStream);
+          }
+
+          std::pair<PathMap::iterator, bool> lDigest = theDigests.insert(
+              std::make_pair(getDigest(*lStream, lFileSize), lPath));
+          if (lDigest.second)
+          {
+            writeEntry(aEntry, lStream, lFileSize);
+            theTarPaths[lPath] = lPath;
+          }
+          else
+          {
+            // same content as an earlier entry => link to its data
+            writeHeader(aEntry, 0, lDigest.first->second);
+            archive_write_finish_entry(theArchive);
+            theTarPaths[lPath] = lDigest.first->second;
+          }
+          return;
+        }
+      }
+
       std::istream* lStream;
       bool lDeleteStream;
       uint64_t lFileSize;
 
-      archive_entry_set_pathname(theEntry, aEntry.getEntryPath().c_str());
-      archive_entry_set_mtime(theEntry, aEntry.getLastModified(), 0);
       if(aEntry.getEntryType() == ArchiveEntry::regular){
-        archive_entry_set_filetype(theEntry, AE_IFREG);
         lDeleteStream = getStream(
           aEntry, aFile, lStream, lFileSize);
-        archive_entry_set_perm(theEntry, 0644);
       } else {
-        archive_entry_set_filetype(theEntry, AE_IFDIR);
         lDeleteStream = false;
         lFileSize = 0;
-        archive_entry_set_perm(theEntry, 0775);
       }
-      archive_entry_set_size(theEntry, lFileSize);
 
-      if (theOptions.getFormat() == "ZIP")
+      writeHeader(aEntry, lFileSize, "");
+
+      if(aEntry.getEntryType() == ArchiveEntry::regular)
+      {
+        writeData(*lStream);
+        theTarPaths[lPath] = lPath;
+      }
+
+      archive_write_finish_entry(theArchive);
+
+      if (lDeleteStream)
+      {
+        delete lStream;
+        lStream = 0;
+      }
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::setPaxTimes(
+    struct archive_entry* aEntry) const
+  {
+    if (theOptions.getFormat() == "PAX" && !archive_entry_ctime_is_set(aEntry))
+    {
+      archive_entry_set_ctime(aEntry, archive_entry_mtime(aEntry), 0);
+    }
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::writeHeader(
+    const ArchiveEntry& aEntry,
+    uint64_t aSize,
+    const std::string& aHardlink)
+  {
+      archive_entry_set_pathname(theEntry, aEntry.getEntryPath().c_str());
+      archive_entry_set_mtime(theEntry, aEntry.getLastModified(), 0);
+      if(aEntry.getEntryType() == ArchiveEntry::regular){
+        archive_entry_set_filetype(theEntry, AE_IFREG);
+        archive_entry_set_perm(theEntry, 0644);
+      } else {
+        archive_entry_set_filetype(theEntry, AE_IFDIR);
+        archive_entry_set_perm(theEntry, 0775);
+      }
+      openWriter(aSize);
+      archive_entry_set_size(theEntry, aSize);
+#if ARCHIVE_VERSION_NUMBER < 3002000
+      // later versions switch to ZIP64 for large entries on their own
+      if (aSize >= 0xFFFFFFFFULL && theOptions.getFormat() == "ZIP")
+      {
+        throwError(ERROR_INVALID_OPTIONS,
+            "ZIP64 (entries of 4 GB or more) is not supported by the used version of libarchive");
+      }
+#endif
+      if (!aHardlink.empty())
+      {
+        archive_entry_set_hardlink(theEntry, aHardlink.c_str());
+      }
+
+      if (theOptions.getFormat() == "ZIP")
       {
         int lNextComp;
         std::string lNextCompString;
@@ -694,33 +1235,272 @@ zorba::Item ArchiveModule::globalEncodingKey;
         }
       }
 
+      if (theSeekableWriter)
+      {
+        theSeekableWriter->startEntry(aSize);
+      }
+      setPaxTimes(theEntry);
       archive_write_header(theArchive, theEntry);
+      archive_entry_clear(theEntry);
+  }
 
-      if(aEntry.getEntryType() == ArchiveEntry::regular)
+  void
+  ArchiveFunction::ArchiveCompressor::writeEntry(
+    const ArchiveEntry& aEntry,
+    std::istream* aStream,
+    uint64_t aSize)
+  {
+    writeHeader(aEntry, aSize, "");
+    if (aStream)
+    {
+      writeData(*aStream);
+    }
+    archive_write_finish_entry(theArchive);
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::writeData(std::istream& aStream)
+  {
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    while (aStream.good())
+    {
+      aStream.read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      archive_write_data(theArchive, lBuf, aStream.gcount());
+    }
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::readContent(
+    const ArchiveEntry& aEntry,
+    zorba::Item& aFile,
+    std::string& aContent) const
+  {
+    std::istream* lStream;
+    uint64_t lFileSize;
+    bool lDeleteStream = getStream(aEntry, aFile, lStream, lFileSize);
+
+    aContent.reserve(static_cast<size_t>(lFileSize));
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    while (lStream->good())
+    {
+      lStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      aContent.append(lBuf, static_cast<size_t>(lStream->gcount()));
+    }
+
+    if (lDeleteStream)
+    {
+      delete lStream;
+    }
+  }
+
+  std::string
+  ArchiveFunction::ArchiveCompressor::getDigest(
+    std::istream& aStream,
+    uint64_t& aSize)
+  {
+    SHA256 lHash;
+    aSize = 0;
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    while (aStream.good())
+    {
+      aStream.read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      lHash.update(lBuf, static_cast<size_t>(aStream.gcount()));
+      aSize += aStream.gcount();
+    }
+
+    // the streams of getDigestStream are seekable (materialized if necessary)
+    aStream.clear();
+    aStream.seekg(0, std::ios::beg);
+    if (aStream.fail())
+    {
+      throwError(ERROR_CORRUPTED_ARCHIVE,
+          "internal error (couldn't rewind entry content)");
+    }
+    return lHash.finish();
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::compressZip(
+    const ArchiveEntry& aEntry,
+    zorba::Item& aFile)
+  {
+    ArchiveOptions lOptions(theOptions);
+    lOptions.setDedup(false);
+    lOptions.setAlignment(0);
+
+    // the entry is compressed in an archive of its own, i.e. the archive
+    // wide compression can be used
+    ArchiveEntry lEntry(aEntry);
+    std::string lCompression = lEntry.getCompression().str();
+    if (!lCompression.empty())
+    {
+      checkZipCompression(lCompression);
+      lOptions.setCompression(lCompression);
+      lEntry.setCompression("");
+    }
+
+    std::istream* lStream = 0;
+    uint64_t lFileSize = 0;
+    std::auto_ptr<std::istream> lOwnedStream;
+    std::string lKey;
+    if (lEntry.getEntryType() == ArchiveEntry::regular)
+    {
+      bool lOwned = theOptions.getDedup()
+        ? getDigestStream(lEntry, aFile, lStream, lFileSize)
+        : getStream(lEntry, aFile, lStream, lFileSize);
+      if (lOwned)
       {
-        char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
-        while (lStream->good())
+        lOwnedStream.reset(lStream);
+      }
+      if (theOptions.getDedup())
+      {
+        lKey = getDigest(*lStream, lFileSize) + lOptions.getCompression();
+
+        ZipBlobMap::const_iterator lBlob = theZipBlobs.find(lKey);
+        if (lBlob != theZipBlobs.end())
         {
-          lStream->read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
-          archive_write_data(theArchive, lBuf, lStream->gcount());
+          // same content as an earlier entry => copy its compressed data
+          // from the output
+          ZipDirectory::Entry lZipEntry = lBlob->second.theEntry;
+          std::string lLocalExtra = lBlob->second.theLocalExtra;
+          lZipEntry.theName = lEntry.getEntryPath().str();
+          lZipEntry.setLastModified(lEntry.getLastModified(), lLocalExtra);
+          if (!theZipWriter->addCopy(lZipEntry, lLocalExtra,
+                *theStream, lBlob->second.theDataOffset))
+          {
+            throwError(ERROR_CORRUPTED_ARCHIVE,
+                "internal error (couldn't copy entry)");
+          }
+          return;
         }
       }
+    }
 
-      archive_entry_clear(theEntry);
-      archive_write_finish_entry(theArchive);
+    ArchiveCompressor lCompressor;
+    lCompressor.open(lOptions);
+    lCompressor.writeEntry(lEntry, lStream, lFileSize);
+    lCompressor.close();
+
+    std::auto_ptr<std::stringstream> lResult(lCompressor.getResultStream());
+    std::string lData = lResult->str();
+
+    // take the name from the written entry (libarchive appends a slash
+    // to directory names)
+    ZipDirectory lDirectory;
+    const char* lCompressed;
+    ZipBlob lBlob;
+    if (!lDirectory.parse(lData.data(), lData.size())
+        || lDirectory.size() != 1
+        || !lDirectory.getEntryData(
+          lDirectory.getEntry(0), lCompressed, lBlob.theLocalExtra))
+    {
+      throwError(ERROR_CORRUPTED_ARCHIVE,
+          "internal error (couldn't compress entry)");
+    }
+    lBlob.theEntry = lDirectory.getEntry(0);
+    theZipWriter->add(lBlob.theEntry, lBlob.theLocalExtra, lCompressed);
 
-      if (lDeleteStream)
+    if (!lKey.empty())
+    {
+      lBlob.theDataOffset
+        = theZipWriter->getOffset() - lBlob.theEntry.theCompressedSize;
+      theZipBlobs[lKey] = lBlob;
+    }
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::copy(
+    struct archive* aSource,
+    struct archive_entry* aEntry,
+    const String& aEntryPath)
+  {
+    assert(!theZipWriter);
+
+    archive_entry_set_pathname(aEntry, aEntryPath.c_str());
+
+    openWriter(archive_entry_size(aEntry));
+    if (theSeekableWriter)
+    {
+      theSeekableWriter->startEntry(archive_entry_size(aEntry));
+    }
+    setPaxTimes(aEntry);
+    int lErr = archive_write_header(theArchive, aEntry);
+    ArchiveFunction::checkForError(lErr, 0, theArchive);
+
+    const void* lBuf;
+    size_t lSize;
+    int64_t lOffset;
+    int64_t lWritten = 0;
+    while ((lErr = archive_read_data_block(aSource, &lBuf, &lSize, &lOffset))
+           == ARCHIVE_OK)
+    {
+      // fill holes of sparse entries
+      while (lWritten < lOffset)
       {
-        delete lStream;
-        lStream = 0;
+        static const char lZeros[ZORBA_ARCHIVE_MAX_READ_BUF] = { 0 };
+        size_t lHole = static_cast<size_t>(std::min<int64_t>(
+              lOffset - lWritten, ZORBA_ARCHIVE_MAX_READ_BUF));
+        archive_write_data(theArchive, lZeros, lHole);
+        lWritten += lHole;
       }
+      archive_write_data(theArchive, lBuf, lSize);
+      lWritten += lSize;
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, aSource);
+    }
+
+    archive_write_finish_entry(theArchive);
+  }
+
+  void
+  ArchiveFunction::ArchiveCompressor::copy(
+    struct archive_entry* aEntry,
+    const String& aEntryPath,
+    const std::string& aData)
+  {
+    assert(!theZipWriter);
+
+    archive_entry_set_pathname(aEntry, aEntryPath.c_str());
+    archive_entry_set_hardlink(aEntry, NULL);
+    archive_entry_set_size(aEntry, aData.size());
+
+    openWriter(aData.size());
+    if (theSeekableWriter)
+    {
+      theSeekableWriter->startEntry(aData.size());
+    }
+    setPaxTimes(aEntry);
+    int lErr = archive_write_header(theArchive, aEntry);
+    ArchiveFunction::checkForError(lErr, 0, theArchive);
+
+    if (!aData.empty())
+    {
+      archive_write_data(theArchive, aData.data(), aData.size());
+    }
+    archive_write_finish_entry(theArchive);
   }
 
   void
   ArchiveFunction::ArchiveCompressor::close()
   {
+    if (theZipWriter)
+    {
+      theZipWriter->close();
+      return;
+    }
+    // an archive without entries
+    openWriter(0);
 	  archive_write_close(theArchive);
 	  archive_write_finish(theArchive);
+
+    if (theSeekableWriter && !theSeekableWriter->close())
+    {
+      std::ostringstream lMsg;
+      lMsg << "internal error (" << theSeekableWriter->getError() << ")";
+      throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+    }
   }
 
   std::stringstream*
@@ -729,6 +1509,19 @@ zorba::Item ArchiveModule::globalEncodingKey;
     return theStream;
   }
 
+  void
+  ArchiveFunction::ArchiveCompressor::write(const char* aData, size_t aLen)
+  {
+    if (theSeekableWriter)
+    {
+      theSeekableWriter->write(aData, aLen);
+    }
+    else
+    {
+      theStream->write(aData, aLen);
+    }
+  }
+
 
   String 
   ArchiveFunction::getURI() const
@@ -766,6 +1559,45 @@ zorba::Item ArchiveModule::globalEncodingKey;
     }
   }
 
+  void
+  ArchiveFunction::getContents(
+      const std::vector<ArchiveEntry>& aEntries,
+      zorba::Iterator_t& aFiles,
+      std::vector<zorba::Item>& aContents)
+  {
+    zorba::Item lFile;
+    aFiles->open();
+
+    for (size_t i = 0; i < aEntries.size(); ++i)
+    {
+      if(aEntries[i].getEntryType() == ArchiveEntry::regular)
+      {
+        if (!aFiles->next(lFile))
+        {
+          std::ostringstream lMsg;
+          lMsg << "number of entries (" << aEntries.size()
+            << ") doesn't match number of content arguments (" << i << ")";
+          throwError(ERROR_ENTRY_COUNT_MISMATCH, lMsg.str().c_str());
+        }
+        aContents.push_back(lFile);
+      }
+      else
+      {
+        aContents.push_back(zorba::Item());
+      }
+    }
+
+    if (aFiles->next(lFile))
+    {
+      std::ostringstream lMsg;
+      lMsg << "number of entries (" << aEntries.size()
+        << ") less than number of content arguments";
+      throwError(ERROR_ENTRY_COUNT_MISMATCH, lMsg.str().c_str());
+    }
+
+    aFiles->close();
+  }
+
   zorba::Item
   ArchiveFunction::getOneItem(const Arguments_t& aArgs, int aIndex)
   {
@@ -775,901 +1607,6237 @@ zorba::Item ArchiveModule::globalEncodingKey;
     args_iter->next(lItem);
     args_iter->close();
 
+    ArchiveHandle* lHandle = ArchiveHandle::get(lItem);
+    if (lHandle && lHandle->isClosed())
+    {
+      throwError(ERROR_INVALID_HANDLE, "archive handle has been closed");
+    }
+
     return lItem;
   }
 
-  std::string
-  ArchiveFunction::formatName(int f)
+  void
+  ArchiveFunction::getArchiveData(
+      zorba::Item& aArchive,
+      zorba::String& aBuffer,
+      const char*& aData,
+      size_t& aSize)
   {
-    // first 16 bit indicate the format family
-    switch (f & ARCHIVE_FORMAT_BASE_MASK)
+    ArchiveHandle* lHandle = ArchiveHandle::get(aArchive);
+    if (lHandle)
     {
-      case ARCHIVE_FORMAT_TAR: return "TAR";
-      case ARCHIVE_FORMAT_ZIP: return "ZIP";
-      default: return "";
+      lHandle->getData(aData, aSize);
     }
-  }
+    else if (aArchive.isStreamable())
+    {
+      std::istream& lStream = aArchive.getStream();
+      lStream.clear();
+      if (aArchive.isSeekable())
+      {
+        lStream.seekg(0, std::ios::beg);
+      }
 
-  std::string
-  ArchiveFunction::compressionName(int c)
-  {
-    switch (c)
+      if (aArchive.isEncoded())
+      {
+        base64::attach(lStream);
+      }
+
+      char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+      while (lStream.good())
+      {
+        lStream.read(lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+        aBuffer.append(lBuf, lStream.gcount());
+      }
+      aData = aBuffer.data();
+      aSize = aBuffer.size();
+    }
+    else
     {
-      case ARCHIVE_COMPRESSION_NONE: return "NONE";
-      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE: return "DEFLATE";
-      case ZORBA_ARCHIVE_COMPRESSION_STORE: return "STORE";
-      case ARCHIVE_COMPRESSION_GZIP: return "GZIP";
-      case ARCHIVE_COMPRESSION_BZIP2: return "BZIP2";
-      case ARCHIVE_COMPRESSION_LZMA: return "LZMA";
-      default: return "";
+      size_t lLen = 0;
+      const char* lData = aArchive.getBase64BinaryValue(lLen);
+
+      if (aArchive.isEncoded())
+      {
+        base64::decode(lData, lLen, &aBuffer);
+        aData = aBuffer.data();
+        aSize = aBuffer.size();
+      }
+      else
+      {
+        aData = lData;
+        aSize = lLen;
+      }
     }
   }
 
-  int
-  ArchiveFunction::formatCode(const std::string& f)
+  void
+  ArchiveFunction::isolateZipEntry(
+      const ZipDirectory& aDirectory,
+      size_t aIndex,
+      std::string& aResult)
   {
-    if (f == "TAR")
-    {
-      return ARCHIVE_FORMAT_TAR_USTAR;
-    }
-    else if (f == "ZIP")
-    {
-      return ARCHIVE_FORMAT_ZIP;
-    }
-    else
+    std::stringstream lSingle;
+    ZipWriter lSingleWriter(lSingle);
+    if (!lSingleWriter.copy(aDirectory, aIndex))
     {
       std::ostringstream lMsg;
-      lMsg << f << ": archive format not supported";
-      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+      lMsg << aDirectory.getEntry(aIndex).theName << ": invalid entry offset";
+      throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
     }
-    return 0;
+    lSingleWriter.close();
+    aResult = lSingle.str();
   }
 
-  int
-  ArchiveFunction::compressionCode(const std::string& c)
+  bool
+  ArchiveFunction::readZipEntry(
+      const ZipDirectory& aDirectory,
+      size_t aIndex,
+      BlockFunction aFunction,
+      void* aArg,
+      std::string& aError,
+      ResourceGuard* aGuard)
   {
-    if (c == "NONE")
+    const ZipDirectory::Entry& lEntry = aDirectory.getEntry(aIndex);
+
+    // stored entries are passed straight out of the archive
+    const char* lEntryData;
+    std::string lLocalExtra;
+    if (lEntry.theMethod == ZORBA_ZIP_METHOD_STORE
+        && !(lEntry.theFlags & 0x1) // not encrypted
+        && aDirectory.getEntryData(lEntry, lEntryData, lLocalExtra))
     {
-      return ARCHIVE_COMPRESSION_NONE;
+      // only the compressed size is checked against the archive bounds
+      if (lEntry.theCompressedSize != lEntry.theUncompressedSize)
+      {
+        std::ostringstream lMsg;
+        lMsg << lEntry.theName << ": stored entry with compressed size "
+          << lEntry.theCompressedSize << " and uncompressed size "
+          << lEntry.theUncompressedSize;
+        aError = lMsg.str();
+        return false;
+      }
+      if (aGuard && !aGuard->addData(lEntry.theCompressedSize,
+                                     lEntry.theCompressedSize))
+      {
+        aError = aGuard->getError();
+        return false;
+      }
+      aFunction(aArg, lEntryData, static_cast<size_t>(lEntry.theCompressedSize));
+      return true;
     }
-    else if (c == "STORE")
+
+    std::stringstream lSingle;
+    ZipWriter lSingleWriter(lSingle);
+    if (!lSingleWriter.copy(aDirectory, aIndex))
     {
-      return ZORBA_ARCHIVE_COMPRESSION_STORE;
+      aError = lEntry.theName + ": invalid entry offset";
+      return false;
     }
-    else if (c == "DEFLATE")
+    lSingleWriter.close();
+    std::string lSingleData = lSingle.str();
+
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
     {
-      return ZORBA_ARCHIVE_COMPRESSION_DEFLATE;
+      aError = "internal error (couldn't create archive)";
+      return false;
     }
-    else if (c == "GZIP")
+
+    struct archive_entry* lArchiveEntry;
+    int lErr = archive_read_support_format_zip(lReader);
+    if (lErr == ARCHIVE_OK)
     {
-      return ARCHIVE_COMPRESSION_GZIP;
+      lErr = archive_read_open_memory(lReader,
+          const_cast<char*>(lSingleData.data()), lSingleData.size());
     }
-    else if (c == "BZIP2")
+    if (lErr == ARCHIVE_OK)
     {
-      return ARCHIVE_COMPRESSION_BZIP2;
+      lErr = archive_read_next_header(lReader, &lArchiveEntry);
     }
-    else if (c == "LZMA")
+
+    const void* lBlock;
+    size_t lBlockSize;
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+    int64_t lBlockOffset;
+#else
+    off_t lBlockOffset;
+#endif
+    try
     {
-      return ARCHIVE_COMPRESSION_LZMA;
+      while (lErr == ARCHIVE_OK
+             && (lErr = archive_read_data_block(
+                   lReader, &lBlock, &lBlockSize, &lBlockOffset)) == ARCHIVE_OK)
+      {
+        // the ratio is checked against the whole compressed entry
+        if (aGuard && !aGuard->addData(lBlockSize, lEntry.theCompressedSize))
+        {
+          break;
+        }
+        if (!aFunction(aArg, static_cast<const char*>(lBlock), lBlockSize))
+        {
+          lErr = ARCHIVE_EOF;
+        }
+      }
     }
-    else
+    catch (...)
     {
-      std::ostringstream lMsg;
-      lMsg << c << ": compression algorithm not supported";
-      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+      // e.g. running out of memory while appending the data
+      archive_read_finish(lReader);
+      throw;
     }
-    return 0;
+
+    bool lResult = lErr == ARCHIVE_EOF;
+    if (aGuard && aGuard->failed())
+    {
+      aError = aGuard->getError();
+    }
+    else if (!lResult)
+    {
+      const char* lMsg = archive_error_string(lReader);
+      aError = lEntry.theName + ": " + (lMsg ? lMsg : "corrupted archive");
+    }
+    archive_read_finish(lReader);
+    return lResult;
   }
 
   void
-  ArchiveFunction::setArchiveCompression(struct archive* a, int c)
+  ArchiveFunction::checkZipLimits(const ZipDirectory& aDirectory)
   {
-    int lErr = 0;
-    switch (c)
+    ResourceGuard lGuard;
+    for (size_t i = 0; i < aDirectory.size(); ++i)
     {
-#ifdef ZORBA_LIBARCHIVE_HAVE_SET_COMPRESSION
-      case ZORBA_ARCHIVE_COMPRESSION_STORE:
-        lErr = archive_write_zip_set_compression_store(a); break;
-      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE:
-      case ARCHIVE_COMPRESSION_NONE:
-        lErr = archive_write_zip_set_compression_deflate(a); break;
-#else
-      case ZORBA_ARCHIVE_COMPRESSION_STORE:
-        archive_write_set_options(a, "zip:compression=store");
-        break;
-      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE:
-        archive_write_set_options(a, "zip:compression=deflate");
-        break;
-      case ARCHIVE_COMPRESSION_NONE:
-        lErr = archive_write_set_compression_none(a); break;
-#endif
-      case ARCHIVE_COMPRESSION_GZIP:
-        lErr = archive_write_set_compression_gzip(a); break;
-      case ARCHIVE_COMPRESSION_BZIP2:
-        lErr = archive_write_set_compression_bzip2(a); break;
-      case ARCHIVE_COMPRESSION_LZMA:
-        lErr = archive_write_set_compression_lzma(a); break;
-      default: assert(false);
+      const ZipDirectory::Entry& lEntry = aDirectory.getEntry(i);
+      if (!lGuard.startEntry(lEntry.theName.c_str())
+          || !lGuard.addData(lEntry.theUncompressedSize, 0))
+      {
+        checkGuard(lGuard);
+      }
     }
-    ArchiveFunction::checkForError(lErr, 0, a);
   }
 
-
-  _ssize_t 
-  ArchiveItemSequence::readStream(struct archive*, void *data, const void **buff)
+  bool
+  ArchiveFunction::parseZip(
+      ZipDirectory& aDirectory,
+      const char* aData,
+      uint64_t aSize)
   {
-    ArchiveItemSequence::CallbackData* lData =
-      reinterpret_cast<ArchiveItemSequence::CallbackData*>(data);
-
-    if (lData->theEnd) return 0;
-
-    std::istream* lStream = lData->theStream;
-
-    // seek to where we left of
-    if (lData->theSeekable) lStream->seekg(lData->thePos, std::ios::beg);
-
-    lStream->read(lData->theBuffer, ZORBA_ARCHIVE_MAX_READ_BUF);
-    *buff = lData->theBuffer;
-
-    if (lStream->eof()) lData->theEnd = true;
-
-    // remember the stream pos before leaving the function
-    if (lData->theSeekable) lData->thePos = lStream->tellg();
-
-    return lStream->gcount(); 
+    if (!ZipDirectory::isZip(aData, aSize))
+    {
+      return false;
+    }
+    if (!aDirectory.parse(aData, aSize))
+    {
+      if (aDirectory.isCorrupted())
+      {
+        throwError(ERROR_CORRUPTED_ARCHIVE,
+            "invalid central directory of ZIP archive");
+      }
+      return false;
+    }
+    return true;
   }
 
-  ArchiveItemSequence::ArchiveIterator::ArchiveIterator(zorba::Item& a)
-    : theArchiveItem(a),
-      theArchive(0),
-      theFactory(Zorba::getInstance(0)->getItemFactory())
-  {}
-
-  void
-  ArchiveItemSequence::ArchiveIterator::open()
+  bool
+  ArchiveFunction::getZipDirectory(
+      zorba::Item& aArchive,
+      ZipDirectory& aDirectory,
+      zorba::String& aBuffer,
+      const char*& aData,
+      size_t& aSize)
   {
-    // open archive and allow for all kinds of formats and compression algos
-    theArchive = archive_read_new();
-
-    if (!theArchive)
-      ArchiveFunction::throwError(
-          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
-
-    int lErr = archive_read_support_compression_all(theArchive);
-    ArchiveFunction::checkForError(lErr, 0, theArchive);
-
-    archive_read_support_format_all(theArchive);
-    ArchiveFunction::checkForError(lErr, 0, theArchive);
-
-    if (theArchiveItem.isStreamable())
+    if (!aData && aArchive.isStreamable() && aArchive.isSeekable()
+        && !aArchive.isEncoded())
     {
-      theData.theStream = &theArchiveItem.getStream();
-      theData.theStream->clear();
-      theData.theSeekable = theArchiveItem.isSeekable();
-      theData.theEnd = false;
-      theData.thePos = 0;
-
-      if (theArchiveItem.isEncoded())
+      std::istream& lStream = aArchive.getStream();
+      lStream.clear();
+      lStream.seekg(0, std::ios::end);
+      std::streamoff lPos = lStream.tellg();
+
+      bool lParsed = false;
+      uint64_t lEnd = lPos > 0 ? static_cast<uint64_t>(lPos) : 0;
+      uint64_t lBase = lEnd > ZipDirectory::TAIL_SIZE
+        ? lEnd - ZipDirectory::TAIL_SIZE : 0;
+      std::string lTail;
+      uint64_t lOffset;
+      if (lEnd)
       {
-        base64::attach(*theData.theStream);
+        readStreamRange(lStream, lBase, lEnd - lBase, lTail);
       }
-
-      lErr = archive_read_open(theArchive, &theData, NULL, ArchiveItemSequence::readStream, NULL);
-      ArchiveFunction::checkForError(lErr, 0, theArchive);
-    }
-    else
-    {
-      size_t lLen = 0;
-      char* lData = const_cast<char*>(
-          theArchiveItem.getBase64BinaryValue(lLen));
-
-      if (theArchiveItem.isEncoded())
+      if (lTail.size() == lEnd - lBase && lEnd
+          && ZipDirectory::findDirectory(
+               lTail.data(), lTail.size(), lBase, lOffset))
       {
-        base64::decode(lData, lLen, &theDecodedData);
-        lLen = theDecodedData.size();
-        lErr = archive_read_open_memory(theArchive,
-            const_cast<char*>(theDecodedData.c_str()), lLen);
-        ArchiveFunction::checkForError(lErr, 0, theArchive);
+        // the directory may start in front of the records read
+        if (lOffset < lBase)
+        {
+          lBase = lOffset;
+          readStreamRange(lStream, lBase, lEnd - lBase, lTail);
+        }
+        lParsed = lTail.size() == lEnd - lBase
+          && aDirectory.parse(lTail.data(), lTail.size(), lBase);
       }
-      else
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+
+      if (lParsed)
       {
-        lErr = archive_read_open_memory(theArchive, lData, lLen);
-        ArchiveFunction::checkForError(lErr, 0, theArchive);
+        // the entries are read by loadZipEntries if needed
+        aDirectory.setData(0, 0, lEnd);
+        return true;
       }
 
+      // anything unexpected (e.g. for the error) is left to a full parse
+      getArchiveData(aArchive, aBuffer, aData, aSize);
     }
+    return parseZip(aDirectory, aData, aSize);
   }
 
   void
-  ArchiveItemSequence::ArchiveIterator::close()
+  ArchiveFunction::loadZipEntries(
+      zorba::Item& aArchive,
+      ZipDirectory& aDirectory,
+      const std::vector<size_t>& aIndexes,
+      std::string& aBuffer)
   {
-    int lErr = archive_read_finish(theArchive);
-    ArchiveFunction::checkForError(lErr, 0, theArchive);
-    theArchive = 0;
-  }
+    // the whole archive is at hand
+    if (aDirectory.getBase() == 0 || aIndexes.empty()) return;
+
+    // an entry ends where the next one (or the directory) starts
+    std::vector<uint64_t> lOffsets;
+    lOffsets.reserve(aDirectory.size() + 1);
+    for (size_t i = 0; i < aDirectory.size(); ++i)
+    {
+      lOffsets.push_back(aDirectory.getEntry(i).theLocalHeaderOffset);
+    }
+    lOffsets.push_back(aDirectory.getDirectoryOffset());
+    std::sort(lOffsets.begin(), lOffsets.end());
 
+    uint64_t lBegin = aDirectory.getBase();
+    uint64_t lEnd = 0;
+    for (size_t i = 0; i < aIndexes.size(); ++i)
+    {
+      uint64_t lOffset = aDirectory.getEntry(aIndexes[i]).theLocalHeaderOffset;
+      std::vector<uint64_t>::const_iterator lNext
+        = std::upper_bound(lOffsets.begin(), lOffsets.end(), lOffset);
+      if (lNext == lOffsets.end()) continue; // behind the directory
 
-  _ssize_t
-  ArchiveFunction::writeStream(
-      struct archive *,
-      void *func,
-      const void *buff,
-      size_t n)
+      lBegin = std::min(lBegin, lOffset);
+      lEnd = std::max(lEnd, *lNext);
+    }
+    // offsets out of range are reported by getEntryData
+    if (lBegin >= lEnd) return;
+
+    std::istream& lStream = aArchive.getStream();
+    lStream.clear();
+    readStreamRange(lStream, lBegin, lEnd - lBegin, aBuffer);
+    lStream.clear();
+    lStream.seekg(0, std::ios::beg);
+    aDirectory.setData(aBuffer.data(), aBuffer.size(), lBegin);
+  }
+
+  void
+  ArchiveFunction::readStreamRange(
+      std::istream& aStream,
+      uint64_t aOffset,
+      uint64_t aLength,
+      std::string& aResult)
   {
-    ArchiveFunction::ArchiveCompressor* lFunc =
-      static_cast<ArchiveFunction::ArchiveCompressor*>(func);
+    aResult.clear();
+    aStream.seekg(static_cast<std::streamoff>(aOffset), std::ios::beg);
 
-    const char * lBuf = static_cast<const char *>(buff);
-    lFunc->getResultStream()->write(lBuf, n);
-  
-    return n;
+    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+    while (aStream.good() && aResult.size() < aLength)
+    {
+      uint64_t lLeft = aLength - aResult.size();
+      aStream.read(lBuf, static_cast<std::streamsize>(
+            std::min<uint64_t>(lLeft, ZORBA_ARCHIVE_MAX_READ_BUF)));
+      aResult.append(lBuf, static_cast<size_t>(aStream.gcount()));
+    }
   }
 
-/*******************************************************************************
- ******************************************************************************/
-  zorba::ItemSequence_t
-    CreateFunction::evaluate(
-      const Arguments_t& aArgs,
-      const zorba::StaticContext* aSctx,
-      const zorba::DynamicContext* aDctx) const 
+  void
+  ArchiveFunction::sniffArchive(
+      zorba::Item& aArchive,
+      std::string& aFormat,
+      std::string& aCompression,
+      zorba::String& aBuffer,
+      const char*& aData,
+      size_t& aSize)
   {
-    std::vector<ArchiveEntry> lEntries;
+    aData = 0;
+    aSize = 0;
 
+    // a non-seekable stream can only be read once, i.e. by libarchive
+    if (aArchive.isStreamable() && !aArchive.isSeekable())
     {
-      Iterator_t lEntriesIter = aArgs[0]->getIterator();
+      return;
+    }
 
-      zorba::Item lEntry;
-      lEntriesIter->open();
-      while (lEntriesIter->next(lEntry))
+    if (aArchive.isStreamable() && !aArchive.isEncoded())
+    {
+      // only the head is needed unless it's a ZIP archive
+      char lHead[ArchiveSniffer::HEAD_SIZE];
+      std::istream& lStream = aArchive.getStream();
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+      lStream.read(lHead, ArchiveSniffer::HEAD_SIZE);
+      size_t lHeadLen = static_cast<size_t>(lStream.gcount());
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+
+      ArchiveSniffer::sniff(lHead, lHeadLen, aFormat, aCompression);
+      // the seek table of a zstd stream is at its end
+      if (aCompression == "ZSTD")
       {
-        lEntries.resize(lEntries.size() + 1);
-        lEntries.back().setValues(lEntry);
+        getArchiveData(aArchive, aBuffer, aData, aSize);
       }
-      lEntriesIter->close();
     }
+    else
+    {
+      getArchiveData(aArchive, aBuffer, aData, aSize);
+      ArchiveSniffer::sniff(aData, aSize, aFormat, aCompression);
+    }
+  }
 
-    ArchiveOptions lOptions;
+  void
+  ArchiveFunction::setReaderSupport(
+      struct archive* a,
+      const char* aHead,
+      size_t aLen)
+  {
+    std::string lFormat;
+    std::string lCompression;
+    ArchiveSniffer::sniff(aHead, aLen, lFormat, lCompression);
+
+    // bidding is skipped for all formats but the detected one
+    int lErr;
+    if (lCompression == "GZIP")
+      lErr = archive_read_support_compression_gzip(a);
+    else if (lCompression == "BZIP2")
+      lErr = archive_read_support_compression_bzip2(a);
+    else if (lCompression == "LZMA")
+      lErr = archive_read_support_compression_lzma(a);
+    else if (lCompression == "XZ")
+      lErr = archive_read_support_compression_xz(a);
+#ifdef ARCHIVE_FILTER_ZSTD
+    else if (lCompression == "ZSTD")
+      lErr = archive_read_support_filter_zstd(a);
+#endif
+    else if (lCompression == "NONE")
+      lErr = archive_read_support_compression_none(a);
+    else
+      lErr = archive_read_support_compression_all(a);
 
-    if (aArgs.size() == 3)
+    // ARCHIVE_WARN if the filter is provided by an external program
+    if (lErr < ARCHIVE_WARN)
     {
-      zorba::Item lOptionsItem = getOneItem(aArgs, 2);
-      lOptions.setValues(lOptionsItem);
+      ArchiveFunction::checkForError(lErr, 0, a);
     }
-    
-    ArchiveCompressor lArchive;
-      
-    zorba::Iterator_t lFileIter = aArgs[1]->getIterator();
-    lArchive.open(lOptions);
-    lArchive.compress(lEntries, lFileIter);
-    lArchive.close();
 
-    zorba::Item lRes = theModule->getItemFactory()->
-      createStreamableBase64Binary(
-        *lArchive.getResultStream(),
-        &(ArchiveFunction::ArchiveCompressor::releaseStream),
-        true, // seekable
-        false // not encoded
-        );
-    return ItemSequence_t(new SingletonItemSequence(lRes));
+    if (lFormat == "ZIP")
+      lErr = archive_read_support_format_zip(a);
+    else if (lFormat == "TAR")
+      lErr = archive_read_support_format_tar(a);
+    else if (lFormat == "CPIO")
+      lErr = archive_read_support_format_cpio(a);
+#ifdef ARCHIVE_FORMAT_XAR
+    else if (lFormat == "XAR")
+      lErr = archive_read_support_format_xar(a);
+#endif
+#ifdef ARCHIVE_FORMAT_7ZIP
+    else if (lFormat == "7ZIP")
+      lErr = archive_read_support_format_7zip(a);
+#endif
+    else
+      lErr = archive_read_support_format_all(a);
+    ArchiveFunction::checkForError(lErr, 0, a);
   }
 
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+  struct DictionarySource
+  {
+    ZstdDictionaryDecoder theDecoder;
+    // the archive in memory or, if theRead is set, read through it
+    const char*           theData;
+    size_t                theSize;
+    void*                 theClientData;
+    _ssize_t (*theRead)(struct archive*, void*, const void**);
+    uint64_t              theConsumed;
+    // decompressed data handed to libarchive
+    std::string           theBuffer;
+
+    DictionarySource()
+      : theData(0), theSize(0), theClientData(0), theRead(0),
+        theConsumed(0) {}
+  };
+#else
+  struct DictionarySource {};
+#endif
 
-/*******************************************************************************
- ******************************************************************************/
-  zorba::ItemSequence_t
-  EntriesFunction::evaluate(
-    const Arguments_t& aArgs,
-    const zorba::StaticContext* aSctx,
-    const zorba::DynamicContext* aDctx) const 
-  { 
-    Item lArchive = getOneItem(aArgs, 0);
-    
-    return ItemSequence_t(new EntriesItemSequence(lArchive));
+  DictionarySource*
+  ArchiveFunction::openReader(
+      struct archive* a,
+      const char* aData,
+      size_t aLen)
+  {
+    DictionarySource* lSource
+      = openDictionaryReader(a, aData, aLen, aData, aLen);
+    if (lSource) return lSource;
+
+    setReaderSupport(a, aData, aLen);
+
+    int lErr = archive_read_open_memory(a, const_cast<char*>(aData), aLen);
+    ArchiveFunction::checkForError(lErr, 0, a);
+    return 0;
   }
 
-  EntriesFunction::EntriesItemSequence::EntriesIterator::EntriesIterator(
-      zorba::Item& aArchive)
-    : ArchiveIterator(aArchive)
+  DictionarySource*
+  ArchiveFunction::openDictionaryReader(
+      struct archive* a,
+      const char* aHead,
+      size_t aHeadLen,
+      const char* aData,
+      size_t aLen,
+      void* aClientData,
+      _ssize_t (*aRead)(struct archive*, void*, const void**))
   {
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    if (!ZstdDictionaryDecoder::hasDictionary(aHead, aHeadLen)) return 0;
+
+    // only TAR archives are written with a dictionary
+    int lErr = archive_read_support_compression_none(a);
+    ArchiveFunction::checkForError(lErr, 0, a);
+    lErr = archive_read_support_format_tar(a);
+    ArchiveFunction::checkForError(lErr, 0, a);
+
+    DictionarySource* lSource = new DictionarySource();
+    lSource->theData = aData;
+    lSource->theSize = aLen;
+    lSource->theClientData = aClientData;
+    lSource->theRead = aRead;
+
+    // released by closeDictionary
+    lErr = archive_read_open2(a, lSource, NULL,
+        ArchiveFunction::readDictionary, NULL,
+        ArchiveFunction::closeDictionary);
+    ArchiveFunction::checkForError(lErr, 0, a);
+    return lSource;
+#else
+    return 0;
+#endif
   }
 
-  bool
-  EntriesFunction::EntriesItemSequence::EntriesIterator::next(zorba::Item& aRes)
+  uint64_t
+  ArchiveFunction::getConsumed(const DictionarySource* aSource)
   {
-    struct archive_entry *lEntry;
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    return aSource->theConsumed;
+#else
+    return 0;
+#endif
+  }
 
-    int lErr = archive_read_next_header(theArchive, &lEntry);
-    
-    if (lErr == ARCHIVE_EOF) return false;
+  _ssize_t
+  ArchiveFunction::readDictionary(
+      struct archive* a,
+      void* aData,
+      const void** aBuf)
+  {
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    DictionarySource* lSource = static_cast<DictionarySource*>(aData);
 
-    if (lErr != ARCHIVE_OK)
+    // the dictionary frame and the seek table don't decompress to anything
+    lSource->theBuffer.clear();
+    while (lSource->theBuffer.empty())
     {
-      ArchiveFunction::checkForError(lErr, 0, theArchive);
-    }
+      const void* lIn = 0;
+      _ssize_t lLen;
+      if (lSource->theRead)
+      {
+        lLen = lSource->theRead(a, lSource->theClientData, &lIn);
+      }
+      else
+      {
+        lIn = lSource->theData;
+        lLen = static_cast<_ssize_t>(std::min<size_t>(
+              lSource->theSize, ZORBA_ARCHIVE_READ_AHEAD_BUF));
+        lSource->theData += lLen;
+        lSource->theSize -= lLen;
+      }
 
-    std::vector<std::pair<zorba::Item, zorba::Item> > lObjectArray;
-    std::pair<zorba::Item, zorba::Item> lElemPair;
+      if (lLen < 0) return lLen;
+      if (lLen == 0)
+      {
+        if (!lSource->theDecoder.isFinished())
+        {
+          archive_set_error(a, ARCHIVE_ERRNO_MISC, "truncated zstd stream");
+          return ARCHIVE_FATAL;
+        }
+        return 0;
+      }
 
-    // create text content (i.e. path name)
-    String lName = archive_entry_pathname(lEntry);
-    lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::NAME),
-                                                         theFactory->createString(lName));
+      lSource->theConsumed += lLen;
+      if (!lSource->theDecoder.decode(
+            static_cast<const char*>(lIn), lLen, lSource->theBuffer))
+      {
+        archive_set_error(a, ARCHIVE_ERRNO_MISC, "%s",
+            lSource->theDecoder.getError().c_str());
+        return ARCHIVE_FATAL;
+      }
+    }
+    *aBuf = lSource->theBuffer.data();
+    return static_cast<_ssize_t>(lSource->theBuffer.size());
+#else
+    return 0;
+#endif
+  }
+
+  int
+  ArchiveFunction::closeDictionary(struct archive*, void* aData)
+  {
+    delete static_cast<DictionarySource*>(aData);
+    return ARCHIVE_OK;
+  }
+
+  bool
+  ArchiveFunction::appendEntryData(
+      struct archive* a,
+      struct archive_entry* aEntry,
+      std::string& aResult,
+      ResourceGuard* aGuard)
+  {
+    size_t lStart = aResult.size();
+    if (aEntry && archive_entry_size_is_set(aEntry))
+    {
+      // the size comes from the (untrusted) header
+      int64_t lSize = archive_entry_size(aEntry);
+      size_t lReserve = aGuard
+        ? aGuard->getReserve(lSize)
+        : static_cast<size_t>(std::min<int64_t>(
+              std::max<int64_t>(lSize, 0), ZORBA_ARCHIVE_MAX_RESERVE));
+      aResult.reserve(lStart + lReserve);
+    }
+
+    const void* lBlock;
+    size_t lBlockSize;
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+    int64_t lBlockOffset;
+#else
+    off_t lBlockOffset;
+#endif
+    int lErr;
+    while ((lErr = archive_read_data_block(
+              a, &lBlock, &lBlockSize, &lBlockOffset)) == ARCHIVE_OK)
+    {
+      // sparse entries: holes read as zeros
+      uint64_t lWritten = aResult.size() - lStart;
+      if (aGuard)
+      {
+        uint64_t lHole = uint64_t(lBlockOffset) > lWritten
+          ? uint64_t(lBlockOffset) - lWritten : 0;
+        if (!aGuard->addData(lHole + lBlockSize,
+                             archive_position_compressed(a)))
+        {
+          return false;
+        }
+      }
+      if (uint64_t(lBlockOffset) > lWritten)
+      {
+        aResult.append(
+            static_cast<size_t>(uint64_t(lBlockOffset) - lWritten), '\0');
+      }
+      aResult.append(static_cast<const char*>(lBlock), lBlockSize);
+    }
+    return lErr == ARCHIVE_EOF;
+  }
+
+  void
+  ArchiveFunction::checkGuard(const ResourceGuard& aGuard)
+  {
+    if (aGuard.failed())
+    {
+      throwError(ERROR_LIMIT_EXCEEDED, aGuard.getError().c_str());
+    }
+  }
+
+  std::string
+  ArchiveFunction::formatName(int f)
+  {
+    // libarchive reports the variant of the current TAR header, i.e. an
+    // archive counts as PAX if the (first) entry has an extended header
+    if (f == ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE)
+    {
+      return "PAX";
+    }
+
+    // first 16 bit indicate the format family
+    switch (f & ARCHIVE_FORMAT_BASE_MASK)
+    {
+      case ARCHIVE_FORMAT_TAR: return "TAR";
+      case ARCHIVE_FORMAT_ZIP: return "ZIP";
+      case ARCHIVE_FORMAT_CPIO: return "CPIO";
+#ifdef ARCHIVE_FORMAT_XAR
+      case ARCHIVE_FORMAT_XAR: return "XAR";
+#endif
+#ifdef ARCHIVE_FORMAT_7ZIP
+      case ARCHIVE_FORMAT_7ZIP: return "7ZIP";
+#endif
+      default: return "";
+    }
+  }
+
+  std::string
+  ArchiveFunction::compressionName(int c)
+  {
+    switch (c)
+    {
+      case ARCHIVE_COMPRESSION_NONE: return "NONE";
+      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE: return "DEFLATE";
+      case ZORBA_ARCHIVE_COMPRESSION_STORE: return "STORE";
+      case ARCHIVE_COMPRESSION_GZIP: return "GZIP";
+      case ARCHIVE_COMPRESSION_BZIP2: return "BZIP2";
+      case ARCHIVE_COMPRESSION_LZMA: return "LZMA";
+#if defined(ZORBA_ARCHIVE_HAVE_ZSTD) && defined(ARCHIVE_FILTER_ZSTD)
+      // rewritten archives get a seek table (plain zstd streams, too)
+      case ARCHIVE_FILTER_ZSTD: return "ZSTD-SEEKABLE";
+#endif
+      default: return "";
+    }
+  }
+
+  int
+  ArchiveFunction::formatCode(const std::string& f)
+  {
+    if (f == "TAR")
+    {
+      // ustar headers unless an entry doesn't fit (e.g. 8 GB or larger)
+      return ARCHIVE_FORMAT_TAR_PAX_RESTRICTED;
+    }
+    else if (f == "PAX")
+    {
+      return ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE;
+    }
+    else if (f == "ZIP")
+    {
+      return ARCHIVE_FORMAT_ZIP;
+    }
+    else if (f == "CPIO")
+    {
+      // SVR4 "newc" headers
+      return ARCHIVE_FORMAT_CPIO_SVR4_NOCRC;
+    }
+#ifdef ARCHIVE_FORMAT_XAR
+    else if (f == "XAR")
+    {
+      return ARCHIVE_FORMAT_XAR;
+    }
+#endif
+#ifdef ARCHIVE_FORMAT_7ZIP
+    else if (f == "7ZIP")
+    {
+      return ARCHIVE_FORMAT_7ZIP;
+    }
+#endif
+    else
+    {
+      std::ostringstream lMsg;
+      lMsg << f << ": archive format not supported";
+      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+    }
+    return 0;
+  }
+
+  int
+  ArchiveFunction::compressionCode(const std::string& c)
+  {
+    if (c == "NONE")
+    {
+      return ARCHIVE_COMPRESSION_NONE;
+    }
+    else if (c == "STORE")
+    {
+      return ZORBA_ARCHIVE_COMPRESSION_STORE;
+    }
+    else if (c == "DEFLATE")
+    {
+      return ZORBA_ARCHIVE_COMPRESSION_DEFLATE;
+    }
+    else if (c == "GZIP")
+    {
+      return ARCHIVE_COMPRESSION_GZIP;
+    }
+    else if (c == "BZIP2")
+    {
+      return ARCHIVE_COMPRESSION_BZIP2;
+    }
+    else if (c == "LZMA")
+    {
+      return ARCHIVE_COMPRESSION_LZMA;
+    }
+    else
+    {
+      std::ostringstream lMsg;
+      lMsg << c << ": compression algorithm not supported";
+      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+    }
+    return 0;
+  }
+
+  void
+  ArchiveFunction::setArchiveCompression(struct archive* a, int c)
+  {
+    int lErr = 0;
+    switch (c)
+    {
+#ifdef ZORBA_LIBARCHIVE_HAVE_SET_COMPRESSION
+      case ZORBA_ARCHIVE_COMPRESSION_STORE:
+        lErr = archive_write_zip_set_compression_store(a); break;
+      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE:
+      case ARCHIVE_COMPRESSION_NONE:
+        lErr = archive_write_zip_set_compression_deflate(a); break;
+#else
+      case ZORBA_ARCHIVE_COMPRESSION_STORE:
+        archive_write_set_options(a, "zip:compression=store");
+        break;
+      case ZORBA_ARCHIVE_COMPRESSION_DEFLATE:
+        archive_write_set_options(a, "zip:compression=deflate");
+        break;
+      case ARCHIVE_COMPRESSION_NONE:
+        lErr = archive_write_set_compression_none(a); break;
+#endif
+      case ARCHIVE_COMPRESSION_GZIP:
+        lErr = archive_write_set_compression_gzip(a); break;
+      case ARCHIVE_COMPRESSION_BZIP2:
+        lErr = archive_write_set_compression_bzip2(a); break;
+      case ARCHIVE_COMPRESSION_LZMA:
+        lErr = archive_write_set_compression_lzma(a); break;
+      default: assert(false);
+    }
+    ArchiveFunction::checkForError(lErr, 0, a);
+  }
+
+
+  _ssize_t 
+  ArchiveItemSequence::readStream(struct archive*, void *data, const void **buff)
+  {
+    ArchiveItemSequence::CallbackData* lData =
+      reinterpret_cast<ArchiveItemSequence::CallbackData*>(data);
+
+    if (lData->theReadAhead) return lData->theReadAhead->next(buff);
+
+    if (lData->theEnd) return 0;
+
+    std::istream* lStream = lData->theStream;
+
+    // seek to where we left of
+    if (lData->theSeekable) lStream->seekg(lData->thePos, std::ios::beg);
+
+    lStream->read(lData->theBuffer, ZORBA_ARCHIVE_MAX_READ_BUF);
+    *buff = lData->theBuffer;
+
+    if (lStream->eof()) lData->theEnd = true;
+
+    // remember the stream pos before leaving the function
+    if (lData->theSeekable) lData->thePos = lStream->tellg();
+
+    return lStream->gcount(); 
+  }
+
+#ifdef WIN32
+  __int64
+  ArchiveItemSequence::skipStream(struct archive*, void *data, __int64 request)
+#else
+  off_t
+  ArchiveItemSequence::skipStream(struct archive*, void *data, off_t request)
+#endif
+  {
+    ArchiveItemSequence::CallbackData* lData =
+      reinterpret_cast<ArchiveItemSequence::CallbackData*>(data);
+
+    // libarchive reads over the data if nothing is skipped
+    if (lData->theSize < 0 || lData->theEnd || request <= 0) return 0;
+
+    std::streamoff lLeft = lData->theSize - std::streamoff(lData->thePos);
+    std::streamoff lSkip = request < lLeft ? std::streamoff(request) : lLeft;
+    lData->thePos += lSkip;
+
+    return lSkip;
+  }
+
+  ArchiveItemSequence::ArchiveIterator::ArchiveIterator(zorba::Item& a)
+    : theArchiveItem(a),
+      theArchive(0),
+      theFactory(Zorba::getInstance(0)->getItemFactory()),
+      theExcludedNames(0),
+      theDictionary(0)
+  {}
+
+  void
+  ArchiveItemSequence::ArchiveIterator::open()
+  {
+    // the limits in effect when the iteration starts
+    theGuard = ResourceGuard();
+
+    // open archive and allow for all kinds of formats and compression algos
+    theArchive = archive_read_new();
+
+    if (!theArchive)
+      ArchiveFunction::throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
+
+    int lErr;
+    theDictionary = 0;
+
+    ArchiveHandle* lHandle = ArchiveHandle::get(theArchiveItem);
+    if (lHandle)
+    {
+      const char* lData;
+      size_t lLen;
+      lHandle->getData(lData, lLen);
+
+      theDictionary = ArchiveFunction::openReader(theArchive, lData, lLen);
+    }
+    else if (theArchiveItem.isStreamable()
+             || (theArchiveItem.isEncoded() && ReadAhead::getDepth()))
+    {
+      // stop reading ahead before the stream goes away
+      delete theData.theReadAhead;
+      theData.theReadAhead = 0;
+
+      if (theArchiveItem.isStreamable())
+      {
+        theData.theStream = &theArchiveItem.getStream();
+        theData.theSeekable = theArchiveItem.isSeekable();
+      }
+      else
+      {
+        // decoded while it's read instead of all at once
+        size_t lLen = 0;
+        const char* lData = theArchiveItem.getBase64BinaryValue(lLen);
+        theEncodedStream.reset();
+        theEncodedBuffer.reset(new MemoryBuffer(lData, lLen));
+        theEncodedStream.reset(new std::istream(theEncodedBuffer.get()));
+        theData.theStream = theEncodedStream.get();
+        theData.theSeekable = false;
+      }
+      theData.theStream->clear();
+      theData.theEnd = false;
+      theData.thePos = 0;
+      theData.theSize = -1;
+
+      if (theArchiveItem.isEncoded())
+      {
+        base64::attach(*theData.theStream);
+      }
+
+      // peek at the leading bytes to only enable the matching readers
+      // (readStream seeks back to the start)
+      char lHead[ArchiveSniffer::HEAD_SIZE];
+      size_t lHeadLen = 0;
+      if (theData.theSeekable)
+      {
+        // the base64 decoding stream can't tell its size
+        if (!theArchiveItem.isEncoded())
+        {
+          theData.theStream->seekg(0, std::ios::end);
+          theData.theSize = theData.theStream->tellg();
+          theData.theStream->clear();
+        }
+
+        theData.theStream->seekg(0, std::ios::beg);
+        theData.theStream->read(lHead, ArchiveSniffer::HEAD_SIZE);
+        lHeadLen = static_cast<size_t>(theData.theStream->gcount());
+        theData.theStream->clear();
+      }
+
+      // entry data is read anyway if the stream is read ahead, so
+      // there's nothing to skip. A seekable stream may be read by other
+      // iterators over the same item in between, i.e. it can't be handed
+      // to another thread. A non-seekable one can only be read once.
+      size_t lDepth = ReadAhead::getDepth();
+      if (lDepth && !theData.theSeekable)
+      {
+        theData.theReadAhead = new ReadAhead(*theData.theStream,
+            lDepth, ZORBA_ARCHIVE_READ_AHEAD_BUF);
+        if (!theData.theReadAhead->start())
+        {
+          delete theData.theReadAhead;
+          theData.theReadAhead = 0;
+        }
+      }
+
+      theDictionary = ArchiveFunction::openDictionaryReader(
+          theArchive, lHead, lHeadLen, 0, 0,
+          &theData, ArchiveItemSequence::readStream);
+      if (!theDictionary)
+      {
+        ArchiveFunction::setReaderSupport(theArchive, lHead, lHeadLen);
+
+        lErr = archive_read_open2(theArchive, &theData, NULL,
+            ArchiveItemSequence::readStream,
+            theData.theReadAhead ? NULL : ArchiveItemSequence::skipStream,
+            NULL);
+        ArchiveFunction::checkForError(lErr, 0, theArchive);
+      }
+    }
+    else
+    {
+      size_t lLen = 0;
+      char* lData = const_cast<char*>(
+          theArchiveItem.getBase64BinaryValue(lLen));
+
+      if (theArchiveItem.isEncoded())
+      {
+        base64::decode(lData, lLen, &theDecodedData);
+        lLen = theDecodedData.size();
+        lData = const_cast<char*>(theDecodedData.c_str());
+      }
+
+      theDictionary = ArchiveFunction::openReader(theArchive, lData, lLen);
+    }
+  }
+
+  void
+  ArchiveItemSequence::ArchiveIterator::close()
+  {
+    int lErr = archive_read_finish(theArchive);
+    theDictionary = 0;
+
+    // stop reading ahead before the stream goes away
+    delete theData.theReadAhead;
+    theData.theReadAhead = 0;
+
+    ArchiveFunction::checkForError(lErr, 0, theArchive);
+    theArchive = 0;
+  }
+
+
+  _ssize_t
+  ArchiveFunction::writeStream(
+      struct archive *,
+      void *func,
+      const void *buff,
+      size_t n)
+  {
+    ArchiveFunction::ArchiveCompressor* lFunc =
+      static_cast<ArchiveFunction::ArchiveCompressor*>(func);
+
+    const char * lBuf = static_cast<const char *>(buff);
+    lFunc->write(lBuf, n);
+  
+    return n;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    CreateFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    std::vector<ArchiveEntry> lEntries;
+
+    {
+      Iterator_t lEntriesIter = aArgs[0]->getIterator();
+
+      zorba::Item lEntry;
+      lEntriesIter->open();
+      while (lEntriesIter->next(lEntry))
+      {
+        lEntries.resize(lEntries.size() + 1);
+        lEntries.back().setValues(lEntry);
+      }
+      lEntriesIter->close();
+    }
+
+    ArchiveOptions lOptions;
+
+    if (aArgs.size() == 3)
+    {
+      zorba::Item lOptionsItem = getOneItem(aArgs, 2);
+      lOptions.setValues(lOptionsItem);
+    }
+    
+    ArchiveCompressor lArchive;
+      
+    zorba::Iterator_t lFileIter = aArgs[1]->getIterator();
+    lArchive.open(lOptions);
+    lArchive.compress(lEntries, lFileIter);
+    lArchive.close();
+
+    zorba::Item lRes = theModule->getItemFactory()->
+      createStreamableBase64Binary(
+        *lArchive.getResultStream(),
+        &(ArchiveFunction::ArchiveCompressor::releaseStream),
+        true, // seekable
+        false // not encoded
+        );
+    return ItemSequence_t(new SingletonItemSequence(lRes));
+  }
+
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+  EntriesFunction::evaluate(
+    const Arguments_t& aArgs,
+    const zorba::StaticContext* aSctx,
+    const zorba::DynamicContext* aDctx) const 
+  { 
+    Item lArchive = getOneItem(aArgs, 0);
+
+    ArchiveHandle* lHandle = ArchiveHandle::get(lArchive);
+    if (lHandle)
+    {
+      return ItemSequence_t(new VectorItemSequence(lHandle->getEntries()));
+    }
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+    if (!lOverlay)
+    {
+      return ItemSequence_t(new EntriesItemSequence(lArchive));
+    }
+
+    // answer from the overlay, i.e. the entries of the base archive
+    // that are kept followed by the added ones
+    std::auto_ptr<EntriesItemSequence> lSeq(
+        new EntriesItemSequence(lOverlay->getBase()));
+    lSeq->getExcludedNames() = lOverlay->getScript().theDeletes;
+
+    std::vector<size_t> lAdds;
+    lOverlay->getAdds(std::set<std::string>(), true, lAdds);
+
+    std::vector<zorba::Item> lEntries;
+    for (size_t i = 0; i < lAdds.size(); ++i)
+    {
+      const ArchiveEntry& lEntry = lOverlay->getScript().theAdds[lAdds[i]];
+      std::string lName = lEntry.getEntryPath().str();
+      long long lSize = 0;
+      if (lEntry.getEntryType() == ArchiveEntry::regular)
+      {
+        size_t lLen;
+        lOverlay->getScript().theContents[lAdds[i]].getBase64BinaryValue(lLen);
+        lSize = lLen;
+      }
+      else if (lName.empty() || lName[lName.size() - 1] != '/')
+      {
+        lName += '/';
+      }
+
+      time_t lTime = lEntry.getLastModified();
+
+      std::vector<std::pair<zorba::Item, zorba::Item> > lObjectArray;
+      lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+            ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+            theModule->getItemFactory()->createString(lName)));
+      lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+            ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
+            theModule->getItemFactory()->createInteger(lSize)));
+      lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+            ArchiveModule::getGlobalItems(ArchiveModule::LAST_MODIFIED),
+            ArchiveModule::createDateTimeItem(lTime)));
+      lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+            ArchiveModule::getGlobalItems(ArchiveModule::TYPE),
+            theModule->getItemFactory()->createString(
+              lEntry.getEntryType() == ArchiveEntry::regular
+              ? "regular" : "directory")));
+      lEntries.push_back(
+          theModule->getItemFactory()->createJSONObject(lObjectArray));
+    }
+
+    return ItemSequence_t(
+        new ConcatItemSequence(ItemSequence_t(lSeq.release()), lEntries));
+  }
+
+  EntriesFunction::EntriesItemSequence::EntriesIterator::EntriesIterator(
+      zorba::Item& aArchive)
+    : ArchiveIterator(aArchive)
+  {
+  }
+
+  bool
+  EntriesFunction::EntriesItemSequence::EntriesIterator::next(zorba::Item& aRes)
+  {
+    struct archive_entry *lEntry;
+    int lErr;
+
+    do
+    {
+      lErr = archive_read_next_header(theArchive, &lEntry);
+
+      if (lErr == ARCHIVE_EOF) return false;
+
+      if (lErr != ARCHIVE_OK)
+      {
+        ArchiveFunction::checkForError(lErr, 0, theArchive);
+      }
+    } while (isExcluded(archive_entry_pathname(lEntry)));
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lObjectArray;
+    std::pair<zorba::Item, zorba::Item> lElemPair;
+
+    // create text content (i.e. path name)
+    String lName = archive_entry_pathname(lEntry);
+    lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+                                                         theFactory->createString(lName));
+    lObjectArray.push_back(lElemPair);
+
+    // create size attr if the value is set in the archive
+    if (archive_entry_size_is_set(lEntry))
+    {
+      long long lSize = archive_entry_size(lEntry);
+      lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
+                                                           theFactory->createInteger(lSize));
+      lObjectArray.push_back(lElemPair);
+    }
+
+    // create last-modified attr if the value is set in the archive
+    if (archive_entry_mtime_is_set(lEntry))
+    {
+      time_t lTime = archive_entry_mtime(lEntry);
+      lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::LAST_MODIFIED),
+                                                           ArchiveModule::createDateTimeItem(lTime));
+      lObjectArray.push_back(lElemPair);
+    }
+
+    std::string lEntryType;
+    if(archive_entry_filetype(lEntry) == AE_IFDIR)
+    {
+      // this entry is a directory
+      lEntryType = "directory";
+    }
+    else if(archive_entry_filetype(lEntry) == AE_IFREG)
+    {
+      lEntryType = "regular";
+    }
+    else
+    {
+      // error! type not supported!
+      // for the time being don't do anything
+    }
+
+    lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::TYPE),
+                                                         theFactory->createString(lEntryType));
     lObjectArray.push_back(lElemPair);
 
-    // create size attr if the value is set in the archive
-    if (archive_entry_size_is_set(lEntry))
+    // skip to the next entry and raise an error if that fails
+    lErr = archive_read_data_skip(theArchive);
+    ArchiveFunction::checkForError(lErr, 0, theArchive);
+
+    aRes = theFactory->createJSONObject(lObjectArray);
+
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+
+ /*******************************************************************************
+ *  This function is meant to replace all the look for specific headers that are
+ *  or are not in a list (ArchiveEntrySet)
+ ******************************************************************************/
+  struct archive_entry*
+    ExtractFunction::ExtractItemSequence::ExtractIterator::lookForHeader(
+        bool aMatch,
+        ArchiveOptions* aOptions)
+  {
+    struct archive_entry *lEntry = 0;
+
+    while (true)
+    {
+      int lErr = archive_read_next_header(theArchive, &lEntry);
+      
+      if (lErr == ARCHIVE_EOF) return NULL;
+
+      if (lErr != ARCHIVE_OK)
+      {
+        ArchiveFunction::checkForError(lErr, 0, theArchive);
+      }
+      ++thePosition;
+
+      if (!theGuard.startEntry(archive_entry_pathname(lEntry)))
+      {
+        ArchiveFunction::checkGuard(theGuard);
+      }
+
+      if(aOptions)
+        aOptions->setValues(theArchive, theDictionary != 0);
+
+      if (isExcluded(archive_entry_pathname(lEntry))) continue;
+
+      if (theReturnAll) break;
+
+      String lName = archive_entry_pathname(lEntry);
+      if(aMatch) {
+        if (theEntryNames.find(lName.str()) != theEntryNames.end())
+        {
+          break;
+        }
+      } else {
+        if (theEntryNames.find(lName.str()) == theEntryNames.end())
+        {
+          break;
+        }
+      }
+    }
+
+    return lEntry;
+  }
+
+  void
+  ExtractFunction::ExtractItemSequence::ExtractIterator::readCachedEntry(
+      struct archive_entry* aEntry,
+      std::string& aResult)
+  {
+    if (!theCacheKey)
+    {
+      readEntry(aEntry, aResult);
+      return;
+    }
+
+    std::string lName = archive_entry_pathname(aEntry);
+    size_t lPosition = thePosition - 1;
+
+    if (findCached(lName, lPosition, aResult)) return;
+
+    readEntry(aEntry, aResult);
+    theCollected[lName].push_back(std::make_pair(lPosition, aResult));
+  }
+
+  bool
+  ExtractFunction::ExtractItemSequence::ExtractIterator::findCached(
+      const std::string& aName,
+      size_t aPosition,
+      std::string& aResult) const
+  {
+    CachedContents::const_iterator lCached = theCached->find(aName);
+    if (lCached == theCached->end()) return false;
+
+    for (ContentCache::Contents::const_iterator lIter
+           = lCached->second.begin();
+         lIter != lCached->second.end(); ++lIter)
+    {
+      if (lIter->first == aPosition)
+      {
+        aResult = lIter->second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool
+  ExtractFunction::ExtractItemSequence::ExtractIterator::nextEntry(
+      std::string& aResult)
+  {
+    if (!thePipelineChecked)
+    {
+      thePipelineChecked = true;
+      // a seekable stream may be read by other iterators over the same
+      // item in between, i.e. it can't be handed to another thread
+      size_t lDepth = EntryPipeline::getDepth();
+      if (lDepth && !(theData.theStream && theData.theSeekable))
+      {
+        thePipeline.reset(new EntryPipeline(
+            &ExtractIterator::produceEntry, this, lDepth));
+        if (!thePipeline->start()) thePipeline.reset();
+      }
+    }
+
+    if (!thePipeline.get())
+    {
+      struct archive_entry* lEntry = lookForHeader(true);
+
+      //NULL is EOF
+      if (!lEntry)
+      {
+        cacheContents();
+        return false;
+      }
+
+      readCachedEntry(lEntry, aResult);
+      return true;
+    }
+
+    EntryPipeline::Entry lEntry;
+    std::string lError;
+    switch (thePipeline->next(lEntry, lError))
+    {
+      case EntryPipeline::END:
+        cacheContents();
+        return false;
+      case EntryPipeline::FAILED:
+        // the producer has stopped, i.e. the guard can be read
+        checkGuard(theGuard);
+        throwError(ERROR_CORRUPTED_ARCHIVE, lError.c_str());
+      default:
+        break;
+    }
+
+    if (lEntry.theExclusive)
+    {
+      // the producer waits until the link target has been read
+      try
+      {
+        readLinkTarget(lEntry.theHardlink, aResult);
+      }
+      catch (...)
+      {
+        thePipeline->resume();
+        throw;
+      }
+      thePipeline->resume();
+    }
+    else
+    {
+      // the previous buffer is decoded into next
+      aResult.swap(lEntry.theData);
+      thePipeline->recycle(lEntry.theData);
+    }
+
+    if (theCacheKey && !lEntry.theCached)
+    {
+      theCollected[lEntry.theName].push_back(
+          std::make_pair(lEntry.thePosition, aResult));
+    }
+    return true;
+  }
+
+  EntryPipeline::Status
+  ExtractFunction::ExtractItemSequence::ExtractIterator::produceEntry(
+      void* aIterator,
+      EntryPipeline::Entry& aEntry,
+      std::string& aError)
+  {
+    return static_cast<ExtractIterator*>(aIterator)->decodeEntry(
+        aEntry, aError);
+  }
+
+  EntryPipeline::Status
+  ExtractFunction::ExtractItemSequence::ExtractIterator::decodeEntry(
+      EntryPipeline::Entry& aEntry,
+      std::string& aError)
+  {
+    // like lookForHeader but reports errors instead of throwing
+    struct archive_entry* lEntry = 0;
+    const char* lName;
+    while (true)
+    {
+      int lErr = archive_read_next_header(theArchive, &lEntry);
+
+      if (lErr == ARCHIVE_EOF) return EntryPipeline::END;
+
+      if (lErr != ARCHIVE_OK)
+      {
+        const char* lMsg = archive_error_string(theArchive);
+        aError = lMsg ? lMsg : "corrupted archive";
+        return EntryPipeline::FAILED;
+      }
+      ++thePosition;
+
+      lName = archive_entry_pathname(lEntry);
+      if (!theGuard.startEntry(lName))
+      {
+        return EntryPipeline::FAILED;
+      }
+      if (isExcluded(lName)) continue;
+
+      if (theReturnAll
+          || theEntryNames.find(lName) != theEntryNames.end())
+      {
+        break;
+      }
+    }
+
+    aEntry.theName = lName;
+    aEntry.thePosition = thePosition - 1;
+
+    if (theCacheKey && findCached(aEntry.theName, aEntry.thePosition,
+                                  aEntry.theData))
+    {
+      aEntry.theCached = true;
+      return EntryPipeline::READY;
+    }
+
+    const char* lHardlink = archive_entry_hardlink(lEntry);
+    if (lHardlink && archive_entry_size(lEntry) == 0)
+    {
+      // reading the target needs another pass over the input
+      aEntry.theHardlink = lHardlink;
+      aEntry.theExclusive = true;
+      return EntryPipeline::READY;
+    }
+
+    if (!ArchiveFunction::appendEntryData(
+            theArchive, lEntry, aEntry.theData, &theGuard))
+    {
+      const char* lMsg = archive_error_string(theArchive);
+      aError = lMsg ? lMsg : "corrupted archive";
+      return EntryPipeline::FAILED;
+    }
+    return EntryPipeline::READY;
+  }
+
+  void
+  ExtractFunction::ExtractItemSequence::ExtractIterator::cacheContents()
+  {
+    if (!theCacheKey || theReturnAll) return;
+
+    ContentCache& lCache = ContentCache::getInstance();
+    for (EntryNameSetIter lName = theEntryNames.begin();
+         lName != theEntryNames.end(); ++lName)
+    {
+      // names without entries are cached as well
+      if (theCached->find(*lName) == theCached->end())
+      {
+        lCache.put(*theCacheKey, *lName, theCollected[*lName]);
+      }
+    }
+    theCollected.clear();
+  }
+
+  bool
+  ExtractFunction::getExtractedContents(
+      zorba::Item& aArchive,
+      ExtractItemSequence& aSeq,
+      std::vector<std::string>& aContents)
+  {
+    ContentCache& lCache = ContentCache::getInstance();
+    bool lCaching = lCache.isEnabled();
+
+    ArchiveHandle* lHandle = ArchiveHandle::get(aArchive);
+    if (!lHandle && getSeekableContents(aArchive, aSeq, aContents))
+    {
+      return true;
+    }
+    if (!lHandle && !lCaching) return false;
+
+    std::string lKey;
+    if (lHandle)
+    {
+      if (lCaching) lKey = lHandle->getCacheKey();
+    }
+    else
+    {
+      // a non-seekable stream can't be read twice
+      if (aArchive.isStreamable() && !aArchive.isSeekable()) return false;
+
+      // a ZIP archive is identified by its central directory, i.e. a hit
+      // doesn't require reading the whole archive
+      std::string lFormat;
+      std::string lCompression;
+      zorba::String lBuffer;
+      const char* lData = 0;
+      size_t lSize = 0;
+      sniffArchive(aArchive, lFormat, lCompression, lBuffer, lData, lSize);
+      ZipDirectory lDirectory;
+      if (lFormat == "ZIP"
+          && getZipDirectory(aArchive, lDirectory, lBuffer, lData, lSize))
+      {
+        lKey = ContentCache::computeKey(lDirectory);
+      }
+      else
+      {
+        if (!lData)
+        {
+          getArchiveData(aArchive, lBuffer, lData, lSize);
+        }
+        lKey = lCache.computeKey(lData, lSize);
+      }
+
+      if (lBuffer.size())
+      {
+        aSeq.setArchive(ArchiveModule::getItemFactory()->createBase64Binary(
+            lData, lSize, false));
+      }
+    }
+
+    const ExtractItemSequence::EntryNameSet& lNames = aSeq.getNameSet();
+    ExtractItemSequence::CachedContents lCached;
+    ContentCache::Contents lAll;
+    bool lComplete = true;
+
+    for (ExtractItemSequence::EntryNameSetIter lName = lNames.begin();
+         lName != lNames.end(); ++lName)
+    {
+      ContentCache::Contents lContents;
+      if (lCaching && lCache.get(lKey, *lName, lContents))
+      {
+        lCached[*lName] = lContents;
+      }
+      else if (lHandle)
+      {
+        std::set<std::string> lName1;
+        lName1.insert(*lName);
+        std::vector<size_t> lPositions;
+        lHandle->getPositions(lName1, lPositions);
+        for (size_t i = 0; i < lPositions.size(); ++i)
+        {
+          lContents.push_back(std::make_pair(lPositions[i], std::string()));
+          lHandle->readEntry(lPositions[i], lContents.back().second);
+        }
+        if (lCaching) lCache.put(lKey, *lName, lContents);
+      }
+      else
+      {
+        lComplete = false;
+        continue;
+      }
+      lAll.insert(lAll.end(), lContents.begin(), lContents.end());
+    }
+
+    if (!lComplete)
+    {
+      aSeq.setCache(lKey, lCached);
+      return false;
+    }
+
+    // in archive order
+    std::sort(lAll.begin(), lAll.end());
+    for (size_t i = 0; i < lAll.size(); ++i)
+    {
+      aContents.push_back(lAll[i].second);
+    }
+    return true;
+  }
+
+  bool
+  ExtractFunction::getSeekableContents(
+      zorba::Item& aArchive,
+      ExtractItemSequence& aSeq,
+      std::vector<std::string>& aContents)
+  {
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    if (!isSeekableZstd(aArchive)) return false;
+
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    getArchiveData(aArchive, lBuffer, lData, lSize);
+
+    if (lBuffer.size())
+    {
+      // the stream has been consumed
+      aSeq.setArchive(ArchiveModule::getItemFactory()->createBase64Binary(
+          lData, lSize, false));
+    }
+
+    ZstdSeekableReader lReader;
+    if (!lReader.open(lData, lSize)) return false;
+
+    // anything unexpected is left to libarchive (e.g. for the error)
+    std::vector<ZstdSeekableTar::Entry> lEntries;
+    ZstdSeekableTar lTar(lReader);
+    if (!lTar.find(aSeq.getNameSet(), lEntries)) return false;
+
+    ResourceGuard lGuard;
+    std::vector<std::string> lContents(lEntries.size());
+    for (size_t i = 0; i < lEntries.size(); ++i)
+    {
+      const ZstdSeekableTar::Entry& lEntry = lEntries[i];
+      if (!lGuard.startEntry(lEntry.theName.c_str())
+          || !lGuard.addData(lEntry.theSize, lReader.getDecompressed()))
+      {
+        checkGuard(lGuard);
+      }
+      if (!lReader.read(lEntry.theOffset, lEntry.theSize, lContents[i]))
+      {
+        return false;
+      }
+    }
+    aContents.swap(lContents);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool
+  ExtractFunction::isSeekableZstd(zorba::Item& aArchive)
+  {
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    // a zstd frame (or dictionary) in front and the seek table footer
+    // at the end, both in the smallest buffer ZstdSeekableReader accepts
+    const size_t lTailSize = 17;
+    std::string lHead;
+    std::string lTail;
+
+    if (aArchive.isStreamable())
+    {
+      // a non-seekable stream can only be read once, i.e. by libarchive
+      if (!aArchive.isSeekable()) return false;
+
+      std::istream& lStream = aArchive.getStream();
+      char lBuf[lTailSize + 7];
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+      if (aArchive.isEncoded())
+      {
+        // the tail of an encoded stream can't be located reliably
+        zorba::String lDecoded;
+        lStream.read(lBuf, 8);
+        base64::decode(lBuf, static_cast<size_t>(lStream.gcount()), &lDecoded);
+        lHead = lDecoded.str();
+      }
+      else
+      {
+        lStream.read(lBuf, 4);
+        lHead.assign(lBuf, static_cast<size_t>(lStream.gcount()));
+        lStream.clear();
+        lStream.seekg(-static_cast<std::streamoff>(lTailSize), std::ios::end);
+        lStream.read(lBuf, lTailSize);
+        lTail.assign(lBuf, static_cast<size_t>(lStream.gcount()));
+      }
+      lStream.clear();
+      lStream.seekg(0, std::ios::beg);
+    }
+    else
+    {
+      size_t lLen = 0;
+      const char* lData = aArchive.getBase64BinaryValue(lLen);
+      if (aArchive.isEncoded())
+      {
+        zorba::String lDecoded;
+        base64::decode(lData, lLen < 8 ? lLen : 8, &lDecoded);
+        lHead = lDecoded.str();
+        // 28 characters give at least 17 bytes, whatever the padding
+        if (lLen >= 28 && lLen % 4 == 0)
+        {
+          lDecoded = "";
+          base64::decode(lData + lLen - 28, 28, &lDecoded);
+          lTail = lDecoded.str();
+        }
+      }
+      else
+      {
+        lHead.assign(lData, lLen < 4 ? lLen : 4);
+        if (lLen >= lTailSize)
+        {
+          lTail.assign(lData + lLen - lTailSize, lTailSize);
+        }
+      }
+    }
+
+    std::string lFormat;
+    std::string lCompression;
+    ArchiveSniffer::sniff(lHead.data(), lHead.size(), lFormat, lCompression);
+    if (lCompression != "ZSTD") return false;
+
+    // without the tail (encoded stream), the seek table is looked up later
+    return lTail.empty()
+        || ZstdSeekableReader::isSeekable(lTail.data(), lTail.size());
+#else
+    return false;
+#endif
+  }
+
+  void
+  ExtractFunction::ExtractItemSequence::ExtractIterator::readData(
+      struct archive_entry* aEntry,
+      std::string& aResult)
+  {
+    if (!ArchiveFunction::appendEntryData(theArchive, aEntry, aResult, &theGuard))
+    {
+      checkGuard(theGuard);
+      throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+    }
+  }
+
+  void
+  ExtractFunction::ExtractItemSequence::ExtractIterator::readEntry(
+      struct archive_entry* aEntry,
+      std::string& aResult)
+  {
+    const char* lHardlink = archive_entry_hardlink(aEntry);
+    if (lHardlink && archive_entry_size(aEntry) == 0)
+    {
+      readLinkTarget(lHardlink, aResult);
+    }
+    else
+    {
+      readData(aEntry, aResult);
+    }
+  }
+
+  // reads a single entry out of an archive (used to resolve hardlinks)
+  class LinkTargetIterator
+    : public ExtractFunction::ExtractItemSequence::ExtractIterator
+  {
+    public:
+      LinkTargetIterator(
+          zorba::Item& aArchive,
+          ExtractFunction::ExtractItemSequence::EntryNameSet& aEntryNames)
+        : ExtractIterator(aArchive, aEntryNames, false) {}
+
+      bool
+      next(zorba::Item&) { return false; }
+
+      bool
+      read(std::string& aResult)
+      {
+        struct archive_entry* lEntry = lookForHeader(true);
+        if (!lEntry) return false;
+        readEntry(lEntry, aResult);
+        return true;
+      }
+  };
+
+  void
+  ExtractFunction::ExtractItemSequence::ExtractIterator::readLinkTarget(
+      const std::string& aTarget,
+      std::string& aResult)
+  {
+    if (theArchiveItem.isStreamable() && !theArchiveItem.isSeekable())
+    {
+      std::ostringstream lMsg;
+      lMsg << aTarget
+        << ": hardlink target can't be read from a non-seekable stream";
+      throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+    }
+
+    // the target precedes the link, i.e. another pass is needed
+    EntryNameSet lNames;
+    lNames.insert(aTarget);
+    LinkTargetIterator lIter(theArchiveItem, lNames);
+    lIter.open();
+    bool lFound = lIter.read(aResult);
+    lIter.close();
+
+    if (!lFound)
+    {
+      std::ostringstream lMsg;
+      lMsg << aTarget << ": hardlink target not found";
+      throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+    }
+  }
+
+  zorba::ItemSequence_t
+  ExtractTextFunction::evaluate(
+    const Arguments_t& aArgs,
+    const zorba::StaticContext* aSctx,
+    const zorba::DynamicContext* aDctx) const 
+  { 
+    Item lArchive = getOneItem(aArgs, 0);
+
+    zorba::String lEncoding("UTF-8");
+    if (aArgs.size() == 3)
+    {
+      zorba::Item lItem = getOneItem(aArgs, 2);
+      lEncoding = lItem.getStringValue();
+      if (!transcode::is_supported(lEncoding.c_str()))
+      {
+        std::ostringstream lMsg;
+        lMsg << lEncoding << ": unsupported encoding";
+          
+        throwError(ERROR_INVALID_ENCODING, lMsg.str().c_str());
+      }
+    }
+    
+    // return all entries if no second arg is given
+    bool lReturnAll = aArgs.size() == 1;
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+
+    std::auto_ptr<ExtractItemSequence> lSeq(
+        new ExtractTextItemSequence(
+          lOverlay ? lOverlay->getBase() : lArchive, lReturnAll, lEncoding));
+
+    // get the names of all entries that should be retruned
+    if (aArgs.size() > 1)
+    {
+      ExtractFunction::ExtractItemSequence::EntryNameSet& lSet
+        = lSeq->getNameSet();
+
+      zorba::Item lItem;
+      Iterator_t lIter = aArgs[1]->getIterator();
+      lIter->open();
+      while (lIter->next(lItem))
+      {
+        lSet.insert(lItem.getStringValue().str());
+      }
+
+      lIter->close();
+    }
+
+    std::vector<std::string> lContents;
+    if (!lReturnAll && !lOverlay && getExtractedContents(lArchive, *lSeq, lContents))
+    {
+      std::vector<zorba::Item> lTexts;
+      for (size_t i = 0; i < lContents.size(); ++i)
+      {
+        lTexts.push_back(createText(lContents[i], lEncoding));
+      }
+      return ItemSequence_t(new VectorItemSequence(lTexts));
+    }
+
+    if (lOverlay)
+    {
+      // answer from the overlay without materializing it
+      lSeq->getExcludedNames() = lOverlay->getScript().theDeletes;
+
+      std::vector<size_t> lAdds;
+      lOverlay->getAdds(lSeq->getNameSet(), lReturnAll, lAdds);
+
+      std::vector<zorba::Item> lTexts;
+      for (size_t i = 0; i < lAdds.size(); ++i)
+      {
+        size_t lLen;
+        const char* lData = lOverlay->getScript().theContents[lAdds[i]]
+          .getBase64BinaryValue(lLen);
+        lTexts.push_back(createText(std::string(lData, lLen), lEncoding));
+      }
+      return ItemSequence_t(
+          new ConcatItemSequence(ItemSequence_t(lSeq.release()), lTexts));
+    }
+
+    return ItemSequence_t(lSeq.release());
+  }
+
+  bool
+  ExtractTextFunction::ExtractTextItemSequence::ExtractTextIterator::next(
+      zorba::Item& aRes)
+  {
+    theBuffer.clear();
+    if (!nextEntry(theBuffer)) return false;
+
+    aRes = createText(theBuffer, theEncoding);
+
+    return true;
+  }
+
+  zorba::Item
+  ExtractTextFunction::createText(
+      const std::string& aContent,
+      const zorba::String& aEncoding)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+    if (!transcode::is_necessary(aEncoding.c_str()))
+    {
+      if (!TextCodec::isValidUtf8(aContent.data(), aContent.size()))
+      {
+        // the documented error for entries with invalid characters
+        zorba::Item lQName = lFactory->createQName(
+            "http://www.w3.org/2005/xqt-errors", "FOCH0001");
+        throw USER_EXCEPTION(lQName, "invalid UTF-8 content");
+      }
+      return lFactory->createString(aContent);
+    }
+
+    TextCodec::Charset lCharset = TextCodec::getCharset(aEncoding.c_str());
+    std::string lDecoded;
+    if (TextCodec::decode(lCharset, aContent.data(), aContent.size(), lDecoded))
+    {
+      return lFactory->createString(lDecoded);
+    }
+    else
+    {
+      zorba::String lTranscodedString;
+      transcode::stream<std::istringstream> lTranscoder(
+          aEncoding.c_str(),
+          aContent.c_str()
+        );
+      char buf[1024];
+      while (lTranscoder.good())
+      {
+        lTranscoder.read(buf, 1024);
+        lTranscodedString.append(buf, lTranscoder.gcount());
+      }
+      return lFactory->createString(lTranscodedString);
+    }
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    ExtractBinaryFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    // return all entries if no second arg is given
+    bool lReturnAll = aArgs.size() == 1;
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+
+    std::auto_ptr<ExtractItemSequence> lSeq(
+        new ExtractBinaryItemSequence(
+          lOverlay ? lOverlay->getBase() : lArchive, lReturnAll));
+
+    // get the names of all entries that should be retruned
+    if (aArgs.size() > 1)
+    {
+      ExtractFunction::ExtractItemSequence::EntryNameSet& lSet
+        = lSeq->getNameSet();
+
+      zorba::Item lItem;
+      Iterator_t lIter = aArgs[1]->getIterator();
+      lIter->open();
+      while (lIter->next(lItem))
+      {
+        lSet.insert(lItem.getStringValue().str());
+      }
+
+      lIter->close();
+    }
+
+    std::vector<zorba::Item> lViews;
+    if (!lReturnAll && !lOverlay
+        && getStoredViews(lArchive, lSeq->getNameSet(), lViews))
+    {
+      return ItemSequence_t(new VectorItemSequence(lViews));
+    }
+
+    std::vector<std::string> lContents;
+    if (!lReturnAll && !lOverlay && getExtractedContents(lArchive, *lSeq, lContents))
+    {
+      std::vector<zorba::Item> lBinaries;
+      for (size_t i = 0; i < lContents.size(); ++i)
+      {
+        lBinaries.push_back(theModule->getItemFactory()->createBase64Binary(
+            lContents[i].data(), lContents[i].size(), false));
+      }
+      return ItemSequence_t(new VectorItemSequence(lBinaries));
+    }
+
+    if (lOverlay)
+    {
+      // answer from the overlay without materializing it
+      lSeq->getExcludedNames() = lOverlay->getScript().theDeletes;
+
+      std::vector<size_t> lAdds;
+      lOverlay->getAdds(lSeq->getNameSet(), lReturnAll, lAdds);
+
+      std::vector<zorba::Item> lContents;
+      for (size_t i = 0; i < lAdds.size(); ++i)
+      {
+        lContents.push_back(lOverlay->getScript().theContents[lAdds[i]]);
+      }
+      return ItemSequence_t(
+          new ConcatItemSequence(ItemSequence_t(lSeq.release()), lContents));
+    }
+
+    return ItemSequence_t(lSeq.release());
+  }
+
+  bool
+  ExtractBinaryFunction::getStoredViews(
+      zorba::Item& aArchive,
+      const ExtractItemSequence::EntryNameSet& aNames,
+      std::vector<zorba::Item>& aViews)
+  {
+    zorba::Item lOwner;
+    const char* lData = 0;
+    size_t lSize = 0;
+    ZipDirectory lParsed;
+    const ZipDirectory* lDirectory = 0;
+
+    ArchiveHandle* lHandle = ArchiveHandle::get(aArchive);
+    if (lHandle)
+    {
+      if (lHandle->isClosed()) return false;
+      lOwner = lHandle->getArchive();
+      lHandle->getData(lData, lSize);
+      lDirectory = lHandle->getDirectory();
+    }
+    else if (!aArchive.isStreamable() && !aArchive.isEncoded())
+    {
+      lOwner = aArchive;
+      lData = aArchive.getBase64BinaryValue(lSize);
+      if (parseZip(lParsed, lData, lSize))
+      {
+        lDirectory = &lParsed;
+      }
+    }
+    if (!lDirectory) return false;
+
+    // in archive order
+    std::vector<size_t> lIndexes;
+    for (ExtractItemSequence::EntryNameSet::const_iterator lName
+           = aNames.begin();
+         lName != aNames.end(); ++lName)
+    {
+      long lIndex = lDirectory->find(*lName);
+      if (lIndex >= 0) lIndexes.push_back(lIndex);
+    }
+    std::sort(lIndexes.begin(), lIndexes.end());
+
+    ResourceGuard lGuard;
+    std::vector<zorba::Item> lViews;
+    for (size_t i = 0; i < lIndexes.size(); ++i)
+    {
+      const ZipDirectory::Entry& lEntry = lDirectory->getEntry(lIndexes[i]);
+      const char* lEntryData;
+      std::string lLocalExtra;
+      if (lEntry.isDirectory()
+          || lEntry.theMethod != ZORBA_ZIP_METHOD_STORE
+          || (lEntry.theFlags & 1) // encrypted
+          || lEntry.theCompressedSize != lEntry.theUncompressedSize
+          || !lDirectory->getEntryData(lEntry, lEntryData, lLocalExtra))
+      {
+        return false;
+      }
+      if (!lGuard.startEntry(lEntry.theName.c_str())
+          || !lGuard.addData(lEntry.theUncompressedSize, 0))
+      {
+        checkGuard(lGuard);
+      }
+
+      // reading the data is still cheaper than copying it; a mismatch is
+      // reported by libarchive
+      CRC32 lCRC32;
+      lCRC32.update(lEntryData, static_cast<size_t>(lEntry.theCompressedSize));
+      if (lCRC32.get() != lEntry.theCRC32)
+      {
+        return false;
+      }
+      lViews.push_back(ArchiveView::createItem(lOwner, lEntryData,
+            static_cast<size_t>(lEntry.theUncompressedSize)));
+    }
+    aViews.swap(lViews);
+    return true;
+  }
+
+  bool
+  ExtractBinaryFunction::ExtractBinaryItemSequence::ExtractBinaryIterator::next(
+      zorba::Item& aRes)
+  {
+    theBuffer.clear();
+    if (!nextEntry(theBuffer)) return false;
+
+    aRes = theFactory->createBase64Binary(
+        theBuffer.data(), theBuffer.size(), false);
+
+    return true;
+  }
+
+
+/*******************************************************************************
+ ******************************************************************************/
+  ArchiveEntryBuffer::int_type
+  ArchiveEntryBuffer::underflow()
+  {
+    static const char lZeros[ZORBA_ARCHIVE_MAX_READ_BUF] = { 0 };
+
+    while (true)
+    {
+      if (theHole)
+      {
+        size_t lLen = static_cast<size_t>(
+            std::min<uint64_t>(theHole, ZORBA_ARCHIVE_MAX_READ_BUF));
+        char* lBegin = const_cast<char*>(lZeros);
+        setg(lBegin, lBegin, lBegin + lLen);
+        theHole -= lLen;
+        return traits_type::to_int_type(*gptr());
+      }
+
+      if (theBlock)
+      {
+        char* lBegin = const_cast<char*>(theBlock);
+        setg(lBegin, lBegin, lBegin + theBlockSize);
+        theBlock = 0;
+        return traits_type::to_int_type(*gptr());
+      }
+
+      if (theFailed) return traits_type::eof();
+
+      const void* lBlock;
+      size_t lBlockSize;
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+      int64_t lBlockOffset;
+#else
+      off_t lBlockOffset;
+#endif
+      int lErr = archive_read_data_block(
+          theArchive, &lBlock, &lBlockSize, &lBlockOffset);
+      if (lErr == ARCHIVE_EOF) return traits_type::eof();
+      if (lErr != ARCHIVE_OK)
+      {
+        theFailed = true;
+        return traits_type::eof();
+      }
+      if (lBlockSize == 0) continue;
+
+      if (theGuard)
+      {
+        uint64_t lHole = uint64_t(lBlockOffset) > theOffset
+          ? uint64_t(lBlockOffset) - theOffset : 0;
+        if (!theGuard->addData(lHole + lBlockSize,
+                               archive_position_compressed(theArchive)))
+        {
+          theFailed = true;
+          return traits_type::eof();
+        }
+      }
+
+      if (uint64_t(lBlockOffset) > theOffset)
+      {
+        theHole = uint64_t(lBlockOffset) - theOffset;
+      }
+      theBlock = static_cast<const char*>(lBlock);
+      theBlockSize = lBlockSize;
+      theOffset = uint64_t(lBlockOffset) + lBlockSize;
+    }
+  }
+
+  bool
+  ArchiveEntryBuffer::nextBlock(const char*& aData, size_t& aLen)
+  {
+    if (gptr() == egptr()
+        && traits_type::eq_int_type(underflow(), traits_type::eof()))
+    {
+      return false;
+    }
+    aData = gptr();
+    aLen = egptr() - gptr();
+    setg(eback(), egptr(), egptr());
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    ExtractParsedFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    // return all entries if no second arg is given
+    bool lReturnAll = aArgs.size() == 1;
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+
+    std::auto_ptr<ExtractItemSequence> lSeq(
+        new ExtractParsedItemSequence(
+          lOverlay ? lOverlay->getBase() : lArchive, lReturnAll, theKind));
+
+    if (aArgs.size() > 1)
+    {
+      ExtractFunction::ExtractItemSequence::EntryNameSet& lSet
+        = lSeq->getNameSet();
+
+      zorba::Item lItem;
+      Iterator_t lIter = aArgs[1]->getIterator();
+      lIter->open();
+      while (lIter->next(lItem))
+      {
+        lSet.insert(lItem.getStringValue().str());
+      }
+
+      lIter->close();
+    }
+
+    // handles and cached contents are parsed from memory
+    std::vector<std::string> lContents;
+    if (!lReturnAll && !lOverlay && getExtractedContents(lArchive, *lSeq, lContents))
+    {
+      std::vector<zorba::Item> lItems;
+      for (size_t i = 0; i < lContents.size(); ++i)
+      {
+        std::istringstream lStream(lContents[i]);
+        parse(theKind, lStream, lItems);
+      }
+      return ItemSequence_t(new VectorItemSequence(lItems));
+    }
+
+    if (lOverlay)
+    {
+      lSeq->getExcludedNames() = lOverlay->getScript().theDeletes;
+
+      std::vector<size_t> lAdds;
+      lOverlay->getAdds(lSeq->getNameSet(), lReturnAll, lAdds);
+
+      std::vector<zorba::Item> lItems;
+      for (size_t i = 0; i < lAdds.size(); ++i)
+      {
+        size_t lLen;
+        const char* lData = lOverlay->getScript().theContents[lAdds[i]]
+          .getBase64BinaryValue(lLen);
+        std::istringstream lStream(std::string(lData, lLen));
+        parse(theKind, lStream, lItems);
+      }
+      return ItemSequence_t(
+          new ConcatItemSequence(ItemSequence_t(lSeq.release()), lItems));
+    }
+
+    return ItemSequence_t(lSeq.release());
+  }
+
+  bool
+  ExtractParsedFunction::ExtractParsedItemSequence::ExtractParsedIterator::next(
+      zorba::Item& aRes)
+  {
+    while (thePendingPos == thePending.size())
+    {
+      thePending.clear();
+      thePendingPos = 0;
+
+      struct archive_entry* lEntry = lookForHeader(true);
+
+      //NULL is EOF
+      if (!lEntry) return false;
+
+      const char* lHardlink = archive_entry_hardlink(lEntry);
+      if (lHardlink && archive_entry_size(lEntry) == 0)
+      {
+        std::string lContent;
+        readLinkTarget(lHardlink, lContent);
+        std::istringstream lStream(lContent);
+        parse(theKind, lStream, thePending);
+        continue;
+      }
+
+      ArchiveEntryBuffer lBuffer(theArchive, &theGuard);
+      std::istream lStream(&lBuffer);
+      try
+      {
+        parse(theKind, lStream, thePending);
+      }
+      catch (...)
+      {
+        // the parser fails on truncated data
+        if (lBuffer.failed())
+        {
+          checkGuard(theGuard);
+          throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+        }
+        throw;
+      }
+      if (lBuffer.failed())
+      {
+        checkGuard(theGuard);
+        throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+      }
+    }
+
+    aRes = thePending[thePendingPos++];
+    return true;
+  }
+
+  void
+  ExtractParsedFunction::parse(
+      Kind aKind,
+      std::istream& aStream,
+      std::vector<zorba::Item>& aItems)
+  {
+    XmlDataManager_t lDataManager
+      = Zorba::getInstance(0)->getXmlDataManager();
+
+    if (aKind == XML)
+    {
+      aItems.push_back(lDataManager->parseXML(aStream));
+      return;
+    }
+
+    // the items are taken while the stream is alive
+    ItemSequence_t lSeq = lDataManager->parseJSON(aStream);
+    Iterator_t lIter = lSeq->getIterator();
+    zorba::Item lItem;
+    lIter->open();
+    while (lIter->next(lItem))
+    {
+      aItems.push_back(lItem);
+    }
+    lIter->close();
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    ExtractLinesFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+    std::string lName = getOneItem(aArgs, 1).getStringValue().str();
+
+    zorba::String lEncoding("UTF-8");
+    if (aArgs.size() == 3)
+    {
+      lEncoding = getOneItem(aArgs, 2).getStringValue();
+      if (!transcode::is_supported(lEncoding.c_str()))
+      {
+        std::ostringstream lMsg;
+        lMsg << lEncoding << ": unsupported encoding";
+
+        throwError(ERROR_INVALID_ENCODING, lMsg.str().c_str());
+      }
+    }
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+
+    std::auto_ptr<ExtractLinesItemSequence> lSeq(
+        new ExtractLinesItemSequence(
+          lOverlay ? lOverlay->getBase() : lArchive, lEncoding));
+    lSeq->getNameSet().insert(lName);
+
+    if (lOverlay)
+    {
+      // an entry replaced by a:update is both deleted and added
+      const TransformFunction::EditScript& lScript = lOverlay->getScript();
+      std::vector<size_t> lAdds;
+      lOverlay->getAdds(lSeq->getNameSet(), false, lAdds);
+      if (!lAdds.empty())
+      {
+        size_t lLen;
+        const char* lData = lScript.theContents[lAdds[0]]
+          .getBase64BinaryValue(lLen);
+        lSeq->setContent(std::string(lData, lLen));
+      }
+      else if (lScript.isDeleted(lName))
+      {
+        return ItemSequence_t(new EmptySequence());
+      }
+    }
+
+    return ItemSequence_t(lSeq.release());
+  }
+
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::ExtractLinesIterator(
+      zorba::Item& aArchive,
+      ExtractItemSequence::EntryNameSet& aEntryNames,
+      const zorba::String& aEncoding,
+      const std::string* aContent)
+    : ExtractIterator(aArchive, aEntryNames, false),
+      theEncoding(aEncoding),
+      theContent(aContent),
+      theMemory(false),
+      theEnd(true),
+      theUnitSize(1),
+      theBigEndian(false),
+      theBlock(0),
+      theBlockEnd(0),
+      thePending(0),
+      thePendingLen(0),
+      theHasCarry(false),
+      theSkipLF(false)
+  {
+    TextCodec::Charset lCharset = TextCodec::getCharset(aEncoding.c_str());
+    if (lCharset == TextCodec::UTF_16LE || lCharset == TextCodec::UTF_16BE)
+    {
+      theUnitSize = 2;
+      theBigEndian = lCharset == TextCodec::UTF_16BE;
+    }
+  }
+
+  void
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::open()
+  {
+    theBlock = theBlockEnd = 0;
+    thePending = 0;
+    thePendingLen = 0;
+    theHasCarry = false;
+    theSkipLF = false;
+    theBuffer.reset();
+    theEnd = false;
+
+    if (theContent)
+    {
+      theMemory = true;
+      thePending = theContent->data();
+      thePendingLen = theContent->size();
+      return;
+    }
+
+    ExtractIterator::open();
+
+    struct archive_entry* lEntry = lookForHeader(true);
+    if (!lEntry)
+    {
+      theEnd = true;
+      return;
+    }
+
+    const char* lHardlink = archive_entry_hardlink(lEntry);
+    if (lHardlink && archive_entry_size(lEntry) == 0)
+    {
+      theLinkContent.clear();
+      readLinkTarget(lHardlink, theLinkContent);
+      theMemory = true;
+      thePending = theLinkContent.data();
+      thePendingLen = theLinkContent.size();
+    }
+    else
+    {
+      theMemory = false;
+      theBuffer.reset(new ArchiveEntryBuffer(theArchive, &theGuard));
+    }
+  }
+
+  void
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::close()
+  {
+    theBuffer.reset();
+    if (isOpen()) ExtractIterator::close();
+  }
+
+  bool
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::next(
+      zorba::Item& aRes)
+  {
+    std::string lLine;
+    if (!readLine(lLine)) return false;
+
+    aRes = ExtractTextFunction::createText(lLine, theEncoding);
+    return true;
+  }
+
+  bool
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::nextBlock()
+  {
+    while (true)
+    {
+      if (thePendingLen == 0)
+      {
+        if (theMemory || !theBuffer->nextBlock(thePending, thePendingLen))
+        {
+          if (theBuffer.get() && theBuffer->failed())
+          {
+            checkGuard(theGuard);
+            throwError(
+                ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+          }
+          return false;
+        }
+        continue;
+      }
+
+      if (theUnitSize == 1)
+      {
+        theBlock = thePending;
+        theBlockEnd = thePending + thePendingLen;
+        thePendingLen = 0;
+        return true;
+      }
+
+      if (theHasCarry)
+      {
+        theUnit[1] = *thePending;
+        ++thePending;
+        --thePendingLen;
+        theHasCarry = false;
+        theBlock = theUnit;
+        theBlockEnd = theUnit + 2;
+        return true;
+      }
+
+      size_t lEven = thePendingLen & ~size_t(1);
+      if (lEven == 0)
+      {
+        theUnit[0] = *thePending;
+        theHasCarry = true;
+        thePendingLen = 0;
+        continue;
+      }
+
+      theBlock = thePending;
+      theBlockEnd = thePending + lEven;
+      thePending += lEven;
+      thePendingLen -= lEven;
+      return true;
+    }
+  }
+
+  bool
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::isUnit(
+      const char* aPos,
+      char aChar) const
+  {
+    if (theUnitSize == 1) return *aPos == aChar;
+
+    return theBigEndian
+      ? aPos[0] == 0 && aPos[1] == aChar
+      : aPos[0] == aChar && aPos[1] == 0;
+  }
+
+  const char*
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::findSeparator(
+      const char* aBegin,
+      const char* aEnd) const
+  {
+    if (theUnitSize == 1)
+    {
+      // a CR can only end the line if it precedes the next LF
+      const char* lLF = static_cast<const char*>(
+          memchr(aBegin, '\n', aEnd - aBegin));
+      const char* lCR = static_cast<const char*>(
+          memchr(aBegin, '\r', (lLF ? lLF : aEnd) - aBegin));
+      return lCR ? lCR : lLF;
+    }
+
+    for (const char* p = aBegin; p < aEnd; p += 2)
+    {
+      if (isUnit(p, '\n') || isUnit(p, '\r')) return p;
+    }
+    return 0;
+  }
+
+  bool
+  ExtractLinesFunction::ExtractLinesItemSequence::ExtractLinesIterator::readLine(
+      std::string& aLine)
+  {
+    if (theEnd) return false;
+
+    while (true)
+    {
+      if (theBlock == theBlockEnd && !nextBlock())
+      {
+        theEnd = true;
+        // a byte left of an incomplete code unit
+        if (theHasCarry) aLine += theUnit[0];
+        return !aLine.empty();
+      }
+
+      if (theSkipLF)
+      {
+        theSkipLF = false;
+        if (isUnit(theBlock, '\n')) theBlock += theUnitSize;
+        continue;
+      }
+
+      const char* lSep = findSeparator(theBlock, theBlockEnd);
+      if (!lSep)
+      {
+        aLine.append(theBlock, theBlockEnd - theBlock);
+        theBlock = theBlockEnd;
+        continue;
+      }
+
+      aLine.append(theBlock, lSep - theBlock);
+      theBlock = lSep + theUnitSize;
+      if (isUnit(lSep, '\r'))
+      {
+        if (theBlock == theBlockEnd)
+          theSkipLF = true;
+        else if (isUnit(theBlock, '\n'))
+          theBlock += theUnitSize;
+      }
+      return true;
+    }
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    ExtractRangeFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+    std::string lName = getOneItem(aArgs, 1).getStringValue().str();
+    uint64_t lOffset = getOneItem(aArgs, 2).getLongValue();
+    uint64_t lLength = getOneItem(aArgs, 3).getLongValue();
+
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+    if (lOverlay)
+    {
+      // only entries added by the overlay require it to be materialized,
+      // an entry replaced by a:update is both deleted and added
+      std::set<std::string> lNames;
+      lNames.insert(lName);
+      std::vector<size_t> lAdds;
+      lOverlay->getAdds(lNames, false, lAdds);
+      if (lAdds.empty())
+      {
+        if (lOverlay->getScript().isDeleted(lName))
+        {
+          return ItemSequence_t(new EmptySequence());
+        }
+        lArchive = lOverlay->getBase();
+      }
+    }
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    // stored ZIP entries are sliced out of the archive
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      long lIndex = lDirectory.find(lName);
+      if (lIndex < 0)
+      {
+        return ItemSequence_t(new EmptySequence());
+      }
+
+      const ZipDirectory::Entry& lEntry = lDirectory.getEntry(lIndex);
+      if (lEntry.theMethod == ZORBA_ZIP_METHOD_STORE
+          && !(lEntry.theFlags & 0x1) // not encrypted
+          && lEntry.theCompressedSize == lEntry.theUncompressedSize)
+      {
+        std::string lEntryBuffer;
+        loadZipEntries(lArchive, lDirectory,
+                       std::vector<size_t>(1, lIndex), lEntryBuffer);
+
+        const char* lEntryData;
+        std::string lLocalExtra;
+        if (lDirectory.getEntryData(lEntry, lEntryData, lLocalExtra))
+        {
+          std::string lResult;
+          appendRange(lEntryData, lEntry.theCompressedSize, 0,
+                      lOffset, lLength, lResult);
+          return ItemSequence_t(new SingletonItemSequence(
+              theModule->getItemFactory()->createBase64Binary(
+                  lResult.data(), lResult.size(), false)));
+        }
+      }
+    }
+
+    if (lBuffer.size())
+    {
+      lArchive = theModule->getItemFactory()->createBase64Binary(
+          lData, lSize, false);
+    }
+    return ItemSequence_t(
+        new ExtractRangeItemSequence(lArchive, lName, lOffset, lLength));
+  }
+
+  void
+  ExtractRangeFunction::appendRange(
+      const char* aBlock,
+      size_t aBlockSize,
+      uint64_t aBlockOffset,
+      uint64_t aOffset,
+      uint64_t aLength,
+      std::string& aResult)
+  {
+    uint64_t lBlockEnd = aBlockOffset + aBlockSize;
+    uint64_t lEnd = aOffset + aLength;
+
+    uint64_t lFrom = std::max(aBlockOffset, aOffset);
+    uint64_t lTo = std::min(lBlockEnd, lEnd);
+    if (lFrom < lTo)
+    {
+      aResult.append(aBlock + (lFrom - aBlockOffset), lTo - lFrom);
+    }
+  }
+
+  bool
+  ExtractRangeFunction::ExtractRangeItemSequence::ExtractRangeIterator::next(
+      zorba::Item& aRes)
+  {
+    if (theExhausted) return false;
+
+    theExhausted = true;
+
+    struct archive_entry *lEntry = lookForHeader(true);
+
+    //NULL is EOF
+    if (!lEntry)
+      return false;
+
+    std::string lResult;
+
+    if (archive_entry_hardlink(lEntry) && archive_entry_size(lEntry) == 0)
+    {
+      std::string lData;
+      readEntry(lEntry, lData);
+      appendRange(lData.data(), lData.size(), 0, theOffset, theLength, lResult);
+    }
+    else
+    {
+      // blocks before the range are skipped without being copied; the
+      // rest of the entry isn't decompressed at all
+      const void* lBlock;
+      size_t lBlockSize;
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+      int64_t lBlockOffset;
+#else
+      off_t lBlockOffset;
+#endif
+      while (lResult.size() < theLength)
+      {
+        int lErr = archive_read_data_block(
+            theArchive, &lBlock, &lBlockSize, &lBlockOffset);
+        if (lErr == ARCHIVE_EOF) break;
+        ArchiveFunction::checkForError(lErr, 0, theArchive);
+
+        // skipped blocks are decompressed as well
+        if (!theGuard.addData(lBlockSize,
+                              archive_position_compressed(theArchive)))
+        {
+          ArchiveFunction::checkGuard(theGuard);
+        }
+
+        // sparse entries: holes read as zeros
+        uint64_t lPos = theOffset + lResult.size();
+        if (uint64_t(lBlockOffset) > lPos)
+        {
+          uint64_t lHole = std::min<uint64_t>(
+              uint64_t(lBlockOffset) - lPos, theLength - lResult.size());
+          if (!theGuard.addData(lHole, archive_position_compressed(theArchive)))
+          {
+            ArchiveFunction::checkGuard(theGuard);
+          }
+          lResult.append(static_cast<size_t>(lHole), '\0');
+        }
+
+        appendRange(static_cast<const char*>(lBlock), lBlockSize,
+                    lBlockOffset, theOffset, theLength, lResult);
+      }
+
+      // a hole at the end of a sparse entry, whose size comes from the
+      // (untrusted) header
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+      bool lSparse = archive_entry_sparse_count(lEntry) > 0;
+#else
+      bool lSparse = true;
+#endif
+      uint64_t lPos = theOffset + lResult.size();
+      uint64_t lEntrySize = archive_entry_size(lEntry);
+      if (lSparse && lResult.size() < theLength && lPos < lEntrySize)
+      {
+        uint64_t lHole
+          = std::min<uint64_t>(lEntrySize - lPos, theLength - lResult.size());
+        if (!theGuard.addData(lHole, archive_position_compressed(theArchive)))
+        {
+          ArchiveFunction::checkGuard(theGuard);
+        }
+        lResult.append(static_cast<size_t>(lHole), '\0');
+      }
+    }
+
+    aRes = theFactory->createBase64Binary(lResult.data(), lResult.size(), false);
+
+    return true;
+  }
+
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    OptionsFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    // edits don't change format and compression
+    ArchiveOverlay* lOverlay = ArchiveOverlay::get(lArchive);
+    if (lOverlay)
+    {
+      lArchive = lOverlay->getBase();
+    }
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      return ItemSequence_t(new SingletonItemSequence(
+          getZipOptions(lDirectory)));
+    }
+
+    // pax archives are told by libarchive (see formatName)
+    if (lFormat == "TAR" && lCompression == "NONE"
+        && lData && !ArchiveSniffer::hasPaxHeader(lData, lSize))
+    {
+      std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+          theModule->getItemFactory()->createString(lFormat)));
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
+          theModule->getItemFactory()->createString(lCompression)));
+      return ItemSequence_t(new SingletonItemSequence(
+          theModule->getItemFactory()->createJSONObject(lJSONObject)));
+    }
+
+    // libarchive doesn't report how XAR entries are compressed (it's
+    // seen behind the TOC, i.e. not in the head)
+    if (lFormat == "XAR" && !lData)
+    {
+      getArchiveData(lArchive, lBuffer, lData, lSize);
+    }
+    std::string lEntryCompression;
+    if (lFormat == "XAR"
+        && ArchiveSniffer::xarCompression(lData, lSize, lEntryCompression))
+    {
+      std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+          theModule->getItemFactory()->createString(lFormat)));
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
+          theModule->getItemFactory()->createString(lEntryCompression)));
+      return ItemSequence_t(new SingletonItemSequence(
+          theModule->getItemFactory()->createJSONObject(lJSONObject)));
+    }
+
+    // let libarchive tell about other formats or compressions
+    if (lBuffer.size())
+    {
+      lArchive = theModule->getItemFactory()->createBase64Binary(
+          lData, lSize, false);
+    }
+    return ItemSequence_t(new OptionsItemSequence(lArchive));
+  }
+
+  zorba::Item
+  OptionsFunction::getZipOptions(const ZipDirectory& aDirectory)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+
+    // the compression of the archive is the one used by most files
+    std::map<uint16_t, size_t> lCounts;
+    for (size_t i = 0; i < aDirectory.size(); ++i)
+    {
+      const ZipDirectory::Entry& lEntry = aDirectory.getEntry(i);
+      if (!lEntry.isDirectory())
+      {
+        ++lCounts[lEntry.theMethod];
+      }
+    }
+
+    uint16_t lMethod = ZORBA_ZIP_METHOD_DEFLATE;
+    size_t lMax = 0;
+    for (std::map<uint16_t, size_t>::const_iterator lIter = lCounts.begin();
+         lIter != lCounts.end(); ++lIter)
+    {
+      if (lIter->second > lMax)
+      {
+        lMethod = lIter->first;
+        lMax = lIter->second;
+      }
+    }
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+        lFactory->createString("ZIP")));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
+        lFactory->createString(ArchiveSniffer::zipMethodName(lMethod))));
+
+    // files compressed differently
+    std::vector<std::pair<zorba::Item, zorba::Item> > lExceptions;
+    for (size_t i = 0; i < aDirectory.size(); ++i)
+    {
+      const ZipDirectory::Entry& lEntry = aDirectory.getEntry(i);
+      if (!lEntry.isDirectory() && lEntry.theMethod != lMethod)
+      {
+        lExceptions.push_back(std::pair<zorba::Item, zorba::Item>(
+            lFactory->createString(lEntry.theName),
+            lFactory->createString(
+                ArchiveSniffer::zipMethodName(lEntry.theMethod))));
+      }
+    }
+    if (!lExceptions.empty())
+    {
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("entry-compressions"),
+          lFactory->createJSONObject(lExceptions)));
+    }
+
+    return lFactory->createJSONObject(lJSONObject);
+  }
+
+  OptionsFunction::OptionsItemSequence::OptionsIterator::OptionsIterator(Item &aArchive)
+      :ArchiveIterator(aArchive)
+  {
+  }
+
+  bool
+  OptionsFunction::OptionsItemSequence::OptionsIterator::next(
+      zorba::Item& aRes)
+  {
+    if (lExhausted) return false;
+
+    lExhausted = true;
+
+    struct archive_entry *lEntry;
+    typedef std::pair<zorba::Item, zorba::Item> tArrElemt;
+    tArrElemt lElemt;
+    std::vector<tArrElemt> lJSONObject;
+
+    // to get the format, we need to peek into the first header
+    int lErr = archive_read_next_header(theArchive, &lEntry);
+
+    if (lErr != ARCHIVE_OK && lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+    }
+
+    std::string lFormat =
+      ArchiveFunction::formatName(archive_format(theArchive));
+    std::string lCompression =
+      ArchiveFunction::compressionName(archive_compression(theArchive));
+
+    // libarchive doesn't report the method of ZIP entries (only for
+    // non-seekable streams that can't be scanned beforehand)
+    if (lFormat == "ZIP")
+    {
+      lCompression = "DEFLATE";
+    }
+    // nor how 7ZIP entries are compressed (XAR entries are sniffed by
+    // OptionsFunction if the data is at hand)
+    if (lFormat == "7ZIP" || lFormat == "XAR")
+    {
+      ArchiveOptions lOptions;
+      lOptions.setValues(theArchive);
+      lCompression = lOptions.getCompression();
+    }
+    // libarchive only sees the decompressed archive
+    if (theDictionary)
+    {
+      lCompression = "ZSTD-SEEKABLE";
+    }
+
+    lElemt = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+                                                      theFactory->createString(lFormat));
+    lJSONObject.push_back(lElemt);
+
+    lElemt = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
+                                                      theFactory->createString(lCompression));
+    lJSONObject.push_back(lElemt);
+
+    if (theDictionary)
+    {
+      lElemt = std::pair<zorba::Item, zorba::Item>(
+          theFactory->createString("dictionary"),
+          theFactory->createBoolean(true));
+      lJSONObject.push_back(lElemt);
+    }
+
+    aRes = theFactory->createJSONObject(lJSONObject);
+
+    return true;
+  }
+
+/*******************************************************************************************
+ *******************************************************************************************/
+  zorba::ItemSequence_t
+    StatFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    // the central directory has all information
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      uint64_t lCompressed = 0;
+      uint64_t lUncompressed = 0;
+      std::string lLargestName;
+      uint64_t lLargestSize = 0;
+
+      for (size_t i = 0; i < lDirectory.size(); ++i)
+      {
+        const ZipDirectory::Entry& lEntry = lDirectory.getEntry(i);
+        lCompressed += lEntry.theCompressedSize;
+        lUncompressed += lEntry.theUncompressedSize;
+        if (!lEntry.isDirectory()
+            && (lLargestName.empty()
+                || lEntry.theUncompressedSize > lLargestSize))
+        {
+          lLargestName = lEntry.theName;
+          lLargestSize = lEntry.theUncompressedSize;
+        }
+      }
+
+      return ItemSequence_t(new SingletonItemSequence(
+          createStat(lFormat, lDirectory.size(), lCompressed, lUncompressed,
+                     lLargestName, lLargestSize)));
+    }
+
+    // otherwise, only the headers are read
+    if (lBuffer.size())
+    {
+      lArchive = theModule->getItemFactory()->createBase64Binary(
+          lData, lSize, false);
+    }
+    return ItemSequence_t(new StatItemSequence(lArchive));
+  }
+
+  zorba::Item
+  StatFunction::createStat(
+      const std::string& aFormat,
+      uint64_t aEntryCount,
+      uint64_t aCompressedSize,
+      uint64_t aUncompressedSize,
+      const std::string& aLargestName,
+      uint64_t aLargestSize)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+        lFactory->createString(aFormat)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("entry-count"),
+        lFactory->createInteger(aEntryCount)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("compressed-size"),
+        lFactory->createInteger(aCompressedSize)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("uncompressed-size"),
+        lFactory->createInteger(aUncompressedSize)));
+
+    if (!aLargestName.empty())
+    {
+      std::vector<std::pair<zorba::Item, zorba::Item> > lLargest;
+      lLargest.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+          lFactory->createString(aLargestName)));
+      lLargest.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
+          lFactory->createInteger(aLargestSize)));
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("largest-entry"),
+          lFactory->createJSONObject(lLargest)));
+    }
+
+    return lFactory->createJSONObject(lJSONObject);
+  }
+
+  StatFunction::StatItemSequence::StatIterator::StatIterator(Item &aArchive)
+      :ArchiveIterator(aArchive)
+  {
+  }
+
+  bool
+  StatFunction::StatItemSequence::StatIterator::next(
+      zorba::Item& aRes)
+  {
+    if (theExhausted) return false;
+
+    theExhausted = true;
+
+    uint64_t lCount = 0;
+    uint64_t lUncompressed = 0;
+    std::string lLargestName;
+    uint64_t lLargestSize = 0;
+
+    struct archive_entry *lEntry;
+    int lErr;
+    while ((lErr = archive_read_next_header(theArchive, &lEntry)) == ARCHIVE_OK)
+    {
+      ++lCount;
+      if (archive_entry_filetype(lEntry) == AE_IFREG)
+      {
+        uint64_t lSize = archive_entry_size(lEntry);
+        lUncompressed += lSize;
+        if (lLargestName.empty() || lSize > lLargestSize)
+        {
+          lLargestName = archive_entry_pathname(lEntry);
+          lLargestSize = lSize;
+        }
+      }
+
+      // uncompressed data is skipped without being read
+      lErr = archive_read_data_skip(theArchive);
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, theArchive);
+    }
+
+    // all bytes of the (compressed) archive have been consumed
+    aRes = StatFunction::createStat(
+        ArchiveFunction::formatName(archive_format(theArchive)),
+        lCount,
+        theDictionary
+          ? ArchiveFunction::getConsumed(theDictionary)
+          : archive_position_compressed(theArchive),
+        lUncompressed,
+        lLargestName,
+        lLargestSize);
+
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  void
+  GrepFunction::Options::setValues(zorba::Item& aOptions)
+  {
+    if (!aOptions.isJSONItem()
+        || aOptions.getJSONItemKind() != store::StoreConsts::jsonObject)
+    {
+      throwError(ERROR_INVALID_OPTIONS, "grep options need to be an object");
+    }
+
+    Item lKey;
+    Iterator_t lKeyIter = aOptions.getObjectKeys();
+    lKeyIter->open();
+    while (lKeyIter->next(lKey))
+    {
+      String lKeyName = lKey.getStringValue();
+      Item lValue = aOptions.getObjectValue(lKeyName);
+
+      if (lKeyName == "entries")
+      {
+        if (lValue.isJSONItem()
+            && lValue.getJSONItemKind() == store::StoreConsts::jsonArray)
+        {
+          uint64_t lSize = lValue.getArraySize();
+          for (uint64_t i = 1; i <= lSize; ++i)
+          {
+            theEntryPatterns.push_back(
+                lValue.getArrayValue(i).getStringValue().str());
+          }
+        }
+        else
+        {
+          theEntryPatterns.push_back(lValue.getStringValue().str());
+        }
+      }
+      else if (lKeyName == "first-only")
+      {
+        theFirstOnly = lValue.getStringValue() == "true";
+      }
+    }
+    lKeyIter->close();
+  }
+
+  bool
+  GrepFunction::Options::isSelected(const std::string& aName) const
+  {
+    if (theEntryPatterns.empty()) return true;
+
+    for (size_t i = 0; i < theEntryPatterns.size(); ++i)
+    {
+      if (matchGlob(aName.c_str(), theEntryPatterns[i].c_str())) return true;
+    }
+    return false;
+  }
+
+  bool
+  GrepFunction::matchGlob(const char* aName, const char* aPattern)
+  {
+    // backtracks to the last * only, i.e. linear in most cases
+    const char* lStar = 0;
+    const char* lRetry = 0;
+    while (*aName)
+    {
+      if (*aPattern == '*')
+      {
+        lStar = aPattern++;
+        lRetry = aName;
+      }
+      else if (*aPattern == '?' || *aPattern == *aName)
+      {
+        ++aPattern;
+        ++aName;
+      }
+      else if (lStar)
+      {
+        aPattern = lStar + 1;
+        aName = ++lRetry;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    while (*aPattern == '*') ++aPattern;
+    return *aPattern == 0;
+  }
+
+  namespace {
+
+  // the entries of a ZIP archive searched by the worker threads
+  struct GrepJob
+  {
+    const ZipDirectory*                       theDirectory;
+    const GrepFunction::Options*              theOptions;
+    std::vector<size_t>                       theIndexes;
+    std::vector<GrepFunction::EntryMatches>*  theResult;
+    // accounts for the total size of all entries
+    ResourceGuard                             theGuard;
+    Mutex                                     theGuardMutex;
+  };
+
+  struct GrepBlockSearch
+  {
+    StreamSearch*                       theSearch;
+    std::vector<StreamSearch::Match>*   theMatches;
+  };
+
+  } /* anonymous namespace */
+
+  bool
+  GrepFunction::searchBlock(void* aSearch, const char* aData, size_t aLen)
+  {
+    GrepBlockSearch* lSearch = static_cast<GrepBlockSearch*>(aSearch);
+    return lSearch->theSearch->feed(aData, aLen, *lSearch->theMatches);
+  }
+
+  void
+  GrepFunction::grepZipEntry(void* aJob, size_t aIndex)
+  {
+    GrepJob* lJob = static_cast<GrepJob*>(aJob);
+    EntryMatches& lResult = (*lJob->theResult)[aIndex];
+
+    // runs on a worker thread, i.e. no exceptions must escape
+    try
+    {
+      StreamSearch lSearch(
+          lJob->theOptions->thePattern, lJob->theOptions->theFirstOnly);
+      GrepBlockSearch lBlockSearch;
+      lBlockSearch.theSearch = &lSearch;
+      lBlockSearch.theMatches = &lResult.theMatches;
+      ResourceGuard lGuard(lJob->theGuard, lJob->theGuardMutex);
+      lGuard.startEntry(lResult.theName.c_str());
+      readZipEntry(*lJob->theDirectory, lJob->theIndexes[aIndex],
+                   &GrepFunction::searchBlock, &lBlockSearch, lResult.theError,
+                   &lGuard);
+      lResult.theLimitExceeded = lGuard.failed();
+    }
+    catch (...)
+    {
+      lResult.theError = lResult.theName + ": internal error";
+    }
+  }
+
+  // reads the headers of an archive one by one (e.g. for a:grep)
+  class EntryScanIterator : public ArchiveItemSequence::ArchiveIterator
+  {
+    public:
+      EntryScanIterator(zorba::Item& aArchive)
+        : ArchiveIterator(aArchive) {}
+
+      bool
+      next(zorba::Item&) { return false; }
+
+      struct archive_entry*
+      nextHeader()
+      {
+        struct archive_entry* lEntry;
+        int lErr = archive_read_next_header(theArchive, &lEntry);
+        if (lErr == ARCHIVE_EOF) return 0;
+        ArchiveFunction::checkForError(lErr, 0, theArchive);
+        if (!theGuard.startEntry(archive_entry_pathname(lEntry)))
+        {
+          ArchiveFunction::checkGuard(theGuard);
+        }
+        return lEntry;
+      }
+
+      struct archive*
+      getArchive() const { return theArchive; }
+
+      ResourceGuard&
+      getGuard() { return theGuard; }
+  };
+
+  void
+  GrepFunction::grepEntries(
+      zorba::Item& aArchive,
+      const Options& aOptions,
+      std::vector<EntryMatches>& aResult)
+  {
+    EntryScanIterator lIter(aArchive);
+    lIter.open();
+
+    try
+    {
+      struct archive_entry* lEntry;
+      while ((lEntry = lIter.nextHeader()))
+      {
+        // hardlinks have no data of their own
+        std::string lName = archive_entry_pathname(lEntry);
+        if (archive_entry_filetype(lEntry) != AE_IFREG
+            || archive_entry_hardlink(lEntry)
+            || !aOptions.isSelected(lName))
+        {
+          continue;
+        }
+
+        aResult.push_back(EntryMatches());
+        EntryMatches& lResult = aResult.back();
+        lResult.theName = lName;
+
+        StreamSearch lSearch(aOptions.thePattern, aOptions.theFirstOnly);
+        ArchiveEntryBuffer lBuffer(lIter.getArchive(), &lIter.getGuard());
+        const char* lData;
+        size_t lLen;
+        while (lBuffer.nextBlock(lData, lLen)
+               && lSearch.feed(lData, lLen, lResult.theMatches))
+        {}
+
+        if (lBuffer.failed())
+        {
+          checkGuard(lIter.getGuard());
+          ArchiveFunction::checkForError(ARCHIVE_FATAL, 0, lIter.getArchive());
+        }
+      }
+    }
+    catch (...)
+    {
+      lIter.close();
+      throw;
+    }
+    lIter.close();
+  }
+
+  void
+  GrepFunction::addMatches(
+      const EntryMatches& aEntry,
+      std::vector<zorba::Item>& aResult)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+    Item lName = lFactory->createString(aEntry.theName);
+    for (size_t i = 0; i < aEntry.theMatches.size(); ++i)
+    {
+      const StreamSearch::Match& lMatch = aEntry.theMatches[i];
+
+      std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          ArchiveModule::getGlobalItems(ArchiveModule::NAME), lName));
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("offset"),
+          lFactory->createInteger(lMatch.theOffset)));
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("line"),
+          lFactory->createInteger(lMatch.theLine)));
+      aResult.push_back(lFactory->createJSONObject(lJSONObject));
+    }
+  }
+
+  zorba::ItemSequence_t
+    GrepFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    Options lOptions;
+    lOptions.thePattern = getOneItem(aArgs, 1).getStringValue().str();
+    if (lOptions.thePattern.empty())
+    {
+      throwError(ERROR_INVALID_OPTIONS, "grep pattern must not be empty");
+    }
+    if (aArgs.size() > 2)
+    {
+      Item lOptionsItem = getOneItem(aArgs, 2);
+      lOptions.setValues(lOptionsItem);
+    }
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    std::vector<EntryMatches> lEntries;
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      checkZipLimits(lDirectory);
+
+      GrepJob lJob;
+      lJob.theDirectory = &lDirectory;
+      lJob.theOptions = &lOptions;
+      for (size_t i = 0; i < lDirectory.size(); ++i)
+      {
+        const ZipDirectory::Entry& lEntry = lDirectory.getEntry(i);
+        if (!lEntry.isDirectory() && lOptions.isSelected(lEntry.theName))
+        {
+          lJob.theIndexes.push_back(i);
+          lEntries.push_back(EntryMatches());
+          lEntries.back().theName = lEntry.theName;
+        }
+      }
+      lJob.theResult = &lEntries;
+
+      std::string lEntryData;
+      loadZipEntries(lArchive, lDirectory, lJob.theIndexes, lEntryData);
+
+      parallelFor(lEntries.size(), ZORBA_ARCHIVE_WORKER_THREADS,
+                  &GrepFunction::grepZipEntry, &lJob);
+
+      for (size_t i = 0; i < lEntries.size(); ++i)
+      {
+        if (!lEntries[i].theError.empty())
+        {
+          throwError(lEntries[i].theLimitExceeded
+                       ? ERROR_LIMIT_EXCEEDED : ERROR_CORRUPTED_ARCHIVE,
+                     lEntries[i].theError.c_str());
+        }
+      }
+    }
+    else
+    {
+      if (lBuffer.size())
+      {
+        lArchive = theModule->getItemFactory()->createBase64Binary(
+            lData, lSize, false);
+      }
+      grepEntries(lArchive, lOptions, lEntries);
+    }
+
+    std::vector<Item> lResult;
+    for (size_t i = 0; i < lEntries.size(); ++i)
+    {
+      addMatches(lEntries[i], lResult);
+    }
+    return ItemSequence_t(new VectorItemSequence(lResult));
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  void
+  ChecksumsFunction::Hasher::update(const char* aData, size_t aLen)
+  {
+    if (theAlgorithms & ALGORITHM_CRC32) theCRC32.update(aData, aLen);
+    if (theAlgorithms & ALGORITHM_SHA256) theSHA256.update(aData, aLen);
+    if (theAlgorithms & ALGORITHM_XXH64) theXXH64.update(aData, aLen);
+  }
+
+  bool
+  ChecksumsFunction::Hasher::update(
+      void* aHasher,
+      const char* aData,
+      size_t aLen)
+  {
+    static_cast<Hasher*>(aHasher)->update(aData, aLen);
+    return true;
+  }
+
+  void
+  ChecksumsFunction::Hasher::finish(EntryDigests& aDigests)
+  {
+    if (theAlgorithms & ALGORITHM_CRC32) aDigests.theCRC32 = theCRC32.get();
+    if (theAlgorithms & ALGORITHM_SHA256) aDigests.theSHA256 = theSHA256.finish();
+    if (theAlgorithms & ALGORITHM_XXH64) aDigests.theXXH64 = theXXH64.get();
+  }
+
+  int
+  ChecksumsFunction::getAlgorithms(zorba::Iterator_t& aNames)
+  {
+    int lAlgorithms = 0;
+    Item lName;
+    aNames->open();
+    while (aNames->next(lName))
+    {
+      // e.g. "sha-256" and "SHA256" are the same
+      std::string lNorm;
+      std::string lValue = lName.getStringValue().str();
+      for (size_t i = 0; i < lValue.size(); ++i)
+      {
+        if (lValue[i] != '-' && lValue[i] != '_')
+          lNorm += static_cast<char>(::toupper(lValue[i]));
+      }
+
+      if (lNorm == "CRC32")
+        lAlgorithms |= ALGORITHM_CRC32;
+      else if (lNorm == "SHA256")
+        lAlgorithms |= ALGORITHM_SHA256;
+      else if (lNorm == "XXH64" || lNorm == "XXHASH")
+        lAlgorithms |= ALGORITHM_XXH64;
+      else
+      {
+        aNames->close();
+        std::ostringstream lMsg;
+        lMsg << lValue
+          << ": checksum algorithm not supported (required: crc32, sha-256, xxh64)";
+        throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+      }
+    }
+    aNames->close();
+    return lAlgorithms;
+  }
+
+  namespace {
+
+  // the entries of a ZIP archive hashed by the worker threads
+  struct ChecksumsJob
+  {
+    const ZipDirectory*                             theDirectory;
+    int                                             theAlgorithms;
+    std::vector<size_t>                             theIndexes;
+    std::vector<ChecksumsFunction::EntryDigests>*   theResult;
+    // accounts for the total size of all entries
+    ResourceGuard                                   theGuard;
+    Mutex                                           theGuardMutex;
+  };
+
+  } /* anonymous namespace */
+
+  void
+  ChecksumsFunction::hashZipEntry(void* aJob, size_t aIndex)
+  {
+    ChecksumsJob* lJob = static_cast<ChecksumsJob*>(aJob);
+    EntryDigests& lResult = (*lJob->theResult)[aIndex];
+
+    // runs on a worker thread, i.e. no exceptions must escape
+    try
+    {
+      Hasher lHasher(lJob->theAlgorithms);
+      ResourceGuard lGuard(lJob->theGuard, lJob->theGuardMutex);
+      lGuard.startEntry(lResult.theName.c_str());
+      if (readZipEntry(*lJob->theDirectory, lJob->theIndexes[aIndex],
+                       &Hasher::update, &lHasher, lResult.theError, &lGuard))
+      {
+        lHasher.finish(lResult);
+      }
+      lResult.theLimitExceeded = lGuard.failed();
+    }
+    catch (...)
+    {
+      lResult.theError = lResult.theName + ": internal error";
+    }
+  }
+
+  void
+  ChecksumsFunction::hashEntries(
+      zorba::Item& aArchive,
+      int aAlgorithms,
+      std::vector<EntryDigests>& aResult)
+  {
+    EntryScanIterator lIter(aArchive);
+    lIter.open();
+
+    // hardlinks get the digests of their targets
+    std::map<std::string, size_t> lFiles;
+    try
+    {
+      struct archive_entry* lEntry;
+      while ((lEntry = lIter.nextHeader()))
+      {
+        if (archive_entry_filetype(lEntry) != AE_IFREG) continue;
+
+        std::string lName = archive_entry_pathname(lEntry);
+        const char* lTarget = archive_entry_hardlink(lEntry);
+        if (lTarget)
+        {
+          std::map<std::string, size_t>::const_iterator lFile
+            = lFiles.find(lTarget);
+          if (lFile != lFiles.end())
+          {
+            EntryDigests lDigests = aResult[lFile->second];
+            lDigests.theName = lName;
+            aResult.push_back(lDigests);
+          }
+          continue;
+        }
+
+        lFiles[lName] = aResult.size();
+        aResult.push_back(EntryDigests());
+        EntryDigests& lResult = aResult.back();
+        lResult.theName = lName;
+
+        Hasher lHasher(aAlgorithms);
+        ArchiveEntryBuffer lBuffer(lIter.getArchive(), &lIter.getGuard());
+        const char* lData;
+        size_t lLen;
+        while (lBuffer.nextBlock(lData, lLen))
+        {
+          lHasher.update(lData, lLen);
+        }
+
+        if (lBuffer.failed())
+        {
+          checkGuard(lIter.getGuard());
+          ArchiveFunction::checkForError(ARCHIVE_FATAL, 0, lIter.getArchive());
+        }
+        lHasher.finish(lResult);
+      }
+    }
+    catch (...)
+    {
+      lIter.close();
+      throw;
+    }
+    lIter.close();
+  }
+
+  zorba::Item
+  ChecksumsFunction::createDigests(
+      const EntryDigests& aDigests,
+      int aAlgorithms)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+        lFactory->createString(aDigests.theName)));
+    if (aAlgorithms & ALGORITHM_CRC32)
+    {
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("crc32"),
+          lFactory->createString(toHex(aDigests.theCRC32, 8))));
+    }
+    if (aAlgorithms & ALGORITHM_SHA256)
+    {
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("sha-256"),
+          lFactory->createString(toHex(aDigests.theSHA256))));
+    }
+    if (aAlgorithms & ALGORITHM_XXH64)
+    {
+      lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("xxh64"),
+          lFactory->createString(toHex(aDigests.theXXH64, 16))));
+    }
+    return lFactory->createJSONObject(lJSONObject);
+  }
+
+  zorba::ItemSequence_t
+    ChecksumsFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    Iterator_t lNames = aArgs[1]->getIterator();
+    int lAlgorithms = getAlgorithms(lNames);
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    std::vector<EntryDigests> lEntries;
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      checkZipLimits(lDirectory);
+
+      ChecksumsJob lJob;
+      lJob.theDirectory = &lDirectory;
+      // the stored CRC-32 is returned without decompressing the entry
+      lJob.theAlgorithms = lAlgorithms & ~ALGORITHM_CRC32;
+      for (size_t i = 0; i < lDirectory.size(); ++i)
+      {
+        const ZipDirectory::Entry& lEntry = lDirectory.getEntry(i);
+        if (lEntry.isDirectory()) continue;
+
+        lJob.theIndexes.push_back(i);
+        lEntries.push_back(EntryDigests());
+        lEntries.back().theName = lEntry.theName;
+        lEntries.back().theCRC32 = lEntry.theCRC32;
+      }
+      lJob.theResult = &lEntries;
+
+      if (lJob.theAlgorithms)
+      {
+        std::string lEntryData;
+        loadZipEntries(lArchive, lDirectory, lJob.theIndexes, lEntryData);
+
+        parallelFor(lEntries.size(), ZORBA_ARCHIVE_WORKER_THREADS,
+                    &ChecksumsFunction::hashZipEntry, &lJob);
+
+        for (size_t i = 0; i < lEntries.size(); ++i)
+        {
+          if (!lEntries[i].theError.empty())
+          {
+            throwError(lEntries[i].theLimitExceeded
+                         ? ERROR_LIMIT_EXCEEDED : ERROR_CORRUPTED_ARCHIVE,
+                       lEntries[i].theError.c_str());
+          }
+        }
+      }
+    }
+    else
+    {
+      if (lBuffer.size())
+      {
+        lArchive = theModule->getItemFactory()->createBase64Binary(
+            lData, lSize, false);
+      }
+      hashEntries(lArchive, lAlgorithms, lEntries);
+    }
+
+    std::vector<Item> lResult;
+    lResult.reserve(lEntries.size());
+    for (size_t i = 0; i < lEntries.size(); ++i)
+    {
+      lResult.push_back(createDigests(lEntries[i], lAlgorithms));
+    }
+    return ItemSequence_t(new VectorItemSequence(lResult));
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  bool
+  VerifyFunction::Sink::consume(void* aSink, const char* aData, size_t aLen)
+  {
+    Sink* lSink = static_cast<Sink*>(aSink);
+    if (lSink->theStop)
+    {
+      ScopedLock lLock(*lSink->theMutex);
+      if (*lSink->theStop)
+      {
+        lSink->theStopped = true;
+        return false;
+      }
+    }
+    lSink->theCRC32.update(aData, aLen);
+    lSink->theSize += aLen;
+    return true;
+  }
+
+  namespace {
+
+  // the entries of a ZIP archive checked by the worker threads
+  struct VerifyJob
+  {
+    const ZipDirectory*                         theDirectory;
+    bool                                        theKeepGoing;
+    Mutex                                       theMutex;
+    bool                                        theStop;
+    std::vector<size_t>                         theIndexes;
+    std::vector<VerifyFunction::EntryReport>*   theResult;
+    // accounts for the total size of all entries
+    ResourceGuard                               theGuard;
+    Mutex                                       theGuardMutex;
+  };
+
+  } /* anonymous namespace */
+
+  void
+  VerifyFunction::verifyZipEntry(void* aJob, size_t aIndex)
+  {
+    VerifyJob* lJob = static_cast<VerifyJob*>(aJob);
+    EntryReport& lResult = (*lJob->theResult)[aIndex];
+    const ZipDirectory::Entry& lEntry
+      = lJob->theDirectory->getEntry(lJob->theIndexes[aIndex]);
+
+    // runs on a worker thread, i.e. no exceptions must escape
+    try
+    {
+      Sink lSink(&lJob->theMutex, lJob->theKeepGoing ? 0 : &lJob->theStop);
+      std::string lError;
+      ResourceGuard lGuard(lJob->theGuard, lJob->theGuardMutex);
+      lGuard.startEntry(lEntry.theName.c_str());
+      bool lRead = readZipEntry(*lJob->theDirectory, lJob->theIndexes[aIndex],
+                                &Sink::consume, &lSink, lError, &lGuard);
+      if (lSink.theStopped) return;
+      lResult.theChecked = true;
+
+      if (lGuard.failed())
+      {
+        lResult.theError = "limit-exceeded";
+        lResult.theMessage = lGuard.getError();
+      }
+      // libarchive fails at the end of a deflated entry with a wrong CRC
+      else if (lSink.theSize == lEntry.theUncompressedSize
+          && lSink.theCRC32.get() != lEntry.theCRC32)
+      {
+        std::ostringstream lMsg;
+        lMsg << "stored CRC-32 " << toHex(lEntry.theCRC32, 8)
+          << ", computed " << toHex(lSink.theCRC32.get(), 8);
+        lResult.theError = "crc-mismatch";
+        lResult.theMessage = lMsg.str();
+      }
+      else if (!lRead)
+      {
+        lResult.theError = "corrupted";
+        lResult.theMessage = lError;
+      }
+      else if (lSink.theSize != lEntry.theUncompressedSize)
+      {
+        std::ostringstream lMsg;
+        lMsg << "stored size " << lEntry.theUncompressedSize
+          << ", decompressed " << lSink.theSize;
+        lResult.theError = "size-mismatch";
+        lResult.theMessage = lMsg.str();
+      }
+    }
+    catch (...)
+    {
+      lResult.theChecked = true;
+      lResult.theError = "corrupted";
+      lResult.theMessage = "internal error";
+    }
+
+    if (!lResult.theError.empty() && !lJob->theKeepGoing)
+    {
+      ScopedLock lLock(lJob->theMutex);
+      lJob->theStop = true;
+    }
+  }
+
+  void
+  VerifyFunction::verifyEntries(
+      zorba::Item& aArchive,
+      bool aKeepGoing,
+      std::vector<EntryReport>& aResult)
+  {
+    EntryScanIterator lIter(aArchive);
+    lIter.open();
+
+    try
+    {
+      for (;;)
+      {
+        struct archive_entry* lEntry;
+        int lErr = archive_read_next_header(lIter.getArchive(), &lEntry);
+        if (lErr == ARCHIVE_EOF) break;
+        if (lErr != ARCHIVE_OK)
+        {
+          // the rest of the archive can't be read
+          const char* lMsg = archive_error_string(lIter.getArchive());
+          aResult.push_back(EntryReport());
+          aResult.back().theChecked = true;
+          aResult.back().theError = "corrupted";
+          aResult.back().theMessage = lMsg ? lMsg : "invalid entry header";
+          break;
+        }
+
+        if (!lIter.getGuard().startEntry(archive_entry_pathname(lEntry)))
+        {
+          checkGuard(lIter.getGuard());
+        }
+
+        if (archive_entry_filetype(lEntry) != AE_IFREG
+            || archive_entry_hardlink(lEntry))
+        {
+          continue;
+        }
+
+        aResult.push_back(EntryReport());
+        EntryReport& lResult = aResult.back();
+        lResult.theName = archive_entry_pathname(lEntry);
+        lResult.theChecked = true;
+
+        Sink lSink(0, 0);
+        ArchiveEntryBuffer lBuffer(lIter.getArchive(), &lIter.getGuard());
+        const char* lData;
+        size_t lLen;
+        while (lBuffer.nextBlock(lData, lLen))
+        {
+          Sink::consume(&lSink, lData, lLen);
+        }
+
+        if (lIter.getGuard().failed())
+        {
+          lResult.theError = "limit-exceeded";
+          lResult.theMessage = lIter.getGuard().getError();
+          break;
+        }
+        if (lBuffer.failed())
+        {
+          const char* lMsg = archive_error_string(lIter.getArchive());
+          lResult.theError = "corrupted";
+          lResult.theMessage = lMsg ? lMsg : "corrupted archive";
+          break;
+        }
+        if (archive_entry_size_is_set(lEntry)
+            && uint64_t(archive_entry_size(lEntry)) != lSink.theSize)
+        {
+          std::ostringstream lMsg;
+          lMsg << "stored size " << archive_entry_size(lEntry)
+            << ", decompressed " << lSink.theSize;
+          lResult.theError = "size-mismatch";
+          lResult.theMessage = lMsg.str();
+          if (!aKeepGoing) break;
+        }
+      }
+    }
+    catch (...)
+    {
+      lIter.close();
+      throw;
+    }
+    lIter.close();
+  }
+
+  zorba::Item
+  VerifyFunction::createReport(const std::vector<EntryReport>& aEntries)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+
+    uint64_t lChecked = 0;
+    std::vector<Item> lErrors;
+    for (size_t i = 0; i < aEntries.size(); ++i)
+    {
+      const EntryReport& lEntry = aEntries[i];
+      if (!lEntry.theChecked) continue;
+      ++lChecked;
+      if (lEntry.theError.empty()) continue;
+
+      std::vector<std::pair<zorba::Item, zorba::Item> > lError;
+      if (!lEntry.theName.empty())
+      {
+        lError.push_back(std::pair<zorba::Item, zorba::Item>(
+            ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+            lFactory->createString(lEntry.theName)));
+      }
+      lError.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("error"),
+          lFactory->createString(lEntry.theError)));
+      lError.push_back(std::pair<zorba::Item, zorba::Item>(
+          lFactory->createString("message"),
+          lFactory->createString(lEntry.theMessage)));
+      lErrors.push_back(lFactory->createJSONObject(lError));
+    }
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("valid"),
+        lFactory->createBoolean(lErrors.empty())));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("checked"),
+        lFactory->createInteger(lChecked)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("errors"),
+        lFactory->createJSONArray(lErrors)));
+    return lFactory->createJSONObject(lJSONObject);
+  }
+
+  zorba::ItemSequence_t
+    VerifyFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    bool lKeepGoing = false;
+    if (aArgs.size() > 1)
+    {
+      Item lOptions = getOneItem(aArgs, 1);
+      if (!lOptions.isJSONItem()
+          || lOptions.getJSONItemKind() != store::StoreConsts::jsonObject)
+      {
+        throwError(ERROR_INVALID_OPTIONS, "verify options need to be an object");
+      }
+      Item lValue = lOptions.getObjectValue("keep-going");
+      lKeepGoing = !lValue.isNull() && lValue.getStringValue() == "true";
+    }
+
+    std::string lFormat;
+    std::string lCompression;
+    zorba::String lBuffer;
+    const char* lData = 0;
+    size_t lSize = 0;
+    sniffArchive(lArchive, lFormat, lCompression, lBuffer, lData, lSize);
+
+    std::vector<EntryReport> lEntries;
+    ZipDirectory lDirectory;
+    if (lFormat == "ZIP"
+        && getZipDirectory(lArchive, lDirectory, lBuffer, lData, lSize))
+    {
+      checkZipLimits(lDirectory);
+
+      VerifyJob lJob;
+      lJob.theDirectory = &lDirectory;
+      lJob.theKeepGoing = lKeepGoing;
+      lJob.theStop = false;
+      for (size_t i = 0; i < lDirectory.size(); ++i)
+      {
+        const ZipDirectory::Entry& lEntry = lDirectory.getEntry(i);
+        if (lEntry.isDirectory()) continue;
+
+        lJob.theIndexes.push_back(i);
+        lEntries.push_back(EntryReport());
+        lEntries.back().theName = lEntry.theName;
+      }
+      lJob.theResult = &lEntries;
+
+      std::string lEntryData;
+      loadZipEntries(lArchive, lDirectory, lJob.theIndexes, lEntryData);
+
+      parallelFor(lEntries.size(), ZORBA_ARCHIVE_WORKER_THREADS,
+                  &VerifyFunction::verifyZipEntry, &lJob);
+    }
+    else
+    {
+      if (lBuffer.size())
+      {
+        lArchive = theModule->getItemFactory()->createBase64Binary(
+            lData, lSize, false);
+      }
+      verifyEntries(lArchive, lKeepGoing, lEntries);
+    }
+
+    return ItemSequence_t(new SingletonItemSequence(createReport(lEntries)));
+  }
+
+/*******************************************************************************************
+ *******************************************************************************************/
+  bool
+  UpdateFunction::UpdateItemSequence::UpdateIterator::next(
+    zorba::Item& aRes)
+  {
+    struct archive_entry *lEntry = lookForHeader(false, &theOptions);
+    
+    //NULL is EOF
+    if (!lEntry)
+      return false;
+
+    //form an ArchiveEntry with the entry
+    theEntry.setValues(lEntry);
+
+    if(archive_entry_filetype(lEntry) == AE_IFREG){
+      //read entry content
+      theBuffer.clear();
+      readEntry(lEntry, theBuffer);
+
+      aRes = theFactory->createBase64Binary(
+          theBuffer.data(), theBuffer.size(), false);
+    }
+
+    return true;
+  }
+
+  void
+  UpdateFunction::getChecksums(
+      const char* aData,
+      size_t aSize,
+      const ExtractItemSequence::EntryNameSet& aNames,
+      ChecksumMap& aChecksums,
+      std::set<std::string>* aEntryNames)
+  {
+    ZipDirectory lDirectory;
+    if (parseZip(lDirectory, aData, aSize))
+    {
+      for (size_t i = 0; i < lDirectory.size(); ++i)
+      {
+        const ZipDirectory::Entry& lEntry = lDirectory.getEntry(i);
+        if (aEntryNames) aEntryNames->insert(lEntry.theName);
+        if (aNames.find(lEntry.theName) == aNames.end()) continue;
+
+        EntryChecksum& lChecksum = aChecksums[lEntry.theName];
+        lChecksum.theCRC32 = lEntry.theCRC32;
+        lChecksum.theSize = lEntry.theUncompressedSize;
+        lChecksum.theMethod = lEntry.theMethod;
+        lChecksum.theRegular = !lEntry.isDirectory();
+        lChecksum.theLastModified = -1;
+        lChecksum.theDosDate = lEntry.theDate;
+        lChecksum.theDosTime = lEntry.theTime;
+      }
+      return;
+    }
+
+    // other formats don't store a checksum, i.e. the entries are inflated
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
+
+    ArchiveFunction::openReader(lReader, aData, aSize);
+
+    int lErr;
+    struct archive_entry* lEntry;
+    while ((lErr = archive_read_next_header(lReader, &lEntry)) == ARCHIVE_OK)
+    {
+      std::string lName = archive_entry_pathname(lEntry);
+      if (aEntryNames) aEntryNames->insert(lName);
+
+      // hardlinks are always rewritten
+      if (aNames.find(lName) == aNames.end()
+          || archive_entry_hardlink(lEntry))
+      {
+        continue;
+      }
+
+      CRC32 lCRC;
+      uint64_t lSize = 0;
+      const void* lBuf;
+      size_t lLen;
+      int64_t lOffset;
+      while ((lErr = archive_read_data_block(lReader, &lBuf, &lLen, &lOffset))
+             == ARCHIVE_OK)
+      {
+        // sparse entries
+        if (static_cast<uint64_t>(lOffset) != lSize) break;
+        lCRC.update(lBuf, lLen);
+        lSize += lLen;
+      }
+      if (lErr != ARCHIVE_EOF && lErr != ARCHIVE_OK)
+      {
+        ArchiveFunction::checkForError(lErr, 0, lReader);
+      }
+      if (lErr == ARCHIVE_OK) continue;
+
+      EntryChecksum& lChecksum = aChecksums[lName];
+      lChecksum.theCRC32 = lCRC.get();
+      lChecksum.theSize = lSize;
+      lChecksum.theMethod = -1;
+      lChecksum.theRegular = archive_entry_filetype(lEntry) == AE_IFREG;
+      lChecksum.theLastModified = archive_entry_mtime_is_set(lEntry)
+        ? archive_entry_mtime(lEntry) : -1;
+      lChecksum.theDosDate = 0;
+      lChecksum.theDosTime = 0;
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, lReader);
+    }
+    archive_read_finish(lReader);
+  }
+
+  bool
+  UpdateFunction::isUnchanged(
+      const ChecksumMap& aChecksums,
+      const ArchiveEntry& aEntry,
+      const std::string& aContent)
+  {
+    ChecksumMap::const_iterator lOld
+      = aChecksums.find(aEntry.getEntryPath().str());
+    if (lOld == aChecksums.end()) return false;
+
+    const EntryChecksum& lChecksum = lOld->second;
+    if (!lChecksum.theRegular || lChecksum.theSize != aContent.size())
+    {
+      return false;
+    }
+
+    // a modification time given by the caller needs to match, too
+    if (aEntry.hasLastModified())
+    {
+      if (lChecksum.theMethod >= 0)
+      {
+        ZipDirectory::Entry lDos;
+        std::string lLocalExtra;
+        lDos.setLastModified(aEntry.getLastModified(), lLocalExtra);
+        if (lDos.theDate != lChecksum.theDosDate
+            || lDos.theTime != lChecksum.theDosTime)
+        {
+          return false;
+        }
+      }
+      else if (lChecksum.theLastModified != aEntry.getLastModified())
+      {
+        return false;
+      }
+    }
+
+    // an explicitly requested compression needs to match, too
+    if (aEntry.getCompression().length() > 0
+        && lChecksum.theMethod != (aEntry.getCompression() == "STORE"
+                                   ? ZORBA_ZIP_METHOD_STORE
+                                   : ZORBA_ZIP_METHOD_DEFLATE))
+    {
+      return false;
+    }
+
+    CRC32 lCRC;
+    lCRC.update(aContent.data(), aContent.size());
+    return lCRC.get() == lChecksum.theCRC32;
+  }
+
+  zorba::Item
+  UpdateFunction::updateOverlay(
+      zorba::Item& aArchive,
+      const std::vector<ArchiveEntry>& aEntries,
+      std::vector<zorba::Item>& aContents)
+  {
+    // chained edits are composed with the edits of the given archive
+    ArchiveOverlay* lBase = ArchiveOverlay::get(aArchive);
+
+    // checksums of the replaced entries that are still in the base archive
+    ExtractItemSequence::EntryNameSet lNames;
+    for (size_t i = 0; i < aEntries.size(); ++i)
+    {
+      const std::string lPath = aEntries[i].getEntryPath().str();
+      if (!lBase || (!lBase->getScript().isDeleted(lPath)
+                     && lBase->getScript().findAdd(lPath) < 0))
+      {
+        lNames.insert(lPath);
+      }
+    }
+
+    ChecksumMap lChecksums;
+    std::auto_ptr<ArchiveOverlay> lOverlay;
+    if (lBase)
+    {
+      lOverlay.reset(new ArchiveOverlay(*lBase));
+      if (!lNames.empty())
+      {
+        const char* lData;
+        size_t lSize;
+        lOverlay->getBaseData(lData, lSize);
+        getChecksums(lData, lSize, lNames, lChecksums);
+      }
+    }
+    else
+    {
+      // computed while the entry names of the base are read
+      lOverlay.reset(new ArchiveOverlay(aArchive, &lNames, &lChecksums));
+    }
+    const TransformFunction::EditScript& lScript = lOverlay->getScript();
+
+    ArchiveCompressor lCompressor;
+    bool lChanged = false;
+    for (size_t i = 0; i < aEntries.size(); ++i)
+    {
+      const std::string lPath = aEntries[i].getEntryPath().str();
+      if (aEntries[i].getEntryType() == ArchiveEntry::regular)
+      {
+        std::string lContent;
+        lCompressor.readContent(aEntries[i], aContents[i], lContent);
+
+        //unchanged entries are kept as they are
+        long lAdd = lScript.findAdd(lPath);
+        if (lAdd >= 0)
+        {
+          const ArchiveEntry& lOld = lScript.theAdds[lAdd];
+          size_t lLen;
+          const char* lOldData
+            = lScript.theContents[lAdd].getBase64BinaryValue(lLen);
+          if (lOld.getEntryType() == ArchiveEntry::regular
+              && lOld.getCompression() == aEntries[i].getCompression()
+              && (!aEntries[i].hasLastModified()
+                  || lOld.getLastModified() == aEntries[i].getLastModified())
+              && lContent.compare(0, std::string::npos, lOldData, lLen) == 0)
+          {
+            continue;
+          }
+        }
+        else if (isUnchanged(lChecksums, aEntries[i], lContent))
+        {
+          continue;
+        }
+
+        lOverlay->add(aEntries[i], lContent);
+      }
+      else
+      {
+        if (lOverlay->contains(lPath) || lOverlay->contains(lPath + "/"))
+        {
+          continue;
+        }
+        lOverlay->add(aEntries[i], "");
+      }
+      lChanged = true;
+    }
+
+    //nothing differs => return the original archive
+    if (!lChanged)
+    {
+      return aArchive;
+    }
+    return ArchiveOverlay::createItem(lOverlay.release());
+  }
+
+  zorba::ItemSequence_t
+    UpdateFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    //Base64 Binary of the Archive
+    Item lArchive = getOneItem(aArgs, 0);
+
+    ArchiveOptions lUserOptions;
+    if (aArgs.size() == 4)
+    {
+      Item lOptionsItem = getOneItem(aArgs, 3);
+      lUserOptions.setValues(lOptionsItem);
+    }
+
+    std::vector<ArchiveEntry> lEntries;
+    ExtractItemSequence::EntryNameSet lNames;
+
+    //prepare list of entries to be updated into the Archive
+    {
+      Iterator_t lEntriesIter = aArgs[1]->getIterator();
+
+      zorba::Item lEntry;
+      lEntriesIter->open();
+      while (lEntriesIter->next(lEntry))
+      {
+        lEntries.resize(lEntries.size() + 1);
+        lEntries.back().setValues(lEntry);
+        lNames.insert(lEntries.back().getEntryPath().str());
+        // directory names may be stored with a trailing slash
+        lNames.insert(lEntries.back().getEntryPath().str() + "/");
+      }
+      lEntriesIter->close();
+    } 
+
+    //get the Files to include in the archive
+    std::vector<Item> lContents;
+    {
+      zorba::Iterator_t lFileIter = aArgs[2]->getIterator();
+      getContents(lEntries, lFileIter, lContents);
+    }
+
+    //the archive is only rewritten once it's read (dedup needs to see
+    //all entries, though)
+    if (!lUserOptions.getDedup())
+    {
+      return ItemSequence_t(new SingletonItemSequence(
+            updateOverlay(lArchive, lEntries, lContents)));
+    }
+
+    zorba::String lBuffer;
+    const char* lData;
+    size_t lSize;
+    getArchiveData(lArchive, lBuffer, lData, lSize);
+    if (lArchive.isStreamable() && !lArchive.isSeekable())
+    {
+      // the stream has been consumed
+      lArchive = theModule->getItemFactory()->createBase64Binary(
+          lData, lSize, false);
+    }
+
+    //compare the new contents with the existing entries
+    ChecksumMap lChecksums;
+    getChecksums(lData, lSize, lNames, lChecksums);
+
+    //Prepare new archive, for compressing the Files form the original 
+    //updated with the new Files specified
+    ArchiveCompressor lResArchive;
+    ArchiveOptions lOptions;
+
+    //Initialize an Update Iterator with the Archive recived from the function
+    std::auto_ptr<UpdateItemSequence> lSeq(
+    new UpdateItemSequence(lArchive, false));
+    ExtractFunction::ExtractItemSequence::EntryNameSet& lNameSet 
+        = lSeq->getNameSet();
+
+    std::vector<ArchiveEntry> lNewEntries;
+    std::vector<Item> lNewContents;
+    for (size_t i = 0; i < lEntries.size(); ++i)
+    {
+      const std::string lPath = lEntries[i].getEntryPath().str();
+      if (lEntries[i].getEntryType() == ArchiveEntry::regular)
+      {
+        std::string lContent;
+        lResArchive.readContent(lEntries[i], lContents[i], lContent);
+
+        //unchanged entries are kept as they are
+        if (isUnchanged(lChecksums, lEntries[i], lContent)) continue;
+
+        lNewContents.push_back(theModule->getItemFactory()->createBase64Binary(
+              lContent.data(), lContent.size(), false));
+      }
+      else
+      {
+        if (lChecksums.find(lPath) != lChecksums.end()
+            || lChecksums.find(lPath + "/") != lChecksums.end())
+        {
+          continue;
+        }
+        lNewContents.push_back(Item());
+      }
+      lNewEntries.push_back(lEntries[i]);
+      lNameSet.insert(lPath);
+    }
+
+    //nothing differs => return the original archive
+    if (lNewEntries.empty())
+    {
+      return ItemSequence_t(new SingletonItemSequence(lArchive));
+    }
+
+    Item lItem;
+    Iterator_t lSeqIter = lSeq->getIterator();
+    
+    //read first header and file of the archive so we can get the options before creating 
+    //the new archive.
+    lSeqIter->open();
+    lSeqIter->next(lItem);
+    //set the options of the archive
+    lOptions = lSeq->getOptions();
+    lOptions.setEntryCompression(lData, lSize);
+    //format and compression are kept, only dedup can be requested
+    lOptions.setDedup(lUserOptions.getDedup());
+    //create new archive with the options read
+    lResArchive.open(lOptions);
+    if (!lItem.isNull())
+    {
+      do 
+      {
+        //add and compress the files of the old archive into the new archive.
+        lResArchive.compress(lSeq->getEntry(), lItem);
+      } while (lSeqIter->next(lItem));
+    }
+    lSeqIter->close();
+
+    //add and compress the new file sspecified as a parameter for the function.
+    for (size_t i = 0; i < lNewEntries.size(); ++i)
+    {
+      lResArchive.compress(lNewEntries[i], lNewContents[i]);
+    }
+    lResArchive.close();
+
+    Item lRes = theModule->getItemFactory()->
+      createStreamableBase64Binary(
+      *lResArchive.getResultStream(),
+      &(ArchiveFunction::ArchiveCompressor::releaseStream),
+      true, // seekable
+      false // no encoded
+      );
+    return ItemSequence_t(new SingletonItemSequence(lRes));
+  }
+
+/*******************************************************************************************
+ *******************************************************************************************/
+  zorba::ItemSequence_t
+    DeleteFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const 
+  {
+    //Base64 Binary of the Archive
+    Item lArchive = getOneItem(aArgs, 0);
+
+    //the deletion is recorded in an overlay (composed with the edits of
+    //the given archive) and applied once the archive is read
+    ArchiveOverlay* lBase = ArchiveOverlay::get(lArchive);
+    std::auto_ptr<ArchiveOverlay> lOverlay(
+        lBase ? new ArchiveOverlay(*lBase) : new ArchiveOverlay(lArchive));
+
+    //set list of files to delete from the archive.
+    bool lChanged = false;
+    zorba::Item lItem;
+    Iterator_t lIter = aArgs[1]->getIterator();
+    lIter->open();
+    while (lIter->next(lItem))
+    {
+      std::string lName = lItem.getStringValue().str();
+      if (lOverlay->contains(lName))
+      {
+        lOverlay->remove(lName);
+        lChanged = true;
+      }
+    }
+    lIter->close();
+
+    if (!lChanged)
+    {
+      return ItemSequence_t(new SingletonItemSequence(lArchive));
+    }
+    return ItemSequence_t(new SingletonItemSequence(
+          ArchiveOverlay::createItem(lOverlay.release())));
+  }
+
+/*******************************************************************************************
+ *******************************************************************************************/
+  void
+  TransformFunction::EditScript::getNames(
+      zorba::Item& aValue,
+      std::set<std::string>& aNames)
+  {
+    if (aValue.isJSONItem()
+        && aValue.getJSONItemKind() == store::StoreConsts::jsonArray)
+    {
+      uint64_t lSize = aValue.getArraySize();
+      for (uint64_t i = 1; i <= lSize; ++i)
+      {
+        aNames.insert(aValue.getArrayValue(i).getStringValue().str());
+      }
+    }
+    else
+    {
+      aNames.insert(aValue.getStringValue().str());
+    }
+  }
+
+  void
+  TransformFunction::EditScript::getNameMap(
+      zorba::Item& aValue,
+      NameMap& aMap,
+      bool aUpperCase)
+  {
+    if (!aValue.isJSONItem()
+        || aValue.getJSONItemKind() != store::StoreConsts::jsonObject)
+    {
+      throwError(ERROR_INVALID_OPTIONS,
+          "rename and compression instructions need to be objects");
+    }
+
+    Item lKey;
+    Iterator_t lKeyIter = aValue.getObjectKeys();
+    lKeyIter->open();
+    while (lKeyIter->next(lKey))
+    {
+      std::string lValue =
+        aValue.getObjectValue(lKey.getStringValue()).getStringValue().str();
+      if (aUpperCase)
+      {
+        std::transform(
+            lValue.begin(), lValue.end(),
+            lValue.begin(), ::toupper);
+      }
+      aMap[lKey.getStringValue().str()] = lValue;
+    }
+    lKeyIter->close();
+  }
+
+  void
+  TransformFunction::EditScript::setValues(zorba::Item& aScript)
+  {
+    Item lKey;
+    Iterator_t lKeyIter = aScript.getObjectKeys();
+    lKeyIter->open();
+    while (lKeyIter->next(lKey))
+    {
+      String lKeyName = lKey.getStringValue();
+      Item lValue = aScript.getObjectValue(lKeyName);
+
+      if (lKeyName == "delete")
+      {
+        getNames(lValue, theDeletes);
+      }
+      else if (lKeyName == "rename")
+      {
+        getNameMap(lValue, theRenames, false);
+      }
+      else if (lKeyName == "compression")
+      {
+        getNameMap(lValue, theCompressions, true);
+      }
+      else if (lKeyName == "add")
+      {
+        std::vector<Item> lEntries;
+        if (lValue.isJSONItem()
+            && lValue.getJSONItemKind() == store::StoreConsts::jsonArray)
+        {
+          uint64_t lSize = lValue.getArraySize();
+          for (uint64_t i = 1; i <= lSize; ++i)
+          {
+            lEntries.push_back(lValue.getArrayValue(i));
+          }
+        }
+        else
+        {
+          lEntries.push_back(lValue);
+        }
+
+        for (size_t i = 0; i < lEntries.size(); ++i)
+        {
+          Item& lEntry = lEntries[i];
+          if (!lEntry.isJSONItem()
+              || lEntry.getJSONItemKind() != store::StoreConsts::jsonObject)
+          {
+            throwError(ERROR_INVALID_ENTRY_VALS,
+                "entries to add need to be objects");
+          }
+
+          theAdds.resize(theAdds.size() + 1);
+          theAdds.back().setValues(lEntry);
+
+          Item lContent = lEntry.getObjectValue("content");
+          if (theAdds.back().getEntryType() == ArchiveEntry::regular
+              && lContent.isNull())
+          {
+            std::ostringstream lMsg;
+            lMsg << theAdds.back().getEntryPath()
+              << ": missing content for entry";
+            throwError(ERROR_INVALID_ENTRY_VALS, lMsg.str().c_str());
+          }
+          theContents.push_back(lContent);
+        }
+      }
+      else
+      {
+        std::ostringstream lMsg;
+        lMsg << lKeyName << ": unknown instruction in edit script "
+          << "(allowed: delete, rename, add, compression)";
+        throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+      }
+    }
+    lKeyIter->close();
+  }
+
+  long
+  TransformFunction::EditScript::findAdd(const std::string& aName) const
+  {
+    for (size_t i = 0; i < theAdds.size(); ++i)
+    {
+      if (theAdds[i].getEntryPath().str() == aName)
+      {
+        return static_cast<long>(i);
+      }
+    }
+    return -1;
+  }
+
+  std::string
+  TransformFunction::EditScript::getNewName(const std::string& aName) const
+  {
+    NameMap::const_iterator lIter = theRenames.find(aName);
+    if (lIter == theRenames.end())
+    {
+      return aName;
+    }
+
+    std::string lNewName = lIter->second;
+    // renamed directories remain directories
+    if (!aName.empty() && aName[aName.size() - 1] == '/'
+        && (lNewName.empty() || lNewName[lNewName.size() - 1] != '/'))
+    {
+      lNewName += '/';
+    }
+    return lNewName;
+  }
+
+  void
+  ArchiveFunction::checkZipCompression(const std::string& aCompression)
+  {
+    if (aCompression != "STORE" && aCompression != "DEFLATE")
+    {
+      std::ostringstream lMsg;
+      lMsg << aCompression << ": compression algorithm not supported for ZIP format (required: deflate, store)";
+      throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+    }
+  }
+
+  void
+  TransformFunction::appendCompressed(
+      ZipWriter& aWriter,
+      ArchiveCompressor& aCompressor)
+  {
+    std::auto_ptr<std::stringstream> lStream(aCompressor.getResultStream());
+    std::string lData = lStream->str();
+
+    // take the name from the written entry (libarchive appends a slash
+    // to directory names)
+    ZipDirectory lDirectory;
+    if (!lDirectory.parse(lData.data(), lData.size())
+        || lDirectory.size() != 1
+        || !aWriter.copy(lDirectory, 0))
+    {
+      throwError(ERROR_CORRUPTED_ARCHIVE,
+          "internal error (couldn't compress entry)");
+    }
+  }
+
+  void
+  TransformFunction::appendZipEntry(
+      ZipWriter& aWriter,
+      const ArchiveEntry& aEntry,
+      zorba::Item& aContent)
+  {
+    ArchiveOptions lOptions;
+    ArchiveEntry lEntry(aEntry);
+
+    // the entry is compressed in an archive of its own, i.e. the archive
+    // wide compression can be used
+    std::string lCompression = lEntry.getCompression().str();
+    if (!lCompression.empty())
+    {
+      checkZipCompression(lCompression);
+      lOptions.setCompression(lCompression);
+      lEntry.setCompression("");
+    }
+
+    ArchiveCompressor lCompressor;
+    lCompressor.open(lOptions);
+    lCompressor.compress(lEntry, aContent);
+    lCompressor.close();
+
+    appendCompressed(aWriter, lCompressor);
+  }
+
+  void
+  TransformFunction::recompressZipEntry(
+      ZipWriter& aWriter,
+      const ZipDirectory& aDirectory,
+      size_t aIndex,
+      const std::string& aName,
+      const std::string& aCompression)
+  {
+    std::string lSingleData;
+    isolateZipEntry(aDirectory, aIndex, lSingleData);
+
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
+
+    int lErr = archive_read_support_format_zip(lReader);
+    ArchiveFunction::checkForError(lErr, 0, lReader);
+
+    lErr = archive_read_open_memory(lReader,
+        const_cast<char*>(lSingleData.data()), lSingleData.size());
+    ArchiveFunction::checkForError(lErr, 0, lReader);
+
+    struct archive_entry* lEntry;
+    lErr = archive_read_next_header(lReader, &lEntry);
+    ArchiveFunction::checkForError(lErr, 0, lReader);
+
+    ArchiveOptions lOptions;
+    lOptions.setCompression(aCompression);
+
+    ArchiveCompressor lCompressor;
+    lCompressor.open(lOptions);
+    lCompressor.copy(lReader, lEntry, aName);
+    lCompressor.close();
+
+    archive_read_finish(lReader);
+
+    appendCompressed(aWriter, lCompressor);
+  }
+
+  std::stringstream*
+  TransformFunction::transformZip(
+      const ZipDirectory& aDirectory,
+      EditScript& aScript)
+  {
+    for (EditScript::NameMap::const_iterator lIter
+           = aScript.theCompressions.begin();
+         lIter != aScript.theCompressions.end(); ++lIter)
     {
-      long long lSize = archive_entry_size(lEntry);
-      lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
-                                                           theFactory->createInteger(lSize));
-      lObjectArray.push_back(lElemPair);
+      checkZipCompression(lIter->second);
     }
 
-    // create last-modified attr if the value is set in the archive
-    if (archive_entry_mtime_is_set(lEntry))
+    std::auto_ptr<std::stringstream> lResult(new std::stringstream());
+    ZipWriter lWriter(*lResult);
+    std::vector<bool> lAdded(aScript.theAdds.size(), false);
+
+    for (size_t i = 0; i < aDirectory.size(); ++i)
     {
-      time_t lTime = archive_entry_mtime(lEntry);
-      lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::LAST_MODIFIED),
-                                                           ArchiveModule::createDateTimeItem(lTime));
-      lObjectArray.push_back(lElemPair);
+      const ZipDirectory::Entry& lEntry = aDirectory.getEntry(i);
+
+      if (aScript.isDeleted(lEntry.theName)) continue;
+
+      // replaced entries keep their position in the archive
+      long lAdd = aScript.findAdd(lEntry.theName);
+      if (lAdd >= 0)
+      {
+        appendZipEntry(lWriter, aScript.theAdds[lAdd], aScript.theContents[lAdd]);
+        lAdded[lAdd] = true;
+        continue;
+      }
+
+      std::string lName = aScript.getNewName(lEntry.theName);
+
+      EditScript::NameMap::const_iterator lCompression
+        = aScript.theCompressions.find(lEntry.theName);
+      if (lCompression != aScript.theCompressions.end()
+          && lEntry.theMethod != (lCompression->second == "STORE"
+                                  ? ZORBA_ZIP_METHOD_STORE
+                                  : ZORBA_ZIP_METHOD_DEFLATE))
+      {
+        recompressZipEntry(lWriter, aDirectory, i, lName, lCompression->second);
+        continue;
+      }
+
+      // untouched entries are copied without decompressing them
+      if (!lWriter.copy(aDirectory, i, lName))
+      {
+        std::ostringstream lMsg;
+        lMsg << lEntry.theName << ": invalid entry offset";
+        throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+      }
     }
 
-    std::string lEntryType;
-    if(archive_entry_filetype(lEntry) == AE_IFDIR)
+    for (size_t i = 0; i < aScript.theAdds.size(); ++i)
     {
-      // this entry is a directory
-      lEntryType = "directory";
+      if (!lAdded[i])
+      {
+        appendZipEntry(lWriter, aScript.theAdds[i], aScript.theContents[i]);
+      }
     }
-    else if(archive_entry_filetype(lEntry) == AE_IFREG)
+
+    lWriter.close();
+    return lResult.release();
+  }
+
+  std::stringstream*
+  TransformFunction::transformArchive(
+      const char* aData,
+      size_t aSize,
+      EditScript& aScript)
+  {
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
+
+    DictionarySource* lDictionary
+      = ArchiveFunction::openReader(lReader, aData, aSize);
+
+    // peek into the first header to get format and compression
+    struct archive_entry* lEntry;
+    int lErr = archive_read_next_header(lReader, &lEntry);
+    if (lErr != ARCHIVE_OK && lErr != ARCHIVE_EOF)
     {
-      lEntryType = "regular";
+      ArchiveFunction::checkForError(lErr, 0, lReader);
     }
-    else
+
+    ArchiveOptions lOptions;
+    if (lErr == ARCHIVE_OK)
     {
-      // error! type not supported!
-      // for the time being don't do anything
+      lOptions.setValues(lReader, lDictionary != 0);
+      lOptions.setEntryCompression(aData, aSize);
     }
 
-    lElemPair = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::TYPE),
-                                                         theFactory->createString(lEntryType));
-    lObjectArray.push_back(lElemPair);
+    if (!aScript.theCompressions.empty())
+    {
+      throwError(ERROR_DIFFERENT_COMPRESSIONS_NOT_SUPPORTED,
+          "changing the compression of entries is only supported for zip format");
+    }
 
-    // skip to the next entry and raise an error if that fails
-    lErr = archive_read_data_skip(theArchive);
-    ArchiveFunction::checkForError(lErr, 0, theArchive);
+    ArchiveCompressor lResArchive;
+    lResArchive.open(lOptions);
+    std::vector<bool> lAdded(aScript.theAdds.size(), false);
 
-    aRes = theFactory->createJSONObject(lObjectArray);
+    while (lErr == ARCHIVE_OK)
+    {
+      std::string lName = archive_entry_pathname(lEntry);
+      long lAdd = aScript.findAdd(lName);
 
-    return true;
+      if (aScript.isDeleted(lName))
+      {
+        // data is skipped when reading the next header
+      }
+      else if (lAdd >= 0)
+      {
+        lResArchive.compress(aScript.theAdds[lAdd], aScript.theContents[lAdd]);
+        lAdded[lAdd] = true;
+      }
+      else
+      {
+        const char* lLink = archive_entry_hardlink(lEntry);
+        std::string lTarget = lLink ? lLink : "";
+        if (!lTarget.empty()
+            && (aScript.isDeleted(lTarget) || aScript.findAdd(lTarget) >= 0))
+        {
+          // the entry holding the data is gone => store the data again
+          std::string lData;
+          readEntryData(aData, aSize, lTarget, lData);
+          lResArchive.copy(lEntry, aScript.getNewName(lName), lData);
+        }
+        else
+        {
+          if (!lTarget.empty())
+          {
+            archive_entry_set_hardlink(
+                lEntry, aScript.getNewName(lTarget).c_str());
+          }
+          lResArchive.copy(lReader, lEntry, aScript.getNewName(lName));
+        }
+      }
+
+      lErr = archive_read_next_header(lReader, &lEntry);
+    }
+
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, lReader);
+    }
+    archive_read_finish(lReader);
+
+    for (size_t i = 0; i < aScript.theAdds.size(); ++i)
+    {
+      if (!lAdded[i])
+      {
+        lResArchive.compress(aScript.theAdds[i], aScript.theContents[i]);
+      }
+    }
+
+    lResArchive.close();
+    return lResArchive.getResultStream();
+  }
+
+  void
+  TransformFunction::readEntryData(
+      const char* aData,
+      size_t aSize,
+      const std::string& aName,
+      std::string& aResult)
+  {
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
+
+    ArchiveFunction::openReader(lReader, aData, aSize);
+
+    int lErr;
+    struct archive_entry* lEntry;
+    while ((lErr = archive_read_next_header(lReader, &lEntry)) == ARCHIVE_OK)
+    {
+      if (aName != archive_entry_pathname(lEntry)) continue;
+
+      ResourceGuard lGuard;
+      lGuard.startEntry(aName.c_str());
+      if (!appendEntryData(lReader, lEntry, aResult, &lGuard))
+      {
+        checkGuard(lGuard);
+        throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(lReader));
+      }
+      archive_read_finish(lReader);
+      return;
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, lReader);
+    }
+    archive_read_finish(lReader);
+
+    std::ostringstream lMsg;
+    lMsg << aName << ": hardlink target not found";
+    throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+  }
+
+  zorba::ItemSequence_t
+    TransformFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+    Item lScriptItem = getOneItem(aArgs, 1);
+
+    EditScript lScript;
+    lScript.setValues(lScriptItem);
+
+    zorba::String lBuffer;
+    const char* lData;
+    size_t lSize;
+    getArchiveData(lArchive, lBuffer, lData, lSize);
+
+    std::stringstream* lResult;
+    ZipDirectory lDirectory;
+    if (parseZip(lDirectory, lData, lSize))
+    {
+      lResult = transformZip(lDirectory, lScript);
+    }
+    else
+    {
+      lResult = transformArchive(lData, lSize, lScript);
+    }
+
+    zorba::Item lRes = theModule->getItemFactory()->
+      createStreamableBase64Binary(
+        *lResult,
+        &(ArchiveFunction::ArchiveCompressor::releaseStream),
+        true, // seekable
+        false // not encoded
+        );
+    return ItemSequence_t(new SingletonItemSequence(lRes));
   }
 
 /*******************************************************************************
  ******************************************************************************/
+  // owns the overlay it reads from
+  class ArchiveOverlayStream : public std::istream
+  {
+    protected:
+      ArchiveOverlay* theOverlay;
 
- /*******************************************************************************
- *  This function is meant to replace all the look for specific headers that are
- *  or are not in a list (ArchiveEntrySet)
- ******************************************************************************/
-  struct archive_entry*
-    ExtractFunction::ExtractItemSequence::ExtractIterator::lookForHeader(
-        bool aMatch,
-        ArchiveOptions* aOptions)
+    public:
+      ArchiveOverlayStream(ArchiveOverlay* aOverlay)
+        : std::istream(aOverlay), theOverlay(aOverlay) {}
+
+      virtual ~ArchiveOverlayStream() { delete theOverlay; }
+  };
+
+  ArchiveOverlay::ArchiveOverlay(
+      zorba::Item& aBase,
+      const std::set<std::string>* aNames,
+      UpdateFunction::ChecksumMap* aChecksums)
+    : theMaterialized(false)
   {
-    struct archive_entry *lEntry = 0;
+    zorba::String lBuffer;
+    const char* lData;
+    size_t lSize;
+    ArchiveFunction::getArchiveData(aBase, lBuffer, lData, lSize);
 
-    while (true)
+    // keep the decoded bytes such that they can be accessed without copy
+    if (aBase.isStreamable() || aBase.isEncoded())
     {
-      int lErr = archive_read_next_header(theArchive, &lEntry);
-      
-      if (lErr == ARCHIVE_EOF) return NULL;
+      theBase = ArchiveModule::getItemFactory()->createBase64Binary(
+          lData, lSize, false);
+    }
+    else
+    {
+      theBase = aBase;
+    }
+    getBaseData(lData, lSize);
+
+    // the names are needed to compose edits; reading them also makes sure
+    // that the base is a valid archive
+    ExtractFunction::ExtractItemSequence::EntryNameSet lNoNames;
+    UpdateFunction::ChecksumMap lNoChecksums;
+    UpdateFunction::getChecksums(lData, lSize,
+        aNames ? *aNames : lNoNames,
+        aChecksums ? *aChecksums : lNoChecksums,
+        &theBaseNames);
+  }
 
-      if (lErr != ARCHIVE_OK)
+  ArchiveOverlay::ArchiveOverlay(const ArchiveOverlay& aOther)
+    : std::streambuf(),
+      theBase(aOther.theBase),
+      theBaseNames(aOther.theBaseNames),
+      theScript(aOther.theScript),
+      theMaterialized(false)
+  {}
+
+  ArchiveOverlay*
+  ArchiveOverlay::get(zorba::Item& aArchive)
+  {
+    if (!aArchive.isStreamable()) return 0;
+
+    return dynamic_cast<ArchiveOverlay*>(aArchive.getStream().rdbuf());
+  }
+
+  zorba::Item
+  ArchiveOverlay::createItem(ArchiveOverlay* aOverlay)
+  {
+    std::istream* lStream = new ArchiveOverlayStream(aOverlay);
+    return ArchiveModule::getItemFactory()->createStreamableBase64Binary(
+        *lStream,
+        &(ArchiveFunction::ArchiveCompressor::releaseStream),
+        true, // seekable
+        false // not encoded
+        );
+  }
+
+  void
+  ArchiveOverlay::getBaseData(const char*& aData, size_t& aSize) const
+  {
+    aData = theBase.getBase64BinaryValue(aSize);
+  }
+
+  bool
+  ArchiveOverlay::contains(const std::string& aName) const
+  {
+    if (theScript.findAdd(aName) >= 0) return true;
+
+    return theBaseNames.find(aName) != theBaseNames.end()
+      && !theScript.isDeleted(aName);
+  }
+
+  void
+  ArchiveOverlay::remove(const std::string& aName)
+  {
+    long lAdd = theScript.findAdd(aName);
+    if (lAdd >= 0)
+    {
+      theScript.theAdds.erase(theScript.theAdds.begin() + lAdd);
+      theScript.theContents.erase(theScript.theContents.begin() + lAdd);
+    }
+    if (theBaseNames.find(aName) != theBaseNames.end())
+    {
+      theScript.theDeletes.insert(aName);
+    }
+  }
+
+  void
+  ArchiveOverlay::add(
+      const ArchiveFunction::ArchiveEntry& aEntry,
+      const std::string& aContent)
+  {
+    // like a rewrite, a replaced entry is moved to the end of the archive
+    remove(aEntry.getEntryPath().str());
+
+    theScript.theAdds.push_back(aEntry);
+    theScript.theContents.push_back(
+        ArchiveModule::getItemFactory()->createBase64Binary(
+          aContent.data(), aContent.size(), false));
+  }
+
+  void
+  ArchiveOverlay::getAdds(
+      const std::set<std::string>& aNames,
+      bool aReturnAll,
+      std::vector<size_t>& aPositions) const
+  {
+    for (size_t i = 0; i < theScript.theAdds.size(); ++i)
+    {
+      if (aReturnAll
+          || aNames.find(theScript.theAdds[i].getEntryPath().str())
+             != aNames.end())
       {
-        ArchiveFunction::checkForError(lErr, 0, theArchive);
+        aPositions.push_back(i);
       }
+    }
+  }
 
-      if(aOptions)
-        aOptions->setValues(theArchive);
+  void
+  ArchiveOverlay::materialize()
+  {
+    const char* lData;
+    size_t lSize;
+    getBaseData(lData, lSize);
 
-      if (theReturnAll) break;
+    std::auto_ptr<std::stringstream> lResult;
+    ZipDirectory lDirectory;
+    if (ArchiveFunction::parseZip(lDirectory, lData, lSize))
+    {
+      lResult.reset(TransformFunction::transformZip(lDirectory, theScript));
+    }
+    else
+    {
+      lResult.reset(
+          TransformFunction::transformArchive(lData, lSize, theScript));
+    }
 
-      String lName = archive_entry_pathname(lEntry);
-      if(aMatch) {
-        if (theEntryNames.find(lName.str()) != theEntryNames.end())
-        {
-          break;
-        }
-      } else {
-        if (theEntryNames.find(lName.str()) == theEntryNames.end())
-        {
-          break;
-        }
+    theData = lResult->str();
+    theMaterialized = true;
+
+    char* lBegin = const_cast<char*>(theData.data());
+    setg(lBegin, lBegin, lBegin + theData.size());
+  }
+
+  ArchiveOverlay::int_type
+  ArchiveOverlay::underflow()
+  {
+    if (!theMaterialized) materialize();
+
+    return gptr() < egptr()
+      ? traits_type::to_int_type(*gptr())
+      : traits_type::eof();
+  }
+
+  std::streamsize
+  ArchiveOverlay::showmanyc()
+  {
+    if (!theMaterialized) materialize();
+
+    return egptr() - gptr();
+  }
+
+  ArchiveOverlay::pos_type
+  ArchiveOverlay::seekoff(
+      off_type aOff,
+      std::ios_base::seekdir aDir,
+      std::ios_base::openmode)
+  {
+    if (!theMaterialized) materialize();
+
+    off_type lPos;
+    switch (aDir)
+    {
+      case std::ios_base::beg: lPos = aOff; break;
+      case std::ios_base::cur: lPos = (gptr() - eback()) + aOff; break;
+      default: lPos = static_cast<off_type>(theData.size()) + aOff; break;
+    }
+    if (lPos < 0 || lPos > static_cast<off_type>(theData.size()))
+    {
+      return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + lPos, egptr());
+    return pos_type(lPos);
+  }
+
+  ArchiveOverlay::pos_type
+  ArchiveOverlay::seekpos(pos_type aPos, std::ios_base::openmode aMode)
+  {
+    return seekoff(off_type(aPos), std::ios_base::beg, aMode);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    OpenFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lArchive = getOneItem(aArgs, 0);
+
+    std::auto_ptr<GzipIndex> lIndex;
+    if (aArgs.size() > 1)
+    {
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
+      Item lIndexItem = getOneItem(aArgs, 1);
+      zorba::String lBuffer;
+      const char* lData;
+      size_t lSize;
+      getArchiveData(lIndexItem, lBuffer, lData, lSize);
+
+      lIndex.reset(new GzipIndex());
+      if (!lIndex->parse(lData, lSize))
+      {
+        throwError(ERROR_INVALID_INDEX, lIndex->getError().c_str());
       }
+#else
+      throwError(ERROR_INVALID_INDEX,
+          "archive indexes are not available (module built without zlib)");
+#endif
     }
 
-    return lEntry;
+    return ItemSequence_t(new SingletonItemSequence(
+        ArchiveHandle::createItem(
+          new ArchiveHandle(lArchive, lIndex.release()))));
   }
 
   zorba::ItemSequence_t
-  ExtractTextFunction::evaluate(
-    const Arguments_t& aArgs,
-    const zorba::StaticContext* aSctx,
-    const zorba::DynamicContext* aDctx) const 
-  { 
+    BuildIndexFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
     Item lArchive = getOneItem(aArgs, 0);
 
-    zorba::String lEncoding("UTF-8");
-    if (aArgs.size() == 3)
+    uint64_t lSpan = ZORBA_ARCHIVE_GZIP_INDEX_SPAN;
+    if (aArgs.size() > 1)
     {
-      zorba::Item lItem = getOneItem(aArgs, 2);
-      lEncoding = lItem.getStringValue();
-      if (!transcode::is_supported(lEncoding.c_str()))
+      Item lOptions = getOneItem(aArgs, 1);
+      if (!lOptions.isJSONItem()
+          || lOptions.getJSONItemKind() != store::StoreConsts::jsonObject)
       {
-        std::ostringstream lMsg;
-        lMsg << lEncoding << ": unsupported encoding";
-          
-        throwError(ERROR_INVALID_ENCODING, lMsg.str().c_str());
+        throwError(ERROR_INVALID_OPTIONS,
+            "build-index options need to be an object");
+      }
+      Item lValue = lOptions.getObjectValue("span");
+      if (!lValue.isNull())
+      {
+        std::string lSpanValue = lValue.getStringValue().str();
+        char* lEnd = 0;
+        double lNumber = strtod(lSpanValue.c_str(), &lEnd);
+        if (lSpanValue.empty() || *lEnd || !(lNumber >= 1))
+        {
+          std::ostringstream lMsg;
+          lMsg << lSpanValue
+            << ": invalid value for span (required: positive integer)";
+          throwError(ERROR_INVALID_OPTIONS, lMsg.str().c_str());
+        }
+        lSpan = static_cast<uint64_t>(lNumber);
       }
     }
-    
-    // return all entries if no second arg is given
-    bool lReturnAll = aArgs.size() == 1;
 
-    std::auto_ptr<ExtractItemSequence> lSeq(
-        new ExtractTextItemSequence(lArchive, lReturnAll, lEncoding));
+    zorba::String lBuffer;
+    const char* lData;
+    size_t lSize;
+    getArchiveData(lArchive, lBuffer, lData, lSize);
 
-    // get the names of all entries that should be retruned
-    if (aArgs.size() > 1)
+    ResourceGuard lGuard;
+    GzipIndex lIndex;
+    if (!lIndex.build(lData, lSize, lSpan, &lGuard))
     {
-      ExtractFunction::ExtractItemSequence::EntryNameSet& lSet
-        = lSeq->getNameSet();
-
-      zorba::Item lItem;
-      Iterator_t lIter = aArgs[1]->getIterator();
-      lIter->open();
-      while (lIter->next(lItem))
-      {
-        lSet.insert(lItem.getStringValue().str());
-      }
-
-      lIter->close();
+      checkGuard(lGuard);
+      throwError(ERROR_CORRUPTED_ARCHIVE, lIndex.getError().c_str());
     }
 
-    return ItemSequence_t(lSeq.release());
+    std::string lResult;
+    lIndex.serialize(lResult);
+    return ItemSequence_t(new SingletonItemSequence(
+        theModule->getItemFactory()->createBase64Binary(
+          lResult.data(), lResult.size(), false)));
+#else
+    throwError(ERROR_INVALID_OPTIONS,
+        "archive indexes are not available (module built without zlib)");
+    return ItemSequence_t(new EmptySequence());
+#endif
   }
 
-  bool
-  ExtractTextFunction::ExtractTextItemSequence::ExtractTextIterator::next(
-      zorba::Item& aRes)
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    BenchmarkFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
   {
-    struct archive_entry *lEntry = lookForHeader(true);
+    Item lArchive = getOneItem(aArgs, 0);
+    Item lOptionsItem = getOneItem(aArgs, 1);
+    if (!lOptionsItem.isJSONItem()
+        || lOptionsItem.getJSONItemKind() != store::StoreConsts::jsonObject)
+    {
+      throwError(ERROR_INVALID_OPTIONS,
+          "benchmark options need to be an object");
+    }
+    ArchiveOptions lOptions;
+    lOptions.setValues(lOptionsItem);
 
-    //NULL is EOF
-    if (!lEntry)
-      return false;
+    zorba::String lBuffer;
+    const char* lData;
+    size_t lSize;
+    getArchiveData(lArchive, lBuffer, lData, lSize);
 
-    String lResult;
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
 
-    // reserve some space if we know the decompressed size
-    if (archive_entry_size_is_set(lEntry))
+    ArchiveFunction::openReader(lReader, lData, lSize);
+
+    // the data of regular entries (hardlinks would only repeat it)
+    std::vector<ArchiveEntry> lEntries;
+    std::vector<zorba::Item> lContents;
+    uint64_t lTotal = 0;
+    ResourceGuard lGuard;
+    std::string lContent;
+    int lErr;
+    struct archive_entry* lEntry;
+    while ((lErr = archive_read_next_header(lReader, &lEntry)) == ARCHIVE_OK)
     {
-      long long lSize = archive_entry_size(lEntry);
-      lResult.reserve(lSize);
+      if (archive_entry_filetype(lEntry) != AE_IFREG
+          || archive_entry_hardlink(lEntry))
+      {
+        continue;
+      }
+      if (!lGuard.startEntry(archive_entry_pathname(lEntry)))
+      {
+        archive_read_finish(lReader);
+        checkGuard(lGuard);
+      }
+
+      lContent.clear();
+      if (!appendEntryData(lReader, lEntry, lContent, &lGuard))
+      {
+        std::string lMsg = archive_error_string(lReader)
+          ? archive_error_string(lReader) : "corrupted entry";
+        archive_read_finish(lReader);
+        checkGuard(lGuard);
+        throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.c_str());
+      }
+
+      lEntries.resize(lEntries.size() + 1);
+      lEntries.back().setValues(lEntry);
+      lContents.push_back(theModule->getItemFactory()->createBase64Binary(
+            lContent.data(), lContent.size(), false));
+      lTotal += lContent.size();
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, lReader);
     }
+    lErr = archive_read_finish(lReader);
+    ArchiveFunction::checkForError(lErr, 0, lReader);
+
+    Result lResult;
+    run(lOptions, lEntries, lContents, lResult);
+
+    // the ZIP format compresses each entry by itself
+    ArchiveOptions lDeflate;
+    Result lDeflateResult;
+    run(lDeflate, lEntries, lContents, lDeflateResult);
+
+    zorba::ItemFactory* lFactory = theModule->getItemFactory();
+    std::vector<zorba::Item> lResults;
+    lResults.push_back(createResult(lOptions, lResult, lTotal));
+    lResults.push_back(createResult(lDeflate, lDeflateResult, lTotal));
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("entries"),
+        lFactory->createInteger(lEntries.size())));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
+        lFactory->createInteger(lTotal)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("results"),
+        lFactory->createJSONArray(lResults)));
+
+    return ItemSequence_t(new SingletonItemSequence(
+        lFactory->createJSONObject(lJSONObject)));
+  }
 
-    char lBuf[ZORBA_ARCHIVE_MAX_READ_BUF];
+  void
+  BenchmarkFunction::run(
+      const ArchiveOptions& aOptions,
+      const std::vector<ArchiveEntry>& aEntries,
+      const std::vector<zorba::Item>& aContents,
+      Result& aResult)
+  {
+    double lStart = getTime();
 
-    // read entire entry into a string
-    while (true)
+    ArchiveCompressor lArchive;
+    lArchive.open(aOptions);
+    for (size_t i = 0; i < aEntries.size(); ++i)
     {
-      int s = archive_read_data(
-          theArchive, &lBuf, ZORBA_ARCHIVE_MAX_READ_BUF);
+      lArchive.compress(aEntries[i], aContents[i]);
+    }
+    lArchive.close();
 
-      if (s == 0) break;
+    std::auto_ptr<std::stringstream> lStream(lArchive.getResultStream());
+    std::string lData = lStream->str();
+    aResult.theCompressTime = getTime() - lStart;
+    aResult.theCompressedSize = lData.size();
+    aResult.theDictionary = false;
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+    aResult.theDictionary
+      = ZstdDictionaryDecoder::hasDictionary(lData.data(), lData.size());
+#endif
 
-      if (s < 0)
-        throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+    lStart = getTime();
 
-      lResult.append(lBuf, s);
-    }
+    struct archive* lReader = archive_read_new();
+    if (!lReader)
+      throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
 
-    if (transcode::is_necessary(theEncoding.c_str()))
+    ArchiveFunction::openReader(lReader, lData.data(), lData.size());
+
+    std::string lContent;
+    int lErr;
+    struct archive_entry* lEntry;
+    while ((lErr = archive_read_next_header(lReader, &lEntry)) == ARCHIVE_OK)
     {
-      zorba::String lTranscodedString;
-      transcode::stream<std::istringstream> lTranscoder(
-          theEncoding.c_str(),
-          lResult.c_str()
-        );
-      char buf[1024];
-      while (lTranscoder.good())
+      lContent.clear();
+      if (!appendEntryData(lReader, lEntry, lContent))
       {
-        lTranscoder.read(buf, 1024);
-        lTranscodedString.append(buf, lTranscoder.gcount());
+        ArchiveFunction::checkForError(ARCHIVE_FATAL, 0, lReader);
       }
-      aRes = theFactory->createString(lTranscodedString);
     }
-    else
+    if (lErr != ARCHIVE_EOF)
     {
-      aRes = theFactory->createString(lResult);
+      ArchiveFunction::checkForError(lErr, 0, lReader);
     }
+    lErr = archive_read_finish(lReader);
+    ArchiveFunction::checkForError(lErr, 0, lReader);
 
-    return true;
+    aResult.theExtractTime = getTime() - lStart;
+  }
+
+  zorba::Item
+  BenchmarkFunction::createResult(
+      const ArchiveOptions& aOptions,
+      const Result& aResult,
+      uint64_t aSize)
+  {
+    zorba::ItemFactory* lFactory = ArchiveModule::getItemFactory();
+
+    // times below the resolution of the clock count as one tick
+    double lCompressTime = std::max(aResult.theCompressTime, 0.001);
+    double lExtractTime = std::max(aResult.theExtractTime, 0.001);
+
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
+        lFactory->createString(aOptions.getFormat())));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
+        lFactory->createString(aOptions.getCompression())));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("dictionary"),
+        lFactory->createBoolean(aResult.theDictionary)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("compressed-size"),
+        lFactory->createInteger(aResult.theCompressedSize)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("ratio"),
+        lFactory->createDouble(aResult.theCompressedSize
+          ? static_cast<double>(aSize) / aResult.theCompressedSize
+          : 0)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("compress-time"),
+        lFactory->createDouble(aResult.theCompressTime)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("extract-time"),
+        lFactory->createDouble(aResult.theExtractTime)));
+    // MB (10^6 bytes) of entry data per second
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("compress-throughput"),
+        lFactory->createDouble(aSize / lCompressTime / 1000000)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("extract-throughput"),
+        lFactory->createDouble(aSize / lExtractTime / 1000000)));
+    return lFactory->createJSONObject(lJSONObject);
+  }
+
+  double
+  BenchmarkFunction::getTime()
+  {
+#if defined (WIN32)
+    struct _timeb lTime;
+    _ftime_s(&lTime);
+    return lTime.time + lTime.millitm / 1000.0;
+#else
+    struct timeval lTime;
+    gettimeofday(&lTime, 0);
+    return lTime.tv_sec + lTime.tv_usec / 1000000.0;
+#endif
+  }
+
+  zorba::ItemSequence_t
+    CloseFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    // not getOneItem because closing twice is fine
+    Item lHandleItem;
+    Iterator_t lIter = aArgs[0]->getIterator();
+    lIter->open();
+    lIter->next(lHandleItem);
+    lIter->close();
+
+    ArchiveHandle* lHandle = ArchiveHandle::get(lHandleItem);
+    if (!lHandle)
+    {
+      throwError(ERROR_INVALID_HANDLE, "archive is not a handle returned by a:open");
+    }
+    lHandle->close();
+
+    return ItemSequence_t(new EmptySequence());
   }
 
 /*******************************************************************************
  ******************************************************************************/
   zorba::ItemSequence_t
-    ExtractBinaryFunction::evaluate(
+    SetCacheBudgetFunction::evaluate(
       const Arguments_t& aArgs,
       const zorba::StaticContext* aSctx,
-      const zorba::DynamicContext* aDctx) const 
+      const zorba::DynamicContext* aDctx) const
   {
-    Item lArchive = getOneItem(aArgs, 0);
+    ContentCache::getInstance().setBudget(getOneItem(aArgs, 0).getLongValue());
 
-    // return all entries if no second arg is given
-    bool lReturnAll = aArgs.size() == 1;
+    return ItemSequence_t(new EmptySequence());
+  }
 
-    std::auto_ptr<ExtractItemSequence> lSeq(
-        new ExtractBinaryItemSequence(lArchive, lReturnAll));
+  zorba::ItemSequence_t
+    CacheStatisticsFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    ContentCache::Statistics lStats;
+    ContentCache::getInstance().getStatistics(lStats);
+
+    zorba::ItemFactory* lFactory = theModule->getItemFactory();
+    std::vector<std::pair<zorba::Item, zorba::Item> > lJSONObject;
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("hits"),
+        lFactory->createInteger(lStats.theHits)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("misses"),
+        lFactory->createInteger(lStats.theMisses)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("evictions"),
+        lFactory->createInteger(lStats.theEvictions)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("bytes"),
+        lFactory->createInteger(lStats.theBytes)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("elements"),
+        lFactory->createInteger(lStats.theElements)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("budget"),
+        lFactory->createInteger(lStats.theBudget)));
+    lJSONObject.push_back(std::pair<zorba::Item, zorba::Item>(
+        lFactory->createString("digested-bytes"),
+        lFactory->createInteger(lStats.theDigestedBytes)));
+
+    return ItemSequence_t(new SingletonItemSequence(
+        lFactory->createJSONObject(lJSONObject)));
+  }
 
-    // get the names of all entries that should be retruned
-    if (aArgs.size() > 1)
-    {
-      ExtractFunction::ExtractItemSequence::EntryNameSet& lSet
-        = lSeq->getNameSet();
+/*******************************************************************************
+ ******************************************************************************/
+  zorba::ItemSequence_t
+    SetLimitsFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    Item lOptionsItem = getOneItem(aArgs, 0);
 
-      zorba::Item lItem;
-      Iterator_t lIter = aArgs[1]->getIterator();
-      lIter->open();
-      while (lIter->next(lItem))
-      {
-        lSet.insert(lItem.getStringValue().str());
-      }
+    ArchiveOptions lOptions;
+    lOptions.setValues(lOptionsItem);
+    ResourceGuard::setDefaults(lOptions.getLimits());
 
-      lIter->close();
-    }
+    return ItemSequence_t(new EmptySequence());
+  }
 
-    return ItemSequence_t(lSeq.release());
+  zorba::ItemSequence_t
+    SetReadAheadFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
+  {
+    long long lBuffers = getOneItem(aArgs, 0).getLongValue();
+
+    // one buffer is held by the reader, another one is filled meanwhile
+    if (lBuffers == 1) lBuffers = 2;
+    ReadAhead::setDepth(static_cast<size_t>(lBuffers));
+
+    return ItemSequence_t(new EmptySequence());
   }
 
-  bool
-  ExtractBinaryFunction::ExtractBinaryItemSequence::ExtractBinaryIterator::next(
-      zorba::Item& aRes)
+  zorba::ItemSequence_t
+    SetPipelineFunction::evaluate(
+      const Arguments_t& aArgs,
+      const zorba::StaticContext* aSctx,
+      const zorba::DynamicContext* aDctx) const
   {
-    struct archive_entry *lEntry = lookForHeader(true);
+    EntryPipeline::setDepth(
+        static_cast<size_t>(getOneItem(aArgs, 0).getLongValue()));
 
-    //NULL is EOF
-    if (!lEntry)
-      return false;
-    
-    std::vector<unsigned char> lResult;
+    return ItemSequence_t(new EmptySequence());
+  }
 
-    // reserve some space if we know the decompressed size
-    if (archive_entry_size_is_set(lEntry))
+/*******************************************************************************
+ ******************************************************************************/
+  class ArchiveHandleStream : public std::istream
+  {
+    protected:
+      ArchiveHandle* theHandle;
+
+    public:
+      ArchiveHandleStream(ArchiveHandle* aHandle)
+        : std::istream(aHandle), theHandle(aHandle) {}
+
+      virtual ~ArchiveHandleStream() { delete theHandle; }
+  };
+
+  ArchiveHandle::ArchiveHandle(zorba::Item& aArchive, GzipIndex* aGzipIndex)
+    : theData(0),
+      theSize(0),
+      theIsZip(false),
+      theGzipIndex(aGzipIndex),
+      theUseCount(0),
+      theHasEntries(false),
+      theClosed(false)
+  {
+    // the destructor isn't called if construction fails, i.e. the index
+    // (owned from here on) and the readers are released by close()
+    try
     {
-      long long lSize = archive_entry_size(lEntry);
-      lResult.reserve(lSize);
+      init(aArchive);
+    }
+    catch (...)
+    {
+      close();
+      throw;
     }
+  }
 
-    std::vector<unsigned char> lBuf;
-    lBuf.resize(ZORBA_ARCHIVE_MAX_READ_BUF);
+  void
+  ArchiveHandle::init(zorba::Item& aArchive)
+  {
+    zorba::String lBuffer;
+    ArchiveFunction::getArchiveData(aArchive, lBuffer, theData, theSize);
 
-    // read entire entry into a string
-    while (true)
+    // keep the decoded bytes such that they can be accessed without copy
+    if (aArchive.isStreamable() || aArchive.isEncoded())
+    {
+      theArchive = ArchiveModule::getItemFactory()->createBase64Binary(
+          theData, theSize, false);
+    }
+    else
     {
-      int s = archive_read_data(
-          theArchive, &lBuf[0], ZORBA_ARCHIVE_MAX_READ_BUF);
+      theArchive = aArchive;
+    }
+    theData = theArchive.getBase64BinaryValue(theSize);
 
-      if (s == 0) break;
+    char* lBegin = const_cast<char*>(theData);
+    setg(lBegin, lBegin, lBegin + theSize);
 
-      if (s < 0)
-        throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
+    if (theGzipIndex)
+    {
+      if (!theGzipIndex->matches(theData, theSize))
+      {
+        ArchiveFunction::throwError(ERROR_INVALID_INDEX,
+            "index has been built for another archive");
+      }
+      const std::vector<GzipIndex::Entry>& lEntries
+        = theGzipIndex->getEntries();
+      for (size_t i = 0; i < lEntries.size(); ++i)
+      {
+        theIndex.insert(NameIndex::value_type(lEntries[i].theName, i));
+      }
+      return;
+    }
+#endif
 
-      lResult.insert(lResult.end(), lBuf.begin(), lBuf.begin() + s);
+    if (ArchiveFunction::parseZip(theDirectory, theData, theSize))
+    {
+      theIsZip = true;
+      for (size_t i = 0; i < theDirectory.size(); ++i)
+      {
+        theIndex.insert(NameIndex::value_type(
+            theDirectory.getEntry(i).theName, i));
+      }
+      return;
     }
 
-    aRes = theFactory->createBase64Binary(reinterpret_cast<char const*>(&lResult[0]), lResult.size(), false);
+    // index the headers; the reader stays open for the first extraction
+    theReaders.push_back(Reader());
+    Reader& lReader = theReaders.back();
+    openReader(lReader);
 
-    return true;
+    struct archive_entry* lEntry;
+    int lErr;
+    while ((lErr = archive_read_next_header(lReader.theArchive, &lEntry))
+           == ARCHIVE_OK)
+    {
+      theIndex.insert(NameIndex::value_type(
+          archive_entry_pathname(lEntry), lReader.theNext++));
+    }
+    if (lErr != ARCHIVE_EOF)
+    {
+      ArchiveFunction::checkForError(lErr, 0, lReader.theArchive);
+    }
   }
 
+  ArchiveHandle::~ArchiveHandle()
+  {
+    close();
+  }
 
-/*******************************************************************************
- ******************************************************************************/
-  zorba::ItemSequence_t
-    OptionsFunction::evaluate(
-      const Arguments_t& aArgs,
-      const zorba::StaticContext* aSctx,
-      const zorba::DynamicContext* aDctx) const 
+  ArchiveHandle*
+  ArchiveHandle::get(zorba::Item& aArchive)
   {
-    Item lArchive = getOneItem(aArgs, 0);
+    if (aArchive.isNull() || !aArchive.isStreamable()) return 0;
 
-    return ItemSequence_t(new OptionsItemSequence(lArchive));
+    return dynamic_cast<ArchiveHandle*>(aArchive.getStream().rdbuf());
   }
 
-  OptionsFunction::OptionsItemSequence::OptionsIterator::OptionsIterator(Item &aArchive)
-      :ArchiveIterator(aArchive)
+  zorba::Item
+  ArchiveHandle::createItem(ArchiveHandle* aHandle)
   {
+    std::istream* lStream = new ArchiveHandleStream(aHandle);
+    return ArchiveModule::getItemFactory()->createStreamableBase64Binary(
+        *lStream,
+        &(ArchiveFunction::ArchiveCompressor::releaseStream),
+        true, // seekable
+        false // not encoded
+        );
   }
 
-  bool
-  OptionsFunction::OptionsItemSequence::OptionsIterator::next(
-      zorba::Item& aRes)
+  void
+  ArchiveHandle::close()
   {
-    if (lExhausted) return false;
-
-    lExhausted = true;
-
-    struct archive_entry *lEntry;
-    typedef std::pair<zorba::Item, zorba::Item> tArrElemt;
-    tArrElemt lElemt;
-    std::vector<tArrElemt> lJSONObject;
+    for (size_t i = 0; i < theReaders.size(); ++i)
+    {
+      archive_read_finish(theReaders[i].theArchive);
+    }
+    theReaders.clear();
+    theIndex.clear();
+    delete theGzipIndex;
+    theGzipIndex = 0;
+    theEntries.clear();
+    theCacheKey.clear();
+    theDirectory = ZipDirectory();
+    theArchive = zorba::Item();
+    theData = 0;
+    theSize = 0;
+    setg(0, 0, 0);
+    theClosed = true;
+  }
 
-    // to get the format, we need to peek into the first header
-    int lErr = archive_read_next_header(theArchive, &lEntry);
+  void
+  ArchiveHandle::getPositions(
+      const std::set<std::string>& aNames,
+      std::vector<size_t>& aPositions) const
+  {
+    for (std::set<std::string>::const_iterator lName = aNames.begin();
+         lName != aNames.end(); ++lName)
+    {
+      std::pair<NameIndex::const_iterator, NameIndex::const_iterator> lRange
+        = theIndex.equal_range(*lName);
+      for (NameIndex::const_iterator lIter = lRange.first;
+           lIter != lRange.second; ++lIter)
+      {
+        aPositions.push_back(lIter->second);
+      }
+    }
+    std::sort(aPositions.begin(), aPositions.end());
+  }
 
-    if (lErr != ARCHIVE_OK && lErr != ARCHIVE_EOF)
+  void
+  ArchiveHandle::readEntry(size_t aPosition, std::string& aResult)
+  {
+    if (theIsZip)
     {
-      ArchiveFunction::checkForError(lErr, 0, theArchive);
+      readZipEntry(aPosition, aResult);
+      return;
     }
 
-    std::string lFormat =
-      ArchiveFunction::formatName(archive_format(theArchive));
-    std::string lCompression =
-      ArchiveFunction::compressionName(archive_compression(theArchive));
-
-    if (lFormat == "ZIP")
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
+    // sparse entries are left to libarchive
+    if (theGzipIndex
+        && theGzipIndex->getEntries()[aPosition].theType
+           != TarScanner::TYPE_SPARSE)
     {
-      lCompression = "DEFLATE";
+      readIndexedEntry(aPosition, aResult);
+      return;
     }
+#endif
 
-    lElemt = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::FORMAT),
-                                                      theFactory->createString(lFormat));
-    lJSONObject.push_back(lElemt);
-
-    lElemt = std::make_pair<zorba::Item, zorba::Item>(ArchiveModule::getGlobalItems(ArchiveModule::COMPRESSION),
-                                                      theFactory->createString(lCompression));
-    lJSONObject.push_back(lElemt);
+    Reader& lReader = getReader(aPosition);
+    struct archive_entry* lEntry = 0;
+    while (lReader.theNext <= aPosition)
+    {
+      int lErr = archive_read_next_header(lReader.theArchive, &lEntry);
+      if (lErr == ARCHIVE_EOF)
+      {
+        ArchiveFunction::throwError(
+            ERROR_CORRUPTED_ARCHIVE, "archive changed since it was opened");
+      }
+      ArchiveFunction::checkForError(lErr, 0, lReader.theArchive);
+      ++lReader.theNext;
+    }
 
-    aRes = theFactory->createJSONObject(lJSONObject);
+    // the data of a hardlink is stored with the (preceding) target
+    const char* lTarget = archive_entry_hardlink(lEntry);
+    if (lTarget && archive_entry_size(lEntry) == 0)
+    {
+      readEntry(getLinkTarget(lTarget, aPosition), aResult);
+      return;
+    }
 
-    return true;
+    readData(lReader.theArchive, lEntry, aResult);
   }
 
-/*******************************************************************************************
- *******************************************************************************************/
-  bool
-  UpdateFunction::UpdateItemSequence::UpdateIterator::next(
-    zorba::Item& aRes)
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
+  void
+  ArchiveHandle::readIndexedEntry(size_t aPosition, std::string& aResult)
   {
-    struct archive_entry *lEntry = lookForHeader(false, &theOptions);
-    
-    //NULL is EOF
-    if (!lEntry)
-      return false;
-
-    //form an ArchiveEntry with the entry
-    theEntry.setValues(lEntry);
+    const GzipIndex::Entry& lEntry = theGzipIndex->getEntries()[aPosition];
+    if (lEntry.isHardlink() && lEntry.theSize == 0)
+    {
+      readEntry(getLinkTarget(lEntry.theLink, aPosition), aResult);
+      return;
+    }
+    if (lEntry.isDirectory()) return;
 
-    if(archive_entry_filetype(lEntry) == AE_IFREG){
-      //read entry content
-      std::vector<unsigned char> lResult;
+    ResourceGuard lGuard;
+    if (!lGuard.startEntry(lEntry.theName.c_str())
+        || !lGuard.addData(lEntry.theSize, 0))
+    {
+      ArchiveFunction::checkGuard(lGuard);
+    }
+    if (!theGzipIndex->read(
+          theData, theSize, lEntry.theOffset, lEntry.theSize, aResult))
+    {
+      std::ostringstream lMsg;
+      lMsg << lEntry.theName << ": " << theGzipIndex->getError();
+      ArchiveFunction::throwError(ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+    }
+  }
+#endif
 
-      if (archive_entry_size_is_set(lEntry))
+  size_t
+  ArchiveHandle::getLinkTarget(
+      const std::string& aTarget,
+      size_t aPosition) const
+  {
+    std::pair<NameIndex::const_iterator, NameIndex::const_iterator> lRange
+      = theIndex.equal_range(aTarget);
+    long lTargetPos = -1;
+    for (NameIndex::const_iterator lIter = lRange.first;
+         lIter != lRange.second; ++lIter)
+    {
+      if (lIter->second < aPosition && long(lIter->second) > lTargetPos)
       {
-        long long lSize = archive_entry_size(lEntry);
-        lResult.reserve(lSize);
+        lTargetPos = lIter->second;
       }
+    }
+    if (lTargetPos < 0)
+    {
+      std::ostringstream lMsg;
+      lMsg << aTarget << ": hardlink target not found";
+      ArchiveFunction::throwError(
+          ERROR_CORRUPTED_ARCHIVE, lMsg.str().c_str());
+    }
+    return lTargetPos;
+  }
 
-      std::vector<unsigned char> lBuf;
-      lBuf.resize(ZORBA_ARCHIVE_MAX_READ_BUF);
+  const std::string&
+  ArchiveHandle::getCacheKey()
+  {
+    if (theCacheKey.empty())
+    {
+      theCacheKey = theIsZip
+        ? ContentCache::computeKey(theDirectory)
+        : ContentCache::getInstance().computeKey(theData, theSize);
+    }
+    return theCacheKey;
+  }
 
-      //read entry into string
-      while (true)
+  const std::vector<zorba::Item>&
+  ArchiveHandle::getEntries()
+  {
+    if (!theHasEntries && theGzipIndex)
+    {
+      ItemFactory* lFactory = ArchiveModule::getItemFactory();
+      const std::vector<GzipIndex::Entry>& lEntries
+        = theGzipIndex->getEntries();
+      for (size_t i = 0; i < lEntries.size(); ++i)
       {
-        int s = archive_read_data(
-          theArchive, &lBuf[0], ZORBA_ARCHIVE_MAX_READ_BUF);
-     
-        if (s == 0) break;
-
-        if (s < 0)
-          throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
-
-        lResult.insert(lResult.end(), lBuf.begin(), lBuf.begin() + s);
+        const GzipIndex::Entry& lEntry = lEntries[i];
+        time_t lTime = static_cast<time_t>(lEntry.theMTime);
+        std::vector<std::pair<zorba::Item, zorba::Item> > lObjectArray;
+        lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+              ArchiveModule::getGlobalItems(ArchiveModule::NAME),
+              lFactory->createString(lEntry.theName)));
+        lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+              ArchiveModule::getGlobalItems(ArchiveModule::SIZE),
+              lFactory->createInteger(static_cast<long long>(lEntry.theSize))));
+        lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+              ArchiveModule::getGlobalItems(ArchiveModule::LAST_MODIFIED),
+              ArchiveModule::createDateTimeItem(lTime)));
+        lObjectArray.push_back(std::pair<zorba::Item, zorba::Item>(
+              ArchiveModule::getGlobalItems(ArchiveModule::TYPE),
+              lFactory->createString(
+                lEntry.isDirectory() ? "directory"
+                : lEntry.isRegular() ? "regular" : "")));
+        theEntries.push_back(lFactory->createJSONObject(lObjectArray));
       }
-
-      aRes = theFactory->createBase64Binary(reinterpret_cast<char const*>(&lResult[0]), lResult.size(), false);
+      theHasEntries = true;
     }
-
-    return true;
+    if (!theHasEntries)
+    {
+      ItemSequence_t lSeq(
+          new EntriesFunction::EntriesItemSequence(theArchive));
+      Iterator_t lIter = lSeq->getIterator();
+      zorba::Item lEntry;
+      lIter->open();
+      while (lIter->next(lEntry))
+      {
+        theEntries.push_back(lEntry);
+      }
+      lIter->close();
+      theHasEntries = true;
+    }
+    return theEntries;
   }
 
-  zorba::ItemSequence_t
-    UpdateFunction::evaluate(
-      const Arguments_t& aArgs,
-      const zorba::StaticContext* aSctx,
-      const zorba::DynamicContext* aDctx) const 
+  void
+  ArchiveHandle::readZipEntry(size_t aPosition, std::string& aResult)
   {
-    //Base64 Binary of the Archive
-    Item lArchive = getOneItem(aArgs, 0);
-
-    //Initialize an Update Iterator with the Archive recived from the function
-    std::auto_ptr<UpdateItemSequence> lSeq(
-    new UpdateItemSequence(lArchive, false));
+    const ZipDirectory::Entry& lEntry = theDirectory.getEntry(aPosition);
+    if (lEntry.isDirectory()) return;
 
-    std::vector<ArchiveEntry> lEntries;
+    ResourceGuard lGuard;
+    lGuard.startEntry(lEntry.theName.c_str());
+    aResult.reserve(aResult.size()
+        + lGuard.getReserve(static_cast<int64_t>(lEntry.theUncompressedSize)));
 
-    //prepare list of entries to be updated into the Archive
+    std::string lError;
+    if (!ArchiveFunction::readZipEntry(theDirectory, aPosition,
+            &ArchiveHandle::appendBlock, &aResult, lError, &lGuard))
     {
-      Iterator_t lEntriesIter = aArgs[1]->getIterator();
+      ArchiveFunction::checkGuard(lGuard);
+      ArchiveFunction::throwError(ERROR_CORRUPTED_ARCHIVE, lError.c_str());
+    }
+  }
 
-      zorba::Item lEntry;
-      lEntriesIter->open();
-      ExtractFunction::ExtractItemSequence::EntryNameSet& lNameSet 
-          = lSeq->getNameSet();
-      while (lEntriesIter->next(lEntry))
+  ArchiveHandle::Reader&
+  ArchiveHandle::getReader(size_t aPosition)
+  {
+    // the reader closest before the entry
+    long lBest = -1;
+    for (size_t i = 0; i < theReaders.size(); ++i)
+    {
+      if (theReaders[i].theNext <= aPosition
+          && (lBest < 0 || theReaders[i].theNext > theReaders[lBest].theNext))
       {
-        lEntries.resize(lEntries.size() + 1);
-        lEntries.back().setValues(lEntry);
-        lNameSet.insert(lEntries.back().getEntryPath().str());
+        lBest = i;
       }
-      lEntriesIter->close();
-    } 
-
-    //get the iterator of Files to include in the archive
-    zorba::Iterator_t lFileIter = aArgs[2]->getIterator();
-
-    //Prepare new archive, for compressing the Files form the original 
-    //updated with the new Files specified
-    ArchiveCompressor lResArchive;
-    ArchiveOptions lOptions;
+    }
 
-    Item lItem;
-    Iterator_t lSeqIter = lSeq->getIterator();
-    
-    //read first header and file of the archive so we can get the options before creating 
-    //the new archive.
-    lSeqIter->open();
-    lSeqIter->next(lItem);
-    //set the options of the archive
-    lOptions = lSeq->getOptions();
-    //create new archive with the options read
-    lResArchive.open(lOptions);
-    if (!lItem.isNull())
+    if (lBest < 0)
     {
-      do 
+      if (theReaders.size() < ZORBA_ARCHIVE_HANDLE_READERS)
       {
-        //add and compress the files of the old archive into the new archive.
-        lResArchive.compress(lSeq->getEntry(), lItem);
-      } while (lSeqIter->next(lItem));
+        theReaders.push_back(Reader());
+        lBest = theReaders.size() - 1;
+      }
+      else
+      {
+        // restart the least recently used one
+        lBest = 0;
+        for (size_t i = 1; i < theReaders.size(); ++i)
+        {
+          if (theReaders[i].theLastUse < theReaders[lBest].theLastUse)
+          {
+            lBest = i;
+          }
+        }
+        archive_read_finish(theReaders[lBest].theArchive);
+      }
+      openReader(theReaders[lBest]);
     }
-    lSeqIter->close();
-
-    //add and compress the new file sspecified as a parameter for the function.
-    lResArchive.compress(lEntries, lFileIter);
-    lResArchive.close();
 
-    Item lRes = theModule->getItemFactory()->
-      createStreamableBase64Binary(
-      *lResArchive.getResultStream(),
-      &(ArchiveFunction::ArchiveCompressor::releaseStream),
-      true, // seekable
-      false // no encoded
-      );
-    return ItemSequence_t(new SingletonItemSequence(lRes));
+    theReaders[lBest].theLastUse = ++theUseCount;
+    return theReaders[lBest];
   }
 
-/*******************************************************************************************
- *******************************************************************************************/
-  zorba::ItemSequence_t
-    DeleteFunction::evaluate(
-      const Arguments_t& aArgs,
-      const zorba::StaticContext* aSctx,
-      const zorba::DynamicContext* aDctx) const 
+  void
+  ArchiveHandle::openReader(Reader& aReader)
   {
-    //Base64 Binary of the Archive
-    Item lArchive = getOneItem(aArgs, 0);
+    aReader.theArchive = archive_read_new();
+    aReader.theNext = 0;
+    aReader.theLastUse = ++theUseCount;
 
-    std::auto_ptr<DeleteItemSequence> lSeq(
-      new DeleteItemSequence(lArchive));
+    if (!aReader.theArchive)
+      ArchiveFunction::throwError(
+          ERROR_CORRUPTED_ARCHIVE, "internal error (couldn't create archive)");
 
-    //set list of files to delete from the archive.
-    zorba::Item lItem;
-    Iterator_t lIter = aArgs[1]->getIterator();
-    lIter->open();
-    ExtractFunction::ExtractItemSequence::EntryNameSet& lNameSet =
-      lSeq->getNameSet();
-    while (lIter->next(lItem))
+    ArchiveFunction::openReader(aReader.theArchive, theData, theSize);
+  }
+
+  void
+  ArchiveHandle::readData(
+      struct archive* aArchive,
+      struct archive_entry* aEntry,
+      std::string& aResult)
+  {
+    ResourceGuard lGuard;
+    lGuard.startEntry(archive_entry_pathname(aEntry));
+    if (!ArchiveFunction::appendEntryData(aArchive, aEntry, aResult, &lGuard))
     {
-      lNameSet.insert(lItem.getStringValue().str());
+      ArchiveFunction::checkGuard(lGuard);
+      ArchiveFunction::throwError(
+          ERROR_CORRUPTED_ARCHIVE, archive_error_string(aArchive));
     }
-    lIter->close();
+  }
 
-    //prepare new archive
-    ArchiveCompressor lResArchive;
-    ArchiveOptions lOptions;
+  bool
+  ArchiveHandle::appendBlock(void* aResult, const char* aData, size_t aLen)
+  {
+    static_cast<std::string*>(aResult)->append(aData, aLen);
+    return true;
+  }
 
-    Item lContent;
-    Iterator_t lSeqIter = lSeq->getIterator();
-    
-    //read first header and file of the archive so we can get the options before creating 
-    //the new archive.
-    lSeqIter->open();
-    lSeqIter->next(lContent);
-    //set the options of the archive
-    lOptions = lSeq->getOptions();
-    //create new archive with the options read
-    lResArchive.open(lOptions);
-    if (!lContent.isNull())
+  ArchiveHandle::pos_type
+  ArchiveHandle::seekoff(
+      off_type aOff,
+      std::ios_base::seekdir aDir,
+      std::ios_base::openmode)
+  {
+    off_type lPos;
+    switch (aDir)
     {
-      do 
-      {
-        //add and compress the files of the old archive into the new archive.
-        lResArchive.compress(lSeq->getEntry(), lContent);
-      } while (lSeqIter->next(lContent));
+      case std::ios_base::beg: lPos = aOff; break;
+      case std::ios_base::cur: lPos = (gptr() - eback()) + aOff; break;
+      default: lPos = static_cast<off_type>(theSize) + aOff; break;
+    }
+    if (lPos < 0 || lPos > static_cast<off_type>(theSize))
+    {
+      return pos_type(off_type(-1));
     }
-    lSeqIter->close();
-    
-    lResArchive.close();
 
-    zorba::Item lRes = theModule->getItemFactory()->
-      createStreamableBase64Binary(
-        *lResArchive.getResultStream(),
+    setg(eback(), eback() + lPos, egptr());
+    return pos_type(lPos);
+  }
+
+  ArchiveHandle::pos_type
+  ArchiveHandle::seekpos(pos_type aPos, std::ios_base::openmode aMode)
+  {
+    return seekoff(off_type(aPos), std::ios_base::beg, aMode);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  class ArchiveViewStream : public std::istream
+  {
+    protected:
+      ArchiveView* theView;
+
+    public:
+      ArchiveViewStream(ArchiveView* aView)
+        : std::istream(aView), theView(aView) {}
+
+      virtual ~ArchiveViewStream() { delete theView; }
+  };
+
+  ArchiveView::ArchiveView(
+      const zorba::Item& aArchive,
+      const char* aData,
+      size_t aSize)
+    : theArchive(aArchive)
+  {
+    char* lBegin = const_cast<char*>(aData);
+    setg(lBegin, lBegin, lBegin + aSize);
+  }
+
+  zorba::Item
+  ArchiveView::createItem(
+      const zorba::Item& aArchive,
+      const char* aData,
+      size_t aSize)
+  {
+    std::istream* lStream
+      = new ArchiveViewStream(new ArchiveView(aArchive, aData, aSize));
+    return ArchiveModule::getItemFactory()->createStreamableBase64Binary(
+        *lStream,
         &(ArchiveFunction::ArchiveCompressor::releaseStream),
         true, // seekable
         false // not encoded
         );
-    return ItemSequence_t(new SingletonItemSequence(lRes));
   }
 
-  bool
-  DeleteFunction::DeleteItemSequence::DeleteIterator::next(
-      zorba::Item& aRes)
+  ArchiveView::pos_type
+  ArchiveView::seekoff(
+      off_type aOff,
+      std::ios_base::seekdir aDir,
+      std::ios_base::openmode)
   {
-    struct archive_entry *lEntry = lookForHeader(false, &theOptions);
-    
-    //NULL is EOF
-    if (!lEntry)
-      return false;
-    
-    //form an ArchiveEntry with the entry
-    theEntry.setValues(lEntry);
-
-    if(archive_entry_filetype(lEntry) == AE_IFREG){
-    
-      //read entry content
-      std::vector<unsigned char> lResult;
-
-      if (archive_entry_size_is_set(lEntry))
-      {
-        long long lSize = archive_entry_size(lEntry);
-        lResult.reserve(lSize);
-      }
-
-      std::vector<unsigned char> lBuf;
-      lBuf.resize(ZORBA_ARCHIVE_MAX_READ_BUF);
+    off_type lSize = egptr() - eback();
+    off_type lPos;
+    switch (aDir)
+    {
+      case std::ios_base::beg: lPos = aOff; break;
+      case std::ios_base::cur: lPos = (gptr() - eback()) + aOff; break;
+      default: lPos = lSize + aOff; break;
+    }
+    if (lPos < 0 || lPos > lSize)
+    {
+      return pos_type(off_type(-1));
+    }
 
-      //read entry into string
-      while (true)
-      {
-        int s = archive_read_data(
-          theArchive, &lBuf[0], ZORBA_ARCHIVE_MAX_READ_BUF);
-     
-        if (s == 0) break;
+    setg(eback(), eback() + lPos, egptr());
+    return pos_type(lPos);
+  }
 
-        if (s < 0)
-          throwError(ERROR_CORRUPTED_ARCHIVE, archive_error_string(theArchive));
+  ArchiveView::pos_type
+  ArchiveView::seekpos(pos_type aPos, std::ios_base::openmode aMode)
+  {
+    return seekoff(off_type(aPos), std::ios_base::beg, aMode);
+  }
 
-        lResult.insert(lResult.end(), lBuf.begin(), lBuf.begin() + s);
-      }
+/*******************************************************************************
+ ******************************************************************************/
+  void
+  ConcatItemSequence::ConcatIterator::open()
+  {
+    theFirst->open();
+    thePos = 0;
+    theOpen = true;
+  }
 
-      aRes = theFactory->createBase64Binary(reinterpret_cast<char const*>(&lResult[0]), lResult.size(), false);
+  bool
+  ConcatItemSequence::ConcatIterator::next(zorba::Item& aItem)
+  {
+    // the first sequence is exhausted once items of the vector are returned
+    if (thePos == 0 && theFirst->next(aItem))
+    {
+      return true;
+    }
+    if (thePos < theRest.size())
+    {
+      aItem = theRest[thePos++];
+      return true;
     }
-    // else? if the entry represents a directory what are we
-    // going to return??
-    // answer: nothing, the directory will have no contents at all
+    thePos = theRest.size() + 1;
+    return false;
+  }
 
-    return true;
+  void
+  ConcatItemSequence::ConcatIterator::close()
+  {
+    theFirst->close();
+    theOpen = false;
   }
 
 } /* namespace zorba */ } /* namespace archive*/
@@ -19,6 +19,7 @@
 #define ORG_EXPATH_NS_ARCHIVE_H_
 
 #include <map>
+#include <memory>
 #include <set>
 
 #include <zorba/zorba.h>
@@ -27,8 +28,27 @@
 #include <zorba/function.h>
 #include <vector>
 
+#include "content_cache.h"
+#include "digest.h"
+#include "entry_pipeline.h"
+#include "gzip_index.h"
+#include "read_ahead.h"
+#include "resource_guard.h"
+#include "stream_search.h"
+#include "zip_format.h"
+#include "zstd_seekable.h"
+
 #define ZORBA_ARCHIVE_MAX_READ_BUF 2048
 
+// size of the buffers filled by the read-ahead thread (see a:set-read-ahead)
+#define ZORBA_ARCHIVE_READ_AHEAD_BUF 262144
+
+// readers kept open by an archive handle (see a:open)
+#define ZORBA_ARCHIVE_HANDLE_READERS 4
+
+// threads processing the entries of a ZIP archive in parallel (e.g. a:grep)
+#define ZORBA_ARCHIVE_WORKER_THREADS 4
+
 #define ZORBA_ARCHIVE_COMPRESSION_DEFLATE 50
 #define ZORBA_ARCHIVE_COMPRESSION_STORE   51
 
@@ -42,6 +62,10 @@ namespace zorba { namespace archive {
   typedef ssize_t _ssize_t;
 #endif
 
+  // a reader decompressing a zstd stream with dictionary itself (see
+  // ArchiveFunction::openDictionaryReader)
+  struct DictionarySource;
+
 /*******************************************************************************
  ******************************************************************************/
   class ArchiveModule : public ExternalModule {
@@ -80,6 +104,9 @@ namespace zorba { namespace archive {
           globalSizeKey = Zorba::getInstance(0)->getItemFactory()->createString("size");
           globalLastModifiedKey = Zorba::getInstance(0)->getItemFactory()->createString("last-modified");
           globalEncodingKey = Zorba::getInstance(0)->getItemFactory()->createString("encoding");
+
+          // make sure the cache exists before queries run concurrently
+          ContentCache::getInstance();
       }
 
       virtual ~ArchiveModule();
@@ -111,6 +138,20 @@ namespace zorba { namespace archive {
   };
 
 
+/*******************************************************************************
+ * Read-only stream buffer over memory that outlives it (e.g. the value of an
+ * item).
+ ******************************************************************************/
+  class MemoryBuffer : public std::streambuf
+  {
+    public:
+      MemoryBuffer(const char* aData, size_t aLen)
+      {
+        char* lData = const_cast<char*>(aData);
+        setg(lData, lData, lData + aLen);
+      }
+  };
+
 /*******************************************************************************
  ******************************************************************************/
   class ArchiveItemSequence : public ItemSequence
@@ -123,9 +164,16 @@ namespace zorba { namespace archive {
         bool          theSeekable;
         bool          theEnd;
         std::streampos thePos;
+        // size of the stream if it can be skipped by seeking, -1 otherwise
+        std::streamoff theSize;
+        // reads theStream on a background thread if enabled
+        ReadAhead*    theReadAhead;
 
         CallbackData()
-          : theStream(0), theSeekable(false), theEnd(false), thePos(0) {}
+          : theStream(0), theSeekable(false), theEnd(false), thePos(0),
+            theSize(-1), theReadAhead(0) {}
+
+        ~CallbackData() { delete theReadAhead; }
       };
 
     public:
@@ -141,11 +189,38 @@ namespace zorba { namespace archive {
           // needed if theArchiveItem is not streamable an needs to be decoded
           zorba::String   theDecodedData;
 
+          // with read-ahead, such an item is decoded on the background
+          // thread through a stream that isn't shared with other iterators
+          std::auto_ptr<MemoryBuffer> theEncodedBuffer;
+          std::auto_ptr<std::istream> theEncodedStream;
+
           zorba::ItemFactory* theFactory;
 
+          // entries that are skipped (e.g. deleted in an ArchiveOverlay)
+          const std::set<std::string>* theExcludedNames;
+
+          // limits on the entries and the data read (see a:set-limits)
+          ResourceGuard   theGuard;
+
+          // set if the archive is compressed with a zstd dictionary
+          DictionarySource* theDictionary;
+
         public:
           ArchiveIterator(zorba::Item& aArchive);
 
+          void
+          setExcludedNames(const std::set<std::string>& aNames)
+          {
+            theExcludedNames = &aNames;
+          }
+
+          bool
+          isExcluded(const char* aName) const
+          {
+            return theExcludedNames
+              && theExcludedNames->find(aName) != theExcludedNames->end();
+          }
+
           virtual ~ArchiveIterator() {}
 
           void
@@ -164,6 +239,8 @@ namespace zorba { namespace archive {
     protected:
       zorba::Item theArchive;
 
+      std::set<std::string> theExcludedNames;
+
     public:
       ArchiveItemSequence(zorba::Item& aArchive)
         : theArchive(aArchive)
@@ -171,6 +248,12 @@ namespace zorba { namespace archive {
 
       virtual ~ArchiveItemSequence() {}
 
+      std::set<std::string>&
+      getExcludedNames() { return theExcludedNames; }
+
+      void
+      setArchive(const zorba::Item& aArchive) { theArchive = aArchive; }
+
     protected:
 
       static _ssize_t  
@@ -182,11 +265,57 @@ namespace zorba { namespace archive {
 #else
       static off_t seekStream(struct archive *a, void *data, off_t request, int whence);
 #endif
+
+      // moves over entry data of seekable streams without reading it
+#ifdef WIN32
+      static __int64 skipStream(struct archive *a, void *data, __int64 request);
+#else
+      static off_t skipStream(struct archive *a, void *data, off_t request);
+#endif
       
 
   };
 
 
+/*******************************************************************************
+ * Reads the data of the entry a libarchive reader is positioned on as it is
+ * decompressed. Errors of the reader aren't thrown (the stream is usually
+ * read by a parser that would swallow them) but must be checked afterwards.
+ ******************************************************************************/
+  class ArchiveEntryBuffer : public std::streambuf
+  {
+    protected:
+      struct archive* theArchive;
+      // offset of the data following the current block within the entry
+      uint64_t        theOffset;
+      // zeros of a hole (sparse entries) to be returned before theBlock
+      uint64_t        theHole;
+      const char*     theBlock;
+      size_t          theBlockSize;
+      bool            theFailed;
+      // fails the buffer if a limit is exceeded
+      ResourceGuard*  theGuard;
+
+    public:
+      ArchiveEntryBuffer(struct archive* aArchive, ResourceGuard* aGuard = 0)
+        : theArchive(aArchive), theOffset(0), theHole(0), theBlock(0),
+          theBlockSize(0), theFailed(false), theGuard(aGuard) {}
+
+      bool
+      failed() const { return theFailed; }
+
+      /**
+       * Returns the next block of data (without copying it) instead of
+       * reading it through an istream. Returns false at the end.
+       */
+      bool
+      nextBlock(const char*& aData, size_t& aLen);
+
+    protected:
+      virtual int_type
+      underflow();
+  };
+
 /*******************************************************************************
  ******************************************************************************/
   class ArchiveFunction : public ContextualExternalFunction
@@ -201,6 +330,15 @@ namespace zorba { namespace archive {
         std::string theCompression;
         std::string theFormat;
         bool        theSkipExtraAttrs;
+        bool        theDedup;
+        // uncompressed frame size for ZSTD-SEEKABLE
+        uint64_t    theFrameSize;
+        // boundary of the data of STORE entries in ZIP archives (0 if none)
+        uint32_t    theAlignment;
+        // train a zstd dictionary from the entries (ZSTD-SEEKABLE)
+        bool        theDictionary;
+        // limits for reading archives (see a:set-limits)
+        ResourceGuard::Limits theLimits;
 
       public:
 
@@ -212,16 +350,83 @@ namespace zorba { namespace archive {
         const std::string&
         getFormat() const { return theFormat; }
 
+        // TAR or PAX
+        bool
+        isTarFormat() const { return theFormat == "TAR" || theFormat == "PAX"; }
+
+        // 7ZIP or XAR, i.e. entries are compressed by the format itself
+        // rather than by a filter for the whole archive
+        bool
+        hasEntryCompression() const
+        {
+          return theFormat == "7ZIP" || theFormat == "XAR";
+        }
+
+        /**
+         * Returns the libarchive option (e.g. "7zip:compression=lzma2")
+         * that selects the compression of a format with entry compression.
+         */
+        std::string
+        getEntryCompressionOption() const;
+
+        void
+        setCompression(const std::string& aCompression)
+        {
+          theCompression = aCompression;
+        }
+
+        void
+        setFormat(const std::string& aFormat) { theFormat = aFormat; }
+
         void
         setValues(Item&);
 
+        /**
+         * Takes format and compression from a reader. aDictionary tells
+         * if it has been opened by openDictionaryReader (libarchive only
+         * sees the decompressed archive then).
+         */
+        void
+        setValues(struct archive* aArchive, bool aDictionary = false);
+
+        /**
+         * Takes the compression of the entries from the archive data if
+         * libarchive doesn't report it (XAR).
+         */
         void
-        setValues(struct archive* aArchive);
+        setEntryCompression(const char* aData, size_t aSize);
 
         bool
         getSkipExtraAttrs() const { return theSkipExtraAttrs; }
 
+        bool
+        getDedup() const { return theDedup; }
+
+        void
+        setDedup(bool aDedup) { theDedup = aDedup; }
+
+        uint64_t
+        getFrameSize() const { return theFrameSize; }
+
+        uint32_t
+        getAlignment() const { return theAlignment; }
+
+        void
+        setAlignment(uint32_t aAlignment) { theAlignment = aAlignment; }
+
+        bool
+        getDictionary() const { return theDictionary; }
+
+        const ResourceGuard::Limits&
+        getLimits() const { return theLimits; }
+
       protected:
+        static double
+        getLimitValue(const Item& aKey, const Item& aValue);
+
+        static std::string
+        getDefaultCompression(const std::string& aFormat);
+
         static std::string
         getAttributeValue(
             const Item& aNode,
@@ -238,9 +443,12 @@ namespace zorba { namespace archive {
         String theEncoding;
         long long theSize;
         time_t theLastModified;
+        // the modification time has been given rather than defaulted
+        bool theHasLastModified;
         String theCompression;
         ArchiveEntryType theEntryType;
         bool theSkipExtras;
+        String theHardlink;
 
       public:
         ArchiveEntry();
@@ -252,11 +460,21 @@ namespace zorba { namespace archive {
         long long getSize() const { return theSize; }
 
         const time_t& getLastModified() const { return theLastModified; }
+
+        bool hasLastModified() const { return theHasLastModified; }
         
         const String& getCompression() const { return theCompression; }
 
         const ArchiveEntryType& getEntryType() const { return theEntryType; }
 
+        // name of the entry holding the data of a (TAR) hardlink entry
+        const String& getHardlink() const { return theHardlink; }
+
+        void setCompression(const String& aCompression)
+        {
+          theCompression = aCompression;
+        }
+
         void setValues(zorba::Item& aEntry);
 
         void setValues(struct archive_entry* aEntry);
@@ -273,6 +491,32 @@ namespace zorba { namespace archive {
         std::stringstream* theStream;
         ArchiveOptions  theOptions;
 
+        // compressed entry that is copied (from the output) for entries
+        // with identical content (dedup option for ZIP)
+        struct ZipBlob
+        {
+          ZipDirectory::Entry theEntry;
+          std::string         theLocalExtra;
+          // offset of the compressed data in the output
+          uint64_t            theDataOffset;
+        };
+
+        typedef std::map<std::string, std::string> PathMap;
+        typedef std::map<std::string, ZipBlob> ZipBlobMap;
+
+        // with dedup, ZIP archives are assembled from compressed entries
+        ZipWriter*  theZipWriter;
+        // ZSTD-SEEKABLE compresses the output of libarchive in frames
+        ZstdSeekableWriter* theSeekableWriter;
+        // content digest -> path of the first entry with that content
+        PathMap     theDigests;
+        // content digest -> compressed entry
+        ZipBlobMap  theZipBlobs;
+        // TAR path -> path of the entry holding its data
+        PathMap     theTarPaths;
+        // set once archive_write_open has been called
+        bool        theOpened;
+
       public:
         ArchiveCompressor();
 
@@ -291,12 +535,99 @@ namespace zorba { namespace archive {
           const ArchiveEntry& aEntry,
           zorba::Item aFile);
 
+        /**
+         * Writes the entry the reader aSource is currently positioned on
+         * to the archive (under the name aEntryPath). The data is
+         * streamed through without creating an item for it.
+         */
+        void copy(
+          struct archive* aSource,
+          struct archive_entry* aEntry,
+          const String& aEntryPath);
+
+        /**
+         * Writes the given entry header (without hardlink) followed by
+         * aData.
+         */
+        void copy(
+          struct archive_entry* aEntry,
+          const String& aEntryPath,
+          const std::string& aData);
+
         std::stringstream* getResultStream();
 
+        /**
+         * Writes output of libarchive to the result stream (through the
+         * seekable zstd compressor if requested).
+         */
+        void write(const char* aData, size_t aLen);
+
         static void
         releaseStream(std::istream* s) { delete s; }
 
+        /**
+         * Materializes the content of an entry as it would be written to
+         * the archive (i.e. decoded or transcoded).
+         */
+        void
+        readContent(
+            const ArchiveEntry& aEntry,
+            zorba::Item& aFile,
+            std::string& aContent) const;
+
       protected:
+        /**
+         * Opens the libarchive writer (if it isn't yet) right before the
+         * first entry is written. aLargestSize is the largest entry size
+         * known at that point; ZIP64 is requested for ZIP archives if it
+         * is 4 GB or more.
+         */
+        void
+        openWriter(uint64_t aLargestSize);
+
+        // size of the content if it can be told without reading it
+        // (0 otherwise)
+        static uint64_t
+        getKnownSize(zorba::Item& aFile);
+
+        /**
+         * libarchive only writes a pax extended header if an entry needs
+         * one, i.e. a PAX archive of short names would read back as
+         * USTAR. For PAX, the ctime (which isn't restored on extraction)
+         * is recorded such that the format can be told from the archive.
+         */
+        void
+        setPaxTimes(struct archive_entry* aEntry) const;
+
+        void
+        writeHeader(
+            const ArchiveEntry& aEntry,
+            uint64_t aSize,
+            const std::string& aHardlink);
+
+        // writes the header and the content of aStream (if any)
+        void
+        writeEntry(
+            const ArchiveEntry& aEntry,
+            std::istream* aStream,
+            uint64_t aSize);
+
+        void
+        writeData(std::istream& aStream);
+
+        void
+        compressZip(
+            const ArchiveEntry& aEntry,
+            zorba::Item& aFile);
+
+        /**
+         * Hashes the content of aStream (setting aSize to its length) and
+         * rewinds it, i.e. the content is streamed twice instead of being
+         * materialized.
+         */
+        static std::string
+        getDigest(std::istream& aStream, uint64_t& aSize);
+
         bool
         getStream(
             const ArchiveEntry& aEntry,
@@ -304,6 +635,17 @@ namespace zorba { namespace archive {
             std::istream*& aResStream,
             uint64_t& aResFileSize) const;
 
+        /**
+         * Like getStream, but the stream can be rewound after getDigest,
+         * i.e. a base64 decoded stream (which can't) is materialized.
+         */
+        bool
+        getDigestStream(
+            const ArchiveEntry& aEntry,
+            zorba::Item& aFile,
+            std::istream*& aResStream,
+            uint64_t& aResFileSize) const;
+
         bool
         getStreamForString(
             const zorba::String& aEncoding,
@@ -311,6 +653,16 @@ namespace zorba { namespace archive {
             std::istream*& aResStream,
             uint64_t& aResFileSize) const;
 
+        /**
+         * Converts the content of a string entry to the given encoding
+         * (using the fast paths of TextCodec if possible).
+         */
+        static void
+        encodeText(
+            const zorba::String& aEncoding,
+            const std::string& aContent,
+            std::string& aResult);
+
         bool
         getStreamForBase64(
             zorba::Item& aFile,
@@ -327,6 +679,123 @@ namespace zorba { namespace archive {
       static zorba::Item
       getOneItem(const Arguments_t& aArgs, int aIndex);
 
+      static void
+      checkZipCompression(const std::string& aCompression);
+
+      /**
+       * Copies the entry with the given index into a ZIP archive of its
+       * own such that libarchive can read it without scanning the others.
+       */
+      static void
+      isolateZipEntry(
+          const ZipDirectory& aDirectory,
+          size_t aIndex,
+          std::string& aResult);
+
+      typedef bool (*BlockFunction)(void*, const char*, size_t);
+
+      /**
+       * Decodes the entry with the given index and passes its data block
+       * by block to aFunction until it returns false. Stored entries are
+       * passed without copying. The Zorba API isn't used, i.e. this can
+       * be called from any thread. Returns false and sets aError if the
+       * entry can't be read.
+       */
+      static bool
+      readZipEntry(
+          const ZipDirectory& aDirectory,
+          size_t aIndex,
+          BlockFunction aFunction,
+          void* aArg,
+          std::string& aError,
+          ResourceGuard* aGuard = 0);
+
+      /**
+       * Checks the number of entries and their total (declared) size
+       * against the limits before the entries are read in parallel.
+       */
+      static void
+      checkZipLimits(const ZipDirectory& aDirectory);
+
+      /**
+       * Collects the content item for each regular entry (a null item for
+       * directories) and checks that the numbers match.
+       */
+      static void
+      getContents(
+          const std::vector<ArchiveEntry>& aEntries,
+          zorba::Iterator_t& aFiles,
+          std::vector<zorba::Item>& aContents);
+
+      /**
+       * Provides the decoded bytes of the given archive as a contiguous
+       * buffer. aBuffer is only used if the item is streamable or needs
+       * to be decoded. Otherwise, aData points into the item.
+       */
+      static void
+      getArchiveData(
+          zorba::Item& aArchive,
+          zorba::String& aBuffer,
+          const char*& aData,
+          size_t& aSize);
+
+
+      /**
+       * Detects the format and compression of the given archive (empty
+       * if unknown or the archive is a non-seekable stream). The bytes
+       * of the archive are provided as by getArchiveData if they had to
+       * be read; otherwise aData is 0 (see getZipDirectory for ZIP).
+       */
+      static void
+      sniffArchive(
+          zorba::Item& aArchive,
+          std::string& aFormat,
+          std::string& aCompression,
+          zorba::String& aBuffer,
+          const char*& aData,
+          size_t& aSize);
+
+      /**
+       * Parses the central directory if aData is a ZIP archive. Raises
+       * CORRUPTED-ARCHIVE if the archive has an end of central directory
+       * record that doesn't point to a valid directory.
+       */
+      static bool
+      parseZip(ZipDirectory& aDirectory, const char* aData, uint64_t aSize);
+
+      /**
+       * Parses the central directory of a ZIP archive as sniffed by
+       * sniffArchive. If aData is 0 (a seekable stream), only the end of
+       * the stream holding the directory is read and the data of the
+       * entries is left to loadZipEntries; the whole archive is read
+       * (as by getArchiveData) only if that fails.
+       */
+      static bool
+      getZipDirectory(
+          zorba::Item& aArchive,
+          ZipDirectory& aDirectory,
+          zorba::String& aBuffer,
+          const char*& aData,
+          size_t& aSize);
+
+      /**
+       * Reads the range of the archive that holds the given entries into
+       * aBuffer if aDirectory has been parsed from the end of a stream.
+       */
+      static void
+      loadZipEntries(
+          zorba::Item& aArchive,
+          ZipDirectory& aDirectory,
+          const std::vector<size_t>& aIndexes,
+          std::string& aBuffer);
+
+      // reads up to aLength bytes from aOffset on (less at the end)
+      static void
+      readStreamRange(
+          std::istream& aStream,
+          uint64_t aOffset,
+          uint64_t aLength,
+          std::string& aResult);
 
       static _ssize_t  
       writeStream(struct archive *a, void *client_data, const void *buff, size_t n);
@@ -334,6 +803,12 @@ namespace zorba { namespace archive {
       static int
       closeStream(struct archive *a, void *client_data);
 
+      static _ssize_t
+      readDictionary(struct archive *a, void *client_data, const void **buff);
+
+      static int
+      closeDictionary(struct archive *a, void *client_data);
+
     public:
 
       ArchiveFunction(const ArchiveModule* module);
@@ -349,6 +824,66 @@ namespace zorba { namespace archive {
       static void
         checkForError(int aErrNo, const char* aLocalName, struct archive *a);
 
+      /**
+       * Enables the readers for the format and compression detected in
+       * the leading bytes of an archive (all readers if unknown).
+       */
+      static void
+        setReaderSupport(struct archive* a, const char* aHead, size_t aLen);
+
+      /**
+       * Enables the matching readers (see setReaderSupport) and opens an
+       * archive in memory. Returns the source of the reader if the archive
+       * is compressed with a zstd dictionary (see openDictionaryReader),
+       * 0 otherwise.
+       */
+      static DictionarySource*
+        openReader(struct archive* a, const char* aData, size_t aLen);
+
+      /**
+       * Opens a reader on a TAR archive compressed with a zstd dictionary
+       * (ZSTD-SEEKABLE with the dictionary option). libarchive can't load
+       * the dictionary, i.e. the archive is decompressed by the module and
+       * libarchive reads the plain TAR archive. The archive is read from
+       * aData or, if given, through aRead. Returns 0 without opening the
+       * reader if the leading bytes aHead don't start with a dictionary.
+       * The source is released when the reader is closed.
+       */
+      static DictionarySource*
+        openDictionaryReader(
+            struct archive* a,
+            const char* aHead,
+            size_t aHeadLen,
+            const char* aData,
+            size_t aLen,
+            void* aClientData = 0,
+            _ssize_t (*aRead)(struct archive*, void*, const void**) = 0);
+
+      // compressed bytes read by the source so far
+      static uint64_t
+        getConsumed(const DictionarySource* aSource);
+
+      /**
+       * Appends the data of the entry the reader is positioned on to
+       * aResult. Each block of libarchive is copied once into aResult,
+       * which is sized up front if aEntry tells the size (capped by
+       * aGuard). Holes of sparse entries read as zeros. Returns false if
+       * the data is corrupted or aGuard fails before a block is appended
+       * (doesn't throw such that it can be used on other threads).
+       */
+      static bool
+        appendEntryData(
+            struct archive* a,
+            struct archive_entry* aEntry,
+            std::string& aResult,
+            ResourceGuard* aGuard = 0);
+
+      /**
+       * Throws a:LIMIT-EXCEEDED if the given guard failed.
+       */
+      static void
+        checkGuard(const ResourceGuard& aGuard);
+
       static std::string
         formatName(int f);
 
@@ -388,7 +923,7 @@ namespace zorba { namespace archive {
  ******************************************************************************/
   class EntriesFunction : public ArchiveFunction
   {
-    protected:
+    public:
       class EntriesItemSequence : public ArchiveItemSequence
       {
         public:
@@ -418,7 +953,12 @@ namespace zorba { namespace archive {
           virtual ~EntriesItemSequence() {}
 
           zorba::Iterator_t
-          getIterator() { return new EntriesIterator(theArchive); }
+          getIterator()
+          {
+            EntriesIterator* lIter = new EntriesIterator(theArchive);
+            lIter->setExcludedNames(theExcludedNames);
+            return lIter;
+          }
       };
       
     public:
@@ -449,6 +989,9 @@ namespace zorba { namespace archive {
           typedef std::set<std::string> EntryNameSet;
           typedef EntryNameSet::const_iterator EntryNameSetIter;
 
+          // cached contents by entry name
+          typedef std::map<std::string, ContentCache::Contents> CachedContents;
+
           class ExtractIterator : public ArchiveIterator
           {
             public:
@@ -458,15 +1001,119 @@ namespace zorba { namespace archive {
                   bool aReturnAll)
                 : ArchiveIterator(aArchive),
                   theEntryNames(aEntryNames),
-                  theReturnAll(aReturnAll) {}
+                  theReturnAll(aReturnAll),
+                  thePosition(0),
+                  theCacheKey(0),
+                  theCached(0),
+                  thePipelineChecked(false) {}
+
+              void
+              open()
+              {
+                ArchiveIterator::open();
+                thePosition = 0;
+                theCollected.clear();
+                thePipeline.reset();
+                thePipelineChecked = false;
+              }
+
+              void
+              close()
+              {
+                // the producer uses the archive
+                thePipeline.reset();
+                ArchiveIterator::close();
+              }
+
+              /**
+               * Lets the iterator take the contents of the given entries
+               * from aCached and put the ones it reads into the content
+               * cache once all entries have been seen.
+               */
+              void
+              setCache(const std::string& aKey, const CachedContents& aCached)
+              {
+                theCacheKey = &aKey;
+                theCached = &aCached;
+              }
 
               struct archive_entry* lookForHeader(bool aMatch, ArchiveOptions* aOptions = NULL);
 
+              /**
+               * Reads the data of the current entry. The data of a hardlink
+               * entry is read from the entry the link refers to.
+               */
+              void
+              readEntry(struct archive_entry* aEntry, std::string& aResult);
+
+              /**
+               * Reads the content of the next matching entry (using the
+               * content cache). The entries are decoded on a background
+               * thread if pipelining is enabled (see a:set-pipeline).
+               * Returns false after the last entry.
+               */
+              bool
+              nextEntry(std::string& aResult);
+
               virtual ~ExtractIterator() {}
 
             protected:
+              void
+              readData(struct archive_entry* aEntry, std::string& aResult);
+
+              /**
+               * Looks up the content of the entry at the given position in
+               * the contents taken from the cache.
+               */
+              bool
+              findCached(
+                  const std::string& aName,
+                  size_t aPosition,
+                  std::string& aResult) const;
+
+              // runs on the thread of thePipeline
+              static EntryPipeline::Status
+              produceEntry(
+                  void* aIterator,
+                  EntryPipeline::Entry& aEntry,
+                  std::string& aError);
+
+              EntryPipeline::Status
+              decodeEntry(EntryPipeline::Entry& aEntry, std::string& aError);
+
+              void
+              readLinkTarget(const std::string& aTarget, std::string& aResult);
+
+              /**
+               * Like readEntry but takes the content from the cache if
+               * possible.
+               */
+              void
+              readCachedEntry(struct archive_entry* aEntry, std::string& aResult);
+
+              /**
+               * Puts the contents read into the content cache (once the
+               * end of the archive has been reached).
+               */
+              void
+              cacheContents();
+
               EntryNameSet& theEntryNames;
               bool theReturnAll;
+
+              // position of the next header
+              size_t thePosition;
+
+              const std::string*    theCacheKey;
+              const CachedContents* theCached;
+              CachedContents        theCollected;
+
+              // reused for the contents of the entries (the items copy it)
+              std::string           theBuffer;
+
+              bool                  thePipelineChecked;
+              // destroyed first because its thread uses the members above
+              std::auto_ptr<EntryPipeline> thePipeline;
           };
 
         public:
@@ -482,12 +1129,65 @@ namespace zorba { namespace archive {
           EntryNameSet&
           getNameSet() { return theEntryNames; }
 
+          void
+          setCache(const std::string& aKey, const CachedContents& aCached)
+          {
+            theCacheKey = aKey;
+            theCached = aCached;
+          }
+
         protected:
+          /**
+           * Passes the cache settings (if any) to the given iterator.
+           */
+          void
+          initCache(ExtractIterator* aIter)
+          {
+            if (!theCacheKey.empty())
+            {
+              aIter->setCache(theCacheKey, theCached);
+            }
+          }
+
           EntryNameSet theEntryNames;
           bool theReturnAll;
+          std::string theCacheKey;
+          CachedContents theCached;
       };
 
     public:
+      /**
+       * Returns the contents of the entries with the names of the given
+       * sequence in archive order if they are available without scanning
+       * the archive, i.e. if the archive is a handle (see a:open) or all
+       * of them are in the content cache. Otherwise, returns false and
+       * prepares the sequence to use and fill the cache.
+       */
+      static bool
+      getExtractedContents(
+          zorba::Item& aArchive,
+          ExtractItemSequence& aSeq,
+          std::vector<std::string>& aContents);
+
+      /**
+       * Like getExtractedContents for a TAR archive compressed with
+       * ZSTD-SEEKABLE, i.e. only the frames holding the headers in front
+       * of the requested entries and their data are decompressed.
+       */
+      static bool
+      getSeekableContents(
+          zorba::Item& aArchive,
+          ExtractItemSequence& aSeq,
+          std::vector<std::string>& aContents);
+
+      /**
+       * Tells if the archive may be compressed with ZSTD-SEEKABLE by looking
+       * at the magic numbers at its both ends, i.e. without reading (or
+       * decoding) all of it.
+       */
+      static bool
+      isSeekableZstd(zorba::Item& aArchive);
+
       ExtractFunction(const ArchiveModule* aModule)
         : ArchiveFunction(aModule) {}
 
@@ -536,8 +1236,11 @@ namespace zorba { namespace archive {
           zorba::Iterator_t
           getIterator()
           {
-            return new ExtractTextIterator(
+            ExtractTextIterator* lIter = new ExtractTextIterator(
                 theArchive, theEntryNames, theReturnAll, theEncoding);
+            lIter->setExcludedNames(theExcludedNames);
+            initCache(lIter);
+            return lIter;
           }
 
         protected:
@@ -557,6 +1260,12 @@ namespace zorba { namespace archive {
         evaluate(const Arguments_t&,
                  const zorba::StaticContext*,
                  const zorba::DynamicContext*) const;
+
+      /**
+       * Creates a string item out of the (encoded) content of an entry.
+       */
+      static zorba::Item
+      createText(const std::string& aContent, const zorba::String& aEncoding);
   };
 
 /*******************************************************************************
@@ -594,8 +1303,11 @@ namespace zorba { namespace archive {
           zorba::Iterator_t
           getIterator()
           {
-            return new ExtractBinaryIterator(
+            ExtractBinaryIterator* lIter = new ExtractBinaryIterator(
                 theArchive, theEntryNames, theReturnAll);
+            lIter->setExcludedNames(theExcludedNames);
+            initCache(lIter);
+            return lIter;
           }
       };
 
@@ -612,134 +1324,232 @@ namespace zorba { namespace archive {
         evaluate(const Arguments_t&,
                  const zorba::StaticContext*,
                  const zorba::DynamicContext*) const;
+
+    protected:
+      /**
+       * Returns the entries of a ZIP archive as views into its bytes (see
+       * ArchiveView) if all of them are stored uncompressed and match
+       * their CRC-32. Returns false if the entries need to be extracted.
+       */
+      static bool
+      getStoredViews(
+          zorba::Item& aArchive,
+          const ExtractItemSequence::EntryNameSet& aNames,
+          std::vector<zorba::Item>& aViews);
   };
 
 /*******************************************************************************
+ * Parses the contents of entries (JSON or XML) while they are decompressed,
+ * i.e. without materializing them as strings.
  ******************************************************************************/
-  class OptionsFunction : public ArchiveFunction
+  class ExtractParsedFunction : public ExtractFunction
   {
     public:
-    class OptionsItemSequence : public ArchiveItemSequence
-    {
-      public:
-        class OptionsIterator : public ArchiveIterator
-        {
-          public:
-            OptionsIterator(zorba::Item& aArchive);
+      enum Kind { JSON, XML };
 
-            virtual ~OptionsIterator() {}
+    protected:
+      class ExtractParsedItemSequence : public ExtractItemSequence
+      {
+        public:
+          class ExtractParsedIterator : public ExtractIterator
+          {
+            public:
+              ExtractParsedIterator(
+                  zorba::Item& aArchive,
+                  ExtractItemSequence::EntryNameSet& aEntryNames,
+                  bool aReturnAll,
+                  Kind aKind)
+                : ExtractIterator(aArchive, aEntryNames, aReturnAll),
+                  theKind(aKind),
+                  thePendingPos(0) {}
 
-            void
-            open()
-            {
-              ArchiveIterator::open();
-              lExhausted = false;
-            }
+              virtual ~ExtractParsedIterator() {}
 
-            bool
-            next(zorba::Item& aItem);
+              void
+              open()
+              {
+                ExtractIterator::open();
+                thePending.clear();
+                thePendingPos = 0;
+              }
 
-          protected:
-            bool lExhausted;
-        };
+              bool
+              next(zorba::Item& aItem);
 
-      public:
-        OptionsItemSequence(zorba::Item& aArchive)
-          : ArchiveItemSequence(aArchive)
-        {}
+            protected:
+              Kind theKind;
 
-        virtual ~OptionsItemSequence() {}
+              // items of a JSON entry with more than one item
+              std::vector<zorba::Item> thePending;
+              size_t                   thePendingPos;
+          };
 
-        zorba::Iterator_t
-        getIterator()
-        {
-          return new OptionsIterator(theArchive);
-        }
-    };
+        public:
+          ExtractParsedItemSequence(
+              zorba::Item& aArchive,
+              bool aReturnAll,
+              Kind aKind)
+            : ExtractItemSequence(aArchive, aReturnAll),
+              theKind(aKind)
+          {}
+
+          virtual ~ExtractParsedItemSequence() {}
+
+          zorba::Iterator_t
+          getIterator()
+          {
+            ExtractParsedIterator* lIter = new ExtractParsedIterator(
+                theArchive, theEntryNames, theReturnAll, theKind);
+            lIter->setExcludedNames(theExcludedNames);
+            return lIter;
+          }
+
+        protected:
+          Kind theKind;
+      };
+
+      Kind theKind;
 
     public:
-      OptionsFunction(const ArchiveModule* aModule)
-        : ArchiveFunction(aModule) {}
+      ExtractParsedFunction(const ArchiveModule* aModule, Kind aKind)
+        : ExtractFunction(aModule),
+          theKind(aKind) {}
 
-      virtual ~OptionsFunction() {}
+      virtual ~ExtractParsedFunction() {}
 
       virtual zorba::String
-        getLocalName() const { return "options"; }
+        getLocalName() const
+      {
+        return theKind == JSON ? "extract-json" : "extract-xml";
+      }
 
       virtual zorba::ItemSequence_t
         evaluate(const Arguments_t&,
                  const zorba::StaticContext*,
                  const zorba::DynamicContext*) const;
-  };
 
+      /**
+       * Parses a stream as JSON (all items) or XML (a document node) and
+       * appends the result to aItems.
+       */
+      static void
+      parse(Kind aKind, std::istream& aStream, std::vector<zorba::Item>& aItems);
+  };
 
 /*******************************************************************************
+ * Returns the lines of an entry lazily. Only the current line is kept in
+ * memory, and the entry is decompressed as far as lines are requested.
  ******************************************************************************/
-
-  class UpdateFunction : public ExtractFunction
+  class ExtractLinesFunction : public ExtractFunction
   {
-    class UpdateItemSequence : public ExtractItemSequence
+    protected:
+      class ExtractLinesItemSequence : public ExtractItemSequence
       {
         public:
-          class UpdateIterator : public ExtractIterator
+          class ExtractLinesIterator : public ExtractIterator
           {
             public:
-              UpdateIterator(
+              ExtractLinesIterator(
                   zorba::Item& aArchive,
-                  EntryNameSet& aEntryNames,
-                  bool aReturnAll,
-                  ArchiveEntry& aEntry,
-                  ArchiveOptions& aOptions)
-                : ExtractIterator(aArchive, aEntryNames, aReturnAll),
-                  theEntry(aEntry),
-                  theOptions(aOptions){}
+                  ExtractItemSequence::EntryNameSet& aEntryNames,
+                  const zorba::String& aEncoding,
+                  const std::string* aContent);
 
-              virtual ~UpdateIterator() {}
+              virtual ~ExtractLinesIterator() {}
+
+              void
+              open();
 
               bool
               next(zorba::Item& aItem);
 
+              void
+              close();
+
             protected:
-              ArchiveEntry& theEntry;
-              ArchiveOptions& theOptions;
+              bool
+              readLine(std::string& aLine);
+
+              /**
+               * Sets theBlock to the next data of the entry. For UTF-16,
+               * blocks are cut such that they contain whole code units.
+               */
+              bool
+              nextBlock();
+
+              const char*
+              findSeparator(const char* aBegin, const char* aEnd) const;
+
+              bool
+              isUnit(const char* aPos, char aChar) const;
+
+              const zorba::String& theEncoding;
+              // the content of an entry added by an overlay (or 0)
+              const std::string*   theContent;
+              // the content of a hardlink target
+              std::string          theLinkContent;
+
+              std::auto_ptr<ArchiveEntryBuffer> theBuffer;
+              bool                 theMemory;
+              bool                 theEnd;
+
+              // bytes per code unit (2 for UTF-16) and its byte order
+              size_t               theUnitSize;
+              bool                 theBigEndian;
+
+              const char*          theBlock;
+              const char*          theBlockEnd;
+              const char*          thePending;
+              size_t               thePendingLen;
+              // a code unit split across blocks
+              char                 theUnit[2];
+              bool                 theHasCarry;
+              // a CR ended the last block, i.e. a leading LF is skipped
+              bool                 theSkipLF;
           };
 
         public:
-          UpdateItemSequence(
+          ExtractLinesItemSequence(
               zorba::Item& aArchive,
-              bool aReturnAll)
-            : ExtractItemSequence(aArchive, aReturnAll)
+              const zorba::String& aEncoding)
+            : ExtractItemSequence(aArchive, false),
+              theEncoding(aEncoding),
+              theHasContent(false)
           {}
 
-          virtual ~UpdateItemSequence() {}
-
-          const ArchiveEntry&
-          getEntry() { return theEntry; }
+          virtual ~ExtractLinesItemSequence() {}
 
-          ArchiveOptions&
-          getOptions() { return theOptions; }
+          void
+          setContent(const std::string& aContent)
+          {
+            theContent = aContent;
+            theHasContent = true;
+          }
 
           zorba::Iterator_t
           getIterator()
           {
-            return new UpdateIterator(
-                theArchive, theEntryNames, theReturnAll, theEntry, theOptions);
+            ExtractLinesIterator* lIter = new ExtractLinesIterator(
+                theArchive, theEntryNames, theEncoding,
+                theHasContent ? &theContent : 0);
+            lIter->setExcludedNames(theExcludedNames);
+            return lIter;
           }
 
         protected:
-          ArchiveEntry theEntry;
-          ArchiveOptions theOptions;
-
+          zorba::String theEncoding;
+          std::string   theContent;
+          bool          theHasContent;
       };
 
     public:
-      UpdateFunction(const ArchiveModule* aModule) 
+      ExtractLinesFunction(const ArchiveModule* aModule)
         : ExtractFunction(aModule) {}
 
-      virtual ~UpdateFunction(){}
+      virtual ~ExtractLinesFunction() {}
 
       virtual zorba::String
-        getLocalName() const { return "update"; }
+        getLocalName() const { return "extract-lines"; }
 
       virtual zorba::ItemSequence_t
         evaluate(const Arguments_t&,
@@ -747,70 +1557,1237 @@ namespace zorba { namespace archive {
                  const zorba::DynamicContext*) const;
   };
 
-
 /*******************************************************************************
  ******************************************************************************/
-
-  class DeleteFunction : public ArchiveFunction{
-     protected:
-      class DeleteItemSequence : public ExtractFunction::ExtractItemSequence
+  class ExtractRangeFunction : public ExtractFunction
+  {
+    public:
+      class ExtractRangeItemSequence : public ExtractItemSequence
       {
         public:
-          class DeleteIterator : public ExtractFunction::ExtractItemSequence::ExtractIterator
+          class ExtractRangeIterator : public ExtractIterator
           {
             public:
-              DeleteIterator(zorba::Item& aArchive,
-                  EntryNameSet& aEntryList,
-                  ArchiveEntry& aEntry,
-                  ArchiveOptions& aOptions)
-                : ExtractIterator(aArchive, aEntryList, false),
-                  theEntry(aEntry),
-                  theOptions(aOptions){}
-
-              virtual ~DeleteIterator() {}
+              ExtractRangeIterator(
+                  zorba::Item& aArchive,
+                  ExtractItemSequence::EntryNameSet& aEntryNames,
+                  uint64_t aOffset,
+                  uint64_t aLength)
+                : ExtractIterator(aArchive, aEntryNames, false),
+                  theOffset(aOffset),
+                  theLength(aLength),
+                  theExhausted(false) {}
+
+              virtual ~ExtractRangeIterator() {}
+
+              void
+              open()
+              {
+                ExtractIterator::open();
+                theExhausted = false;
+              }
 
               bool
               next(zorba::Item& aItem);
 
             protected:
-              ArchiveEntry& theEntry;
-              ArchiveOptions& theOptions;
+              uint64_t theOffset;
+              uint64_t theLength;
+              bool     theExhausted;
           };
 
-          DeleteItemSequence(zorba::Item& aArchive)
-            : ExtractFunction::ExtractItemSequence(aArchive, false) {}
-
-          virtual ~DeleteItemSequence() {}
-
-          const ArchiveEntry&
-          getEntry() { return theEntry; }
+        public:
+          ExtractRangeItemSequence(
+              zorba::Item& aArchive,
+              const std::string& aName,
+              uint64_t aOffset,
+              uint64_t aLength)
+            : ExtractItemSequence(aArchive, false),
+              theOffset(aOffset),
+              theLength(aLength)
+          {
+            theEntryNames.insert(aName);
+          }
 
-          ArchiveOptions&
-          getOptions() { return theOptions; }
+          virtual ~ExtractRangeItemSequence() {}
 
           zorba::Iterator_t
-          getIterator() 
-          { 
-            return new DeleteIterator(theArchive, theEntryNames, theEntry, theOptions); 
+          getIterator()
+          {
+            ExtractRangeIterator* lIter = new ExtractRangeIterator(
+                theArchive, theEntryNames, theOffset, theLength);
+            lIter->setExcludedNames(theExcludedNames);
+            return lIter;
           }
 
         protected:
-          ArchiveEntry theEntry;
-          ArchiveOptions theOptions;
+          uint64_t theOffset;
+          uint64_t theLength;
       };
 
     public:
-      DeleteFunction(const ArchiveModule* aModule) : ArchiveFunction(aModule) {}
+      ExtractRangeFunction(const ArchiveModule* aModule)
+        : ExtractFunction(aModule) {}
 
-      virtual ~DeleteFunction(){}
+      virtual ~ExtractRangeFunction() {}
 
       virtual zorba::String
-        getLocalName() const { return "delete"; }
+        getLocalName() const { return "extract-range"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+      /**
+       * Appends the part of a block of entry data (starting at aBlockOffset
+       * in the entry) that lies within the range [aOffset, aOffset+aLength).
+       */
+      static void
+      appendRange(
+          const char* aBlock,
+          size_t aBlockSize,
+          uint64_t aBlockOffset,
+          uint64_t aOffset,
+          uint64_t aLength,
+          std::string& aResult);
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class OptionsFunction : public ArchiveFunction
+  {
+    public:
+    class OptionsItemSequence : public ArchiveItemSequence
+    {
+      public:
+        class OptionsIterator : public ArchiveIterator
+        {
+          public:
+            OptionsIterator(zorba::Item& aArchive);
+
+            virtual ~OptionsIterator() {}
+
+            void
+            open()
+            {
+              ArchiveIterator::open();
+              lExhausted = false;
+            }
+
+            bool
+            next(zorba::Item& aItem);
+
+          protected:
+            bool lExhausted;
+        };
+
+      public:
+        OptionsItemSequence(zorba::Item& aArchive)
+          : ArchiveItemSequence(aArchive)
+        {}
+
+        virtual ~OptionsItemSequence() {}
+
+        zorba::Iterator_t
+        getIterator()
+        {
+          return new OptionsIterator(theArchive);
+        }
+    };
+
+    protected:
+      /**
+       * Reports the method used by most files of a ZIP archive and
+       * the files compressed with another method.
+       */
+      static zorba::Item
+      getZipOptions(const ZipDirectory& aDirectory);
+
+    public:
+      OptionsFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~OptionsFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "options"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class StatFunction : public ArchiveFunction
+  {
+    public:
+    class StatItemSequence : public ArchiveItemSequence
+    {
+      public:
+        class StatIterator : public ArchiveIterator
+        {
+          public:
+            StatIterator(zorba::Item& aArchive);
+
+            virtual ~StatIterator() {}
+
+            void
+            open()
+            {
+              ArchiveIterator::open();
+              theExhausted = false;
+            }
+
+            bool
+            next(zorba::Item& aItem);
+
+          protected:
+            bool theExhausted;
+        };
+
+      public:
+        StatItemSequence(zorba::Item& aArchive)
+          : ArchiveItemSequence(aArchive)
+        {}
+
+        virtual ~StatItemSequence() {}
+
+        zorba::Iterator_t
+        getIterator()
+        {
+          return new StatIterator(theArchive);
+        }
+    };
+
+    public:
+      StatFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~StatFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "stat"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+      /**
+       * Creates the summary object returned by a:stat. The largest entry
+       * is omitted if aLargestName is empty.
+       */
+      static zorba::Item
+      createStat(
+          const std::string& aFormat,
+          uint64_t aEntryCount,
+          uint64_t aCompressedSize,
+          uint64_t aUncompressedSize,
+          const std::string& aLargestName,
+          uint64_t aLargestSize);
+  };
+
+
+/*******************************************************************************
+ * a:grep searches the entries of an archive for a literal pattern while
+ * they are decoded, i.e. without creating items for their contents. The
+ * entries of a ZIP archive that is available as a buffer are searched in
+ * parallel.
+ ******************************************************************************/
+  class GrepFunction : public ArchiveFunction
+  {
+    public:
+      struct Options
+      {
+        std::string              thePattern;
+        // glob patterns (* and ?) the names of the searched entries match
+        std::vector<std::string> theEntryPatterns;
+        bool                     theFirstOnly;
+
+        Options() : theFirstOnly(false) {}
+
+        void
+        setValues(zorba::Item& aOptions);
+
+        bool
+        isSelected(const std::string& aName) const;
+      };
+
+      struct EntryMatches
+      {
+        std::string                       theName;
+        std::vector<StreamSearch::Match>  theMatches;
+        // set if the entry couldn't be read by a worker thread
+        std::string                       theError;
+        bool                              theLimitExceeded;
+
+        EntryMatches() : theLimitExceeded(false) {}
+      };
+
+    public:
+      GrepFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~GrepFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "grep"; }
 
       virtual zorba::ItemSequence_t
         evaluate(const Arguments_t&,
                  const zorba::StaticContext*,
                  const zorba::DynamicContext*) const;
+
+      /**
+       * Returns true if aName matches the glob pattern aPattern.
+       */
+      static bool
+      matchGlob(const char* aName, const char* aPattern);
+
+    protected:
+      static void
+      grepZipEntry(void* aJob, size_t aIndex);
+
+      static bool
+      searchBlock(void* aSearch, const char* aData, size_t aLen);
+
+      static void
+      grepEntries(
+          zorba::Item& aArchive,
+          const Options& aOptions,
+          std::vector<EntryMatches>& aResult);
+
+      static void
+      addMatches(
+          const EntryMatches& aEntry,
+          std::vector<zorba::Item>& aResult);
+  };
+
+/*******************************************************************************
+ * a:checksums computes digests of the entries of an archive while they
+ * are decoded. The CRC-32 of ZIP entries is taken from the central
+ * directory, and the other digests are computed in parallel.
+ ******************************************************************************/
+  class ChecksumsFunction : public ArchiveFunction
+  {
+    public:
+      enum Algorithm
+      {
+        ALGORITHM_CRC32  = 1,
+        ALGORITHM_SHA256 = 2,
+        ALGORITHM_XXH64  = 4
+      };
+
+      struct EntryDigests
+      {
+        std::string theName;
+        uint32_t    theCRC32;
+        std::string theSHA256;
+        uint64_t    theXXH64;
+        // set if the entry couldn't be read by a worker thread
+        std::string theError;
+        bool        theLimitExceeded;
+
+        EntryDigests() : theCRC32(0), theXXH64(0), theLimitExceeded(false) {}
+      };
+
+      /**
+       * Feeds the data of an entry into the requested digests.
+       */
+      class Hasher
+      {
+        protected:
+          int    theAlgorithms;
+          CRC32  theCRC32;
+          SHA256 theSHA256;
+          XXH64  theXXH64;
+
+        public:
+          Hasher(int aAlgorithms) : theAlgorithms(aAlgorithms) {}
+
+          void
+          update(const char* aData, size_t aLen);
+
+          void
+          finish(EntryDigests& aDigests);
+
+          static bool
+          update(void* aHasher, const char* aData, size_t aLen);
+      };
+
+    public:
+      ChecksumsFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~ChecksumsFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "checksums"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+    protected:
+      static int
+      getAlgorithms(zorba::Iterator_t& aNames);
+
+      static void
+      hashZipEntry(void* aJob, size_t aIndex);
+
+      static void
+      hashEntries(
+          zorba::Item& aArchive,
+          int aAlgorithms,
+          std::vector<EntryDigests>& aResult);
+
+      static zorba::Item
+      createDigests(const EntryDigests& aDigests, int aAlgorithms);
+  };
+
+/*******************************************************************************
+ * a:verify decompresses all entries of an archive without keeping their
+ * data and checks their sizes and (for ZIP) CRC-32s. The entries of a
+ * ZIP archive that is available as a buffer are checked in parallel.
+ ******************************************************************************/
+  class VerifyFunction : public ArchiveFunction
+  {
+    public:
+      struct EntryReport
+      {
+        std::string theName;
+        // empty if the entry is valid, otherwise the kind of the problem
+        std::string theError;
+        std::string theMessage;
+        // false if the entry hasn't been checked (fail fast)
+        bool        theChecked;
+
+        EntryReport() : theChecked(false) {}
+      };
+
+      /**
+       * Counts the bytes and computes the CRC-32 of the data of an entry.
+       */
+      struct Sink
+      {
+        CRC32       theCRC32;
+        uint64_t    theSize;
+        // set (under theMutex) by a worker thread to stop the others
+        Mutex*      theMutex;
+        const bool* theStop;
+        bool        theStopped;
+
+        Sink(Mutex* aMutex, const bool* aStop)
+          : theSize(0), theMutex(aMutex), theStop(aStop), theStopped(false) {}
+
+        static bool
+        consume(void* aSink, const char* aData, size_t aLen);
+      };
+
+    public:
+      VerifyFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~VerifyFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "verify"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+    protected:
+      static void
+      verifyZipEntry(void* aJob, size_t aIndex);
+
+      static void
+      verifyEntries(
+          zorba::Item& aArchive,
+          bool aKeepGoing,
+          std::vector<EntryReport>& aResult);
+
+      static zorba::Item
+      createReport(const std::vector<EntryReport>& aEntries);
+  };
+
+/*******************************************************************************
+ * a:build-index records inflate checkpoints and the entries of a gzip
+ * compressed TAR archive (see GzipIndex) for a:open#2.
+ ******************************************************************************/
+  class BuildIndexFunction : public ArchiveFunction
+  {
+    public:
+      BuildIndexFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~BuildIndexFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "build-index"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ * a:benchmark compresses the entries of an archive with the given options
+ * and with DEFLATE (ZIP format), extracts them again, and reports sizes
+ * and times of both (e.g. to tell if a zstd dictionary pays off).
+ ******************************************************************************/
+  class BenchmarkFunction : public ArchiveFunction
+  {
+    public:
+      struct Result
+      {
+        uint64_t theCompressedSize;
+        // a dictionary has been stored (see ZstdSeekableWriter)
+        bool     theDictionary;
+        // wall clock seconds
+        double   theCompressTime;
+        double   theExtractTime;
+      };
+
+    public:
+      BenchmarkFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~BenchmarkFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "benchmark"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+    protected:
+      static void
+      run(const ArchiveOptions& aOptions,
+          const std::vector<ArchiveEntry>& aEntries,
+          const std::vector<zorba::Item>& aContents,
+          Result& aResult);
+
+      static zorba::Item
+      createResult(
+          const ArchiveOptions& aOptions,
+          const Result& aResult,
+          uint64_t aSize);
+
+      static double
+      getTime();
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+
+  class UpdateFunction : public ExtractFunction
+  {
+    class UpdateItemSequence : public ExtractItemSequence
+      {
+        public:
+          class UpdateIterator : public ExtractIterator
+          {
+            public:
+              UpdateIterator(
+                  zorba::Item& aArchive,
+                  EntryNameSet& aEntryNames,
+                  bool aReturnAll,
+                  ArchiveEntry& aEntry,
+                  ArchiveOptions& aOptions)
+                : ExtractIterator(aArchive, aEntryNames, aReturnAll),
+                  theEntry(aEntry),
+                  theOptions(aOptions){}
+
+              virtual ~UpdateIterator() {}
+
+              bool
+              next(zorba::Item& aItem);
+
+            protected:
+              ArchiveEntry& theEntry;
+              ArchiveOptions& theOptions;
+          };
+
+        public:
+          UpdateItemSequence(
+              zorba::Item& aArchive,
+              bool aReturnAll)
+            : ExtractItemSequence(aArchive, aReturnAll)
+          {}
+
+          virtual ~UpdateItemSequence() {}
+
+          const ArchiveEntry&
+          getEntry() { return theEntry; }
+
+          ArchiveOptions&
+          getOptions() { return theOptions; }
+
+          zorba::Iterator_t
+          getIterator()
+          {
+            return new UpdateIterator(
+                theArchive, theEntryNames, theReturnAll, theEntry, theOptions);
+          }
+
+        protected:
+          ArchiveEntry theEntry;
+          ArchiveOptions theOptions;
+
+      };
+
+    public:
+      UpdateFunction(const ArchiveModule* aModule) 
+        : ExtractFunction(aModule) {}
+
+      virtual ~UpdateFunction(){}
+
+      virtual zorba::String
+        getLocalName() const { return "update"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+      struct EntryChecksum
+      {
+        uint32_t theCRC32;
+        uint64_t theSize;
+        // ZIP compression method or -1 if unknown
+        int      theMethod;
+        bool     theRegular;
+        // modification time, as DOS date and time for ZIP archives (i.e.
+        // in steps of 2 seconds)
+        time_t   theLastModified;
+        uint16_t theDosDate;
+        uint16_t theDosTime;
+      };
+
+      typedef std::map<std::string, EntryChecksum> ChecksumMap;
+
+      /**
+       * Computes CRC32 and size of the given entries of an archive. For ZIP
+       * archives, the values are taken from the central directory. The
+       * names of all entries are returned in aEntryNames (if given), i.e.
+       * the archive is read only once.
+       */
+      static void
+      getChecksums(
+          const char* aData,
+          size_t aSize,
+          const ExtractItemSequence::EntryNameSet& aNames,
+          ChecksumMap& aChecksums,
+          std::set<std::string>* aEntryNames = 0);
+
+    protected:
+      static bool
+      isUnchanged(
+          const ChecksumMap& aChecksums,
+          const ArchiveEntry& aEntry,
+          const std::string& aContent);
+
+      /**
+       * Records the update in an ArchiveOverlay instead of rewriting the
+       * archive.
+       */
+      static zorba::Item
+      updateOverlay(
+          zorba::Item& aArchive,
+          const std::vector<ArchiveEntry>& aEntries,
+          std::vector<zorba::Item>& aContents);
+  };
+
+
+/*******************************************************************************
+ ******************************************************************************/
+
+  class DeleteFunction : public ArchiveFunction{
+    public:
+      DeleteFunction(const ArchiveModule* aModule) : ArchiveFunction(aModule) {}
+
+      virtual ~DeleteFunction(){}
+
+      virtual zorba::String
+        getLocalName() const { return "delete"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+
+  class TransformFunction : public ArchiveFunction
+  {
+    public:
+      class EditScript
+      {
+        public:
+          typedef std::map<std::string, std::string> NameMap;
+
+          std::set<std::string>     theDeletes;
+          NameMap                   theRenames;
+          NameMap                   theCompressions;
+          std::vector<ArchiveEntry> theAdds;
+          std::vector<zorba::Item>  theContents;
+
+          void
+          setValues(zorba::Item& aScript);
+
+          bool
+          isDeleted(const std::string& aName) const
+          {
+            return theDeletes.find(aName) != theDeletes.end();
+          }
+
+          long
+          findAdd(const std::string& aName) const;
+
+          std::string
+          getNewName(const std::string& aName) const;
+
+        protected:
+          static void
+          getNames(zorba::Item& aValue, std::set<std::string>& aNames);
+
+          static void
+          getNameMap(zorba::Item& aValue, NameMap& aMap, bool aUpperCase);
+      };
+
+    public:
+      TransformFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~TransformFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "transform"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+
+      // also used to materialize an ArchiveOverlay
+      static std::stringstream*
+      transformZip(
+          const ZipDirectory& aDirectory,
+          EditScript& aScript);
+
+      static std::stringstream*
+      transformArchive(
+          const char* aData,
+          size_t aSize,
+          EditScript& aScript);
+
+    protected:
+      static void
+      appendZipEntry(
+          ZipWriter& aWriter,
+          const ArchiveEntry& aEntry,
+          zorba::Item& aContent);
+
+      static void
+      recompressZipEntry(
+          ZipWriter& aWriter,
+          const ZipDirectory& aDirectory,
+          size_t aIndex,
+          const std::string& aName,
+          const std::string& aCompression);
+
+      static void
+      appendCompressed(
+          ZipWriter& aWriter,
+          ArchiveCompressor& aCompressor);
+
+      static void
+      readEntryData(
+          const char* aData,
+          size_t aSize,
+          const std::string& aName,
+          std::string& aResult);
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class OpenFunction : public ArchiveFunction
+  {
+    public:
+      OpenFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~OpenFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "open"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class CloseFunction : public ArchiveFunction
+  {
+    public:
+      CloseFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~CloseFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "close"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class SetCacheBudgetFunction : public ArchiveFunction
+  {
+    public:
+      SetCacheBudgetFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~SetCacheBudgetFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "set-cache-budget"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class CacheStatisticsFunction : public ArchiveFunction
+  {
+    public:
+      CacheStatisticsFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~CacheStatisticsFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "cache-statistics"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class SetReadAheadFunction : public ArchiveFunction
+  {
+    public:
+      SetReadAheadFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~SetReadAheadFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "set-read-ahead"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class SetLimitsFunction : public ArchiveFunction
+  {
+    public:
+      SetLimitsFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~SetLimitsFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "set-limits"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  class SetPipelineFunction : public ArchiveFunction
+  {
+    public:
+      SetPipelineFunction(const ArchiveModule* aModule)
+        : ArchiveFunction(aModule) {}
+
+      virtual ~SetPipelineFunction() {}
+
+      virtual zorba::String
+        getLocalName() const { return "set-pipeline"; }
+
+      virtual zorba::ItemSequence_t
+        evaluate(const Arguments_t&,
+                 const zorba::StaticContext*,
+                 const zorba::DynamicContext*) const;
+  };
+
+/*******************************************************************************
+ * The result of a:update and a:delete. The archive is described by a base
+ * archive and the edits applied to it. Chained edits are composed in
+ * memory. The edits are applied in a single pass (see TransformFunction)
+ * when the bytes of the archive are read for the first time. Entries
+ * and extract functions answer from the overlay without materializing it.
+ ******************************************************************************/
+  class ArchiveOverlay : public std::streambuf
+  {
+    protected:
+      // never an overlay, neither streamable nor encoded
+      zorba::Item                   theBase;
+      std::set<std::string>         theBaseNames;
+      TransformFunction::EditScript theScript;
+      std::string                   theData;
+      bool                          theMaterialized;
+
+    public:
+      /**
+       * If aNames is given, the checksums of these entries (see
+       * UpdateFunction::getChecksums) are computed while the names of the
+       * base entries are read.
+       */
+      ArchiveOverlay(
+          zorba::Item& aBase,
+          const std::set<std::string>* aNames = 0,
+          UpdateFunction::ChecksumMap* aChecksums = 0);
+
+      ArchiveOverlay(const ArchiveOverlay& aOther);
+
+      /**
+       * Returns the overlay of the given archive or 0 if it isn't the
+       * result of a:update or a:delete.
+       */
+      static ArchiveOverlay*
+      get(zorba::Item& aArchive);
+
+      /**
+       * Creates an archive item that takes ownership of the overlay.
+       */
+      static zorba::Item
+      createItem(ArchiveOverlay* aOverlay);
+
+      zorba::Item&
+      getBase() { return theBase; }
+
+      void
+      getBaseData(const char*& aData, size_t& aSize) const;
+
+      const TransformFunction::EditScript&
+      getScript() const { return theScript; }
+
+      bool
+      contains(const std::string& aName) const;
+
+      void
+      remove(const std::string& aName);
+
+      void
+      add(const ArchiveFunction::ArchiveEntry& aEntry, const std::string& aContent);
+
+      /**
+       * Returns the positions of the added entries (in theScript) matching
+       * the given names (or all if aReturnAll).
+       */
+      void
+      getAdds(
+          const std::set<std::string>& aNames,
+          bool aReturnAll,
+          std::vector<size_t>& aPositions) const;
+
+    protected:
+      void
+      materialize();
+
+      virtual int_type
+      underflow();
+
+      virtual std::streamsize
+      showmanyc();
+
+      virtual pos_type
+      seekoff(
+          off_type aOff,
+          std::ios_base::seekdir aDir,
+          std::ios_base::openmode aMode = std::ios_base::in);
+
+      virtual pos_type
+      seekpos(
+          pos_type aPos,
+          std::ios_base::openmode aMode = std::ios_base::in);
+  };
+
+/*******************************************************************************
+ * The result of a:open. The handle owns the decoded bytes of the archive, an
+ * index of its entries by name, and a few readers that are kept open at
+ * their position such that entries can be extracted without reparsing the
+ * archive. The bytes are provided as seekable stream to all other functions.
+ * If a GzipIndex is given (a:open#2), the entries are taken from it and
+ * are read from its closest checkpoint instead.
+ ******************************************************************************/
+  class ArchiveHandle : public std::streambuf
+  {
+    protected:
+      struct Reader
+      {
+        struct archive* theArchive;
+        // position of the next header
+        size_t          theNext;
+        unsigned long   theLastUse;
+      };
+
+      typedef std::multimap<std::string, size_t> NameIndex;
+
+      // neither streamable nor encoded
+      zorba::Item               theArchive;
+      const char*               theData;
+      size_t                    theSize;
+
+      bool                      theIsZip;
+      ZipDirectory              theDirectory;
+      NameIndex                 theIndex;
+      GzipIndex*                theGzipIndex;
+
+      std::vector<Reader>       theReaders;
+      unsigned long             theUseCount;
+
+      std::vector<zorba::Item>  theEntries;
+      bool                      theHasEntries;
+
+      std::string               theCacheKey;
+
+      bool                      theClosed;
+
+    public:
+      /**
+       * Takes ownership of the index (if any), even if it throws.
+       */
+      ArchiveHandle(zorba::Item& aArchive, GzipIndex* aGzipIndex = 0);
+
+      virtual ~ArchiveHandle();
+
+      /**
+       * Returns the handle of the given archive or 0 if it isn't the
+       * result of a:open.
+       */
+      static ArchiveHandle*
+      get(zorba::Item& aArchive);
+
+      /**
+       * Creates an archive item that takes ownership of the handle.
+       */
+      static zorba::Item
+      createItem(ArchiveHandle* aHandle);
+
+      void
+      getData(const char*& aData, size_t& aSize) const
+      {
+        aData = theData;
+        aSize = theSize;
+      }
+
+      /**
+       * Releases the bytes, the index, and the readers of the handle.
+       */
+      void
+      close();
+
+      bool
+      isClosed() const { return theClosed; }
+
+      /**
+       * Returns the positions of the entries with the given names in
+       * archive order.
+       */
+      void
+      getPositions(
+          const std::set<std::string>& aNames,
+          std::vector<size_t>& aPositions) const;
+
+      void
+      readEntry(size_t aPosition, std::string& aResult);
+
+      /**
+       * Returns the key of the archive in the content cache (computed
+       * once).
+       */
+      const std::string&
+      getCacheKey();
+
+      // 0 if the archive isn't a ZIP archive
+      const ZipDirectory*
+      getDirectory() const { return theIsZip ? &theDirectory : 0; }
+
+      // the item owning the bytes
+      const zorba::Item&
+      getArchive() const { return theArchive; }
+
+      /**
+       * Returns the result of a:entries (computed once).
+       */
+      const std::vector<zorba::Item>&
+      getEntries();
+
+    protected:
+      // loads the archive and indexes its entries (see the constructor)
+      void
+      init(zorba::Item& aArchive);
+
+      void
+      readZipEntry(size_t aPosition, std::string& aResult);
+
+      void
+      readIndexedEntry(size_t aPosition, std::string& aResult);
+
+      /**
+       * Returns the position of the last entry with the given name in
+       * front of aPosition (the target of a hardlink).
+       */
+      size_t
+      getLinkTarget(const std::string& aTarget, size_t aPosition) const;
+
+      Reader&
+      getReader(size_t aPosition);
+
+      void
+      openReader(Reader& aReader);
+
+      static void
+      readData(
+          struct archive* aArchive,
+          struct archive_entry* aEntry,
+          std::string& aResult);
+
+      // a BlockFunction appending to a std::string
+      static bool
+      appendBlock(void* aResult, const char* aData, size_t aLen);
+
+      virtual pos_type
+      seekoff(
+          off_type aOff,
+          std::ios_base::seekdir aDir,
+          std::ios_base::openmode aMode = std::ios_base::in);
+
+      virtual pos_type
+      seekpos(
+          pos_type aPos,
+          std::ios_base::openmode aMode = std::ios_base::in);
+  };
+
+/*******************************************************************************
+ * A read-only stream over a range of the bytes of an archive (e.g. the data
+ * of a STORE entry) that keeps the item holding the bytes alive, i.e. the
+ * range isn't copied.
+ ******************************************************************************/
+  class ArchiveView : public std::streambuf
+  {
+    protected:
+      zorba::Item theArchive;
+
+    public:
+      ArchiveView(const zorba::Item& aArchive, const char* aData, size_t aSize);
+
+      virtual ~ArchiveView() {}
+
+      /**
+       * Creates a seekable streamable xs:base64Binary over the range.
+       */
+      static zorba::Item
+      createItem(const zorba::Item& aArchive, const char* aData, size_t aSize);
+
+    protected:
+      virtual pos_type
+      seekoff(
+          off_type aOff,
+          std::ios_base::seekdir aDir,
+          std::ios_base::openmode aMode = std::ios_base::in);
+
+      virtual pos_type
+      seekpos(
+          pos_type aPos,
+          std::ios_base::openmode aMode = std::ios_base::in);
+  };
+
+/*******************************************************************************
+ * The items of a sequence followed by the items of a vector.
+ ******************************************************************************/
+  class ConcatItemSequence : public ItemSequence
+  {
+    protected:
+      class ConcatIterator : public Iterator
+      {
+        protected:
+          zorba::Iterator_t                theFirst;
+          const std::vector<zorba::Item>&  theRest;
+          size_t                           thePos;
+          bool                             theOpen;
+
+        public:
+          ConcatIterator(
+              zorba::Iterator_t aFirst,
+              const std::vector<zorba::Item>& aRest)
+            : theFirst(aFirst), theRest(aRest), thePos(0), theOpen(false) {}
+
+          virtual ~ConcatIterator() {}
+
+          void
+          open();
+
+          bool
+          next(zorba::Item& aItem);
+
+          void
+          close();
+
+          bool
+          isOpen() const { return theOpen; }
+      };
+
+      zorba::ItemSequence_t     theFirst;
+      std::vector<zorba::Item>  theRest;
+
+    public:
+      ConcatItemSequence(
+          zorba::ItemSequence_t aFirst,
+          const std::vector<zorba::Item>& aRest)
+        : theFirst(aFirst), theRest(aRest) {}
+
+      virtual ~ConcatItemSequence() {}
+
+      zorba::Iterator_t
+      getIterator()
+      {
+        return new ConcatIterator(theFirst->getIterator(), theRest);
+      }
   };
 
 } /* namespace archive  */ } /* namespace zorba */
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <sstream>
+
+#include "archive_sniffer.h"
+
+#define TAR_BLOCK_SIZE      512
+#define TAR_CHECKSUM_OFFSET 148
+#define TAR_CHECKSUM_SIZE   8
+#define TAR_TYPEFLAG_OFFSET 156
+#define TAR_MAGIC_OFFSET    257
+#define XAR_HEADER_SIZE     28
+
+namespace zorba { namespace archive {
+
+  static inline bool
+  startsWith(const char* aHead, size_t aLen, const char* aMagic, size_t aMagicLen)
+  {
+    return aLen >= aMagicLen && memcmp(aHead, aMagic, aMagicLen) == 0;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  bool
+  ArchiveSniffer::isTarHeader(const char* aHead, size_t aLen)
+  {
+    if (aLen < TAR_BLOCK_SIZE) return false;
+
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(aHead);
+
+    // the checksum field itself counts as spaces
+    unsigned long lSum = 0;
+    bool lZero = true;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+      if (i >= TAR_CHECKSUM_OFFSET
+          && i < TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE)
+      {
+        lSum += ' ';
+      }
+      else
+      {
+        lSum += u[i];
+      }
+      lZero = lZero && u[i] == 0;
+    }
+    // an empty archive starts with an end-of-archive block
+    if (lZero) return false;
+
+    // octal, terminated by NUL or space
+    unsigned long lStored = 0;
+    size_t i = TAR_CHECKSUM_OFFSET;
+    while (i < TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE && aHead[i] == ' ') ++i;
+    if (i == TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE) return false;
+    for (; i < TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE; ++i)
+    {
+      if (aHead[i] < '0' || aHead[i] > '7') break;
+      lStored = (lStored << 3) + (aHead[i] - '0');
+    }
+
+    return lStored == lSum
+      || memcmp(aHead + TAR_MAGIC_OFFSET, "ustar", 5) == 0;
+  }
+
+  bool
+  ArchiveSniffer::hasPaxHeader(const char* aHead, size_t aLen)
+  {
+    return isTarHeader(aHead, aLen) && aHead[TAR_TYPEFLAG_OFFSET] == 'x';
+  }
+
+  void
+  ArchiveSniffer::sniff(
+      const char* aHead,
+      size_t aLen,
+      std::string& aFormat,
+      std::string& aCompression)
+  {
+    aFormat = "";
+    aCompression = "";
+
+    if (startsWith(aHead, aLen, "\x1f\x8b", 2))
+    {
+      aCompression = "GZIP";
+    }
+    else if (startsWith(aHead, aLen, "BZh", 3))
+    {
+      aCompression = "BZIP2";
+    }
+    else if (startsWith(aHead, aLen, "\xfd" "7zXZ\0", 6))
+    {
+      aCompression = "XZ";
+    }
+    // zstd frames, or the dictionary of a seekable stream in front of them
+    else if (startsWith(aHead, aLen, "\x28\xb5\x2f\xfd", 4)
+             || startsWith(aHead, aLen, "\x5d\x2a\x4d\x18", 4))
+    {
+      aCompression = "ZSTD";
+    }
+    // lzma_alone: properties byte and a power-of-two dictionary size
+    else if (startsWith(aHead, aLen, "\x5d\0\0", 3) && aLen >= 13)
+    {
+      aCompression = "LZMA";
+    }
+    else if (startsWith(aHead, aLen, "PK\x03\x04", 4)
+             || startsWith(aHead, aLen, "PK\x05\x06", 4))
+    {
+      aFormat = "ZIP";
+      aCompression = "NONE";
+    }
+    else if (startsWith(aHead, aLen, "7z\xbc\xaf\x27\x1c", 6))
+    {
+      aFormat = "7ZIP";
+      aCompression = "NONE";
+    }
+    else if (startsWith(aHead, aLen, "xar!", 4))
+    {
+      aFormat = "XAR";
+      aCompression = "NONE";
+    }
+    // odc, newc, and newc with CRC headers
+    else if (startsWith(aHead, aLen, "070707", 6)
+             || startsWith(aHead, aLen, "070701", 6)
+             || startsWith(aHead, aLen, "070702", 6))
+    {
+      aFormat = "CPIO";
+      aCompression = "NONE";
+    }
+    else if (isTarHeader(aHead, aLen))
+    {
+      aFormat = "TAR";
+      aCompression = "NONE";
+    }
+  }
+
+  bool
+  ArchiveSniffer::xarCompression(
+      const char* aData,
+      size_t aLen,
+      std::string& aCompression)
+  {
+    if (aLen < XAR_HEADER_SIZE || !startsWith(aData, aLen, "xar!", 4))
+      return false;
+
+    // big endian header: size of the header, version, compressed and
+    // uncompressed size of the TOC, checksum algorithm of the TOC
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(aData);
+    uint64_t lHeaderSize = (u[4] << 8) | u[5];
+    uint64_t lTocSize = 0;
+    for (size_t i = 8; i < 16; ++i)
+    {
+      lTocSize = (lTocSize << 8) | u[i];
+    }
+    uint32_t lSumAlgorithm = (u[24] << 24) | (u[25] << 16) | (u[26] << 8) | u[27];
+
+    uint64_t lSumSize;
+    switch (lSumAlgorithm)
+    {
+      case 0: lSumSize = 0; break;   // none
+      case 1: lSumSize = 20; break;  // sha1
+      case 2: lSumSize = 16; break;  // md5
+      default: return false;
+    }
+
+    // the heap starts with the checksum of the TOC followed by the data
+    // of the first entry with content
+    uint64_t lOffset = lHeaderSize + lTocSize + lSumSize;
+    if (lHeaderSize < XAR_HEADER_SIZE || lTocSize > aLen
+        || lOffset + 6 > aLen)
+    {
+      return false;
+    }
+    const char* lHead = aData + lOffset;
+    const unsigned char* h = u + lOffset;
+
+    if (startsWith(lHead, 6, "\xfd" "7zXZ\x00", 6))
+      aCompression = "XZ";
+    else if (startsWith(lHead, 6, "BZh", 3))
+      aCompression = "BZIP2";
+    else if (startsWith(lHead, 6, "\x5d\x00\x00", 3))
+      aCompression = "LZMA";
+    // "gzip" entries of xar archives are zlib streams
+    else if ((h[0] & 0x0F) == 8 && ((h[0] << 8) | h[1]) % 31 == 0)
+      aCompression = "GZIP";
+    else
+      aCompression = "NONE";
+    return true;
+  }
+
+  std::string
+  ArchiveSniffer::zipMethodName(uint16_t aMethod)
+  {
+    switch (aMethod)
+    {
+      case 0:  return "STORE";
+      case 8:  return "DEFLATE";
+      case 9:  return "DEFLATE64";
+      case 12: return "BZIP2";
+      case 14: return "LZMA";
+      case 93: return "ZSTD";
+      case 95: return "XZ";
+      default:
+      {
+        std::ostringstream lName;
+        lName << aMethod;
+        return lName.str();
+      }
+    }
+  }
+
+} /* namespace archive */ } /* namespace zorba */
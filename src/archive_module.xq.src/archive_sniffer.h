@@ -0,0 +1,83 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_ARCHIVE_SNIFFER_H_
+#define ZORBA_ARCHIVE_ARCHIVE_SNIFFER_H_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Detects format and compression of an archive from its leading bytes
+ * without setting up a libarchive reader.
+ ******************************************************************************/
+  class ArchiveSniffer
+  {
+    public:
+      // number of leading bytes needed to detect all known formats
+      static const size_t HEAD_SIZE = 512;
+
+      /**
+       * Sets aFormat to "ZIP", "TAR", "7ZIP", "XAR", "CPIO", or ""
+       * (unknown or hidden by the compression) and aCompression to
+       * "NONE", "GZIP", "BZIP2", "LZMA", "XZ", "ZSTD", or "" (unknown).
+       */
+      static void
+      sniff(
+          const char* aHead,
+          size_t aLen,
+          std::string& aFormat,
+          std::string& aCompression);
+
+      /**
+       * Tells if a (TAR) archive starts with a pax extended header,
+       * i.e. was written in pax format. sniff reports such archives as
+       * "TAR".
+       */
+      static bool
+      hasPaxHeader(const char* aHead, size_t aLen);
+
+      /**
+       * Sets aCompression to the compression of the entries of a XAR
+       * archive ("GZIP", "BZIP2", "LZMA", "XZ", or "NONE"), which
+       * libarchive doesn't report. It's taken from the data of the first
+       * entry with content, i.e. aData must contain the header and the
+       * TOC. Returns false if that data isn't available.
+       */
+      static bool
+      xarCompression(
+          const char* aData,
+          size_t aLen,
+          std::string& aCompression);
+
+      /**
+       * Returns the name of a ZIP compression method (the number for
+       * unknown methods).
+       */
+      static std::string
+      zipMethodName(uint16_t aMethod);
+
+    protected:
+      static bool
+      isTarHeader(const char* aHead, size_t aLen);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_ARCHIVE_SNIFFER_H_
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "content_cache.h"
+#include "digest.h"
+#include "zip_format.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ ******************************************************************************/
+  ContentCache::ContentCache()
+    : theBudget(0),
+      theBytes(0),
+      theHits(0),
+      theMisses(0),
+      theEvictions(0),
+      theDigestedBytes(0)
+  {}
+
+  ContentCache&
+  ContentCache::getInstance()
+  {
+    // created while the module is loaded, i.e. before queries run
+    static ContentCache theInstance;
+    return theInstance;
+  }
+
+  bool
+  ContentCache::isEnabled() const
+  {
+    ScopedLock lLock(theMutex);
+    return theBudget > 0;
+  }
+
+  void
+  ContentCache::setBudget(uint64_t aBudget)
+  {
+    ScopedLock lLock(theMutex);
+    theBudget = aBudget;
+    evict(theBudget);
+  }
+
+  bool
+  ContentCache::get(
+      const std::string& aArchiveKey,
+      const std::string& aName,
+      Contents& aContents)
+  {
+    ScopedLock lLock(theMutex);
+
+    ElementMap::iterator lIter = theMap.find(getElementKey(aArchiveKey, aName));
+    if (lIter == theMap.end())
+    {
+      ++theMisses;
+      return false;
+    }
+
+    ++theHits;
+    theElements.splice(theElements.begin(), theElements, lIter->second);
+    aContents = lIter->second->theContents;
+    return true;
+  }
+
+  void
+  ContentCache::put(
+      const std::string& aArchiveKey,
+      const std::string& aName,
+      const Contents& aContents)
+  {
+    std::string lKey = getElementKey(aArchiveKey, aName);
+
+    uint64_t lSize = lKey.size();
+    for (Contents::const_iterator lIter = aContents.begin();
+         lIter != aContents.end(); ++lIter)
+    {
+      lSize += lIter->second.size();
+    }
+
+    ScopedLock lLock(theMutex);
+
+    if (lSize > theBudget || theMap.find(lKey) != theMap.end())
+    {
+      return;
+    }
+
+    evict(theBudget - lSize);
+
+    theElements.push_front(Element());
+    Element& lElement = theElements.front();
+    lElement.theKey = lKey;
+    lElement.theContents = aContents;
+    lElement.theSize = lSize;
+    theMap[lKey] = theElements.begin();
+    theBytes += lSize;
+  }
+
+  void
+  ContentCache::getStatistics(Statistics& aStatistics) const
+  {
+    ScopedLock lLock(theMutex);
+    aStatistics.theHits = theHits;
+    aStatistics.theMisses = theMisses;
+    aStatistics.theEvictions = theEvictions;
+    aStatistics.theBytes = theBytes;
+    aStatistics.theElements = theMap.size();
+    aStatistics.theBudget = theBudget;
+    aStatistics.theDigestedBytes = theDigestedBytes;
+  }
+
+  void
+  ContentCache::evict(uint64_t aBudget)
+  {
+    while (theBytes > aBudget && !theElements.empty())
+    {
+      Element& lElement = theElements.back();
+      theBytes -= lElement.theSize;
+      theMap.erase(lElement.theKey);
+      theElements.pop_back();
+      ++theEvictions;
+    }
+  }
+
+  std::string
+  ContentCache::computeKey(const char* aData, size_t aSize)
+  {
+    {
+      ScopedLock lLock(theMutex);
+      theDigestedBytes += aSize;
+    }
+
+    // without checksums of the entries' data (as in ZIP), all bytes count
+    SHA256 lDigest;
+    lDigest.update(aData, aSize);
+    return lDigest.finish();
+  }
+
+  std::string
+  ContentCache::computeKey(const ZipDirectory& aDirectory)
+  {
+    // accidental collisions would need equal names, offsets, sizes, and
+    // CRC-32 values; the prefix keeps these keys apart from the others
+    SHA256 lDigest;
+    uint64_t lFields[5];
+    for (size_t i = 0; i < aDirectory.size(); ++i)
+    {
+      const ZipDirectory::Entry& lEntry = aDirectory.getEntry(i);
+      lFields[0] = lEntry.theLocalHeaderOffset;
+      lFields[1] = lEntry.theCompressedSize;
+      lFields[2] = lEntry.theUncompressedSize;
+      lFields[3] = lEntry.theCRC32;
+      lFields[4] = (static_cast<uint64_t>(lEntry.theMethod) << 16)
+        | lEntry.theFlags;
+      lDigest.update(lFields, sizeof(lFields));
+      lDigest.update(lEntry.theName.c_str(), lEntry.theName.size() + 1);
+    }
+    lFields[0] = aDirectory.getDirectoryOffset();
+    lDigest.update(lFields, sizeof(lFields[0]));
+    return "zip:" + lDigest.finish();
+  }
+
+  std::string
+  ContentCache::getElementKey(
+      const std::string& aArchiveKey,
+      const std::string& aName)
+  {
+    // the archive key has a fixed size
+    return aArchiveKey + aName;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
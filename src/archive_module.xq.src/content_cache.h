@@ -0,0 +1,143 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_CONTENT_CACHE_H_
+#define ZORBA_ARCHIVE_CONTENT_CACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "sync.h"
+
+namespace zorba { namespace archive {
+
+  class ZipDirectory;
+
+/*******************************************************************************
+ * Module-wide LRU cache of decompressed entry contents. An element is
+ * identified by the key of an archive (see computeKey) and an entry name
+ * and holds the contents of all entries with this name together with their
+ * positions in the archive. The cache is disabled as long as its budget
+ * is 0. Elements are evicted in least recently used order to keep the
+ * size of the cached contents and names within the budget.
+ ******************************************************************************/
+  class ContentCache
+  {
+    public:
+      // position of the entry in the archive and its content
+      typedef std::vector<std::pair<size_t, std::string> > Contents;
+
+      struct Statistics
+      {
+        uint64_t theHits;
+        uint64_t theMisses;
+        uint64_t theEvictions;
+        uint64_t theBytes;
+        uint64_t theElements;
+        uint64_t theBudget;
+        uint64_t theDigestedBytes;
+      };
+
+    protected:
+      struct Element
+      {
+        std::string theKey;
+        Contents    theContents;
+        uint64_t    theSize;
+      };
+
+      typedef std::list<Element> ElementList;
+      typedef std::map<std::string, ElementList::iterator> ElementMap;
+
+      mutable Mutex theMutex;
+      ElementList   theElements; // most recently used first
+      ElementMap    theMap;
+      uint64_t      theBudget;
+      uint64_t      theBytes;
+      uint64_t      theHits;
+      uint64_t      theMisses;
+      uint64_t      theEvictions;
+      uint64_t      theDigestedBytes;
+
+    public:
+      static ContentCache&
+      getInstance();
+
+      bool
+      isEnabled() const;
+
+      /**
+       * Sets the budget in bytes and evicts elements if needed. A budget
+       * of 0 disables the cache and drops all elements.
+       */
+      void
+      setBudget(uint64_t aBudget);
+
+      /**
+       * Returns true and the contents of all entries with the given name
+       * if they are cached. Each call counts as hit or miss.
+       */
+      bool
+      get(
+          const std::string& aArchiveKey,
+          const std::string& aName,
+          Contents& aContents);
+
+      /**
+       * Caches the contents of all entries with the given name (possibly
+       * none). Contents larger than the budget aren't cached.
+       */
+      void
+      put(
+          const std::string& aArchiveKey,
+          const std::string& aName,
+          const Contents& aContents);
+
+      void
+      getStatistics(Statistics& aStatistics) const;
+
+      /**
+       * Computes a key that identifies the content of an archive, i.e.
+       * the SHA-256 digest of all its bytes.
+       */
+      std::string
+      computeKey(const char* aData, size_t aSize);
+
+      /**
+       * Computes the key of a ZIP archive out of its central directory,
+       * which holds the CRC-32 of each entry, i.e. without reading the
+       * data of the archive.
+       */
+      static std::string
+      computeKey(const ZipDirectory& aDirectory);
+
+    protected:
+      ContentCache();
+
+      void
+      evict(uint64_t aBudget);
+
+      static std::string
+      getElementKey(const std::string& aArchiveKey, const std::string& aName);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_CONTENT_CACHE_H_
@@ -0,0 +1,516 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+// CRC-32 by carry-less multiplication; the CPU is checked at runtime
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) \
+  || defined(_M_X64)
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define ZORBA_ARCHIVE_PCLMUL_TARGET
+# else
+#  include <cpuid.h>
+#  define ZORBA_ARCHIVE_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+# endif
+# include <smmintrin.h>
+# include <wmmintrin.h>
+# define ZORBA_ARCHIVE_HAVE_PCLMUL
+#endif
+
+#include "digest.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ ******************************************************************************/
+  static uint32_t theCRC32Table[256];
+
+  static struct CRC32TableInit
+  {
+    CRC32TableInit()
+    {
+      for (uint32_t i = 0; i < 256; ++i)
+      {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+        {
+          c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        theCRC32Table[i] = c;
+      }
+    }
+  } theCRC32TableInit;
+
+#ifdef ZORBA_ARCHIVE_HAVE_PCLMUL
+  static bool
+  hasPCLMUL()
+  {
+    unsigned int lECX;
+# ifdef _MSC_VER
+    int lInfo[4];
+    __cpuid(lInfo, 1);
+    lECX = static_cast<unsigned int>(lInfo[2]);
+# else
+    unsigned int lEAX, lEBX, lEDX;
+    if (!__get_cpuid(1, &lEAX, &lEBX, &lECX, &lEDX)) return false;
+# endif
+    // PCLMULQDQ and SSE4.1
+    return (lECX & (1 << 1)) && (lECX & (1 << 19));
+  }
+
+  static const bool theHasPCLMUL = hasPCLMUL();
+
+  /**
+   * Folds 64 bytes at a time into four 128 bit lanes and reduces them
+   * with a Barrett reduction (see Intel's "Fast CRC Computation for
+   * Generic Polynomials Using PCLMULQDQ Instruction"). aLen must be a
+   * multiple of 16 and at least 64.
+   */
+  ZORBA_ARCHIVE_PCLMUL_TARGET
+  static uint32_t
+  crc32Fold(uint32_t aCRC, const unsigned char* p, size_t aLen)
+  {
+    const __m128i lK1K2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i lK3K4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i lK5K0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+    const __m128i lPoly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i lMask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(aCRC)));
+    p += 64;
+    aLen -= 64;
+
+    __m128i x5, x6, x7, x8;
+    while (aLen >= 64)
+    {
+      x5 = _mm_clmulepi64_si128(x1, lK1K2, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, lK1K2, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, lK1K2, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, lK1K2, 0x00);
+
+      x1 = _mm_clmulepi64_si128(x1, lK1K2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, lK1K2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, lK1K2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, lK1K2, 0x11);
+
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)));
+      p += 64;
+      aLen -= 64;
+    }
+
+    // fold the four lanes into one
+    x5 = _mm_clmulepi64_si128(x1, lK3K4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, lK3K4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, lK3K4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, lK3K4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, lK3K4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, lK3K4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (aLen >= 16)
+    {
+      x5 = _mm_clmulepi64_si128(x1, lK3K4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, lK3K4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+      p += 16;
+      aLen -= 16;
+    }
+
+    // 128 to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, lK3K4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, lMask);
+    x1 = _mm_clmulepi64_si128(x1, lK5K0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, lMask);
+    x2 = _mm_clmulepi64_si128(x2, lPoly, 0x10);
+    x2 = _mm_and_si128(x2, lMask);
+    x2 = _mm_clmulepi64_si128(x2, lPoly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+  }
+#endif
+
+  void
+  CRC32::update(const void* aData, size_t aLen)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(aData);
+    uint32_t c = theValue;
+#ifdef ZORBA_ARCHIVE_HAVE_PCLMUL
+    if (theHasPCLMUL && aLen >= 64)
+    {
+      size_t lFolded = aLen & ~static_cast<size_t>(15);
+      c = crc32Fold(c, p, lFolded);
+      p += lFolded;
+      aLen -= lFolded;
+    }
+#endif
+    for (size_t i = 0; i < aLen; ++i)
+    {
+      c = theCRC32Table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    }
+    theValue = c;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  static const uint32_t theSHA256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  static inline uint32_t
+  rotr(uint32_t x, int n)
+  {
+    return (x >> n) | (x << (32 - n));
+  }
+
+  SHA256::SHA256()
+  {
+    reset();
+  }
+
+  void
+  SHA256::reset()
+  {
+    theState[0] = 0x6a09e667;
+    theState[1] = 0xbb67ae85;
+    theState[2] = 0x3c6ef372;
+    theState[3] = 0xa54ff53a;
+    theState[4] = 0x510e527f;
+    theState[5] = 0x9b05688c;
+    theState[6] = 0x1f83d9ab;
+    theState[7] = 0x5be0cd19;
+    theLength = 0;
+    theBlockLen = 0;
+  }
+
+  void
+  SHA256::transform(const unsigned char* aBlock)
+  {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+    {
+      w[i] = (static_cast<uint32_t>(aBlock[4 * i]) << 24)
+        | (static_cast<uint32_t>(aBlock[4 * i + 1]) << 16)
+        | (static_cast<uint32_t>(aBlock[4 * i + 2]) << 8)
+        | static_cast<uint32_t>(aBlock[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; ++i)
+    {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = theState[0], b = theState[1], c = theState[2],
+             d = theState[3], e = theState[4], f = theState[5],
+             g = theState[6], h = theState[7];
+
+    for (int i = 0; i < 64; ++i)
+    {
+      uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + S1 + ch + theSHA256Constants[i] + w[i];
+      uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = S0 + maj;
+
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    theState[0] += a; theState[1] += b; theState[2] += c; theState[3] += d;
+    theState[4] += e; theState[5] += f; theState[6] += g; theState[7] += h;
+  }
+
+  void
+  SHA256::update(const void* aData, size_t aLen)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(aData);
+    theLength += aLen;
+
+    if (theBlockLen)
+    {
+      size_t lFill = 64 - theBlockLen;
+      if (aLen < lFill)
+      {
+        memcpy(theBlock + theBlockLen, p, aLen);
+        theBlockLen += aLen;
+        return;
+      }
+      memcpy(theBlock + theBlockLen, p, lFill);
+      transform(theBlock);
+      p += lFill;
+      aLen -= lFill;
+      theBlockLen = 0;
+    }
+
+    while (aLen >= 64)
+    {
+      transform(p);
+      p += 64;
+      aLen -= 64;
+    }
+
+    memcpy(theBlock, p, aLen);
+    theBlockLen = aLen;
+  }
+
+  std::string
+  SHA256::finish()
+  {
+    uint64_t lBits = theLength * 8;
+
+    unsigned char lPad[72];
+    size_t lPadLen = (theBlockLen < 56 ? 56 : 120) - theBlockLen;
+    memset(lPad, 0, sizeof(lPad));
+    lPad[0] = 0x80;
+    for (int i = 0; i < 8; ++i)
+    {
+      lPad[lPadLen + i] = static_cast<unsigned char>(lBits >> (56 - 8 * i));
+    }
+    update(lPad, lPadLen + 8);
+
+    std::string lRes(DIGEST_SIZE, '\0');
+    for (int i = 0; i < 8; ++i)
+    {
+      lRes[4 * i] = static_cast<char>(theState[i] >> 24);
+      lRes[4 * i + 1] = static_cast<char>(theState[i] >> 16);
+      lRes[4 * i + 2] = static_cast<char>(theState[i] >> 8);
+      lRes[4 * i + 3] = static_cast<char>(theState[i]);
+    }
+    return lRes;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+  static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+  static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+  static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+  static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+  static inline uint64_t
+  rotl64(uint64_t x, int n)
+  {
+    return (x << n) | (x >> (64 - n));
+  }
+
+  static inline uint64_t
+  readLE64(const unsigned char* p)
+  {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+  }
+
+  static inline uint32_t
+  readLE32(const unsigned char* p)
+  {
+    return static_cast<uint32_t>(p[0])
+      | (static_cast<uint32_t>(p[1]) << 8)
+      | (static_cast<uint32_t>(p[2]) << 16)
+      | (static_cast<uint32_t>(p[3]) << 24);
+  }
+
+  XXH64::XXH64()
+  {
+    reset();
+  }
+
+  void
+  XXH64::reset()
+  {
+    theState[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    theState[1] = XXH_PRIME64_2;
+    theState[2] = 0;
+    theState[3] = 0 - XXH_PRIME64_1;
+    theLength = 0;
+    theBlockLen = 0;
+  }
+
+  uint64_t
+  XXH64::round(uint64_t aAcc, uint64_t aInput)
+  {
+    aAcc += aInput * XXH_PRIME64_2;
+    aAcc = rotl64(aAcc, 31);
+    return aAcc * XXH_PRIME64_1;
+  }
+
+  uint64_t
+  XXH64::mergeRound(uint64_t aAcc, uint64_t aValue)
+  {
+    aAcc ^= round(0, aValue);
+    return aAcc * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+
+  void
+  XXH64::update(const void* aData, size_t aLen)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(aData);
+    theLength += aLen;
+
+    if (theBlockLen)
+    {
+      size_t lFill = 32 - theBlockLen;
+      if (aLen < lFill)
+      {
+        memcpy(theBlock + theBlockLen, p, aLen);
+        theBlockLen += aLen;
+        return;
+      }
+      memcpy(theBlock + theBlockLen, p, lFill);
+      for (int i = 0; i < 4; ++i)
+      {
+        theState[i] = round(theState[i], readLE64(theBlock + 8 * i));
+      }
+      p += lFill;
+      aLen -= lFill;
+      theBlockLen = 0;
+    }
+
+    // the four lanes are independent, i.e. processed in parallel by the CPU
+    uint64_t v1 = theState[0], v2 = theState[1],
+             v3 = theState[2], v4 = theState[3];
+    while (aLen >= 32)
+    {
+      v1 = round(v1, readLE64(p));
+      v2 = round(v2, readLE64(p + 8));
+      v3 = round(v3, readLE64(p + 16));
+      v4 = round(v4, readLE64(p + 24));
+      p += 32;
+      aLen -= 32;
+    }
+    theState[0] = v1; theState[1] = v2; theState[2] = v3; theState[3] = v4;
+
+    memcpy(theBlock, p, aLen);
+    theBlockLen = aLen;
+  }
+
+  uint64_t
+  XXH64::get() const
+  {
+    uint64_t h;
+    if (theLength >= 32)
+    {
+      h = rotl64(theState[0], 1) + rotl64(theState[1], 7)
+        + rotl64(theState[2], 12) + rotl64(theState[3], 18);
+      for (int i = 0; i < 4; ++i)
+      {
+        h = mergeRound(h, theState[i]);
+      }
+    }
+    else
+    {
+      h = theState[2] + XXH_PRIME64_5;
+    }
+    h += theLength;
+
+    const unsigned char* p = theBlock;
+    size_t lLen = theBlockLen;
+    while (lLen >= 8)
+    {
+      h ^= round(0, readLE64(p));
+      h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+      p += 8;
+      lLen -= 8;
+    }
+    if (lLen >= 4)
+    {
+      h ^= static_cast<uint64_t>(readLE32(p)) * XXH_PRIME64_1;
+      h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+      p += 4;
+      lLen -= 4;
+    }
+    while (lLen > 0)
+    {
+      h ^= (*p) * XXH_PRIME64_5;
+      h = rotl64(h, 11) * XXH_PRIME64_1;
+      ++p;
+      --lLen;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  std::string
+  toHex(const std::string& aBytes)
+  {
+    static const char lDigits[] = "0123456789abcdef";
+    std::string lRes;
+    lRes.reserve(aBytes.size() * 2);
+    for (size_t i = 0; i < aBytes.size(); ++i)
+    {
+      unsigned char c = static_cast<unsigned char>(aBytes[i]);
+      lRes += lDigits[c >> 4];
+      lRes += lDigits[c & 0xF];
+    }
+    return lRes;
+  }
+
+  std::string
+  toHex(uint64_t aValue, int aDigits)
+  {
+    static const char lDigits[] = "0123456789abcdef";
+    std::string lRes(aDigits, '0');
+    for (int i = aDigits - 1; i >= 0 && aValue; --i)
+    {
+      lRes[i] = lDigits[aValue & 0xF];
+      aValue >>= 4;
+    }
+    return lRes;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
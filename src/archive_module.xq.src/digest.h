@@ -0,0 +1,128 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_DIGEST_H_
+#define ZORBA_ARCHIVE_DIGEST_H_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Incremental CRC-32 (ISO 3309, as used by ZIP and gzip).
+ ******************************************************************************/
+  class CRC32
+  {
+    protected:
+      uint32_t theValue;
+
+    public:
+      CRC32() : theValue(0xFFFFFFFF) {}
+
+      void
+      reset() { theValue = 0xFFFFFFFF; }
+
+      void
+      update(const void* aData, size_t aLen);
+
+      uint32_t
+      get() const { return theValue ^ 0xFFFFFFFF; }
+  };
+
+/*******************************************************************************
+ * Incremental SHA-256 (FIPS 180-4).
+ ******************************************************************************/
+  class SHA256
+  {
+    public:
+      static const size_t DIGEST_SIZE = 32;
+
+    protected:
+      uint32_t      theState[8];
+      uint64_t      theLength;
+      unsigned char theBlock[64];
+      size_t        theBlockLen;
+
+    public:
+      SHA256();
+
+      void
+      reset();
+
+      void
+      update(const void* aData, size_t aLen);
+
+      /**
+       * Returns the raw (32 byte) digest. The object needs to be reset
+       * before it can be used again.
+       */
+      std::string
+      finish();
+
+    protected:
+      void
+      transform(const unsigned char* aBlock);
+  };
+
+/*******************************************************************************
+ * Incremental XXH64 (xxHash, 64 bit) with seed 0.
+ ******************************************************************************/
+  class XXH64
+  {
+    protected:
+      uint64_t      theState[4];
+      uint64_t      theLength;
+      unsigned char theBlock[32];
+      size_t        theBlockLen;
+
+    public:
+      XXH64();
+
+      void
+      reset();
+
+      void
+      update(const void* aData, size_t aLen);
+
+      uint64_t
+      get() const;
+
+    protected:
+      static uint64_t
+      round(uint64_t aAcc, uint64_t aInput);
+
+      static uint64_t
+      mergeRound(uint64_t aAcc, uint64_t aValue);
+  };
+
+  /**
+   * Returns the lower case hex representation of the given bytes.
+   */
+  std::string
+  toHex(const std::string& aBytes);
+
+  /**
+   * Returns the lower case hex representation of the given number
+   * with aDigits digits.
+   */
+  std::string
+  toHex(uint64_t aValue, int aDigits);
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_DIGEST_H_
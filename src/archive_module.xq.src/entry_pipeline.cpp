@@ -0,0 +1,185 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+
+#include "entry_pipeline.h"
+
+namespace zorba { namespace archive {
+
+  Mutex  EntryPipeline::theDepthMutex;
+  size_t EntryPipeline::theDefaultDepth = 0;
+
+/*******************************************************************************
+ ******************************************************************************/
+  void
+  EntryPipeline::Entry::swap(Entry& aOther)
+  {
+    theName.swap(aOther.theName);
+    std::swap(thePosition, aOther.thePosition);
+    theData.swap(aOther.theData);
+    theHardlink.swap(aOther.theHardlink);
+    std::swap(theCached, aOther.theCached);
+    std::swap(theExclusive, aOther.theExclusive);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  EntryPipeline::EntryPipeline(Function aFunction, void* aArg, size_t aDepth)
+    : theFunction(aFunction),
+      theArg(aArg),
+      theDepth(aDepth ? aDepth : 1),
+      theStatus(READY),
+      theCancelled(false),
+      theWaiting(false)
+  {}
+
+  EntryPipeline::~EntryPipeline()
+  {
+    cancel();
+  }
+
+  bool
+  EntryPipeline::start()
+  {
+    return theThread.start(&EntryPipeline::run, this);
+  }
+
+  void
+  EntryPipeline::run(void* aPipeline)
+  {
+    static_cast<EntryPipeline*>(aPipeline)->produce();
+  }
+
+  void
+  EntryPipeline::produce()
+  {
+    for (;;)
+    {
+      Entry lEntry;
+      {
+        ScopedLock lLock(theMutex);
+        while ((theQueue.size() >= theDepth || theWaiting) && !theCancelled)
+        {
+          theNotFull.wait(theMutex);
+        }
+        if (theCancelled) return;
+
+        if (!theSpare.empty())
+        {
+          lEntry.theData.swap(theSpare.back());
+          theSpare.pop_back();
+        }
+      }
+
+      std::string lError;
+      Status lStatus;
+      try
+      {
+        lStatus = theFunction(theArg, lEntry, lError);
+      }
+      catch (...)
+      {
+        lStatus = FAILED;
+        lError = "internal error (couldn't decode entry)";
+      }
+
+      ScopedLock lLock(theMutex);
+      if (lStatus == READY)
+      {
+        theWaiting = lEntry.theExclusive;
+        theQueue.push_back(Entry());
+        theQueue.back().swap(lEntry);
+      }
+      else
+      {
+        theStatus = lStatus;
+        theError = lError;
+      }
+      theNotEmpty.signal();
+      if (lStatus != READY) return;
+    }
+  }
+
+  EntryPipeline::Status
+  EntryPipeline::next(Entry& aEntry, std::string& aError)
+  {
+    ScopedLock lLock(theMutex);
+
+    while (theQueue.empty() && theStatus == READY)
+    {
+      theNotEmpty.wait(theMutex);
+    }
+
+    if (theQueue.empty())
+    {
+      aError = theError;
+      return theStatus;
+    }
+
+    aEntry.swap(theQueue.front());
+    theQueue.pop_front();
+    theNotFull.signal();
+    return READY;
+  }
+
+  void
+  EntryPipeline::recycle(std::string& aBuffer)
+  {
+    ScopedLock lLock(theMutex);
+    if (theSpare.size() < theDepth)
+    {
+      aBuffer.clear();
+      theSpare.push_back(std::string());
+      theSpare.back().swap(aBuffer);
+    }
+  }
+
+  void
+  EntryPipeline::resume()
+  {
+    ScopedLock lLock(theMutex);
+    theWaiting = false;
+    theNotFull.signal();
+  }
+
+  void
+  EntryPipeline::cancel()
+  {
+    {
+      ScopedLock lLock(theMutex);
+      theCancelled = true;
+      theNotFull.broadcast();
+    }
+    theThread.join();
+  }
+
+  size_t
+  EntryPipeline::getDepth()
+  {
+    ScopedLock lLock(theDepthMutex);
+    return theDefaultDepth;
+  }
+
+  void
+  EntryPipeline::setDepth(size_t aDepth)
+  {
+    ScopedLock lLock(theDepthMutex);
+    theDefaultDepth = aDepth;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ZORBA_ARCHIVE_ENTRY_PIPELINE_H_
+#define ZORBA_ARCHIVE_ENTRY_PIPELINE_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "sync.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Decodes the entries of an archive on a background thread into a bounded
+ * queue while the consumer processes the previous ones. The produce
+ * function runs on that thread and must neither throw nor use the Zorba
+ * API. Its error is reported by the call of next() that would have
+ * returned the failing entry.
+ ******************************************************************************/
+  class EntryPipeline
+  {
+    public:
+      struct Entry
+      {
+        std::string theName;
+        // position of the entry's header in the archive
+        size_t      thePosition;
+        std::string theData;
+        // target of a hardlink whose data must be read by the consumer
+        std::string theHardlink;
+        // the data was taken from the content cache
+        bool        theCached;
+        // the producer waits for resume() once the entry is consumed
+        // (e.g. because the consumer needs to read the input itself)
+        bool        theExclusive;
+
+        Entry() : thePosition(0), theCached(false), theExclusive(false) {}
+
+        void
+        swap(Entry& aOther);
+      };
+
+      enum Status { READY, END, FAILED };
+
+      // produces the next entry (READY), or reports the end or an error
+      typedef Status (*Function)(void* aArg, Entry& aEntry, std::string& aError);
+
+    protected:
+      Function          theFunction;
+      void*             theArg;
+      size_t            theDepth;
+
+      std::deque<Entry> theQueue;
+      // buffers given back by the consumer to decode further entries into
+      std::vector<std::string> theSpare;
+      // END or FAILED once the producer stopped
+      Status            theStatus;
+      std::string       theError;
+      bool              theCancelled;
+      bool              theWaiting;
+
+      Mutex             theMutex;
+      Condition         theNotEmpty;
+      Condition         theNotFull;
+      Thread            theThread;
+
+      static Mutex      theDepthMutex;
+      static size_t     theDefaultDepth;
+
+    public:
+      EntryPipeline(Function aFunction, void* aArg, size_t aDepth);
+
+      ~EntryPipeline();
+
+      /**
+       * Returns false if the thread couldn't be started.
+       */
+      bool
+      start();
+
+      /**
+       * Waits for the next entry. Returns END after the last entry and
+       * FAILED (with the message of the producer) if producing the next
+       * entry failed.
+       */
+      Status
+      next(Entry& aEntry, std::string& aError);
+
+      /**
+       * Gives a buffer back (e.g. the one swapped out for the data of the
+       * last entry) such that the producer reuses its memory.
+       */
+      void
+      recycle(std::string& aBuffer);
+
+      /**
+       * Lets the producer continue after an exclusive entry.
+       */
+      void
+      resume();
+
+      /**
+       * Stops the thread after it produced the entry in progress.
+       */
+      void
+      cancel();
+
+      /**
+       * Number of entries decoded ahead by the extract functions (0 if
+       * pipelining is disabled).
+       */
+      static size_t
+      getDepth();
+
+      static void
+      setDepth(size_t aDepth);
+
+    protected:
+      static void
+      run(void* aPipeline);
+
+      void
+      produce();
+
+    private:
+      EntryPipeline(const EntryPipeline&);
+
+      EntryPipeline&
+      operator=(const EntryPipeline&);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_ENTRY_PIPELINE_H_
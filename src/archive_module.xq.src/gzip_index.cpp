@@ -0,0 +1,563 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#ifdef ZORBA_ARCHIVE_HAVE_ZLIB
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "gzip_index.h"
+#include "resource_guard.h"
+
+#define GZIP_INDEX_MAGIC   "ZAGZ"
+#define GZIP_INDEX_VERSION 1
+#define GZIP_WINDOW_SIZE   32768
+#define GZIP_TRAILER_SIZE  8
+
+// inflate takes the input in chunks of at most this size (uInt)
+#define GZIP_MAX_INPUT     1073741824
+
+namespace zorba { namespace archive {
+
+  static inline void
+  appendUInt32(std::string& aBuf, uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i)
+    {
+      aBuf += static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+  }
+
+  static inline void
+  appendUInt64(std::string& aBuf, uint64_t v)
+  {
+    appendUInt32(aBuf, static_cast<uint32_t>(v & 0xFFFFFFFF));
+    appendUInt32(aBuf, static_cast<uint32_t>(v >> 32));
+  }
+
+  static inline void
+  appendString(std::string& aBuf, const std::string& aValue)
+  {
+    appendUInt32(aBuf, static_cast<uint32_t>(aValue.size()));
+    aBuf += aValue;
+  }
+
+  /**
+   * Reads the values of a serialized index; every read fails once the
+   * end has been reached.
+   */
+  class IndexInput
+  {
+    protected:
+      const unsigned char* theData;
+      size_t               theSize;
+      size_t               thePos;
+
+    public:
+      IndexInput(const char* aData, size_t aSize)
+        : theData(reinterpret_cast<const unsigned char*>(aData)),
+          theSize(aSize),
+          thePos(0) {}
+
+      bool
+      atEnd() const { return thePos == theSize; }
+
+      bool
+      getBytes(size_t aLen, std::string& aValue)
+      {
+        if (aLen > theSize - thePos) return false;
+        aValue.assign(reinterpret_cast<const char*>(theData + thePos), aLen);
+        thePos += aLen;
+        return true;
+      }
+
+      bool
+      getByte(unsigned char& aValue)
+      {
+        if (thePos == theSize) return false;
+        aValue = theData[thePos++];
+        return true;
+      }
+
+      bool
+      getUInt32(uint32_t& aValue)
+      {
+        if (theSize - thePos < 4) return false;
+        aValue = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+          aValue |= static_cast<uint32_t>(theData[thePos++]) << (8 * i);
+        }
+        return true;
+      }
+
+      bool
+      getUInt64(uint64_t& aValue)
+      {
+        uint32_t lLow, lHigh;
+        if (!getUInt32(lLow) || !getUInt32(lHigh)) return false;
+        aValue = (static_cast<uint64_t>(lHigh) << 32) | lLow;
+        return true;
+      }
+
+      bool
+      getString(std::string& aValue)
+      {
+        uint32_t lLen;
+        return getUInt32(lLen) && getBytes(lLen, aValue);
+      }
+  };
+
+  /**
+   * A z_stream that is released on all paths.
+   */
+  struct Inflater
+  {
+    z_stream theStream;
+    bool     theInitialized;
+
+    Inflater(int aWindowBits)
+    {
+      memset(&theStream, 0, sizeof(theStream));
+      theInitialized = inflateInit2(&theStream, aWindowBits) == Z_OK;
+    }
+
+    ~Inflater()
+    {
+      if (theInitialized) inflateEnd(&theStream);
+    }
+
+    uint64_t
+    getInOffset(const char* aData) const
+    {
+      return reinterpret_cast<const char*>(theStream.next_in) - aData;
+    }
+
+    // hands the input to zlib in chunks it can take
+    void
+    refill(const char* aData, uint64_t aSize)
+    {
+      if (theStream.avail_in) return;
+      uint64_t lPos = getInOffset(aData);
+      theStream.avail_in = static_cast<uInt>(
+          std::min<uint64_t>(aSize - lPos, GZIP_MAX_INPUT));
+    }
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  GzipIndex::GzipIndex()
+    : theCompressedSize(0),
+      theSize(0)
+  {
+  }
+
+  bool
+  GzipIndex::isGzip(const char* aData, uint64_t aSize)
+  {
+    return aSize >= 3
+      && static_cast<unsigned char>(aData[0]) == 0x1F
+      && static_cast<unsigned char>(aData[1]) == 0x8B
+      && aData[2] == 8;
+  }
+
+  bool
+  GzipIndex::build(
+      const char* aData,
+      uint64_t aSize,
+      uint64_t aSpan,
+      ResourceGuard* aGuard)
+  {
+    theCheckpoints.clear();
+    theEntries.clear();
+    theError.clear();
+    theSize = 0;
+
+    if (!isGzip(aData, aSize))
+    {
+      theError = "archive is not gzip compressed";
+      return false;
+    }
+    if (!aSpan)
+    {
+      aSpan = ZORBA_ARCHIVE_GZIP_INDEX_SPAN;
+    }
+
+    // gzip header (32) and maximum window (15)
+    Inflater lInflater(47);
+    z_stream& lStream = lInflater.theStream;
+    if (!lInflater.theInitialized)
+    {
+      theError = "couldn't initialize zlib";
+      return false;
+    }
+
+    // the output goes round the window such that it always holds the
+    // last 32 KB for the next checkpoint
+    std::string lWindow(GZIP_WINDOW_SIZE, '\0');
+    Bytef* lOut = reinterpret_cast<Bytef*>(&lWindow[0]);
+    lStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(aData));
+    lStream.avail_in = 0;
+    lStream.next_out = lOut;
+    lStream.avail_out = GZIP_WINDOW_SIZE;
+
+    TarScanner lScanner;
+    uint64_t lTotal = 0;
+    uint64_t lLast = 0;
+    size_t lSeen = 0;
+    while (true)
+    {
+      lInflater.refill(aData, aSize);
+      if (!lStream.avail_out)
+      {
+        lStream.next_out = lOut;
+        lStream.avail_out = GZIP_WINDOW_SIZE;
+      }
+
+      Bytef* lBefore = lStream.next_out;
+      int lErr = inflate(&lStream, Z_BLOCK);
+      size_t lProduced = lStream.next_out - lBefore;
+      if (lProduced)
+      {
+        lTotal += lProduced;
+        if (!lScanner.feed(reinterpret_cast<const char*>(lBefore), lProduced))
+        {
+          theError = "not a TAR archive (" + lScanner.getError() + ")";
+          return false;
+        }
+        if (aGuard)
+        {
+          const std::vector<Entry>& lEntries = lScanner.getEntries();
+          for (; lSeen < lEntries.size(); ++lSeen)
+          {
+            aGuard->startEntry(lEntries[lSeen].theName.c_str());
+          }
+          if (!aGuard->addData(lProduced, lInflater.getInOffset(aData)))
+          {
+            theError = aGuard->getError();
+            return false;
+          }
+        }
+      }
+
+      if (lErr == Z_STREAM_END)
+      {
+        // concatenated members (e.g. pigz, appended archives); anything
+        // else after the trailer is ignored like gzip does
+        uint64_t lNext = lInflater.getInOffset(aData);
+        if (!isGzip(aData + lNext, aSize - lNext)) break;
+        inflateReset(&lStream);
+        continue;
+      }
+      if (lErr != Z_OK && lErr != Z_BUF_ERROR)
+      {
+        theError = lStream.msg ? lStream.msg : "invalid gzip data";
+        return false;
+      }
+      if (lErr == Z_BUF_ERROR && lInflater.getInOffset(aData) == aSize)
+      {
+        theError = "unexpected end of archive";
+        return false;
+      }
+
+      // at a block boundary, except behind the last block of a member
+      if ((lStream.data_type & 128) && !(lStream.data_type & 64)
+          && (theCheckpoints.empty() || lTotal - lLast >= aSpan))
+      {
+        Checkpoint lPoint;
+        lPoint.theOffset = lTotal;
+        lPoint.theInOffset = lInflater.getInOffset(aData);
+        lPoint.theBits = lStream.data_type & 7;
+        size_t lFill = GZIP_WINDOW_SIZE - lStream.avail_out;
+        if (lTotal >= GZIP_WINDOW_SIZE)
+        {
+          lPoint.theWindow = lWindow.substr(lFill) + lWindow.substr(0, lFill);
+        }
+        else
+        {
+          lPoint.theWindow = lWindow.substr(0, lFill);
+        }
+        theCheckpoints.push_back(lPoint);
+        lLast = lTotal;
+      }
+    }
+
+    theEntries.swap(lScanner.getEntries());
+    theSize = lTotal;
+    theCompressedSize = aSize;
+    theTrailer.assign(
+        aData + aSize - std::min<uint64_t>(aSize, GZIP_TRAILER_SIZE),
+        aData + aSize);
+    return true;
+  }
+
+  bool
+  GzipIndex::matches(const char* aData, uint64_t aSize) const
+  {
+    return aSize == theCompressedSize
+      && aSize >= theTrailer.size()
+      && memcmp(aData + aSize - theTrailer.size(),
+                theTrailer.data(), theTrailer.size()) == 0;
+  }
+
+  bool
+  GzipIndex::read(
+      const char* aData,
+      uint64_t aSize,
+      uint64_t aOffset,
+      uint64_t aLen,
+      std::string& aResult)
+  {
+    if (!aLen) return true;
+    if (aOffset > theSize || aLen > theSize - aOffset)
+    {
+      theError = "range exceeds the archive";
+      return false;
+    }
+
+    // the checkpoint closest before the offset
+    size_t i = theCheckpoints.size();
+    while (i > 0 && theCheckpoints[i - 1].theOffset > aOffset) --i;
+    if (i == 0)
+    {
+      theError = "index doesn't cover the range";
+      return false;
+    }
+    const Checkpoint& lPoint = theCheckpoints[i - 1];
+    if (lPoint.theInOffset > aSize || (lPoint.theBits && !lPoint.theInOffset))
+    {
+      theError = "index doesn't match the archive";
+      return false;
+    }
+
+    // raw deflate, i.e. continue in the middle of a member
+    Inflater lInflater(-15);
+    z_stream& lStream = lInflater.theStream;
+    if (!lInflater.theInitialized)
+    {
+      theError = "couldn't initialize zlib";
+      return false;
+    }
+    lStream.next_in = reinterpret_cast<Bytef*>(
+        const_cast<char*>(aData + lPoint.theInOffset));
+    lStream.avail_in = 0;
+    if (lPoint.theBits)
+    {
+      int lByte = static_cast<unsigned char>(aData[lPoint.theInOffset - 1]);
+      inflatePrime(&lStream, lPoint.theBits, lByte >> (8 - lPoint.theBits));
+    }
+    if (!lPoint.theWindow.empty())
+    {
+      inflateSetDictionary(&lStream,
+          reinterpret_cast<const Bytef*>(lPoint.theWindow.data()),
+          static_cast<uInt>(lPoint.theWindow.size()));
+    }
+
+    std::string lBuffer(GZIP_WINDOW_SIZE, '\0');
+    Bytef* lOut = reinterpret_cast<Bytef*>(&lBuffer[0]);
+    uint64_t lSkip = aOffset - lPoint.theOffset;
+    while (aLen)
+    {
+      lInflater.refill(aData, aSize);
+      lStream.next_out = lOut;
+      lStream.avail_out = GZIP_WINDOW_SIZE;
+
+      int lErr = inflate(&lStream, Z_NO_FLUSH);
+      size_t lProduced = GZIP_WINDOW_SIZE - lStream.avail_out;
+      if (lSkip >= lProduced)
+      {
+        lSkip -= lProduced;
+      }
+      else
+      {
+        size_t lLen = static_cast<size_t>(
+            std::min<uint64_t>(lProduced - lSkip, aLen));
+        aResult.append(lBuffer, static_cast<size_t>(lSkip), lLen);
+        aLen -= lLen;
+        lSkip = 0;
+      }
+
+      if (lErr == Z_STREAM_END)
+      {
+        if (!aLen) break;
+
+        // the next member starts behind the trailer
+        uint64_t lNext = lInflater.getInOffset(aData) + GZIP_TRAILER_SIZE;
+        if (lNext > aSize || !isGzip(aData + lNext, aSize - lNext))
+        {
+          theError = "unexpected end of archive";
+          return false;
+        }
+        inflateReset2(&lStream, 31);
+        lStream.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(aData + lNext));
+        lStream.avail_in = 0;
+        continue;
+      }
+      if (lErr != Z_OK && lErr != Z_BUF_ERROR)
+      {
+        theError = lStream.msg ? lStream.msg : "invalid gzip data";
+        return false;
+      }
+      if (lErr == Z_BUF_ERROR && lInflater.getInOffset(aData) == aSize)
+      {
+        theError = "unexpected end of archive";
+        return false;
+      }
+    }
+    return true;
+  }
+
+/*******************************************************************************
+ * Layout (little-endian): magic, version, compressed size, trailer,
+ * decompressed size, checkpoints (offsets, bits, deflated window), and
+ * entries (offsets, size, mtime, type, name, link).
+ ******************************************************************************/
+  void
+  GzipIndex::serialize(std::string& aResult) const
+  {
+    aResult = GZIP_INDEX_MAGIC;
+    appendUInt32(aResult, GZIP_INDEX_VERSION);
+    appendUInt64(aResult, theCompressedSize);
+    appendString(aResult, theTrailer);
+    appendUInt64(aResult, theSize);
+
+    appendUInt32(aResult, static_cast<uint32_t>(theCheckpoints.size()));
+    std::string lWindow;
+    for (size_t i = 0; i < theCheckpoints.size(); ++i)
+    {
+      const Checkpoint& lPoint = theCheckpoints[i];
+      appendUInt64(aResult, lPoint.theOffset);
+      appendUInt64(aResult, lPoint.theInOffset);
+      aResult += static_cast<char>(lPoint.theBits);
+
+      // the windows make up most of the index
+      uLongf lLen = compressBound(lPoint.theWindow.size());
+      lWindow.resize(lLen);
+      compress2(reinterpret_cast<Bytef*>(&lWindow[0]), &lLen,
+          reinterpret_cast<const Bytef*>(lPoint.theWindow.data()),
+          lPoint.theWindow.size(), Z_BEST_COMPRESSION);
+      lWindow.resize(lLen);
+      appendUInt32(aResult, static_cast<uint32_t>(lPoint.theWindow.size()));
+      appendString(aResult, lWindow);
+    }
+
+    appendUInt32(aResult, static_cast<uint32_t>(theEntries.size()));
+    for (size_t i = 0; i < theEntries.size(); ++i)
+    {
+      const Entry& lEntry = theEntries[i];
+      appendUInt64(aResult, lEntry.theHeaderOffset);
+      appendUInt64(aResult, lEntry.theOffset);
+      appendUInt64(aResult, lEntry.theSize);
+      appendUInt64(aResult, static_cast<uint64_t>(lEntry.theMTime));
+      aResult += lEntry.theType;
+      appendString(aResult, lEntry.theName);
+      appendString(aResult, lEntry.theLink);
+    }
+  }
+
+  bool
+  GzipIndex::parse(const char* aData, size_t aSize)
+  {
+    theCheckpoints.clear();
+    theEntries.clear();
+    theError = "malformed index";
+
+    IndexInput lInput(aData, aSize);
+    std::string lMagic;
+    uint32_t lVersion;
+    if (!lInput.getBytes(4, lMagic) || lMagic != GZIP_INDEX_MAGIC
+        || !lInput.getUInt32(lVersion))
+    {
+      return false;
+    }
+    if (lVersion != GZIP_INDEX_VERSION)
+    {
+      theError = "unsupported index version";
+      return false;
+    }
+
+    uint32_t lCount;
+    if (!lInput.getUInt64(theCompressedSize)
+        || !lInput.getString(theTrailer)
+        || !lInput.getUInt64(theSize)
+        || !lInput.getUInt32(lCount))
+    {
+      return false;
+    }
+
+    std::string lWindow;
+    for (uint32_t i = 0; i < lCount; ++i)
+    {
+      Checkpoint lPoint;
+      unsigned char lBits;
+      uint32_t lWindowSize;
+      if (!lInput.getUInt64(lPoint.theOffset)
+          || !lInput.getUInt64(lPoint.theInOffset)
+          || !lInput.getByte(lBits) || lBits > 7
+          || !lInput.getUInt32(lWindowSize) || lWindowSize > GZIP_WINDOW_SIZE
+          || !lInput.getString(lWindow))
+      {
+        return false;
+      }
+      lPoint.theBits = lBits;
+      lPoint.theWindow.resize(lWindowSize);
+      uLongf lLen = lWindowSize;
+      if (lWindowSize
+          && (uncompress(reinterpret_cast<Bytef*>(&lPoint.theWindow[0]),
+                         &lLen,
+                         reinterpret_cast<const Bytef*>(lWindow.data()),
+                         lWindow.size()) != Z_OK
+              || lLen != lWindowSize))
+      {
+        return false;
+      }
+      theCheckpoints.push_back(lPoint);
+    }
+
+    if (!lInput.getUInt32(lCount)) return false;
+    for (uint32_t i = 0; i < lCount; ++i)
+    {
+      Entry lEntry;
+      uint64_t lMTime;
+      unsigned char lType;
+      if (!lInput.getUInt64(lEntry.theHeaderOffset)
+          || !lInput.getUInt64(lEntry.theOffset)
+          || !lInput.getUInt64(lEntry.theSize)
+          || !lInput.getUInt64(lMTime)
+          || !lInput.getByte(lType)
+          || !lInput.getString(lEntry.theName)
+          || !lInput.getString(lEntry.theLink))
+      {
+        return false;
+      }
+      lEntry.theMTime = static_cast<int64_t>(lMTime);
+      lEntry.theType = static_cast<char>(lType);
+      theEntries.push_back(lEntry);
+    }
+
+    if (!lInput.atEnd()) return false;
+    theError.clear();
+    return true;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_HAVE_ZLIB
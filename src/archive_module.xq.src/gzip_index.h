@@ -0,0 +1,131 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_GZIP_INDEX_H_
+#define ZORBA_ARCHIVE_GZIP_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "tar_scanner.h"
+
+// default distance (uncompressed) between two checkpoints
+#define ZORBA_ARCHIVE_GZIP_INDEX_SPAN 1048576
+
+namespace zorba { namespace archive {
+
+  class ResourceGuard;
+
+/*******************************************************************************
+ * Random access into a gzip compressed TAR archive (zran). build
+ * decompresses the archive once and records checkpoints: the position
+ * of a deflate block boundary together with the 32 KB of output in front
+ * of it, i.e. everything needed to resume inflating there. The headers
+ * of the entries are recorded as well (see TarScanner). read starts at
+ * the checkpoint closest before the requested offset. The index is
+ * serialized into a compact binary form that is kept next to the
+ * archive. Only available if the module is built with zlib
+ * (ZORBA_ARCHIVE_HAVE_ZLIB).
+ ******************************************************************************/
+  class GzipIndex
+  {
+    public:
+      typedef TarScanner::Entry Entry;
+
+    protected:
+      struct Checkpoint
+      {
+        // uncompressed offset
+        uint64_t    theOffset;
+        // compressed offset of the first byte not fully consumed
+        uint64_t    theInOffset;
+        // bits of the byte in front of theInOffset that are still needed
+        int         theBits;
+        std::string theWindow;
+      };
+
+      uint64_t                theCompressedSize;
+      // CRC-32 and size of the last member, i.e. to detect another archive
+      std::string             theTrailer;
+      uint64_t                theSize;
+      std::vector<Checkpoint> theCheckpoints;
+      std::vector<Entry>      theEntries;
+      std::string             theError;
+
+    public:
+      GzipIndex();
+
+      /**
+       * Decompresses the archive and records a checkpoint every aSpan
+       * bytes of output. Returns false if the archive isn't a gzip
+       * compressed TAR archive or a limit of the guard is exceeded (see
+       * getError).
+       */
+      bool
+      build(
+          const char* aData,
+          uint64_t aSize,
+          uint64_t aSpan = ZORBA_ARCHIVE_GZIP_INDEX_SPAN,
+          ResourceGuard* aGuard = 0);
+
+      void
+      serialize(std::string& aResult) const;
+
+      /**
+       * Reads a serialized index. Returns false if it is malformed.
+       */
+      bool
+      parse(const char* aData, size_t aSize);
+
+      /**
+       * Returns true if the index has been built for the given archive.
+       */
+      bool
+      matches(const char* aData, uint64_t aSize) const;
+
+      /**
+       * Appends aLen decompressed bytes starting at aOffset to aResult.
+       * Returns false if the archive is corrupted (see getError).
+       */
+      bool
+      read(
+          const char* aData,
+          uint64_t aSize,
+          uint64_t aOffset,
+          uint64_t aLen,
+          std::string& aResult);
+
+      const std::vector<Entry>&
+      getEntries() const { return theEntries; }
+
+      size_t
+      getCheckpointCount() const { return theCheckpoints.size(); }
+
+      // decompressed size
+      uint64_t
+      getSize() const { return theSize; }
+
+      const std::string&
+      getError() const { return theError; }
+
+      static bool
+      isGzip(const char* aData, uint64_t aSize);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_GZIP_INDEX_H_
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "read_ahead.h"
+
+namespace zorba { namespace archive {
+
+  Mutex  ReadAhead::theDepthMutex;
+  size_t ReadAhead::theDepth = 0;
+
+/*******************************************************************************
+ ******************************************************************************/
+  ReadAhead::ReadAhead(
+      std::istream& aStream,
+      size_t aDepth,
+      size_t aBufferSize)
+    : theStream(aStream),
+      theBuffers(aDepth < 2 ? 2 : aDepth),
+      theHead(0),
+      theTail(0),
+      theFilled(0),
+      theHolding(false),
+      theEnd(false),
+      theError(false),
+      theCancelled(false)
+  {
+    for (size_t i = 0; i < theBuffers.size(); ++i)
+    {
+      theBuffers[i].theData.resize(aBufferSize);
+      theBuffers[i].theSize = 0;
+    }
+  }
+
+  ReadAhead::~ReadAhead()
+  {
+    cancel();
+  }
+
+  bool
+  ReadAhead::start()
+  {
+    return theThread.start(&ReadAhead::run, this);
+  }
+
+  void
+  ReadAhead::run(void* aReadAhead)
+  {
+    static_cast<ReadAhead*>(aReadAhead)->fill();
+  }
+
+  void
+  ReadAhead::fill()
+  {
+    for (;;)
+    {
+      size_t lIndex;
+      {
+        ScopedLock lLock(theMutex);
+        while (theFilled == theBuffers.size() && !theCancelled)
+        {
+          theNotFull.wait(theMutex);
+        }
+        if (theCancelled) return;
+        lIndex = theTail;
+      }
+
+      // the consumer doesn't look at this buffer before it's counted
+      Buffer& lBuffer = theBuffers[lIndex];
+      bool lError = false;
+      try
+      {
+        theStream.read(&lBuffer.theData[0], lBuffer.theData.size());
+        lBuffer.theSize = theStream.gcount();
+        lError = theStream.bad();
+      }
+      catch (...)
+      {
+        lBuffer.theSize = 0;
+        lError = true;
+      }
+
+      ScopedLock lLock(theMutex);
+      theTail = (theTail + 1) % theBuffers.size();
+      ++theFilled;
+      theError = lError;
+      theEnd = lError || theStream.eof()
+        || lBuffer.theSize < static_cast<std::streamsize>(lBuffer.theData.size());
+      theNotEmpty.signal();
+      if (theEnd) return;
+    }
+  }
+
+  std::streamsize
+  ReadAhead::next(const void** aBuffer)
+  {
+    ScopedLock lLock(theMutex);
+
+    if (theHolding)
+    {
+      theHead = (theHead + 1) % theBuffers.size();
+      --theFilled;
+      theHolding = false;
+      theNotFull.signal();
+    }
+
+    while (theFilled == 0 && !theEnd)
+    {
+      theNotEmpty.wait(theMutex);
+    }
+
+    if (theFilled == 0) return theError ? -1 : 0;
+
+    const Buffer& lBuffer = theBuffers[theHead];
+    if (theError && theFilled == 1) return -1;
+
+    theHolding = true;
+    *aBuffer = &lBuffer.theData[0];
+    return lBuffer.theSize;
+  }
+
+  void
+  ReadAhead::cancel()
+  {
+    {
+      ScopedLock lLock(theMutex);
+      theCancelled = true;
+      theNotFull.broadcast();
+    }
+    theThread.join();
+  }
+
+  size_t
+  ReadAhead::getDepth()
+  {
+    ScopedLock lLock(theDepthMutex);
+    return theDepth;
+  }
+
+  void
+  ReadAhead::setDepth(size_t aDepth)
+  {
+    ScopedLock lLock(theDepthMutex);
+    theDepth = aDepth;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ZORBA_ARCHIVE_READ_AHEAD_H_
+#define ZORBA_ARCHIVE_READ_AHEAD_H_
+
+#include <istream>
+#include <vector>
+
+#include "sync.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Reads a stream on a background thread into a ring of buffers such that
+ * the consumer (e.g. libarchive decompressing the previous block) doesn't
+ * wait for I/O. At most aDepth buffers are filled ahead, including the one
+ * the consumer holds. Only the background thread touches the stream until
+ * cancel() (or the destructor) returns, i.e. the stream must not be shared
+ * with other readers (see ArchiveIterator::open).
+ ******************************************************************************/
+  class ReadAhead
+  {
+    protected:
+      struct Buffer
+      {
+        std::vector<char> theData;
+        std::streamsize   theSize;
+      };
+
+      std::istream&       theStream;
+      std::vector<Buffer> theBuffers;
+
+      // next buffer to be consumed and next buffer to be filled
+      size_t              theHead;
+      size_t              theTail;
+      size_t              theFilled;
+      // the consumer holds theHead until the next call to next()
+      bool                theHolding;
+
+      bool                theEnd;
+      bool                theError;
+      bool                theCancelled;
+
+      Mutex               theMutex;
+      Condition           theNotEmpty;
+      Condition           theNotFull;
+      Thread              theThread;
+
+      static Mutex        theDepthMutex;
+      static size_t       theDepth;
+
+    public:
+      ReadAhead(std::istream& aStream, size_t aDepth, size_t aBufferSize);
+
+      ~ReadAhead();
+
+      /**
+       * Returns false if the thread couldn't be started. The stream must
+       * be read synchronously in that case.
+       */
+      bool
+      start();
+
+      /**
+       * Releases the previously returned buffer and waits for the next
+       * one. Returns its size, 0 at the end of the stream, or -1 if
+       * reading failed.
+       */
+      std::streamsize
+      next(const void** aBuffer);
+
+      /**
+       * Stops the thread after it finished the read in progress.
+       */
+      void
+      cancel();
+
+      /**
+       * Number of buffers used for streamed archives (0 if disabled).
+       */
+      static size_t
+      getDepth();
+
+      static void
+      setDepth(size_t aDepth);
+
+    protected:
+      static void
+      run(void* aReadAhead);
+
+      void
+      fill();
+
+    private:
+      ReadAhead(const ReadAhead&);
+
+      ReadAhead&
+      operator=(const ReadAhead&);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_READ_AHEAD_H_
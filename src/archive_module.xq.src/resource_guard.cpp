@@ -0,0 +1,163 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include "resource_guard.h"
+#include "sync.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ ******************************************************************************/
+  static Mutex theDefaultsMutex;
+  static ResourceGuard::Limits theDefaults;
+
+  ResourceGuard::Limits
+  ResourceGuard::getDefaults()
+  {
+    ScopedLock lLock(theDefaultsMutex);
+    return theDefaults;
+  }
+
+  void
+  ResourceGuard::setDefaults(const Limits& aLimits)
+  {
+    ScopedLock lLock(theDefaultsMutex);
+    theDefaults = aLimits;
+  }
+
+  ResourceGuard::ResourceGuard()
+    : theLimits(getDefaults()),
+      theTotal(0),
+      theTotalMutex(0)
+  {
+    reset();
+  }
+
+  ResourceGuard::ResourceGuard(const Limits& aLimits)
+    : theLimits(aLimits),
+      theTotal(0),
+      theTotalMutex(0)
+  {
+    reset();
+  }
+
+  ResourceGuard::ResourceGuard(ResourceGuard& aTotal, Mutex& aMutex)
+    : theLimits(aTotal.theLimits),
+      theTotal(&aTotal),
+      theTotalMutex(&aMutex)
+  {
+    reset();
+  }
+
+  void
+  ResourceGuard::reset()
+  {
+    theEntries = 0;
+    theSize = 0;
+    theEntrySize = 0;
+    theEntryName.clear();
+    theError.clear();
+  }
+
+  bool
+  ResourceGuard::startEntry(const char* aName)
+  {
+    if (failed()) return false;
+
+    ++theEntries;
+    theEntrySize = 0;
+    theEntryName = aName ? aName : "";
+    if (theLimits.theMaxEntries && theEntries > theLimits.theMaxEntries)
+    {
+      std::ostringstream lMsg;
+      lMsg << theEntryName << ": archive has more than "
+        << theLimits.theMaxEntries << " entries";
+      theError = lMsg.str();
+      return false;
+    }
+    return true;
+  }
+
+  bool
+  ResourceGuard::addData(uint64_t aLen, uint64_t aCompressed)
+  {
+    if (failed()) return false;
+
+    theSize += aLen;
+    theEntrySize += aLen;
+
+    std::ostringstream lMsg;
+    if (theLimits.theMaxEntrySize && theEntrySize > theLimits.theMaxEntrySize)
+    {
+      lMsg << theEntryName << ": entry is larger than "
+        << theLimits.theMaxEntrySize << " bytes";
+    }
+    else if (theLimits.theMaxRatio > 0
+             && aCompressed
+             && theSize >= ZORBA_ARCHIVE_RATIO_MIN_SIZE
+             && double(theSize) / double(aCompressed) > theLimits.theMaxRatio)
+    {
+      lMsg << theEntryName << ": compression ratio exceeds "
+        << theLimits.theMaxRatio;
+    }
+    else if (theTotal)
+    {
+      ScopedLock lLock(*theTotalMutex);
+      if (theTotal->failed())
+      {
+        // another entry exceeded the total size
+        theError = theTotal->theError;
+        return false;
+      }
+      theTotal->theSize += aLen;
+      if (!theLimits.theMaxSize || theTotal->theSize <= theLimits.theMaxSize)
+      {
+        return true;
+      }
+      lMsg << theEntryName << ": entries are larger than "
+        << theLimits.theMaxSize << " bytes in total";
+      theTotal->theError = lMsg.str();
+    }
+    else if (theLimits.theMaxSize && theSize > theLimits.theMaxSize)
+    {
+      lMsg << theEntryName << ": entries are larger than "
+        << theLimits.theMaxSize << " bytes in total";
+    }
+    else
+    {
+      return true;
+    }
+    theError = lMsg.str();
+    return false;
+  }
+
+  size_t
+  ResourceGuard::getReserve(int64_t aSize) const
+  {
+    if (aSize <= 0) return 0;
+
+    uint64_t lMax = ZORBA_ARCHIVE_MAX_RESERVE;
+    if (theLimits.theMaxEntrySize)
+    {
+      lMax = std::min<uint64_t>(lMax, theLimits.theMaxEntrySize);
+    }
+    return static_cast<size_t>(std::min<uint64_t>(uint64_t(aSize), lMax));
+  }
+
+} /* namespace archive */ } /* namespace zorba */
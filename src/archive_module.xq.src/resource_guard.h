@@ -0,0 +1,125 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_RESOURCE_GUARD_H_
+#define ZORBA_ARCHIVE_RESOURCE_GUARD_H_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+// entries are decompressed this far before their compression ratio counts
+#define ZORBA_ARCHIVE_RATIO_MIN_SIZE 1048576
+
+// upper bound for buffers reserved according to an (untrusted) entry size
+#define ZORBA_ARCHIVE_MAX_RESERVE 16777216
+
+namespace zorba { namespace archive {
+
+  class Mutex;
+
+/*******************************************************************************
+ * Enforces limits on the entries and the decompressed data of an archive
+ * while it is read (e.g. against zip bombs). The data is accounted for
+ * block by block, i.e. before it is appended to a buffer. The default
+ * limits are set by a:set-limits. The Zorba API isn't used, i.e. a guard
+ * can be used on any thread (but by a single one at a time). If entries
+ * are read by several threads, each one guards its entry with a guard
+ * that also accounts for the total size in a shared one.
+ ******************************************************************************/
+  class ResourceGuard
+  {
+    public:
+      // 0 means unlimited
+      struct Limits
+      {
+        uint64_t theMaxEntries;
+        uint64_t theMaxSize;
+        uint64_t theMaxEntrySize;
+        double   theMaxRatio;
+
+        Limits()
+          : theMaxEntries(0), theMaxSize(0), theMaxEntrySize(0),
+            theMaxRatio(0) {}
+      };
+
+    protected:
+      Limits      theLimits;
+      uint64_t    theEntries;
+      uint64_t    theSize;
+      uint64_t    theEntrySize;
+      std::string theEntryName;
+      std::string theError;
+
+      // the guard of all entries and its lock (if shared)
+      ResourceGuard* theTotal;
+      Mutex*         theTotalMutex;
+
+    public:
+      ResourceGuard();
+
+      ResourceGuard(const Limits& aLimits);
+
+      /**
+       * Guards a single entry with the limits of aTotal, which accounts
+       * for the total size of all entries and is locked by aMutex.
+       */
+      ResourceGuard(ResourceGuard& aTotal, Mutex& aMutex);
+
+      const Limits&
+      getLimits() const { return theLimits; }
+
+      void
+      reset();
+
+      /**
+       * Accounts for the next entry. Returns false if there are too many.
+       */
+      bool
+      startEntry(const char* aName);
+
+      /**
+       * Accounts for aLen decompressed bytes of the current entry that
+       * have been decoded from aCompressed bytes so far (0 if unknown).
+       * Returns false if a limit is exceeded.
+       */
+      bool
+      addData(uint64_t aLen, uint64_t aCompressed);
+
+      /**
+       * Returns how much to reserve for an entry of the given size (-1
+       * if unknown) such that a lying header can't cause a huge
+       * allocation.
+       */
+      size_t
+      getReserve(int64_t aSize) const;
+
+      bool
+      failed() const { return !theError.empty(); }
+
+      const std::string&
+      getError() const { return theError; }
+
+      static Limits
+      getDefaults();
+
+      static void
+      setDefaults(const Limits& aLimits);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_RESOURCE_GUARD_H_
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "stream_search.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ ******************************************************************************/
+  StreamSearch::StreamSearch(const std::string& aPattern, bool aFirstOnly)
+    : thePattern(aPattern),
+      theFirstOnly(aFirstOnly)
+  {
+    reset();
+  }
+
+  void
+  StreamSearch::reset()
+  {
+    theTail.clear();
+    theOffset = 0;
+    theLines = 0;
+    theDone = false;
+  }
+
+  const char*
+  StreamSearch::find(const char* aBegin, const char* aEnd) const
+  {
+    size_t lLen = thePattern.size();
+    const char* lLast = aEnd - lLen;
+    const char* p = aBegin;
+    while (aEnd - p >= static_cast<ptrdiff_t>(lLen))
+    {
+      p = static_cast<const char*>(memchr(p, thePattern[0], lLast - p + 1));
+      if (!p) return 0;
+      if (memcmp(p + 1, thePattern.data() + 1, lLen - 1) == 0) return p;
+      ++p;
+    }
+    return 0;
+  }
+
+  uint64_t
+  StreamSearch::countLines(const char* aBegin, const char* aEnd)
+  {
+    uint64_t lCount = 0;
+    while (aBegin < aEnd)
+    {
+      aBegin = static_cast<const char*>(memchr(aBegin, '\n', aEnd - aBegin));
+      if (!aBegin) break;
+      ++lCount;
+      ++aBegin;
+    }
+    return lCount;
+  }
+
+  bool
+  StreamSearch::feed(
+      const char* aData,
+      size_t aLen,
+      std::vector<Match>& aMatches)
+  {
+    if (theDone) return false;
+
+    size_t lKeep = thePattern.size() - 1;
+
+    // nothing can be confirmed yet, i.e. the block is only collected
+    // (keeping all bytes in front of it)
+    if (theTail.size() + aLen < thePattern.size())
+    {
+      theTail.append(aData, aLen);
+      theLines += countLines(aData, aData + aLen);
+      theOffset += aLen;
+      return true;
+    }
+
+    // matches starting in the tail of the previous data
+    if (!theTail.empty())
+    {
+      std::string lWindow(theTail);
+      lWindow.append(aData, std::min(aLen, lKeep));
+      const char* lBegin = lWindow.data();
+      const char* lEnd = lBegin + lWindow.size();
+      const char* lTailEnd = lBegin + theTail.size();
+      for (const char* p = find(lBegin, lEnd); p && p < lTailEnd;
+           p = find(p + 1, lEnd))
+      {
+        Match lMatch;
+        lMatch.theOffset = theOffset - theTail.size() + (p - lBegin);
+        lMatch.theLine = theLines + 1 - countLines(p, lTailEnd);
+        aMatches.push_back(lMatch);
+        if (theFirstOnly)
+        {
+          theDone = true;
+          return false;
+        }
+      }
+    }
+
+    const char* lEnd = aData + aLen;
+    const char* lCounted = aData;
+    for (const char* p = find(aData, lEnd); p; p = find(p + 1, lEnd))
+    {
+      theLines += countLines(lCounted, p);
+      lCounted = p;
+
+      Match lMatch;
+      lMatch.theOffset = theOffset + (p - aData);
+      lMatch.theLine = theLines + 1;
+      aMatches.push_back(lMatch);
+      if (theFirstOnly)
+      {
+        theDone = true;
+        return false;
+      }
+    }
+    theLines += countLines(lCounted, lEnd);
+
+    // keep the bytes a match spanning the next block could start with.
+    // If the block is shorter than that, they reach back into the tail:
+    // only its bytes that have been ruled out above (i.e. whose candidate
+    // lies completely within tail and block) are dropped.
+    if (aLen >= lKeep)
+    {
+      theTail.assign(lEnd - lKeep, lKeep);
+    }
+    else
+    {
+      size_t lRuledOut = theTail.size() + aLen - lKeep;
+      theTail.erase(0, lRuledOut);
+      theTail.append(aData, aLen);
+    }
+    theOffset += aLen;
+    return true;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_STREAM_SEARCH_H_
+#define ZORBA_ARCHIVE_STREAM_SEARCH_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Finds the occurrences of a literal pattern in data that is fed block by
+ * block (matches may span blocks). Candidates are located with memchr,
+ * which the C library vectorizes, and lines are counted the same way.
+ ******************************************************************************/
+  class StreamSearch
+  {
+    public:
+      struct Match
+      {
+        // byte offset of the match in the data
+        uint64_t theOffset;
+        // number of the line containing the match (starting at 1)
+        uint64_t theLine;
+      };
+
+    protected:
+      std::string thePattern;
+      bool        theFirstOnly;
+
+      // the last bytes of the data fed so far (shorter than the pattern)
+      std::string theTail;
+      uint64_t    theOffset;
+      uint64_t    theLines;
+      bool        theDone;
+
+    public:
+      /**
+       * aPattern must not be empty. If aFirstOnly is true, the search
+       * stops after the first match.
+       */
+      StreamSearch(const std::string& aPattern, bool aFirstOnly);
+
+      /**
+       * Searches the next block and appends its matches. Returns false
+       * if the search is done (i.e. no more data needs to be fed).
+       */
+      bool
+      feed(const char* aData, size_t aLen, std::vector<Match>& aMatches);
+
+      void
+      reset();
+
+    protected:
+      /**
+       * Returns the position of the next match in [aBegin, aEnd) or 0.
+       */
+      const char*
+      find(const char* aBegin, const char* aEnd) const;
+
+      static uint64_t
+      countLines(const char* aBegin, const char* aEnd);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_STREAM_SEARCH_H_
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "sync.h"
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ ******************************************************************************/
+#ifdef WIN32
+  Mutex::Mutex()
+  {
+    InitializeCriticalSection(&theMutex);
+  }
+
+  Mutex::~Mutex()
+  {
+    DeleteCriticalSection(&theMutex);
+  }
+
+  void
+  Mutex::lock()
+  {
+    EnterCriticalSection(&theMutex);
+  }
+
+  void
+  Mutex::unlock()
+  {
+    LeaveCriticalSection(&theMutex);
+  }
+#else
+  Mutex::Mutex()
+  {
+    pthread_mutex_init(&theMutex, 0);
+  }
+
+  Mutex::~Mutex()
+  {
+    pthread_mutex_destroy(&theMutex);
+  }
+
+  void
+  Mutex::lock()
+  {
+    pthread_mutex_lock(&theMutex);
+  }
+
+  void
+  Mutex::unlock()
+  {
+    pthread_mutex_unlock(&theMutex);
+  }
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+#ifdef WIN32
+  Condition::Condition()
+  {
+    InitializeConditionVariable(&theCondition);
+  }
+
+  Condition::~Condition()
+  {
+  }
+
+  void
+  Condition::wait(Mutex& aMutex)
+  {
+    SleepConditionVariableCS(&theCondition, &aMutex.theMutex, INFINITE);
+  }
+
+  void
+  Condition::signal()
+  {
+    WakeConditionVariable(&theCondition);
+  }
+
+  void
+  Condition::broadcast()
+  {
+    WakeAllConditionVariable(&theCondition);
+  }
+#else
+  Condition::Condition()
+  {
+    pthread_cond_init(&theCondition, 0);
+  }
+
+  Condition::~Condition()
+  {
+    pthread_cond_destroy(&theCondition);
+  }
+
+  void
+  Condition::wait(Mutex& aMutex)
+  {
+    pthread_cond_wait(&theCondition, &aMutex.theMutex);
+  }
+
+  void
+  Condition::signal()
+  {
+    pthread_cond_signal(&theCondition);
+  }
+
+  void
+  Condition::broadcast()
+  {
+    pthread_cond_broadcast(&theCondition);
+  }
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+  Thread::Thread()
+    : theStarted(false),
+      theFunction(0),
+      theArg(0)
+  {}
+
+  Thread::~Thread()
+  {
+    join();
+  }
+
+#ifdef WIN32
+  DWORD WINAPI
+  Thread::run(LPVOID aThread)
+  {
+    Thread* lThread = static_cast<Thread*>(aThread);
+    lThread->theFunction(lThread->theArg);
+    return 0;
+  }
+
+  bool
+  Thread::start(Function aFunction, void* aArg)
+  {
+    theFunction = aFunction;
+    theArg = aArg;
+    theThread = CreateThread(0, 0, &Thread::run, this, 0, 0);
+    theStarted = theThread != 0;
+    return theStarted;
+  }
+
+  void
+  Thread::join()
+  {
+    if (!theStarted) return;
+
+    WaitForSingleObject(theThread, INFINITE);
+    CloseHandle(theThread);
+    theStarted = false;
+  }
+#else
+  void*
+  Thread::run(void* aThread)
+  {
+    Thread* lThread = static_cast<Thread*>(aThread);
+    lThread->theFunction(lThread->theArg);
+    return 0;
+  }
+
+  bool
+  Thread::start(Function aFunction, void* aArg)
+  {
+    theFunction = aFunction;
+    theArg = aArg;
+    theStarted = pthread_create(&theThread, 0, &Thread::run, this) == 0;
+    return theStarted;
+  }
+
+  void
+  Thread::join()
+  {
+    if (!theStarted) return;
+
+    pthread_join(theThread, 0);
+    theStarted = false;
+  }
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+  namespace {
+
+  struct ParallelLoop
+  {
+    Mutex         theMutex;
+    size_t        theNext;
+    size_t        theCount;
+    IndexFunction theFunction;
+    void*         theArg;
+  };
+
+  void
+  runParallelLoop(void* aLoop)
+  {
+    ParallelLoop* lLoop = static_cast<ParallelLoop*>(aLoop);
+    for (;;)
+    {
+      size_t lIndex;
+      {
+        ScopedLock lLock(lLoop->theMutex);
+        if (lLoop->theNext == lLoop->theCount) return;
+        lIndex = lLoop->theNext++;
+      }
+      lLoop->theFunction(lLoop->theArg, lIndex);
+    }
+  }
+
+  } /* anonymous namespace */
+
+  void
+  parallelFor(
+      size_t aCount,
+      size_t aThreads,
+      IndexFunction aFunction,
+      void* aArg)
+  {
+    ParallelLoop lLoop;
+    lLoop.theNext = 0;
+    lLoop.theCount = aCount;
+    lLoop.theFunction = aFunction;
+    lLoop.theArg = aArg;
+
+    // the calling thread is one of the workers; threads that can't be
+    // created simply leave more work to the others
+    size_t lExtra = (aThreads > 1 && aCount > 1)
+                  ? std::min(aThreads, aCount) - 1 : 0;
+    std::vector<Thread*> lThreads;
+    lThreads.reserve(lExtra);
+    for (size_t i = 0; i < lExtra; ++i)
+    {
+      Thread* lThread = new Thread();
+      lThreads.push_back(lThread);
+      if (!lThread->start(&runParallelLoop, &lLoop)) break;
+    }
+
+    runParallelLoop(&lLoop);
+
+    for (size_t i = 0; i < lThreads.size(); ++i)
+    {
+      lThreads[i]->join();
+      delete lThreads[i];
+    }
+  }
+
+} /* namespace archive */ } /* namespace zorba */
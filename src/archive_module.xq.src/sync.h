@@ -0,0 +1,185 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_SYNC_H_
+#define ZORBA_ARCHIVE_SYNC_H_
+
+#include <cstddef>
+
+#ifdef WIN32
+# include <Windows.h>
+#else
+# include <pthread.h>
+#endif
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Non-recursive mutex.
+ ******************************************************************************/
+  class Mutex
+  {
+    protected:
+#ifdef WIN32
+      CRITICAL_SECTION theMutex;
+#else
+      pthread_mutex_t  theMutex;
+#endif
+
+    public:
+      Mutex();
+
+      ~Mutex();
+
+      void
+      lock();
+
+      void
+      unlock();
+
+    private:
+      friend class Condition;
+
+      Mutex(const Mutex&);
+
+      Mutex&
+      operator=(const Mutex&);
+  };
+
+/*******************************************************************************
+ * Locks a mutex for the lifetime of the object.
+ ******************************************************************************/
+  class ScopedLock
+  {
+    protected:
+      Mutex& theMutex;
+
+    public:
+      ScopedLock(Mutex& aMutex) : theMutex(aMutex) { theMutex.lock(); }
+
+      ~ScopedLock() { theMutex.unlock(); }
+
+    private:
+      ScopedLock(const ScopedLock&);
+
+      ScopedLock&
+      operator=(const ScopedLock&);
+  };
+
+/*******************************************************************************
+ * Condition variable to be used with a locked Mutex.
+ ******************************************************************************/
+  class Condition
+  {
+    protected:
+#ifdef WIN32
+      CONDITION_VARIABLE theCondition;
+#else
+      pthread_cond_t     theCondition;
+#endif
+
+    public:
+      Condition();
+
+      ~Condition();
+
+      /**
+       * Unlocks the given (locked) mutex while waiting.
+       */
+      void
+      wait(Mutex& aMutex);
+
+      void
+      signal();
+
+      void
+      broadcast();
+
+    private:
+      Condition(const Condition&);
+
+      Condition&
+      operator=(const Condition&);
+  };
+
+/*******************************************************************************
+ * A thread that runs a function. The function must not throw.
+ ******************************************************************************/
+  class Thread
+  {
+    public:
+      typedef void (*Function)(void*);
+
+    protected:
+#ifdef WIN32
+      HANDLE    theThread;
+#else
+      pthread_t theThread;
+#endif
+      bool      theStarted;
+      Function  theFunction;
+      void*     theArg;
+
+    public:
+      Thread();
+
+      /**
+       * Joins the thread if it hasn't been joined yet.
+       */
+      ~Thread();
+
+      /**
+       * Returns false if the thread couldn't be created.
+       */
+      bool
+      start(Function aFunction, void* aArg);
+
+      void
+      join();
+
+    private:
+#ifdef WIN32
+      static DWORD WINAPI
+      run(LPVOID aThread);
+#else
+      static void*
+      run(void* aThread);
+#endif
+
+      Thread(const Thread&);
+
+      Thread&
+      operator=(const Thread&);
+  };
+
+/*******************************************************************************
+ * Calls aFunction(aArg, i) for every i in [0, aCount) on up to aThreads
+ * threads, including the calling one, and returns once all calls are
+ * done. The indexes are handed out in increasing order. The function
+ * must not throw.
+ ******************************************************************************/
+  typedef void (*IndexFunction)(void*, size_t);
+
+  void
+  parallelFor(
+      size_t aCount,
+      size_t aThreads,
+      IndexFunction aFunction,
+      void* aArg);
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_SYNC_H_
@@ -0,0 +1,442 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "tar_scanner.h"
+
+#define TAR_NAME_OFFSET      0
+#define TAR_NAME_SIZE        100
+#define TAR_MTIME_OFFSET     136
+#define TAR_SIZE_OFFSET      124
+#define TAR_NUMBER_SIZE      12
+#define TAR_CHECKSUM_OFFSET  148
+#define TAR_CHECKSUM_SIZE    8
+#define TAR_TYPE_OFFSET      156
+#define TAR_LINK_OFFSET      157
+#define TAR_LINK_SIZE        100
+#define TAR_MAGIC_OFFSET     257
+#define TAR_PREFIX_OFFSET    345
+#define TAR_PREFIX_SIZE      155
+
+// GNU sparse headers
+#define TAR_SPARSE_EXTENDED_OFFSET 482
+#define TAR_SPARSE_REALSIZE_OFFSET 483
+#define TAR_SPARSE_NEXT_OFFSET     504
+
+// pax and GNU long name headers are kept in memory
+#define TAR_MAX_META_SIZE    1048576
+
+namespace zorba { namespace archive {
+
+  // definitions of the constants initialized in the class, such that
+  // they can be bound to references (e.g. by std::max)
+  const size_t TarScanner::BLOCK_SIZE;
+  const char TarScanner::TYPE_SPARSE;
+
+  static inline uint64_t
+  padded(uint64_t aSize)
+  {
+    return (aSize + TarScanner::BLOCK_SIZE - 1)
+      / TarScanner::BLOCK_SIZE * TarScanner::BLOCK_SIZE;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  bool
+  TarScanner::Entry::isDirectory() const
+  {
+    // old archives mark directories by a trailing slash only
+    return theType == '5'
+      || ((theType == '0' || theType == '\0')
+          && !theName.empty() && theName[theName.size() - 1] == '/');
+  }
+
+  bool
+  TarScanner::Entry::isRegular() const
+  {
+    return !isDirectory()
+      && (theType == '0' || theType == '\0' || theType == '1'
+          || theType == '7' || theType == TYPE_SPARSE);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  TarScanner::TarScanner()
+    : theState(STATE_HEADER),
+      theOffset(0),
+      theRemaining(0),
+      theMetaType(0),
+      theMetaPadding(0),
+      thePaxSize(0),
+      theHasPaxSize(false),
+      thePaxMTime(0),
+      theHasPaxMTime(false),
+      thePaxSparse(false),
+      thePaxRealSize(0),
+      theHasPaxRealSize(false)
+  {
+    theBlock.reserve(BLOCK_SIZE);
+  }
+
+  bool
+  TarScanner::parseNumber(const char* aField, size_t aLen, uint64_t& aValue)
+  {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(aField);
+    aValue = 0;
+    if (u[0] & 0x80)
+    {
+      // base-256 (e.g. GNU tar for 8 GB or larger)
+      aValue = u[0] & 0x7F;
+      for (size_t i = 1; i < aLen; ++i)
+      {
+        if (aValue >> 56) return false;
+        aValue = (aValue << 8) | u[i];
+      }
+      return true;
+    }
+
+    size_t i = 0;
+    while (i < aLen && aField[i] == ' ') ++i;
+    for (; i < aLen && aField[i] != '\0' && aField[i] != ' '; ++i)
+    {
+      if (aField[i] < '0' || aField[i] > '7') return false;
+      aValue = (aValue << 3) + (aField[i] - '0');
+    }
+    return true;
+  }
+
+  std::string
+  TarScanner::getField(const char* aField, size_t aLen)
+  {
+    const char* lEnd = static_cast<const char*>(memchr(aField, '\0', aLen));
+    return std::string(aField, lEnd ? lEnd - aField : aLen);
+  }
+
+  bool
+  TarScanner::isValidHeader(const char* aHeader)
+  {
+    uint64_t lStored;
+    if (!parseNumber(aHeader + TAR_CHECKSUM_OFFSET, TAR_CHECKSUM_SIZE, lStored))
+    {
+      return false;
+    }
+
+    // the checksum field itself counts as spaces; some old archives
+    // have been written with signed chars
+    uint64_t lSum = 0;
+    int64_t lSignedSum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i)
+    {
+      bool lInChecksum = i >= TAR_CHECKSUM_OFFSET
+        && i < TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE;
+      lSum += lInChecksum ? ' ' : static_cast<unsigned char>(aHeader[i]);
+      lSignedSum += lInChecksum ? ' ' : static_cast<signed char>(aHeader[i]);
+    }
+    return lStored == lSum || int64_t(lStored) == lSignedSum;
+  }
+
+  uint64_t
+  TarScanner::getWanted() const
+  {
+    switch (theState)
+    {
+      case STATE_HEADER:
+      case STATE_SPARSE:
+        return BLOCK_SIZE - theBlock.size();
+      case STATE_META:
+        return theRemaining - theBlock.size();
+      default:
+        return 0;
+    }
+  }
+
+  void
+  TarScanner::skip(uint64_t aLen)
+  {
+    theOffset += aLen;
+    theRemaining -= aLen;
+    if (!theRemaining)
+    {
+      theState = STATE_HEADER;
+    }
+  }
+
+  void
+  TarScanner::startData(uint64_t aSize)
+  {
+    theRemaining = padded(aSize);
+    theState = theRemaining ? STATE_DATA : STATE_HEADER;
+  }
+
+  bool
+  TarScanner::feed(const char* aData, size_t aLen)
+  {
+    while (aLen && theState != STATE_END)
+    {
+      if (theState == STATE_DATA)
+      {
+        size_t lLen = static_cast<size_t>(
+            std::min<uint64_t>(aLen, theRemaining));
+        skip(lLen);
+        aData += lLen;
+        aLen -= lLen;
+        continue;
+      }
+
+      size_t lLen = static_cast<size_t>(
+          std::min<uint64_t>(aLen, getWanted()));
+      theBlock.append(aData, lLen);
+      theOffset += lLen;
+      aData += lLen;
+      aLen -= lLen;
+      if (getWanted()) continue;
+
+      if (theState == STATE_HEADER)
+      {
+        if (!processHeader()) return false;
+      }
+      else if (theState == STATE_SPARSE)
+      {
+        // extension blocks of the sparse map until one isn't extended
+        bool lMore = theBlock[TAR_SPARSE_NEXT_OFFSET] != '\0';
+        theBlock.clear();
+        if (!lMore)
+        {
+          startData(theRemaining);
+        }
+      }
+      else
+      {
+        processMeta();
+      }
+    }
+    return true;
+  }
+
+  bool
+  TarScanner::processHeader()
+  {
+    const char* h = theBlock.data();
+    uint64_t lHeaderOffset = theOffset - BLOCK_SIZE;
+
+    // end-of-archive block
+    if (theBlock.find_first_not_of('\0') == std::string::npos)
+    {
+      theBlock.clear();
+      theState = STATE_END;
+      return true;
+    }
+
+    uint64_t lSize;
+    if (!isValidHeader(h)
+        || !parseNumber(h + TAR_SIZE_OFFSET, TAR_NUMBER_SIZE, lSize))
+    {
+      theError = "invalid TAR header";
+      return false;
+    }
+    char lType = h[TAR_TYPE_OFFSET];
+
+    if (lType == 'x' || lType == 'L' || lType == 'K')
+    {
+      if (lSize > TAR_MAX_META_SIZE)
+      {
+        theError = "TAR extension header too large";
+        return false;
+      }
+      theBlock.clear();
+      theMetaType = lType;
+      theMetaPadding = padded(lSize) - lSize;
+      theRemaining = lSize;
+      theState = STATE_META;
+      if (!lSize)
+      {
+        processMeta();
+      }
+      return true;
+    }
+    // global pax headers and GNU volume labels aren't entries
+    if (lType == 'g' || lType == 'V')
+    {
+      theBlock.clear();
+      startData(lSize);
+      return true;
+    }
+
+    Entry lEntry;
+    if (!thePaxSparseName.empty())
+    {
+      // pax sparse format 1.0 stores the real name separately
+      lEntry.theName = thePaxSparseName;
+    }
+    else if (!thePaxPath.empty())
+    {
+      lEntry.theName = thePaxPath;
+    }
+    else if (!theLongName.empty())
+    {
+      lEntry.theName = theLongName;
+    }
+    else
+    {
+      lEntry.theName = getField(h + TAR_NAME_OFFSET, TAR_NAME_SIZE);
+      // POSIX ustar ("ustar\0"), GNU tar uses the field differently
+      if (memcmp(h + TAR_MAGIC_OFFSET, "ustar\0", 6) == 0
+          && h[TAR_PREFIX_OFFSET] != '\0')
+      {
+        lEntry.theName = getField(h + TAR_PREFIX_OFFSET, TAR_PREFIX_SIZE)
+          + "/" + lEntry.theName;
+      }
+    }
+    lEntry.theLink = !thePaxLink.empty() ? thePaxLink
+      : !theLongLink.empty() ? theLongLink
+      : getField(h + TAR_LINK_OFFSET, TAR_LINK_SIZE);
+
+    uint64_t lMTime = 0;
+    parseNumber(h + TAR_MTIME_OFFSET, TAR_NUMBER_SIZE, lMTime);
+    lEntry.theMTime = theHasPaxMTime ? thePaxMTime : int64_t(lMTime);
+
+    if (theHasPaxSize)
+    {
+      lSize = thePaxSize;
+    }
+    lEntry.theType = lType;
+    lEntry.theHeaderOffset = lHeaderOffset;
+    lEntry.theOffset = theOffset;
+    lEntry.theSize = lSize;
+
+    bool lExtended = false;
+    if (lType == 'S')
+    {
+      uint64_t lRealSize;
+      if (parseNumber(h + TAR_SPARSE_REALSIZE_OFFSET, TAR_NUMBER_SIZE,
+                      lRealSize))
+      {
+        lEntry.theSize = lRealSize;
+      }
+      lExtended = h[TAR_SPARSE_EXTENDED_OFFSET] != '\0';
+    }
+    else if (thePaxSparse)
+    {
+      lEntry.theType = TYPE_SPARSE;
+      if (theHasPaxRealSize)
+      {
+        lEntry.theSize = thePaxRealSize;
+      }
+    }
+    theEntries.push_back(lEntry);
+
+    thePaxPath.clear();
+    thePaxLink.clear();
+    thePaxSparseName.clear();
+    theHasPaxSize = false;
+    theHasPaxMTime = false;
+    thePaxSparse = false;
+    theHasPaxRealSize = false;
+    theLongName.clear();
+    theLongLink.clear();
+
+    theBlock.clear();
+    if (lExtended)
+    {
+      theRemaining = lSize;
+      theState = STATE_SPARSE;
+    }
+    else
+    {
+      startData(lSize);
+    }
+    return true;
+  }
+
+  void
+  TarScanner::processMeta()
+  {
+    if (theMetaType == 'x')
+    {
+      // "<length> <key>=<value>\n"
+      size_t lPos = 0;
+      while (lPos < theBlock.size())
+      {
+        size_t lSpace = theBlock.find(' ', lPos);
+        if (lSpace == std::string::npos) break;
+
+        size_t lLen = static_cast<size_t>(
+            strtoul(theBlock.substr(lPos, lSpace - lPos).c_str(), 0, 10));
+        if (lLen <= lSpace - lPos + 1 || lPos + lLen > theBlock.size()) break;
+
+        std::string lRecord
+          = theBlock.substr(lSpace + 1, lPos + lLen - lSpace - 2);
+        size_t lEq = lRecord.find('=');
+        if (lEq != std::string::npos)
+        {
+          std::string lKey = lRecord.substr(0, lEq);
+          std::string lValue = lRecord.substr(lEq + 1);
+          if (lKey == "path")
+          {
+            thePaxPath = lValue;
+          }
+          else if (lKey == "linkpath")
+          {
+            thePaxLink = lValue;
+          }
+          else if (lKey == "size")
+          {
+            thePaxSize = strtoull(lValue.c_str(), 0, 10);
+            theHasPaxSize = true;
+          }
+          else if (lKey == "mtime")
+          {
+            // seconds, possibly with a fraction
+            thePaxMTime = strtoll(lValue.c_str(), 0, 10);
+            theHasPaxMTime = true;
+          }
+          else if (lKey == "GNU.sparse.realsize" || lKey == "GNU.sparse.size")
+          {
+            thePaxRealSize = strtoull(lValue.c_str(), 0, 10);
+            theHasPaxRealSize = true;
+            thePaxSparse = true;
+          }
+          else if (lKey == "GNU.sparse.name")
+          {
+            thePaxSparseName = lValue;
+            thePaxSparse = true;
+          }
+          else if (lKey.compare(0, 11, "GNU.sparse.") == 0)
+          {
+            thePaxSparse = true;
+          }
+        }
+        lPos += lLen;
+      }
+    }
+    else if (theMetaType == 'L')
+    {
+      theLongName = getField(theBlock.data(), theBlock.size());
+    }
+    else
+    {
+      theLongLink = getField(theBlock.data(), theBlock.size());
+    }
+
+    theBlock.clear();
+    theRemaining = theMetaPadding;
+    theState = theRemaining ? STATE_DATA : STATE_HEADER;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
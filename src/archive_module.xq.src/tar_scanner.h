@@ -0,0 +1,170 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_TAR_SCANNER_H_
+#define ZORBA_ARCHIVE_TAR_SCANNER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Collects the headers of a TAR archive from its (decompressed) bytes.
+ * The bytes are fed in order; the data of entries isn't needed, i.e. a
+ * caller with random access can skip it (see getSkippable). ustar, pax
+ * ('x'), and GNU long name ('L', 'K') headers are understood. The
+ * positions of the entries are the ones libarchive reports.
+ ******************************************************************************/
+  class TarScanner
+  {
+    public:
+      static const size_t BLOCK_SIZE = 512;
+
+      // GNU sparse entries (incl. pax sparse formats) have no contiguous data
+      static const char TYPE_SPARSE = 'S';
+
+      struct Entry
+      {
+        std::string theName;
+        // hardlink target
+        std::string theLink;
+        uint64_t    theHeaderOffset;
+        uint64_t    theOffset;
+        uint64_t    theSize;
+        int64_t     theMTime;
+        char        theType;
+
+        bool
+        isDirectory() const;
+
+        // incl. hardlinks, contiguous, and sparse files
+        bool
+        isRegular() const;
+
+        bool
+        isHardlink() const { return theType == '1'; }
+      };
+
+    protected:
+      enum State
+      {
+        STATE_HEADER,
+        STATE_META,
+        STATE_SPARSE,
+        STATE_DATA,
+        STATE_END
+      };
+
+      State              theState;
+      uint64_t           theOffset;
+      uint64_t           theRemaining;
+      std::string        theBlock;
+      char               theMetaType;
+      uint64_t           theMetaPadding;
+
+      // pending values of pax and GNU long name headers
+      std::string        thePaxPath;
+      std::string        thePaxLink;
+      std::string        thePaxSparseName;
+      uint64_t           thePaxSize;
+      bool               theHasPaxSize;
+      int64_t            thePaxMTime;
+      bool               theHasPaxMTime;
+      bool               thePaxSparse;
+      uint64_t           thePaxRealSize;
+      bool               theHasPaxRealSize;
+      std::string        theLongName;
+      std::string        theLongLink;
+
+      std::vector<Entry> theEntries;
+      std::string        theError;
+
+    public:
+      TarScanner();
+
+      /**
+       * Consumes the next bytes of the archive. Returns false if the
+       * headers are inconsistent (see getError).
+       */
+      bool
+      feed(const char* aData, size_t aLen);
+
+      // offset of the next byte to feed
+      uint64_t
+      getOffset() const { return theOffset; }
+
+      /**
+       * Returns how many of the next bytes are entry data (and padding)
+       * that can be skipped instead of fed.
+       */
+      uint64_t
+      getSkippable() const
+      {
+        return theState == STATE_DATA ? theRemaining : 0;
+      }
+
+      void
+      skip(uint64_t aLen);
+
+      /**
+       * Returns how many bytes are needed to complete the current
+       * header or extension (0 at the end of the archive).
+       */
+      uint64_t
+      getWanted() const;
+
+      bool
+      isFinished() const { return theState == STATE_END; }
+
+      const std::vector<Entry>&
+      getEntries() const { return theEntries; }
+
+      std::vector<Entry>&
+      getEntries() { return theEntries; }
+
+      const std::string&
+      getError() const { return theError; }
+
+      /**
+       * Parses an octal (or base-256) numeric header field.
+       */
+      static bool
+      parseNumber(const char* aField, size_t aLen, uint64_t& aValue);
+
+      // a NUL terminated (or full) header field
+      static std::string
+      getField(const char* aField, size_t aLen);
+
+    protected:
+      static bool
+      isValidHeader(const char* aHeader);
+
+      bool
+      processHeader();
+
+      void
+      processMeta();
+
+      void
+      startData(uint64_t aSize);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_TAR_SCANNER_H_
@@ -0,0 +1,433 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cctype>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+  || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define ZORBA_ARCHIVE_HAVE_SSE2
+#endif
+
+#include "text_codec.h"
+
+namespace zorba { namespace archive {
+
+  // Windows-1252 code points of the bytes 0x80-0x9F (0 if undefined)
+  static const uint16_t theWindows1252[32] =
+  {
+    0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+    0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178
+  };
+
+/*******************************************************************************
+ ******************************************************************************/
+  TextCodec::Charset
+  TextCodec::getCharset(const char* aEncoding)
+  {
+    // compare case-insensitively and without separators
+    std::string lName;
+    for (const char* c = aEncoding; *c; ++c)
+    {
+      if (*c != '-' && *c != '_')
+      {
+        lName += static_cast<char>(toupper(static_cast<unsigned char>(*c)));
+      }
+    }
+
+    if (lName == "UTF8")
+      return UTF_8;
+    if (lName == "ISO88591" || lName == "LATIN1")
+      return ISO_8859_1;
+    if (lName == "WINDOWS1252" || lName == "CP1252")
+      return WINDOWS_1252;
+    if (lName == "UTF16LE")
+      return UTF_16LE;
+    if (lName == "UTF16BE")
+      return UTF_16BE;
+    return OTHER;
+  }
+
+  size_t
+  TextCodec::asciiPrefix(const char* aData, size_t aLen)
+  {
+    size_t i = 0;
+#ifdef ZORBA_ARCHIVE_HAVE_SSE2
+    for (; i + 16 <= aLen; i += 16)
+    {
+      __m128i lChunk = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(aData + i));
+      // the high bit of each byte
+      if (_mm_movemask_epi8(lChunk)) break;
+    }
+#endif
+    while (i < aLen && !(aData[i] & 0x80)) ++i;
+    return i;
+  }
+
+  bool
+  TextCodec::nextCodePoint(
+      const char* aData,
+      size_t aLen,
+      size_t& aPos,
+      uint32_t& aCodePoint)
+  {
+    const unsigned char* lData = reinterpret_cast<const unsigned char*>(aData);
+    unsigned char c = lData[aPos];
+
+    size_t lExtra;
+    uint32_t lMin;
+    if (c < 0x80)
+    {
+      aCodePoint = c;
+      ++aPos;
+      return true;
+    }
+    else if ((c & 0xE0) == 0xC0)
+    {
+      lExtra = 1; lMin = 0x80; aCodePoint = c & 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+      lExtra = 2; lMin = 0x800; aCodePoint = c & 0x0F;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+      lExtra = 3; lMin = 0x10000; aCodePoint = c & 0x07;
+    }
+    else
+    {
+      return false;
+    }
+
+    if (aLen - aPos <= lExtra) return false;
+
+    for (size_t i = 1; i <= lExtra; ++i)
+    {
+      unsigned char lNext = lData[aPos + i];
+      if ((lNext & 0xC0) != 0x80) return false;
+      aCodePoint = (aCodePoint << 6) | (lNext & 0x3F);
+    }
+
+    // overlong forms, surrogates, and code points beyond Unicode
+    if (aCodePoint < lMin || aCodePoint > 0x10FFFF
+        || (aCodePoint >= 0xD800 && aCodePoint <= 0xDFFF))
+    {
+      return false;
+    }
+
+    aPos += lExtra + 1;
+    return true;
+  }
+
+  bool
+  TextCodec::isValidUtf8(const char* aData, size_t aLen)
+  {
+    size_t lPos = 0;
+    while (lPos < aLen)
+    {
+      lPos += asciiPrefix(aData + lPos, aLen - lPos);
+      if (lPos == aLen) break;
+
+      uint32_t lCodePoint;
+      if (!nextCodePoint(aData, aLen, lPos, lCodePoint)) return false;
+    }
+    return true;
+  }
+
+  size_t
+  TextCodec::completeUtf8(const char* aData, size_t aLen)
+  {
+    const unsigned char* lData = reinterpret_cast<const unsigned char*>(aData);
+
+    // the lead byte of the last sequence is at most 3 bytes back
+    size_t lStart = aLen;
+    for (size_t i = 1; i <= 3 && i <= aLen; ++i)
+    {
+      if ((lData[aLen - i] & 0xC0) != 0x80)
+      {
+        lStart = aLen - i;
+        break;
+      }
+    }
+    if (lStart == aLen) return aLen;
+
+    unsigned char c = lData[lStart];
+    size_t lSize = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    return aLen - lStart < lSize ? lStart : aLen;
+  }
+
+  void
+  TextCodec::appendUtf8(uint32_t aCodePoint, std::string& aResult)
+  {
+    if (aCodePoint < 0x80)
+    {
+      aResult += static_cast<char>(aCodePoint);
+    }
+    else if (aCodePoint < 0x800)
+    {
+      aResult += static_cast<char>(0xC0 | (aCodePoint >> 6));
+      aResult += static_cast<char>(0x80 | (aCodePoint & 0x3F));
+    }
+    else if (aCodePoint < 0x10000)
+    {
+      aResult += static_cast<char>(0xE0 | (aCodePoint >> 12));
+      aResult += static_cast<char>(0x80 | ((aCodePoint >> 6) & 0x3F));
+      aResult += static_cast<char>(0x80 | (aCodePoint & 0x3F));
+    }
+    else
+    {
+      aResult += static_cast<char>(0xF0 | (aCodePoint >> 18));
+      aResult += static_cast<char>(0x80 | ((aCodePoint >> 12) & 0x3F));
+      aResult += static_cast<char>(0x80 | ((aCodePoint >> 6) & 0x3F));
+      aResult += static_cast<char>(0x80 | (aCodePoint & 0x3F));
+    }
+  }
+
+  bool
+  TextCodec::decode(
+      Charset aCharset,
+      const char* aData,
+      size_t aLen,
+      std::string& aResult)
+  {
+    switch (aCharset)
+    {
+      case UTF_8:
+        if (!isValidUtf8(aData, aLen)) return false;
+        aResult.append(aData, aLen);
+        return true;
+      case UTF_16LE:
+        return decodeUtf16(false, aData, aLen, aResult);
+      case UTF_16BE:
+        return decodeUtf16(true, aData, aLen, aResult);
+      case ISO_8859_1:
+      case WINDOWS_1252:
+        break;
+      default:
+        return false;
+    }
+
+    aResult.reserve(aResult.size() + aLen);
+    size_t lPos = 0;
+    while (lPos < aLen)
+    {
+      size_t lRun = asciiPrefix(aData + lPos, aLen - lPos);
+      aResult.append(aData + lPos, lRun);
+      lPos += lRun;
+      if (lPos == aLen) break;
+
+      unsigned char c = static_cast<unsigned char>(aData[lPos++]);
+      uint32_t lCodePoint = c;
+      if (aCharset == WINDOWS_1252 && c < 0xA0)
+      {
+        lCodePoint = theWindows1252[c - 0x80];
+        if (!lCodePoint) return false;
+      }
+      appendUtf8(lCodePoint, aResult);
+    }
+    return true;
+  }
+
+  bool
+  TextCodec::encode(
+      Charset aCharset,
+      const char* aData,
+      size_t aLen,
+      std::string& aResult)
+  {
+    switch (aCharset)
+    {
+      case UTF_8:
+        if (!isValidUtf8(aData, aLen)) return false;
+        aResult.append(aData, aLen);
+        return true;
+      case UTF_16LE:
+        return encodeUtf16(false, aData, aLen, aResult);
+      case UTF_16BE:
+        return encodeUtf16(true, aData, aLen, aResult);
+      case ISO_8859_1:
+      case WINDOWS_1252:
+        break;
+      default:
+        return false;
+    }
+
+    aResult.reserve(aResult.size() + aLen);
+    size_t lPos = 0;
+    while (lPos < aLen)
+    {
+      size_t lRun = asciiPrefix(aData + lPos, aLen - lPos);
+      aResult.append(aData + lPos, lRun);
+      lPos += lRun;
+      if (lPos == aLen) break;
+
+      uint32_t lCodePoint;
+      if (!nextCodePoint(aData, aLen, lPos, lCodePoint)) return false;
+
+      if (aCharset == WINDOWS_1252 && (lCodePoint < 0xA0 || lCodePoint > 0xFF))
+      {
+        // C1 controls aren't part of Windows-1252
+        size_t i = 0;
+        while (i < 32 && theWindows1252[i] != lCodePoint) ++i;
+        if (i == 32) return false;
+        aResult += static_cast<char>(0x80 + i);
+      }
+      else
+      {
+        if (lCodePoint > 0xFF) return false;
+        aResult += static_cast<char>(lCodePoint);
+      }
+    }
+    return true;
+  }
+
+  bool
+  TextCodec::decodeUtf16(
+      bool aBigEndian,
+      const char* aData,
+      size_t aLen,
+      std::string& aResult)
+  {
+    if (aLen % 2) return false;
+
+    const unsigned char* lData = reinterpret_cast<const unsigned char*>(aData);
+    aResult.reserve(aResult.size() + aLen / 2);
+
+    size_t lPos = 0;
+    while (lPos < aLen)
+    {
+#ifdef ZORBA_ARCHIVE_HAVE_SSE2
+      // 8 ASCII code units at a time
+      const __m128i lHigh = _mm_set1_epi16(static_cast<short>(0xFF80));
+      const __m128i lZero = _mm_setzero_si128();
+      while (lPos + 16 <= aLen)
+      {
+        __m128i lUnits = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(aData + lPos));
+        if (aBigEndian)
+        {
+          lUnits = _mm_or_si128(
+              _mm_slli_epi16(lUnits, 8), _mm_srli_epi16(lUnits, 8));
+        }
+        __m128i lNonAscii = _mm_cmpeq_epi16(_mm_and_si128(lUnits, lHigh), lZero);
+        if (_mm_movemask_epi8(lNonAscii) != 0xFFFF) break;
+
+        char lBytes[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lBytes),
+                         _mm_packus_epi16(lUnits, lUnits));
+        aResult.append(lBytes, 8);
+        lPos += 16;
+      }
+      if (lPos == aLen) break;
+#endif
+      uint32_t lUnit = aBigEndian
+        ? (lData[lPos] << 8) | lData[lPos + 1]
+        : (lData[lPos + 1] << 8) | lData[lPos];
+      lPos += 2;
+
+      if (lUnit >= 0xD800 && lUnit <= 0xDBFF)
+      {
+        if (lPos == aLen) return false;
+        uint32_t lLow = aBigEndian
+          ? (lData[lPos] << 8) | lData[lPos + 1]
+          : (lData[lPos + 1] << 8) | lData[lPos];
+        if (lLow < 0xDC00 || lLow > 0xDFFF) return false;
+        lPos += 2;
+        lUnit = 0x10000 + ((lUnit - 0xD800) << 10) + (lLow - 0xDC00);
+      }
+      else if (lUnit >= 0xDC00 && lUnit <= 0xDFFF)
+      {
+        return false;
+      }
+      appendUtf8(lUnit, aResult);
+    }
+    return true;
+  }
+
+  bool
+  TextCodec::encodeUtf16(
+      bool aBigEndian,
+      const char* aData,
+      size_t aLen,
+      std::string& aResult)
+  {
+    aResult.reserve(aResult.size() + 2 * aLen);
+
+    size_t lPos = 0;
+    while (lPos < aLen)
+    {
+#ifdef ZORBA_ARCHIVE_HAVE_SSE2
+      // 16 ASCII characters at a time
+      const __m128i lZero = _mm_setzero_si128();
+      while (lPos + 16 <= aLen)
+      {
+        __m128i lChars = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(aData + lPos));
+        if (_mm_movemask_epi8(lChars)) break;
+
+        char lUnits[32];
+        if (aBigEndian)
+        {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lUnits),
+                           _mm_unpacklo_epi8(lZero, lChars));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lUnits + 16),
+                           _mm_unpackhi_epi8(lZero, lChars));
+        }
+        else
+        {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lUnits),
+                           _mm_unpacklo_epi8(lChars, lZero));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lUnits + 16),
+                           _mm_unpackhi_epi8(lChars, lZero));
+        }
+        aResult.append(lUnits, 32);
+        lPos += 16;
+      }
+      if (lPos == aLen) break;
+#endif
+      uint32_t lCodePoint;
+      if (!nextCodePoint(aData, aLen, lPos, lCodePoint)) return false;
+
+      uint32_t lUnits[2];
+      size_t lCount = 1;
+      if (lCodePoint >= 0x10000)
+      {
+        lCodePoint -= 0x10000;
+        lUnits[0] = 0xD800 | (lCodePoint >> 10);
+        lUnits[1] = 0xDC00 | (lCodePoint & 0x3FF);
+        lCount = 2;
+      }
+      else
+      {
+        lUnits[0] = lCodePoint;
+      }
+
+      for (size_t i = 0; i < lCount; ++i)
+      {
+        char lHigh = static_cast<char>(lUnits[i] >> 8);
+        char lLow = static_cast<char>(lUnits[i] & 0xFF);
+        aResult += aBigEndian ? lHigh : lLow;
+        aResult += aBigEndian ? lLow : lHigh;
+      }
+    }
+    return true;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
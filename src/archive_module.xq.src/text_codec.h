@@ -0,0 +1,124 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ZORBA_ARCHIVE_TEXT_CODEC_H_
+#define ZORBA_ARCHIVE_TEXT_CODEC_H_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Fast paths for the encodings of text entries that are common enough to
+ * bypass the generic transcode streams: UTF-8 validation, ISO-8859-1,
+ * Windows-1252, and UTF-16LE/BE from and to UTF-8. ASCII runs are handled
+ * 16 bytes at a time if SSE2 is available. The conversions fail (rather
+ * than substitute) if the input can't be converted such that the caller
+ * can fall back to the generic transcoding.
+ ******************************************************************************/
+  class TextCodec
+  {
+    public:
+      enum Charset
+      {
+        OTHER,
+        UTF_8,
+        ISO_8859_1,
+        WINDOWS_1252,
+        UTF_16LE,
+        UTF_16BE
+      };
+
+      /**
+       * Returns the charset of an encoding name (OTHER if there's no fast
+       * path for it).
+       */
+      static Charset
+      getCharset(const char* aEncoding);
+
+      /**
+       * Returns the length of the leading run of ASCII characters.
+       */
+      static size_t
+      asciiPrefix(const char* aData, size_t aLen);
+
+      static bool
+      isValidUtf8(const char* aData, size_t aLen);
+
+      /**
+       * Returns the length of the prefix that doesn't end within a UTF-8
+       * sequence, e.g. such that text read block by block can be
+       * converted up to there.
+       */
+      static size_t
+      completeUtf8(const char* aData, size_t aLen);
+
+      /**
+       * Converts text in the given charset to UTF-8 (appended to aResult).
+       */
+      static bool
+      decode(
+          Charset aCharset,
+          const char* aData,
+          size_t aLen,
+          std::string& aResult);
+
+      /**
+       * Converts UTF-8 text to the given charset (appended to aResult).
+       */
+      static bool
+      encode(
+          Charset aCharset,
+          const char* aData,
+          size_t aLen,
+          std::string& aResult);
+
+    protected:
+      static void
+      appendUtf8(uint32_t aCodePoint, std::string& aResult);
+
+      /**
+       * Decodes the UTF-8 sequence at aData[aPos] and advances aPos.
+       * Returns false if the sequence is malformed.
+       */
+      static bool
+      nextCodePoint(
+          const char* aData,
+          size_t aLen,
+          size_t& aPos,
+          uint32_t& aCodePoint);
+
+      static bool
+      decodeUtf16(
+          bool aBigEndian,
+          const char* aData,
+          size_t aLen,
+          std::string& aResult);
+
+      static bool
+      encodeUtf16(
+          bool aBigEndian,
+          const char* aData,
+          size_t aLen,
+          std::string& aResult);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_TEXT_CODEC_H_
@@ -0,0 +1,695 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "zip_format.h"
+
+#define ZIP_LOCAL_HEADER_SIG    0x04034b50
+#define ZIP_CENTRAL_HEADER_SIG  0x02014b50
+#define ZIP_EOCD_SIG            0x06054b50
+#define ZIP64_EOCD_SIG          0x06064b50
+#define ZIP64_LOCATOR_SIG       0x07064b50
+
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_EOCD_SIZE           22
+#define ZIP64_EOCD_SIZE         56
+#define ZIP64_LOCATOR_SIZE      20
+
+#define ZIP64_EXTRA_ID          0x0001
+#define ZIP_TIMESTAMP_EXTRA_ID  0x5455
+// padding in front of stored data (as written by Android's zipalign)
+#define ZIP_ALIGNMENT_EXTRA_ID  0xD935
+#define ZIP64_VERSION_NEEDED    45
+
+#define ZIP_FLAG_DATA_DESCRIPTOR 0x0008
+
+#define ZIP_MAX16 0xFFFF
+#define ZIP_MAX32 0xFFFFFFFFULL
+
+namespace zorba { namespace archive {
+
+  static inline uint16_t
+  readUInt16(const char* p)
+  {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(u[0] | (u[1] << 8));
+  }
+
+  static inline uint32_t
+  readUInt32(const char* p)
+  {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0])
+      | (static_cast<uint32_t>(u[1]) << 8)
+      | (static_cast<uint32_t>(u[2]) << 16)
+      | (static_cast<uint32_t>(u[3]) << 24);
+  }
+
+  static inline uint64_t
+  readUInt64(const char* p)
+  {
+    return static_cast<uint64_t>(readUInt32(p))
+      | (static_cast<uint64_t>(readUInt32(p + 4)) << 32);
+  }
+
+  static inline void
+  appendUInt16(std::string& aBuf, uint16_t v)
+  {
+    aBuf += static_cast<char>(v & 0xFF);
+    aBuf += static_cast<char>((v >> 8) & 0xFF);
+  }
+
+  // removes the fields with the given id from an extra field block
+  static std::string
+  stripExtra(const char* aExtra, uint16_t aLen, uint16_t aId)
+  {
+    std::string lRes;
+    uint16_t i = 0;
+    while (i + 4 <= aLen)
+    {
+      uint16_t lId = readUInt16(aExtra + i);
+      uint16_t lSize = readUInt16(aExtra + i + 2);
+      if (i + 4 + lSize > aLen) break;
+      if (lId != aId)
+      {
+        lRes.append(aExtra + i, 4 + lSize);
+      }
+      i += 4 + lSize;
+    }
+    return lRes;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  ZipDirectory::Entry::Entry()
+    : theVersionMadeBy(0),
+      theVersionNeeded(20),
+      theFlags(0),
+      theMethod(ZORBA_ZIP_METHOD_STORE),
+      theTime(0),
+      theDate(0),
+      theCRC32(0),
+      theCompressedSize(0),
+      theUncompressedSize(0),
+      theLocalHeaderOffset(0),
+      theInternalAttrs(0),
+      theExternalAttrs(0)
+  {}
+
+  bool
+  ZipDirectory::Entry::isDirectory() const
+  {
+    return !theName.empty() && theName[theName.size() - 1] == '/';
+  }
+
+  // patches the modification time of an extended timestamp field
+  static void
+  setTimestampExtra(std::string& aExtra, time_t aTime)
+  {
+    size_t i = 0;
+    while (i + 4 <= aExtra.size())
+    {
+      uint16_t lId = readUInt16(aExtra.data() + i);
+      uint16_t lSize = readUInt16(aExtra.data() + i + 2);
+      if (i + 4 + lSize > aExtra.size()) break;
+      // flags byte followed by mtime (if bit 0 is set)
+      if (lId == ZIP_TIMESTAMP_EXTRA_ID && lSize >= 5 && (aExtra[i + 4] & 1))
+      {
+        uint32_t lTime = static_cast<uint32_t>(aTime);
+        for (int j = 0; j < 4; ++j)
+        {
+          aExtra[i + 5 + j] = static_cast<char>((lTime >> (8 * j)) & 0xFF);
+        }
+      }
+      i += 4 + lSize;
+    }
+  }
+
+  void
+  ZipDirectory::Entry::setLastModified(time_t aTime, std::string& aLocalExtra)
+  {
+    struct ::tm lTm;
+#ifdef WIN32
+    localtime_s(&lTm, &aTime);
+#else
+    localtime_r(&aTime, &lTm);
+#endif
+    if (lTm.tm_year < 80)
+    {
+      // DOS dates start in 1980
+      theDate = (1 << 5) | 1;
+      theTime = 0;
+    }
+    else
+    {
+      theDate = static_cast<uint16_t>(((lTm.tm_year - 80) << 9)
+          | ((lTm.tm_mon + 1) << 5) | lTm.tm_mday);
+      theTime = static_cast<uint16_t>((lTm.tm_hour << 11)
+          | (lTm.tm_min << 5) | (lTm.tm_sec / 2));
+    }
+
+    setTimestampExtra(theExtra, aTime);
+    setTimestampExtra(aLocalExtra, aTime);
+  }
+
+  const uint64_t ZipDirectory::TAIL_SIZE
+    = ZIP64_EOCD_SIZE + ZIP64_LOCATOR_SIZE + ZIP_EOCD_SIZE + ZIP_MAX16;
+
+  ZipDirectory::ZipDirectory()
+    : theData(0),
+      theSize(0),
+      theBase(0),
+      theDirectoryOffset(0),
+      theCorrupted(false)
+  {}
+
+  bool
+  ZipDirectory::isZip(const char* aData, uint64_t aSize)
+  {
+    if (aSize < 4) return false;
+    uint32_t lSig = readUInt32(aData);
+    return lSig == ZIP_LOCAL_HEADER_SIG || lSig == ZIP_EOCD_SIG;
+  }
+
+  bool
+  ZipDirectory::parseZip64Extra(
+      const char* aExtra,
+      uint16_t aLen,
+      Entry& aEntry,
+      bool aOffset,
+      std::string& aOtherFields)
+  {
+    aOtherFields = stripExtra(aExtra, aLen, ZIP64_EXTRA_ID);
+
+    uint16_t i = 0;
+    while (i + 4 <= aLen)
+    {
+      uint16_t lId = readUInt16(aExtra + i);
+      uint16_t lSize = readUInt16(aExtra + i + 2);
+      if (i + 4 + lSize > aLen) return false;
+
+      if (lId == ZIP64_EXTRA_ID)
+      {
+        // only the fields whose 32 bit counterpart is saturated are present
+        const char* lField = aExtra + i + 4;
+        const char* lEnd = lField + lSize;
+        if (aEntry.theUncompressedSize == ZIP_MAX32)
+        {
+          if (lEnd - lField < 8) return false;
+          aEntry.theUncompressedSize = readUInt64(lField);
+          lField += 8;
+        }
+        if (aEntry.theCompressedSize == ZIP_MAX32)
+        {
+          if (lEnd - lField < 8) return false;
+          aEntry.theCompressedSize = readUInt64(lField);
+          lField += 8;
+        }
+        if (aOffset && aEntry.theLocalHeaderOffset == ZIP_MAX32)
+        {
+          if (lEnd - lField < 8) return false;
+          aEntry.theLocalHeaderOffset = readUInt64(lField);
+        }
+      }
+      i += 4 + lSize;
+    }
+    return true;
+  }
+
+  bool
+  ZipDirectory::readEnd(
+      const char* aData,
+      uint64_t aSize,
+      uint64_t aBase,
+      bool& aFound,
+      uint64_t& aNumEntries,
+      uint64_t& aDirectorySize,
+      uint64_t& aDirectoryOffset)
+  {
+    aFound = false;
+    if (aSize < ZIP_EOCD_SIZE) return false;
+
+    // the EOCD record is followed by a comment of at most 64k
+    uint64_t lEOCD = aSize - ZIP_EOCD_SIZE;
+    uint64_t lLimit = lEOCD > ZIP_MAX16 ? lEOCD - ZIP_MAX16 : 0;
+    while (readUInt32(aData + lEOCD) != ZIP_EOCD_SIG)
+    {
+      if (lEOCD == lLimit) return false;
+      --lEOCD;
+    }
+    aFound = true;
+
+    const char* p = aData + lEOCD;
+    aNumEntries = readUInt16(p + 10);
+    aDirectorySize = readUInt32(p + 12);
+    aDirectoryOffset = readUInt32(p + 16);
+
+    if ((aNumEntries == ZIP_MAX16 || aDirectorySize == ZIP_MAX32
+          || aDirectoryOffset == ZIP_MAX32)
+        && lEOCD >= ZIP64_LOCATOR_SIZE
+        && readUInt32(aData + lEOCD - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIG)
+    {
+      uint64_t lEOCD64 = readUInt64(aData + lEOCD - ZIP64_LOCATOR_SIZE + 8);
+      // the offset is taken from the archive, i.e. the check must not
+      // overflow
+      if (lEOCD64 < aBase) return false;
+      lEOCD64 -= aBase;
+      if (lEOCD64 > lEOCD || lEOCD - lEOCD64 < ZIP64_EOCD_SIZE
+          || readUInt32(aData + lEOCD64) != ZIP64_EOCD_SIG)
+      {
+        return false;
+      }
+      p = aData + lEOCD64;
+      aNumEntries = readUInt64(p + 32);
+      aDirectorySize = readUInt64(p + 40);
+      aDirectoryOffset = readUInt64(p + 48);
+    }
+
+    uint64_t lArchiveSize = aBase + aSize;
+    return aDirectoryOffset <= lArchiveSize
+      && aDirectorySize <= lArchiveSize - aDirectoryOffset;
+  }
+
+  bool
+  ZipDirectory::findDirectory(
+      const char* aData,
+      uint64_t aSize,
+      uint64_t aBase,
+      uint64_t& aOffset)
+  {
+    bool lFound;
+    uint64_t lNumEntries;
+    uint64_t lCDSize;
+    return readEnd(aData, aSize, aBase, lFound, lNumEntries, lCDSize, aOffset);
+  }
+
+  void
+  ZipDirectory::setData(const char* aData, uint64_t aSize, uint64_t aBase)
+  {
+    theData = aData;
+    theSize = aSize;
+    theBase = aBase;
+  }
+
+  bool
+  ZipDirectory::parse(const char* aData, uint64_t aSize, uint64_t aBase)
+  {
+    theData = aData;
+    theSize = aSize;
+    theBase = aBase;
+    theDirectoryOffset = 0;
+    theEntries.clear();
+
+    bool lFound;
+    uint64_t lNumEntries;
+    uint64_t lCDSize;
+    uint64_t lCDOffset;
+    bool lValid = readEnd(
+        aData, aSize, aBase, lFound, lNumEntries, lCDSize, lCDOffset);
+
+    // an EOCD record whose directory can't be parsed
+    theCorrupted = lFound;
+
+    if (!lValid || lCDOffset < aBase)
+      return false;
+
+    // each central header takes at least 46 bytes
+    if (lNumEntries > lCDSize / ZIP_CENTRAL_HEADER_SIZE)
+      return false;
+
+    theEntries.reserve(static_cast<size_t>(lNumEntries));
+
+    const char* lCur = aData + (lCDOffset - aBase);
+    const char* lEnd = lCur + lCDSize;
+    for (uint64_t i = 0; i < lNumEntries; ++i)
+    {
+      if (lEnd - lCur < ZIP_CENTRAL_HEADER_SIZE
+          || readUInt32(lCur) != ZIP_CENTRAL_HEADER_SIG)
+      {
+        return false;
+      }
+
+      uint16_t lNameLen = readUInt16(lCur + 28);
+      uint16_t lExtraLen = readUInt16(lCur + 30);
+      uint16_t lCommentLen = readUInt16(lCur + 32);
+      if (static_cast<uint64_t>(lEnd - lCur) < static_cast<uint64_t>(
+            ZIP_CENTRAL_HEADER_SIZE) + lNameLen + lExtraLen + lCommentLen)
+      {
+        return false;
+      }
+
+      theEntries.resize(theEntries.size() + 1);
+      Entry& lEntry = theEntries.back();
+      lEntry.theVersionMadeBy = readUInt16(lCur + 4);
+      lEntry.theVersionNeeded = readUInt16(lCur + 6);
+      lEntry.theFlags = readUInt16(lCur + 8);
+      lEntry.theMethod = readUInt16(lCur + 10);
+      lEntry.theTime = readUInt16(lCur + 12);
+      lEntry.theDate = readUInt16(lCur + 14);
+      lEntry.theCRC32 = readUInt32(lCur + 16);
+      lEntry.theCompressedSize = readUInt32(lCur + 20);
+      lEntry.theUncompressedSize = readUInt32(lCur + 24);
+      lEntry.theInternalAttrs = readUInt16(lCur + 36);
+      lEntry.theExternalAttrs = readUInt32(lCur + 38);
+      lEntry.theLocalHeaderOffset = readUInt32(lCur + 42);
+
+      const char* lVar = lCur + ZIP_CENTRAL_HEADER_SIZE;
+      lEntry.theName.assign(lVar, lNameLen);
+      if (!parseZip64Extra(lVar + lNameLen, lExtraLen, lEntry, true,
+                           lEntry.theExtra))
+      {
+        return false;
+      }
+      lEntry.theComment.assign(lVar + lNameLen + lExtraLen, lCommentLen);
+
+      lCur = lVar + lNameLen + lExtraLen + lCommentLen;
+    }
+    theDirectoryOffset = lCDOffset;
+    theCorrupted = false;
+    return true;
+  }
+
+  long
+  ZipDirectory::find(const std::string& aName) const
+  {
+    for (size_t i = 0; i < theEntries.size(); ++i)
+    {
+      if (theEntries[i].theName == aName)
+      {
+        return static_cast<long>(i);
+      }
+    }
+    return -1;
+  }
+
+  bool
+  ZipDirectory::getEntryData(
+      const Entry& aEntry,
+      const char*& aData,
+      std::string& aLocalExtra) const
+  {
+    // offsets are relative to the start of the archive
+    if (aEntry.theLocalHeaderOffset < theBase) return false;
+    uint64_t lOffset = aEntry.theLocalHeaderOffset - theBase;
+    if (lOffset > theSize || theSize - lOffset < ZIP_LOCAL_HEADER_SIZE)
+      return false;
+
+    const char* p = theData + lOffset;
+    if (readUInt32(p) != ZIP_LOCAL_HEADER_SIG)
+      return false;
+
+    uint16_t lNameLen = readUInt16(p + 26);
+    uint16_t lExtraLen = readUInt16(p + 28);
+    uint64_t lDataOffset = lOffset + ZIP_LOCAL_HEADER_SIZE
+      + lNameLen + lExtraLen;
+    if (lDataOffset > theSize
+        || theSize - lDataOffset < aEntry.theCompressedSize)
+    {
+      return false;
+    }
+
+    aLocalExtra = stripExtra(
+        p + ZIP_LOCAL_HEADER_SIZE + lNameLen, lExtraLen, ZIP64_EXTRA_ID);
+    aData = theData + lDataOffset;
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  ZipWriter::ZipWriter(std::ostream& aStream)
+    : theStream(aStream),
+      theOffset(0),
+      theAlignment(0)
+  {}
+
+  void
+  ZipWriter::write(const char* aData, size_t aLen)
+  {
+    theStream.write(aData, aLen);
+    theOffset += aLen;
+  }
+
+  void
+  ZipWriter::writeUInt16(uint16_t v)
+  {
+    char lBuf[2] = {
+      static_cast<char>(v & 0xFF),
+      static_cast<char>((v >> 8) & 0xFF)
+    };
+    write(lBuf, 2);
+  }
+
+  void
+  ZipWriter::writeUInt32(uint32_t v)
+  {
+    writeUInt16(static_cast<uint16_t>(v & 0xFFFF));
+    writeUInt16(static_cast<uint16_t>(v >> 16));
+  }
+
+  void
+  ZipWriter::writeUInt64(uint64_t v)
+  {
+    writeUInt32(static_cast<uint32_t>(v & ZIP_MAX32));
+    writeUInt32(static_cast<uint32_t>(v >> 32));
+  }
+
+  bool
+  ZipWriter::copy(
+      const ZipDirectory& aSource,
+      size_t aIndex,
+      const std::string& aName)
+  {
+    ZipDirectory::Entry lEntry = aSource.getEntry(aIndex);
+
+    const char* lData;
+    std::string lLocalExtra;
+    if (!aSource.getEntryData(lEntry, lData, lLocalExtra))
+      return false;
+
+    lEntry.theName = aName;
+    add(lEntry, lLocalExtra, lData);
+    return true;
+  }
+
+  void
+  ZipWriter::add(
+      const ZipDirectory::Entry& aEntry,
+      const std::string& aLocalExtra,
+      const char* aData)
+  {
+    ZipDirectory::Entry lEntry = aEntry;
+    writeLocalHeader(lEntry, aLocalExtra);
+
+    write(aData, static_cast<size_t>(lEntry.theCompressedSize));
+
+    theCentral.push_back(lEntry);
+  }
+
+  bool
+  ZipWriter::addCopy(
+      const ZipDirectory::Entry& aEntry,
+      const std::string& aLocalExtra,
+      std::istream& aOutput,
+      uint64_t aDataOffset)
+  {
+    if (aDataOffset > theOffset
+        || theOffset - aDataOffset < aEntry.theCompressedSize)
+    {
+      return false;
+    }
+
+    ZipDirectory::Entry lEntry = aEntry;
+    writeLocalHeader(lEntry, aLocalExtra);
+
+    // the source lies in front of the header that was just written,
+    // i.e. it's read block by block while the output grows
+    char lBuf[4096];
+    uint64_t lRemaining = lEntry.theCompressedSize;
+    uint64_t lPos = aDataOffset;
+    while (lRemaining > 0)
+    {
+      size_t lLen = static_cast<size_t>(
+          std::min<uint64_t>(lRemaining, sizeof(lBuf)));
+      aOutput.clear();
+      aOutput.seekg(static_cast<std::streamoff>(lPos), std::ios::beg);
+      aOutput.read(lBuf, lLen);
+      if (static_cast<size_t>(aOutput.gcount()) != lLen)
+        return false;
+      write(lBuf, lLen);
+      lPos += lLen;
+      lRemaining -= lLen;
+    }
+
+    theCentral.push_back(lEntry);
+    return true;
+  }
+
+  void
+  ZipWriter::writeLocalHeader(
+      ZipDirectory::Entry& aEntry,
+      const std::string& aLocalExtra)
+  {
+    // sizes and crc are known upfront, i.e. no data descriptor is written
+    aEntry.theFlags &= ~ZIP_FLAG_DATA_DESCRIPTOR;
+    aEntry.theLocalHeaderOffset = theOffset;
+
+    bool lZip64 = aEntry.theCompressedSize >= ZIP_MAX32
+      || aEntry.theUncompressedSize >= ZIP_MAX32;
+    if (lZip64)
+    {
+      aEntry.theVersionNeeded =
+        std::max<uint16_t>(aEntry.theVersionNeeded, ZIP64_VERSION_NEEDED);
+    }
+
+    std::string lLocalExtra = aLocalExtra;
+    if (theAlignment > 1 && aEntry.theMethod == ZORBA_ZIP_METHOD_STORE)
+    {
+      // pad the extra field such that the data starts at a multiple of
+      // the alignment (replacing the padding of a copied entry)
+      lLocalExtra = stripExtra(aLocalExtra.data(),
+          static_cast<uint16_t>(aLocalExtra.size()), ZIP_ALIGNMENT_EXTRA_ID);
+      uint64_t lDataOffset = theOffset + ZIP_LOCAL_HEADER_SIZE
+        + aEntry.theName.size() + lLocalExtra.size() + (lZip64 ? 20 : 0) + 6;
+      uint16_t lPadding = static_cast<uint16_t>(
+          (theAlignment - lDataOffset % theAlignment) % theAlignment);
+      if (lLocalExtra.size() + (lZip64 ? 20 : 0) + 6 + lPadding <= ZIP_MAX16)
+      {
+        appendUInt16(lLocalExtra, ZIP_ALIGNMENT_EXTRA_ID);
+        appendUInt16(lLocalExtra, static_cast<uint16_t>(2 + lPadding));
+        appendUInt16(lLocalExtra, static_cast<uint16_t>(theAlignment));
+        lLocalExtra.append(lPadding, '\0');
+      }
+    }
+
+    writeUInt32(ZIP_LOCAL_HEADER_SIG);
+    writeUInt16(aEntry.theVersionNeeded);
+    writeUInt16(aEntry.theFlags);
+    writeUInt16(aEntry.theMethod);
+    writeUInt16(aEntry.theTime);
+    writeUInt16(aEntry.theDate);
+    writeUInt32(aEntry.theCRC32);
+    writeUInt32(lZip64 ? ZIP_MAX32 : aEntry.theCompressedSize);
+    writeUInt32(lZip64 ? ZIP_MAX32 : aEntry.theUncompressedSize);
+    writeUInt16(static_cast<uint16_t>(aEntry.theName.size()));
+    writeUInt16(static_cast<uint16_t>(lLocalExtra.size() + (lZip64 ? 20 : 0)));
+    write(aEntry.theName.data(), aEntry.theName.size());
+    if (lZip64)
+    {
+      writeUInt16(ZIP64_EXTRA_ID);
+      writeUInt16(16);
+      writeUInt64(aEntry.theUncompressedSize);
+      writeUInt64(aEntry.theCompressedSize);
+    }
+    write(lLocalExtra.data(), lLocalExtra.size());
+  }
+
+  void
+  ZipWriter::close()
+  {
+    uint64_t lCDOffset = theOffset;
+
+    for (size_t i = 0; i < theCentral.size(); ++i)
+    {
+      const ZipDirectory::Entry& lEntry = theCentral[i];
+
+      bool lBigUncompressed = lEntry.theUncompressedSize >= ZIP_MAX32;
+      bool lBigCompressed = lEntry.theCompressedSize >= ZIP_MAX32;
+      bool lBigOffset = lEntry.theLocalHeaderOffset >= ZIP_MAX32;
+      uint16_t lZip64Len = static_cast<uint16_t>(
+          (lBigUncompressed ? 8 : 0) + (lBigCompressed ? 8 : 0)
+          + (lBigOffset ? 8 : 0));
+
+      uint16_t lVersionNeeded = lEntry.theVersionNeeded;
+      if (lZip64Len)
+      {
+        lVersionNeeded =
+          std::max<uint16_t>(lVersionNeeded, ZIP64_VERSION_NEEDED);
+      }
+
+      writeUInt32(ZIP_CENTRAL_HEADER_SIG);
+      writeUInt16(lEntry.theVersionMadeBy);
+      writeUInt16(lVersionNeeded);
+      writeUInt16(lEntry.theFlags);
+      writeUInt16(lEntry.theMethod);
+      writeUInt16(lEntry.theTime);
+      writeUInt16(lEntry.theDate);
+      writeUInt32(lEntry.theCRC32);
+      writeUInt32(lBigCompressed ? ZIP_MAX32 : lEntry.theCompressedSize);
+      writeUInt32(lBigUncompressed ? ZIP_MAX32 : lEntry.theUncompressedSize);
+      writeUInt16(static_cast<uint16_t>(lEntry.theName.size()));
+      writeUInt16(static_cast<uint16_t>(
+            lEntry.theExtra.size() + (lZip64Len ? lZip64Len + 4 : 0)));
+      writeUInt16(static_cast<uint16_t>(lEntry.theComment.size()));
+      writeUInt16(0); // disk number start
+      writeUInt16(lEntry.theInternalAttrs);
+      writeUInt32(lEntry.theExternalAttrs);
+      writeUInt32(lBigOffset ? ZIP_MAX32 : lEntry.theLocalHeaderOffset);
+      write(lEntry.theName.data(), lEntry.theName.size());
+      if (lZip64Len)
+      {
+        writeUInt16(ZIP64_EXTRA_ID);
+        writeUInt16(lZip64Len);
+        if (lBigUncompressed) writeUInt64(lEntry.theUncompressedSize);
+        if (lBigCompressed) writeUInt64(lEntry.theCompressedSize);
+        if (lBigOffset) writeUInt64(lEntry.theLocalHeaderOffset);
+      }
+      write(lEntry.theExtra.data(), lEntry.theExtra.size());
+      write(lEntry.theComment.data(), lEntry.theComment.size());
+    }
+
+    uint64_t lCDSize = theOffset - lCDOffset;
+    uint64_t lNumEntries = theCentral.size();
+
+    bool lZip64 = lNumEntries >= ZIP_MAX16
+      || lCDSize >= ZIP_MAX32
+      || lCDOffset >= ZIP_MAX32;
+
+    if (lZip64)
+    {
+      uint64_t lEOCD64 = theOffset;
+
+      writeUInt32(ZIP64_EOCD_SIG);
+      writeUInt64(ZIP64_EOCD_SIZE - 12);
+      writeUInt16(ZIP64_VERSION_NEEDED);
+      writeUInt16(ZIP64_VERSION_NEEDED);
+      writeUInt32(0);
+      writeUInt32(0);
+      writeUInt64(lNumEntries);
+      writeUInt64(lNumEntries);
+      writeUInt64(lCDSize);
+      writeUInt64(lCDOffset);
+
+      writeUInt32(ZIP64_LOCATOR_SIG);
+      writeUInt32(0);
+      writeUInt64(lEOCD64);
+      writeUInt32(1);
+    }
+
+    writeUInt32(ZIP_EOCD_SIG);
+    writeUInt16(0);
+    writeUInt16(0);
+    writeUInt16(static_cast<uint16_t>(lZip64 ? ZIP_MAX16 : lNumEntries));
+    writeUInt16(static_cast<uint16_t>(lZip64 ? ZIP_MAX16 : lNumEntries));
+    writeUInt32(static_cast<uint32_t>(lZip64 ? ZIP_MAX32 : lCDSize));
+    writeUInt32(static_cast<uint32_t>(lZip64 ? ZIP_MAX32 : lCDOffset));
+    writeUInt16(0); // comment length
+
+    theStream.flush();
+  }
+
+} /* namespace archive */ } /* namespace zorba */
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_ZIP_FORMAT_H_
+#define ZORBA_ARCHIVE_ZIP_FORMAT_H_
+
+#include <ctime>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define ZORBA_ZIP_METHOD_STORE   0
+#define ZORBA_ZIP_METHOD_DEFLATE 8
+
+// largest alignment of stored entries (see ZipWriter::setAlignment)
+#define ZORBA_ZIP_MAX_ALIGNMENT  32768
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Read-only view of the central directory of a ZIP archive that is
+ * available as a contiguous buffer. The buffer is not copied and must
+ * outlive the directory.
+ ******************************************************************************/
+  class ZipDirectory
+  {
+    public:
+      struct Entry
+      {
+        std::string theName;
+        uint16_t    theVersionMadeBy;
+        uint16_t    theVersionNeeded;
+        uint16_t    theFlags;
+        uint16_t    theMethod;
+        uint16_t    theTime;
+        uint16_t    theDate;
+        uint32_t    theCRC32;
+        uint64_t    theCompressedSize;
+        uint64_t    theUncompressedSize;
+        uint64_t    theLocalHeaderOffset;
+        uint16_t    theInternalAttrs;
+        uint32_t    theExternalAttrs;
+        // central extra fields without the ZIP64 field (0x0001)
+        std::string theExtra;
+        std::string theComment;
+
+        Entry();
+
+        bool
+        isDirectory() const;
+
+        /**
+         * Sets the DOS date and time and the modification time of an
+         * extended timestamp field (in the central and the given local
+         * extra field) if present.
+         */
+        void
+        setLastModified(time_t aTime, std::string& aLocalExtra);
+      };
+
+    protected:
+      const char*        theData;
+      uint64_t           theSize;
+      // offset of theData in the archive (non-zero if only the end of
+      // the archive is at hand)
+      uint64_t           theBase;
+      uint64_t           theDirectoryOffset;
+      std::vector<Entry> theEntries;
+      bool               theCorrupted;
+
+    public:
+      // size of the end of an archive that holds its end of central
+      // directory records (with a comment of maximum length)
+      static const uint64_t TAIL_SIZE;
+
+      ZipDirectory();
+
+      /**
+       * Parses the end of central directory record (ZIP64 aware) and
+       * all central directory headers. Returns false if the buffer
+       * doesn't contain a (consistent) ZIP archive. aData may hold the
+       * archive from offset aBase on only, as long as the directory is
+       * contained.
+       */
+      bool
+      parse(const char* aData, uint64_t aSize, uint64_t aBase = 0);
+
+      /**
+       * Sets aOffset to the offset of the central directory given the
+       * end of an archive (starting at offset aBase). Returns false if
+       * aData doesn't contain the end of central directory records.
+       */
+      static bool
+      findDirectory(
+          const char* aData,
+          uint64_t aSize,
+          uint64_t aBase,
+          uint64_t& aOffset);
+
+      /**
+       * Makes getEntryData locate entries in aData, which holds the
+       * archive from offset aBase on (e.g. after parsing the directory
+       * out of the end of the archive).
+       */
+      void
+      setData(const char* aData, uint64_t aSize, uint64_t aBase);
+
+      uint64_t
+      getBase() const { return theBase; }
+
+      uint64_t
+      getDirectoryOffset() const { return theDirectoryOffset; }
+
+      /**
+       * Tells if the last parse failed although an end of central
+       * directory record was found (e.g. its offsets are out of range).
+       */
+      bool
+      isCorrupted() const { return theCorrupted; }
+
+      size_t
+      size() const { return theEntries.size(); }
+
+      const Entry&
+      getEntry(size_t i) const { return theEntries[i]; }
+
+      /**
+       * Returns the index of the entry with the given name or -1.
+       */
+      long
+      find(const std::string& aName) const;
+
+      /**
+       * Locates the (compressed) data of the given entry. The extra
+       * field of the local header is returned without the ZIP64 field.
+       */
+      bool
+      getEntryData(
+          const Entry& aEntry,
+          const char*& aData,
+          std::string& aLocalExtra) const;
+
+      static bool
+      isZip(const char* aData, uint64_t aSize);
+
+    protected:
+      static bool
+      readEnd(
+          const char* aData,
+          uint64_t aSize,
+          uint64_t aBase,
+          bool& aFound,
+          uint64_t& aNumEntries,
+          uint64_t& aDirectorySize,
+          uint64_t& aDirectoryOffset);
+
+      static bool
+      parseZip64Extra(
+          const char* aExtra,
+          uint16_t aLen,
+          Entry& aEntry,
+          bool aOffset,
+          std::string& aOtherFields);
+  };
+
+/*******************************************************************************
+ * Writes a ZIP archive to a stream by copying already compressed entries
+ * (e.g. out of a ZipDirectory) without inflating them.
+ ******************************************************************************/
+  class ZipWriter
+  {
+    protected:
+      std::ostream&                     theStream;
+      uint64_t                          theOffset;
+      std::vector<ZipDirectory::Entry>  theCentral;
+      uint32_t                          theAlignment;
+
+    public:
+      ZipWriter(std::ostream& aStream);
+
+      /**
+       * Lets the data of STORE entries added from now on start at a
+       * multiple of aAlignment (a power of 2 up to ZORBA_ZIP_MAX_ALIGNMENT)
+       * by padding the extra field of their local header, e.g. such that
+       * they can be mapped into memory directly. 0 turns it off.
+       */
+      void
+      setAlignment(uint32_t aAlignment) { theAlignment = aAlignment; }
+
+      /**
+       * Appends the entry with the given index (optionally renamed) to
+       * the archive. Returns false if its data can't be located in the
+       * source buffer.
+       */
+      bool
+      copy(
+          const ZipDirectory& aSource,
+          size_t aIndex,
+          const std::string& aName);
+
+      bool
+      copy(
+          const ZipDirectory& aSource,
+          size_t aIndex)
+      {
+        return copy(aSource, aIndex, aSource.getEntry(aIndex).theName);
+      }
+
+      /**
+       * Appends an entry given its central directory information, the
+       * extra field of its local header, and its compressed data.
+       */
+      void
+      add(
+          const ZipDirectory::Entry& aEntry,
+          const std::string& aLocalExtra,
+          const char* aData);
+
+      /**
+       * Appends an entry whose compressed data has already been written
+       * by this writer at offset aDataOffset (e.g. an entry with the same
+       * content as an earlier one). aOutput reads the output stream, which
+       * must have been empty when the writer was created. Returns false if
+       * the data can't be read back.
+       */
+      bool
+      addCopy(
+          const ZipDirectory::Entry& aEntry,
+          const std::string& aLocalExtra,
+          std::istream& aOutput,
+          uint64_t aDataOffset);
+
+      /**
+       * Writes the central directory and the end of central directory
+       * records. No entries can be added afterwards.
+       */
+      void
+      close();
+
+      uint64_t
+      getOffset() const { return theOffset; }
+
+    protected:
+      // sets the offset (and flags) of aEntry and writes its local header
+      void
+      writeLocalHeader(
+          ZipDirectory::Entry& aEntry,
+          const std::string& aLocalExtra);
+
+      void
+      write(const char* aData, size_t aLen);
+
+      void
+      writeUInt16(uint16_t);
+
+      void
+      writeUInt32(uint32_t);
+
+      void
+      writeUInt64(uint64_t);
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_ZIP_FORMAT_H_
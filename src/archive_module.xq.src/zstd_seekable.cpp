@@ -0,0 +1,674 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+
+#ifdef ZORBA_ARCHIVE_HAVE_ZSTD
+
+#include <algorithm>
+
+#include <zstd.h>
+#include <zdict.h>
+
+#include "digest.h"
+#include "tar_scanner.h"
+#include "zstd_seekable.h"
+
+#define ZSTD_SKIPPABLE_MAGIC    0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC     0x8F92EAB1
+#define ZSTD_SEEK_FOOTER_SIZE   9
+#define ZSTD_SEEK_CHECKSUM_FLAG 0x80
+#define ZSTD_SEEK_RESERVED_BITS 0x7C
+
+// skippable frame in front of the others holding the dictionary
+#define ZSTD_DICTIONARY_MAGIC   0x184D2A5D
+// leading bytes of a dictionary in the zstd format (see ZDICT)
+#define ZSTD_DICTIONARY_ID      0xEC30A437
+// training fails or doesn't pay off below
+#define ZSTD_MIN_SAMPLES        8
+#define ZSTD_MIN_DICTIONARY     256
+
+namespace zorba { namespace archive {
+
+  static inline uint32_t
+  readUInt32(const char* p)
+  {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0])
+      | (static_cast<uint32_t>(u[1]) << 8)
+      | (static_cast<uint32_t>(u[2]) << 16)
+      | (static_cast<uint32_t>(u[3]) << 24);
+  }
+
+  static inline void
+  appendUInt32(std::string& aBuf, uint32_t v)
+  {
+    aBuf += static_cast<char>(v & 0xFF);
+    aBuf += static_cast<char>((v >> 8) & 0xFF);
+    aBuf += static_cast<char>((v >> 16) & 0xFF);
+    aBuf += static_cast<char>((v >> 24) & 0xFF);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  ZstdSeekableWriter::ZstdSeekableWriter(
+      std::ostream& aStream,
+      size_t aFrameSize,
+      int aLevel)
+    : theStream(aStream),
+      theFrameSize(std::max<size_t>(
+            std::min<size_t>(aFrameSize, ZORBA_ARCHIVE_ZSTD_MAX_FRAME_SIZE),
+            TarScanner::BLOCK_SIZE)),
+      theLevel(aLevel),
+      theContext(ZSTD_createCCtx()),
+      theDictionarySize(0),
+      theDictionary(0)
+  {
+    theFrame.reserve(
+        std::min<size_t>(theFrameSize, ZORBA_ARCHIVE_ZSTD_FRAME_SIZE));
+    if (!theContext)
+    {
+      theError = "couldn't create zstd context";
+    }
+  }
+
+  ZstdSeekableWriter::~ZstdSeekableWriter()
+  {
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(theContext));
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(theDictionary));
+  }
+
+  void
+  ZstdSeekableWriter::startEntry(uint64_t aSize)
+  {
+    if (theDictionarySize)
+    {
+      theStarts.push_back(theContent.size());
+      theStartSizes.push_back(aSize);
+      return;
+    }
+    if (!theFrame.empty() && theFrame.size() + aSize > theFrameSize)
+    {
+      flushFrame();
+    }
+  }
+
+  void
+  ZstdSeekableWriter::write(const char* aData, size_t aLen)
+  {
+    if (theDictionarySize)
+    {
+      theContent.append(aData, aLen);
+      return;
+    }
+    while (aLen)
+    {
+      size_t lLen = std::min(aLen, theFrameSize - theFrame.size());
+      theFrame.append(aData, lLen);
+      aData += lLen;
+      aLen -= lLen;
+      if (theFrame.size() >= theFrameSize)
+      {
+        flushFrame();
+      }
+    }
+  }
+
+  bool
+  ZstdSeekableWriter::close()
+  {
+    if (theDictionarySize)
+    {
+      trainDictionary();
+
+      // frames are cut as if the data was written just now
+      std::string lContent;
+      std::vector<uint64_t> lStarts;
+      std::vector<uint64_t> lSizes;
+      lContent.swap(theContent);
+      lStarts.swap(theStarts);
+      lSizes.swap(theStartSizes);
+      theDictionarySize = 0;
+
+      size_t lPos = 0;
+      for (size_t i = 0; i < lStarts.size(); ++i)
+      {
+        size_t lStart = static_cast<size_t>(lStarts[i]);
+        write(lContent.data() + lPos, lStart - lPos);
+        startEntry(lSizes[i]);
+        lPos = lStart;
+      }
+      write(lContent.data() + lPos, lContent.size() - lPos);
+    }
+
+    flushFrame();
+    if (!theError.empty())
+    {
+      return false;
+    }
+
+    std::string lTable;
+    uint32_t lCount = static_cast<uint32_t>(theFrames.size());
+    appendUInt32(lTable, ZSTD_SKIPPABLE_MAGIC);
+    appendUInt32(lTable, lCount * 12 + ZSTD_SEEK_FOOTER_SIZE);
+    for (size_t i = 0; i < theFrames.size(); ++i)
+    {
+      appendUInt32(lTable, theFrames[i].theCompressedSize);
+      appendUInt32(lTable, theFrames[i].theSize);
+      appendUInt32(lTable, theFrames[i].theChecksum);
+    }
+    appendUInt32(lTable, lCount);
+    lTable += static_cast<char>(ZSTD_SEEK_CHECKSUM_FLAG);
+    appendUInt32(lTable, ZSTD_SEEKABLE_MAGIC);
+    theStream.write(lTable.data(), lTable.size());
+    return true;
+  }
+
+  void
+  ZstdSeekableWriter::flushFrame()
+  {
+    if (theFrame.empty()) return;
+    if (!theError.empty())
+    {
+      theFrame.clear();
+      return;
+    }
+
+    size_t lBound = ZSTD_compressBound(theFrame.size());
+    theBuffer.resize(lBound);
+    size_t lLen;
+    if (theDictionary)
+    {
+      lLen = ZSTD_compress_usingCDict(
+          static_cast<ZSTD_CCtx*>(theContext),
+          &theBuffer[0], lBound,
+          theFrame.data(), theFrame.size(),
+          static_cast<ZSTD_CDict*>(theDictionary));
+    }
+    else
+    {
+      lLen = ZSTD_compressCCtx(
+          static_cast<ZSTD_CCtx*>(theContext),
+          &theBuffer[0], lBound,
+          theFrame.data(), theFrame.size(),
+          theLevel);
+    }
+    if (ZSTD_isError(lLen))
+    {
+      theError = ZSTD_getErrorName(lLen);
+      theFrame.clear();
+      return;
+    }
+    theStream.write(theBuffer.data(), lLen);
+
+    // the seek table holds the lower 32 bit of the XXH64 of each frame
+    XXH64 lHash;
+    lHash.update(theFrame.data(), theFrame.size());
+
+    Frame lFrame;
+    lFrame.theCompressedSize = static_cast<uint32_t>(lLen);
+    lFrame.theSize = static_cast<uint32_t>(theFrame.size());
+    lFrame.theChecksum = static_cast<uint32_t>(lHash.get() & 0xFFFFFFFF);
+    theFrames.push_back(lFrame);
+    theFrame.clear();
+  }
+
+  void
+  ZstdSeekableWriter::trainDictionary()
+  {
+    if (!theError.empty()) return;
+
+    // each entry (header included) is a sample; only the beginning of
+    // large ones is used
+    std::vector<size_t> lOffsets;
+    std::vector<size_t> lSizes;
+    uint64_t lTotal = 0;
+    for (size_t i = 0; i < theStarts.size(); ++i)
+    {
+      size_t lStart = static_cast<size_t>(theStarts[i]);
+      size_t lEnd = i + 1 < theStarts.size()
+        ? static_cast<size_t>(theStarts[i + 1])
+        : theContent.size();
+      if (lEnd <= lStart) continue;
+      lOffsets.push_back(lStart);
+      lSizes.push_back(std::min<size_t>(
+            lEnd - lStart, ZORBA_ARCHIVE_ZSTD_DICTIONARY_SIZE));
+      lTotal += lSizes.back();
+    }
+
+    // the dictionary is stored, too, i.e. it must stay small compared
+    // to the content
+    size_t lCapacity = std::min<size_t>(
+        theDictionarySize,
+        theContent.size() / ZORBA_ARCHIVE_ZSTD_SAMPLE_FACTOR);
+    if (lSizes.size() < ZSTD_MIN_SAMPLES || lCapacity < ZSTD_MIN_DICTIONARY)
+    {
+      return;
+    }
+
+    // every n-th entry if there are more than needed
+    uint64_t lBudget
+      = static_cast<uint64_t>(lCapacity) * ZORBA_ARCHIVE_ZSTD_SAMPLE_FACTOR;
+    size_t lStep = static_cast<size_t>(lTotal / lBudget) + 1;
+    std::string lSamples;
+    std::vector<size_t> lSampleSizes;
+    for (size_t i = 0; i < lSizes.size(); i += lStep)
+    {
+      lSamples.append(theContent, lOffsets[i], lSizes[i]);
+      lSampleSizes.push_back(lSizes[i]);
+    }
+    if (lSampleSizes.size() < ZSTD_MIN_SAMPLES) return;
+
+    std::string lDictionary(lCapacity, '\0');
+    size_t lLen = ZDICT_trainFromBuffer(
+        &lDictionary[0], lCapacity,
+        lSamples.data(), &lSampleSizes[0],
+        static_cast<unsigned>(lSampleSizes.size()));
+    // e.g. samples that are too small to learn from
+    if (ZDICT_isError(lLen)) return;
+
+    theDictionary = ZSTD_createCDict(lDictionary.data(), lLen, theLevel);
+    if (!theDictionary) return;
+
+    // listed in the seek table without content, i.e. the offsets of the
+    // other frames stay the same
+    std::string lFrame;
+    appendUInt32(lFrame, ZSTD_DICTIONARY_MAGIC);
+    appendUInt32(lFrame, static_cast<uint32_t>(lLen));
+    lFrame.append(lDictionary.data(), lLen);
+    theStream.write(lFrame.data(), lFrame.size());
+
+    XXH64 lHash;
+    Frame lEntry;
+    lEntry.theCompressedSize = static_cast<uint32_t>(lFrame.size());
+    lEntry.theSize = 0;
+    lEntry.theChecksum = static_cast<uint32_t>(lHash.get() & 0xFFFFFFFF);
+    theFrames.push_back(lEntry);
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  ZstdSeekableReader::ZstdSeekableReader()
+    : theData(0),
+      theDataSize(0),
+      theSize(0),
+      theContext(0),
+      theDictionary(0),
+      theCurrent(-1),
+      theDecompressed(0)
+  {}
+
+  ZstdSeekableReader::~ZstdSeekableReader()
+  {
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(theContext));
+    ZSTD_freeDDict(static_cast<ZSTD_DDict*>(theDictionary));
+  }
+
+  bool
+  ZstdSeekableReader::isSeekable(const char* aData, uint64_t aSize)
+  {
+    return aSize >= 8 + ZSTD_SEEK_FOOTER_SIZE
+      && readUInt32(aData + aSize - 4) == ZSTD_SEEKABLE_MAGIC;
+  }
+
+  bool
+  ZstdSeekableReader::open(const char* aData, uint64_t aSize)
+  {
+    if (!isSeekable(aData, aSize)) return false;
+
+    const char* lFooter = aData + aSize - ZSTD_SEEK_FOOTER_SIZE;
+    uint32_t lCount = readUInt32(lFooter);
+    unsigned char lDescriptor = static_cast<unsigned char>(lFooter[4]);
+    if (lDescriptor & ZSTD_SEEK_RESERVED_BITS) return false;
+
+    uint64_t lEntrySize = (lDescriptor & ZSTD_SEEK_CHECKSUM_FLAG) ? 12 : 8;
+    uint64_t lTableSize = 8 + lCount * lEntrySize + ZSTD_SEEK_FOOTER_SIZE;
+    if (lTableSize > aSize) return false;
+
+    const char* lTable = aData + aSize - lTableSize;
+    if (readUInt32(lTable) != ZSTD_SKIPPABLE_MAGIC
+        || readUInt32(lTable + 4) != lTableSize - 8)
+    {
+      return false;
+    }
+
+    theFrames.clear();
+    theFrames.reserve(lCount);
+    uint64_t lCompressedOffset = 0;
+    uint64_t lOffset = 0;
+    const char* lEntry = lTable + 8;
+    for (uint32_t i = 0; i < lCount; ++i, lEntry += lEntrySize)
+    {
+      Frame lFrame;
+      lFrame.theCompressedOffset = lCompressedOffset;
+      lFrame.theOffset = lOffset;
+      lFrame.theCompressedSize = readUInt32(lEntry);
+      lFrame.theSize = readUInt32(lEntry + 4);
+      theFrames.push_back(lFrame);
+      lCompressedOffset += lFrame.theCompressedSize;
+      lOffset += lFrame.theSize;
+    }
+
+    // the frames need to cover everything in front of the seek table
+    if (lCompressedOffset != aSize - lTableSize)
+    {
+      theFrames.clear();
+      return false;
+    }
+
+    if (!theContext)
+    {
+      theContext = ZSTD_createDCtx();
+      if (!theContext)
+      {
+        theError = "couldn't create zstd context";
+        return false;
+      }
+    }
+
+    ZSTD_freeDDict(static_cast<ZSTD_DDict*>(theDictionary));
+    theDictionary = 0;
+    if (ZstdDictionaryDecoder::hasDictionary(
+          aData, static_cast<size_t>(std::min<uint64_t>(aSize, 12))))
+    {
+      uint32_t lLen = readUInt32(aData + 4);
+      if (theFrames[0].theCompressedSize != 8 + static_cast<uint64_t>(lLen))
+      {
+        theFrames.clear();
+        return false;
+      }
+      theDictionary = ZSTD_createDDict(aData + 8, lLen);
+      if (!theDictionary)
+      {
+        theError = "couldn't load zstd dictionary";
+        theFrames.clear();
+        return false;
+      }
+    }
+
+    theData = aData;
+    theDataSize = aSize;
+    theSize = lOffset;
+    theCurrent = -1;
+    theCurrentData.clear();
+    theDecompressed = 0;
+    return true;
+  }
+
+  bool
+  ZstdSeekableReader::loadFrame(size_t aIndex)
+  {
+    if (theCurrent == static_cast<long>(aIndex)) return true;
+
+    const Frame& lFrame = theFrames[aIndex];
+    theCurrent = -1;
+    theCurrentData.resize(lFrame.theSize);
+    if (lFrame.theSize)
+    {
+      size_t lLen = theDictionary
+        ? ZSTD_decompress_usingDDict(
+            static_cast<ZSTD_DCtx*>(theContext),
+            &theCurrentData[0], lFrame.theSize,
+            theData + lFrame.theCompressedOffset, lFrame.theCompressedSize,
+            static_cast<ZSTD_DDict*>(theDictionary))
+        : ZSTD_decompressDCtx(
+            static_cast<ZSTD_DCtx*>(theContext),
+            &theCurrentData[0], lFrame.theSize,
+            theData + lFrame.theCompressedOffset, lFrame.theCompressedSize);
+      if (ZSTD_isError(lLen))
+      {
+        theError = ZSTD_getErrorName(lLen);
+        return false;
+      }
+      if (lLen != lFrame.theSize)
+      {
+        theError = "frame size doesn't match the seek table";
+        return false;
+      }
+    }
+    theDecompressed += lFrame.theCompressedSize;
+    theCurrent = static_cast<long>(aIndex);
+    return true;
+  }
+
+  bool
+  ZstdSeekableReader::read(
+      uint64_t aOffset,
+      uint64_t aLen,
+      std::string& aResult)
+  {
+    if (aLen > theSize || aOffset > theSize - aLen)
+    {
+      theError = "range exceeds the content";
+      return false;
+    }
+    if (!aLen) return true;
+
+    // last frame starting at or before the offset
+    size_t lLow = 0;
+    size_t lHigh = theFrames.size();
+    while (lHigh - lLow > 1)
+    {
+      size_t lMid = lLow + (lHigh - lLow) / 2;
+      if (theFrames[lMid].theOffset <= aOffset)
+      {
+        lLow = lMid;
+      }
+      else
+      {
+        lHigh = lMid;
+      }
+    }
+
+    for (size_t i = lLow; aLen && i < theFrames.size(); ++i)
+    {
+      const Frame& lFrame = theFrames[i];
+      if (aOffset >= lFrame.theOffset + lFrame.theSize) continue;
+      if (!loadFrame(i)) return false;
+
+      size_t lStart = static_cast<size_t>(aOffset - lFrame.theOffset);
+      size_t lLen = static_cast<size_t>(
+          std::min<uint64_t>(aLen, lFrame.theSize - lStart));
+      aResult.append(theCurrentData, lStart, lLen);
+      aOffset += lLen;
+      aLen -= lLen;
+    }
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  ZstdDictionaryDecoder::ZstdDictionaryDecoder()
+    : theContext(0),
+      theLoaded(false),
+      thePending(0)
+  {}
+
+  ZstdDictionaryDecoder::~ZstdDictionaryDecoder()
+  {
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(theContext));
+  }
+
+  bool
+  ZstdDictionaryDecoder::hasDictionary(const char* aHead, size_t aLen)
+  {
+    return aLen >= 12
+      && readUInt32(aHead) == ZSTD_DICTIONARY_MAGIC
+      && readUInt32(aHead + 8) == ZSTD_DICTIONARY_ID;
+  }
+
+  bool
+  ZstdDictionaryDecoder::decode(
+      const char* aData,
+      size_t aLen,
+      std::string& aResult)
+  {
+    if (!theError.empty()) return false;
+
+    while (!theLoaded && aLen)
+    {
+      size_t lWanted = theHeader.size() < 8
+        ? 8
+        : 8 + static_cast<size_t>(readUInt32(theHeader.data() + 4));
+      size_t lLen = std::min(aLen, lWanted - theHeader.size());
+      theHeader.append(aData, lLen);
+      aData += lLen;
+      aLen -= lLen;
+
+      if (theHeader.size() == 8)
+      {
+        uint32_t lSize = readUInt32(theHeader.data() + 4);
+        if (readUInt32(theHeader.data()) != ZSTD_DICTIONARY_MAGIC
+            || lSize < 8 || lSize > ZORBA_ARCHIVE_ZSTD_MAX_FRAME_SIZE)
+        {
+          theError = "missing zstd dictionary";
+          return false;
+        }
+      }
+      else if (theHeader.size() == lWanted)
+      {
+        if (!theContext)
+        {
+          theContext = ZSTD_createDCtx();
+          if (!theContext)
+          {
+            theError = "couldn't create zstd context";
+            return false;
+          }
+        }
+        size_t lRes = ZSTD_DCtx_loadDictionary(
+            static_cast<ZSTD_DCtx*>(theContext),
+            theHeader.data() + 8, theHeader.size() - 8);
+        if (ZSTD_isError(lRes))
+        {
+          theError = ZSTD_getErrorName(lRes);
+          return false;
+        }
+        theHeader.clear();
+        theLoaded = true;
+      }
+    }
+    if (!aLen) return true;
+
+    theBuffer.resize(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer lIn = { aData, aLen, 0 };
+    bool lFull = true;
+    // a full output buffer may hide more output for the same input
+    while (lIn.pos < lIn.size || lFull)
+    {
+      ZSTD_outBuffer lOut = { &theBuffer[0], theBuffer.size(), 0 };
+      size_t lRes = ZSTD_decompressStream(
+          static_cast<ZSTD_DCtx*>(theContext), &lOut, &lIn);
+      if (ZSTD_isError(lRes))
+      {
+        theError = ZSTD_getErrorName(lRes);
+        return false;
+      }
+      aResult.append(theBuffer.data(), lOut.pos);
+      thePending = lRes;
+      lFull = lOut.pos == lOut.size;
+    }
+    return true;
+  }
+
+/*******************************************************************************
+ ******************************************************************************/
+  bool
+  ZstdSeekableTar::find(
+      const std::set<std::string>& aNames,
+      std::vector<Entry>& aEntries)
+  {
+    TarScanner lScanner;
+    std::set<std::string> lMissing(aNames);
+    std::string lBuffer;
+    size_t lSeen = 0;
+    while (!lMissing.empty() && !lScanner.isFinished())
+    {
+      uint64_t lAvailable = theReader.getSize() - lScanner.getOffset();
+      uint64_t lSkip = lScanner.getSkippable();
+      if (lSkip)
+      {
+        if (lSkip > lAvailable)
+        {
+          theError = "entry exceeds the archive";
+          return false;
+        }
+        lScanner.skip(lSkip);
+        continue;
+      }
+
+      // archives without end-of-archive blocks just end
+      uint64_t lWanted = lScanner.getWanted();
+      if (lWanted > lAvailable) break;
+
+      lBuffer.clear();
+      if (!theReader.read(lScanner.getOffset(), lWanted, lBuffer))
+      {
+        theError = theReader.getError();
+        return false;
+      }
+      if (!lScanner.feed(lBuffer.data(), lBuffer.size()))
+      {
+        theError = lScanner.getError();
+        return false;
+      }
+
+      const std::vector<TarScanner::Entry>& lAll = lScanner.getEntries();
+      for (; lSeen < lAll.size(); ++lSeen)
+      {
+        if (aNames.find(lAll[lSeen].theName) == aNames.end()) continue;
+
+        // the data of a hardlink is stored with the (preceding) target
+        size_t lData = lSeen;
+        while (lAll[lData].isHardlink())
+        {
+          size_t i = lData;
+          while (i > 0 && lAll[i - 1].theName != lAll[lData].theLink) --i;
+          if (i == 0)
+          {
+            theError = lAll[lData].theLink + ": hardlink target not found";
+            return false;
+          }
+          lData = i - 1;
+        }
+
+        const TarScanner::Entry& lTarEntry = lAll[lData];
+        if (lTarEntry.theType == TarScanner::TYPE_SPARSE)
+        {
+          theError = lTarEntry.theName + ": sparse entries are not supported";
+          return false;
+        }
+        if (lTarEntry.theSize > theReader.getSize() - lTarEntry.theOffset)
+        {
+          theError = "entry exceeds the archive";
+          return false;
+        }
+
+        Entry lEntry;
+        lEntry.theName = lAll[lSeen].theName;
+        lEntry.theOffset = lTarEntry.theOffset;
+        lEntry.theSize = lTarEntry.theSize;
+        lEntry.thePosition = lSeen;
+        aEntries.push_back(lEntry);
+        lMissing.erase(lEntry.theName);
+      }
+    }
+    return true;
+  }
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif /* ZORBA_ARCHIVE_HAVE_ZSTD */
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2012 The FLWOR Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZORBA_ARCHIVE_ZSTD_SEEKABLE_H_
+#define ZORBA_ARCHIVE_ZSTD_SEEKABLE_H_
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// default uncompressed size of the frames of a seekable archive
+#define ZORBA_ARCHIVE_ZSTD_FRAME_SIZE 1048576
+
+// frames are described by 32 bit sizes in the seek table
+#define ZORBA_ARCHIVE_ZSTD_MAX_FRAME_SIZE 1073741824
+
+#define ZORBA_ARCHIVE_ZSTD_LEVEL 3
+
+// upper bound for the size of a dictionary trained from the entries
+#define ZORBA_ARCHIVE_ZSTD_DICTIONARY_SIZE 112640
+
+// bytes of samples used for training, relative to the dictionary size
+#define ZORBA_ARCHIVE_ZSTD_SAMPLE_FACTOR 100
+
+namespace zorba { namespace archive {
+
+/*******************************************************************************
+ * Compresses a stream into independent zstd frames and appends a seek
+ * table in a skippable frame (zstd seekable format), i.e. the result can
+ * be decompressed by any zstd decoder. Frames hold up to aFrameSize bytes;
+ * startEntry lets them start at entry boundaries. Only available if the
+ * module is built with zstd (ZORBA_ARCHIVE_HAVE_ZSTD).
+ *
+ * Optionally, a dictionary is trained from the entries and all frames are
+ * compressed with it (see setDictionarySize). It's stored once in a
+ * skippable frame in front of them, i.e. decoders need to load it from
+ * there (see ZstdDictionaryDecoder). Plain zstd decoders (including
+ * libarchive) can't decompress such frames.
+ ******************************************************************************/
+  class ZstdSeekableWriter
+  {
+    protected:
+      struct Frame
+      {
+        uint32_t theCompressedSize;
+        uint32_t theSize;
+        uint32_t theChecksum;
+      };
+
+      std::ostream&      theStream;
+      size_t             theFrameSize;
+      int                theLevel;
+      std::string        theFrame;
+      std::string        theBuffer;
+      std::vector<Frame> theFrames;
+      void*              theContext;
+      // dictionary training: the data is kept until close
+      size_t                theDictionarySize;
+      std::string           theContent;
+      std::vector<uint64_t> theStarts;
+      std::vector<uint64_t> theStartSizes;
+      void*                 theDictionary;
+      std::string           theError;
+
+    public:
+      ZstdSeekableWriter(
+          std::ostream& aStream,
+          size_t aFrameSize = ZORBA_ARCHIVE_ZSTD_FRAME_SIZE,
+          int aLevel = ZORBA_ARCHIVE_ZSTD_LEVEL);
+
+      ~ZstdSeekableWriter();
+
+      /**
+       * Starts a new frame if the next aSize bytes don't fit into the
+       * current one anymore.
+       */
+      void
+      startEntry(uint64_t aSize);
+
+      void
+      write(const char* aData, size_t aLen);
+
+      /**
+       * Trains a dictionary of up to aSize bytes from a sample of the
+       * entries (the data between two calls of startEntry) once the
+       * writer is closed. Nothing is written before. If there are too few
+       * entries to train on, the frames are compressed without it.
+       */
+      void
+      setDictionarySize(size_t aSize) { theDictionarySize = aSize; }
+
+      // true once close has stored a dictionary
+      bool
+      hasDictionary() const { return theDictionary != 0; }
+
+      /**
+       * Compresses the pending data and writes the seek table.
+       * Returns false if compressing failed (see getError).
+       */
+      bool
+      close();
+
+      const std::string&
+      getError() const { return theError; }
+
+    protected:
+      void
+      flushFrame();
+
+      void
+      trainDictionary();
+  };
+
+/*******************************************************************************
+ * Random access to the decompressed content of a buffer in the zstd
+ * seekable format. Only the frames covering a requested range are
+ * decompressed; the last one is kept for subsequent reads.
+ ******************************************************************************/
+  class ZstdSeekableReader
+  {
+    protected:
+      struct Frame
+      {
+        uint64_t theCompressedOffset;
+        uint64_t theOffset;
+        uint32_t theCompressedSize;
+        uint32_t theSize;
+      };
+
+      const char*        theData;
+      uint64_t           theDataSize;
+      std::vector<Frame> theFrames;
+      uint64_t           theSize;
+      void*              theContext;
+      void*              theDictionary;
+      long               theCurrent;
+      std::string        theCurrentData;
+      uint64_t           theDecompressed;
+      std::string        theError;
+
+    public:
+      ZstdSeekableReader();
+
+      ~ZstdSeekableReader();
+
+      /**
+       * Parses the seek table at the end of the buffer and loads the
+       * dictionary in front of the frames (if any). Returns false if
+       * there is none or it doesn't match the buffer. The buffer is not
+       * copied and must outlive the reader.
+       */
+      bool
+      open(const char* aData, uint64_t aSize);
+
+      // decompressed size
+      uint64_t
+      getSize() const { return theSize; }
+
+      size_t
+      getFrameCount() const { return theFrames.size(); }
+
+      // compressed bytes decompressed so far (e.g. for a ResourceGuard)
+      uint64_t
+      getDecompressed() const { return theDecompressed; }
+
+      /**
+       * Appends aLen decompressed bytes starting at aOffset to aResult.
+       * Returns false if the range exceeds the content or a frame is
+       * corrupted (see getError).
+       */
+      bool
+      read(uint64_t aOffset, uint64_t aLen, std::string& aResult);
+
+      const std::string&
+      getError() const { return theError; }
+
+      /**
+       * Returns true if the buffer ends with a seek table.
+       */
+      static bool
+      isSeekable(const char* aData, uint64_t aSize);
+
+    protected:
+      bool
+      loadFrame(size_t aIndex);
+  };
+
+/*******************************************************************************
+ * Sequentially decompresses a stream written by a ZstdSeekableWriter with
+ * a dictionary, e.g. for libarchive that can't load it itself. The
+ * dictionary is loaded from the leading skippable frame; the seek table
+ * is skipped like any other skippable frame.
+ ******************************************************************************/
+  class ZstdDictionaryDecoder
+  {
+    protected:
+      void*       theContext;
+      // the dictionary frame until it's complete
+      std::string theHeader;
+      bool        theLoaded;
+      // 0 at the end of a frame
+      size_t      thePending;
+      std::string theBuffer;
+      std::string theError;
+
+    public:
+      ZstdDictionaryDecoder();
+
+      ~ZstdDictionaryDecoder();
+
+      /**
+       * Decompresses the next aLen bytes of the stream and appends the
+       * output to aResult. Returns false if the stream is corrupted (see
+       * getError).
+       */
+      bool
+      decode(const char* aData, size_t aLen, std::string& aResult);
+
+      // true if the stream read so far ends with a complete frame
+      bool
+      isFinished() const { return theLoaded && !thePending; }
+
+      const std::string&
+      getError() const { return theError; }
+
+      /**
+       * Returns true if the leading bytes start a stream with dictionary.
+       */
+      static bool
+      hasDictionary(const char* aHead, size_t aLen);
+  };
+
+/*******************************************************************************
+ * Locates the data of TAR entries within a seekable zstd stream by
+ * walking from header to header (see TarScanner), i.e. without
+ * decompressing the data of the entries in between. Hardlinks are
+ * resolved to their target.
+ ******************************************************************************/
+  class ZstdSeekableTar
+  {
+    public:
+      struct Entry
+      {
+        std::string theName;
+        uint64_t    theOffset;
+        uint64_t    theSize;
+        // position in the archive
+        size_t      thePosition;
+      };
+
+    protected:
+      ZstdSeekableReader& theReader;
+      std::string         theError;
+
+    public:
+      ZstdSeekableTar(ZstdSeekableReader& aReader) : theReader(aReader) {}
+
+      /**
+       * Finds the entries with the given names (in archive order). The
+       * walk stops as soon as all of them have been seen. Returns false
+       * if the content isn't a (consistent) TAR archive or an entry
+       * can't be read from it directly (e.g. a sparse one).
+       */
+      bool
+      find(const std::set<std::string>& aNames, std::vector<Entry>& aEntries);
+
+      const std::string&
+      getError() const { return theError; }
+  };
+
+} /* namespace archive */ } /* namespace zorba */
+
+#endif // ZORBA_ARCHIVE_ZSTD_SEEKABLE_H_
@@ -0,0 +1 @@
+0 0 first aligned b25l c2Vjb25kIGFsaWduZWQ=
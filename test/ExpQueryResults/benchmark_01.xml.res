@@ -0,0 +1 @@
+300 20184 true ZIP DEFLATE true true
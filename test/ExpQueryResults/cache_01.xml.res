@@ -0,0 +1 @@
+true 2 2 2 0
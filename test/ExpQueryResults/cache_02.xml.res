@@ -0,0 +1 @@
+true 1 0 true true
@@ -0,0 +1 @@
+abc.txt:352441c2:ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad:44bc2cf5ad770999 empty.txt:00000000:e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855:ef46db3751d8e999 abc.txt:352441c2 empty.txt:00000000
@@ -0,0 +1 @@
+3 true other
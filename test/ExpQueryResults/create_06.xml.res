@@ -0,0 +1 @@
+3 true other 3 true other
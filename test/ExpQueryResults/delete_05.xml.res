@@ -0,0 +1 @@
+bar.txt &lt;foo/&gt;
@@ -0,0 +1 @@
+{ "id" : 123, "name" : "item 123", "tags" : [ "small", "similar" ] } true 300 true
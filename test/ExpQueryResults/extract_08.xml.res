@@ -0,0 +1 @@
+ZmlsZQ== cjEvZmlsZTEK ZmlsZQ== cjEvZmlsZTEK MSAyIDM= 0
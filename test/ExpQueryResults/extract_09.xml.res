@@ -0,0 +1 @@
+€é hi AGgA6Q== hé
\ No newline at end of file
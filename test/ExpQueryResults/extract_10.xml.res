@@ -0,0 +1 @@
+1 2 2
\ No newline at end of file
@@ -0,0 +1 @@
+one two three 3 one x y 0
\ No newline at end of file
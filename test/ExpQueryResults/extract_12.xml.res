@@ -0,0 +1 @@
+b28y YmFy 0
\ No newline at end of file
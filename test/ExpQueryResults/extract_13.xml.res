@@ -0,0 +1 @@
+one two bar 0
\ No newline at end of file
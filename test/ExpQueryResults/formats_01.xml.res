@@ -0,0 +1,2 @@
+<?xml version="1.0" encoding="UTF-8"?>
+7ZIP LZMA2 dir/b.txt c.txt two three
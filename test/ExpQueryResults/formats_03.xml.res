@@ -0,0 +1,2 @@
+<?xml version="1.0" encoding="UTF-8"?>
+XAR XZ b.txt c.txt two three
\ No newline at end of file
@@ -0,0 +1,2 @@
+<?xml version="1.0" encoding="UTF-8"?>
+PAX a.txt b.txt c.txt TAR a.txt b.txt c.txt
\ No newline at end of file
@@ -0,0 +1 @@
+a.txt:0:1 a.txt:12:2 a.txt:16:2 dir/c.txt:1:1 a.txt:0:1 dir/c.txt:1:1 0
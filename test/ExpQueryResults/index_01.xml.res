@@ -0,0 +1 @@
+three 3 8892 a.txt big.txt c.txt
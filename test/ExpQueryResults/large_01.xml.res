@@ -0,0 +1 @@
+5368709120 5368709120 aGVsbG8= one two PAX
@@ -0,0 +1 @@
+size hi count hello hi
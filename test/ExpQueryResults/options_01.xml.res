@@ -1 +1 @@
-{ "format" : "ZIP", "compression" : "DEFLATE" }{ "format" : "TAR", "compression" : "GZIP" }
\ No newline at end of file
+{ "format" : "ZIP", "compression" : "DEFLATE", "entry-compressions" : { "mimetype" : "STORE" } }{ "format" : "TAR", "compression" : "GZIP" }
\ No newline at end of file
@@ -0,0 +1 @@
+DEFLATE STORE
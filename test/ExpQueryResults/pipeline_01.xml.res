@@ -0,0 +1 @@
+5 |dir1/file1|dir1/file2||file1 ZmlsZTEK
@@ -0,0 +1 @@
+a1000 b1000 c1000 corrupted
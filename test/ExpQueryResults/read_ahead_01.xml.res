@@ -0,0 +1,3 @@
+dir1/ dir1/file1 dir1/file2 dir2/ file1 dir1/file2
+ file1
+
@@ -0,0 +1 @@
+three 3 8892 ZSTD-SEEKABLE a.txt big.txt c.txt
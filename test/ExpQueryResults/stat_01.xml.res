@@ -0,0 +1 @@
+ZIP 5 28 dir1/file1 11 TAR 5 28 dir1/file1 11
@@ -0,0 +1 @@
+5 dir1/file1:5b54dc8e dir1/file2:70798f4d file1:e229f704 ecdc5536f73bdae8816f0ea40726ef5e9b810d914493075903bb90623d97b1d8 ZmlsZTI= true 3 dir1/file2:5:1
@@ -0,0 +1 @@
+foo.xml dir/bar.txt new.txt &lt;foo2/&gt; bar new
@@ -0,0 +1 @@
+dir1/ dir1/file1 dir2/ file3 dir2/new new GZIP
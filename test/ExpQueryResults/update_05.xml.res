@@ -0,0 +1 @@
+&lt;foo/&gt; &lt;foo2/&gt;
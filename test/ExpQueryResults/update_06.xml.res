@@ -0,0 +1 @@
+true bar.txt foo.xml &lt;foo2/&gt;
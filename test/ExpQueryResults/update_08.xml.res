@@ -0,0 +1 @@
+baz.txt foo.xml new.txt baz &lt;foo2/&gt; new2 baz.txt foo.xml new.txt baz &lt;foo2/&gt; new2
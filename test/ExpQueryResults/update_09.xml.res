@@ -0,0 +1 @@
+true true false true true false
\ No newline at end of file
@@ -0,0 +1 @@
+true 2 false 2 a.txt crc-mismatch false
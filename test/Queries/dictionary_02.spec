@@ -0,0 +1 @@
+Error: http://zorba.io/modules/archive:INVALID-OPTIONS